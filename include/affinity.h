@@ -27,6 +27,13 @@ hwloc_topology_t topology;
 #define CPU_FOR_MAIN_THREAD 3
 #define CPU_FOR_NEW_UFD_HANDLER_THREAD 3
 #define CPU_FOR_REAPER_THREAD 3
+#define CPU_FOR_PAGE_IDLE_THREAD 3
+#define CPU_FOR_REBALANCE_THREAD 3
+#define CPU_FOR_AUTOSIZE_THREAD 3
+#define CPU_FOR_RESIZE_DRAIN_THREAD 3
+#define CPU_FOR_PRECOPY_THREAD 3
+#define CPU_FOR_IDLE_SWAPOUT_THREAD 3
+#define CPU_FOR_ZERO_SWEEP_THREAD 3
 #define CPU_FOR_POLLING_THREAD 1
 #define CPU_FOR_PREFETCH_THREAD 4
 #define CPU_FOR_WRITE_THREAD 2
@@ -88,6 +95,19 @@ static inline int getNthInCpuSet(int n)
 	return i;
 }
 
+/* the cpu_index of the nth of several threads that start at cpu_index,
+ * wrapping around the CPUs of the container */
+static inline int spreadCPUIndex(int cpu_index, int n)
+{
+#ifndef HWLOC
+	int nCpus = CPU_COUNT(&container_cpuset);
+
+	if (nCpus > 0)
+		return 1 + (cpu_index - 1 + n) % nCpus;
+#endif
+	return cpu_index;
+}
+
 static inline void setThreadCPUAffinity(int cpu_index, char * threadname, int tid)
 {
 #ifdef ENABLE_AFFINITY
@@ -3,6 +3,7 @@
 
 #include <semaphore.h>
 #define WRITE_BATCH_SIZE 100
+#define MAX_PREFETCH_WORKERS 16
 
 typedef struct {
   int ufd;
@@ -19,22 +20,23 @@ typedef struct write_info {
 typedef struct prefetch_info {
   UT_hash_handle hh3;
   info_key_t key;
+  uint32_t ptid;     // faulting thread whose stream queued the entry
+  bool in_flight;
 } prefetch_info;
 
 pthread_t write_worker;
-pthread_t prefetch_worker;
+pthread_t prefetch_worker[MAX_PREFETCH_WORKERS];
 write_info * write_list = NULL;
 prefetch_info * prefetch_list = NULL;
 
-#ifdef ASYNREAD
-pthread_mutex_t read_lock;
-#endif
-
 pthread_mutex_t list_lock;
 // below are protected by list_lock
 bool isWriterWaiting = false;
-bool isPrefetcherWaiting = false;
+int numPrefetchersWaiting = 0;
 bool isUfhandlerWaiting = false;
+// demand reads in progress; prefetch workers hold back new batches until zero
+int demand_reads_pending = 0;
+pthread_cond_t demand_reads_cond;
 
 pthread_mutex_t flush_write_needed_lock;
 // below are protected by flush_write_needed_lock
@@ -110,9 +112,38 @@ void del_write_info( int ufd, uint64_t pageaddr )
     log_err("%s: failed to delete key %llx from write_list", __func__, pageaddr);
 }
 
+// entries put on write_list in flight by a thread that moves the page out
+// of the ufd, until it has written it or queued it for write_thread
+int num_flushing_write_info = 0;
+
+void add_flushing_write_info( int ufd, uint64_t pageaddr )
+{
+  if( exist_write_info( ufd, pageaddr ) )
+  {
+    log_err("%s: key %llx of ufd %d is already on write_list", __func__, pageaddr, ufd);
+    return;
+  }
+  add_write_info( ufd, pageaddr, NULL );
+  find_write_info( ufd, pageaddr )->in_flight = true;
+  num_flushing_write_info++;
+}
+
+void del_flushing_write_info( int ufd, uint64_t pageaddr )
+{
+  write_info * w = find_write_info( ufd, pageaddr );
+  // entries of write_thread always carry a page
+  if( (w!=NULL) && (w->page==NULL) )
+  {
+    HASH_DELETE( hh2, write_list, w );
+    free(w);
+    num_flushing_write_info--;
+  }
+}
+
+// entries waiting for write_thread
 int get_write_list_size()
 {
-  return HASH_CNT( hh2, write_list );
+  return HASH_CNT( hh2, write_list ) - num_flushing_write_info;
 }
 
 void * extract_page_from_write_list ( write_info * w)
@@ -132,15 +163,26 @@ void * extract_page_from_write_list ( write_info * w)
 
 void *write_into_externram_thread(void * tmp);
 
-void add_prefetch_info( int ufd, uint64_t pageaddr )
+void add_prefetch_info( int ufd, uint64_t pageaddr, uint32_t ptid )
 {
   prefetch_info *s;
   s = (prefetch_info *) malloc(sizeof(prefetch_info));
   s->key.ufd = ufd;
   memcpy( s->key.pageaddr, &pageaddr, sizeof(pageaddr) );
+  s->ptid = ptid;
+  s->in_flight = false;
   HASH_ADD( hh3, prefetch_list, key, sizeof(info_key_t), s );
 }
 
+prefetch_info * find_prefetch_info( int ufd, uint64_t pageaddr )
+{
+  prefetch_info l, *p = NULL;
+  l.key.ufd = ufd;
+  memcpy( l.key.pageaddr, &pageaddr, sizeof(pageaddr) );
+  HASH_FIND( hh3, prefetch_list, &l.key, sizeof(info_key_t), p );
+  return p;
+}
+
 bool exist_prefetch_info( int ufd, uint64_t pageaddr )
 {
   prefetch_info l, *p = NULL;
@@ -191,6 +233,89 @@ int get_prefetch_list_size()
   return HASH_CNT( hh3, prefetch_list );
 }
 
+/*
+ * mark up to max queued entries of a single ufd as in flight, oldest first,
+ * and copy their keys. Returns the number of entries taken and sets remaining
+ * to the number of queued entries left for other workers
+ */
+int take_prefetch_batch( uint64_t * keys, int * ufd, int max, int * remaining )
+{
+  prefetch_info *current, *tmp;
+  int num = 0;
+  *remaining = 0;
+  HASH_ITER( hh3, prefetch_list, current, tmp ) {
+    if( current->in_flight )
+      continue;
+    if( num==0 )
+      *ufd = current->key.ufd;
+    if( current->key.ufd == *ufd && num<max ) // we can do multiread for only one ufd
+    {
+      keys[num++] = *((uint64_t*)current->key.pageaddr);
+      current->in_flight = true;
+    }
+    else
+      (*remaining)++;
+  }
+  return num;
+}
+
+/*
+ * drop queued entries that thread ptid of ufd queued outside [start,end).
+ * Entries already in flight are left for their worker to complete
+ */
+int cancel_prefetch_info( int ufd, uint32_t ptid, uint64_t start, uint64_t end )
+{
+  prefetch_info *current, *tmp;
+  int num = 0;
+  HASH_ITER( hh3, prefetch_list, current, tmp ) {
+    uint64_t pageaddr = *((uint64_t*)current->key.pageaddr);
+    if( current->key.ufd == ufd && current->ptid == ptid && !current->in_flight &&
+        (pageaddr < start || pageaddr >= end) )
+    {
+      HASH_DELETE( hh3, prefetch_list, current );
+      free(current);
+      num++;
+    }
+  }
+  return num;
+}
+
+/*
+ * drop queued entries of ufd in [start,end) and return their number.
+ * in_flight is set if an entry in the range is being read
+ */
+int cancel_prefetch_range( int ufd, uint64_t start, uint64_t end, bool * in_flight )
+{
+  prefetch_info *current, *tmp;
+  int num = 0;
+  *in_flight = false;
+  HASH_ITER( hh3, prefetch_list, current, tmp ) {
+    uint64_t pageaddr = *((uint64_t*)current->key.pageaddr);
+    if( current->key.ufd != ufd || pageaddr < start || pageaddr >= end )
+      continue;
+    if( current->in_flight )
+    {
+      *in_flight = true;
+      continue;
+    }
+    HASH_DELETE( hh3, prefetch_list, current );
+    free(current);
+    num++;
+  }
+  return num;
+}
+
+// returns true if an idle prefetch worker should be woken up
+bool claim_waiting_prefetcher()
+{
+  if( numPrefetchersWaiting>0 )
+  {
+    numPrefetchersWaiting--;
+    return true;
+  }
+  return false;
+}
+
 void *prefetch_thread(void * tmp);
 
 #endif
@@ -0,0 +1,464 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * compressedClient.cc
+ *
+ * This file implements a client of externRAMClient that stores pages
+ * compressed with LZ4 in another client. The other client must copy the
+ * values it is given, so it can't be the noop store, which keeps them
+*/
+
+
+#include "compressedClient.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <cstdint>  // for uint types
+#include <sys/user.h> /* for PAGE_SIZE */
+
+// dbg.h defines globals that the backend linked into this library already
+// defines, so errors are printed as externRAMClientWrapper.cc prints them
+#define log_err(M, ...) {fprintf(stderr, "[ERROR] (%s:%d: ) " M "\n", __FILE__, __LINE__, ##__VA_ARGS__);}
+#define log_trace_in(M, ...)
+#define log_trace_out(M, ...)
+#include <monitorstats.h>
+#include <lz4.h>
+
+using namespace std;
+
+// packed values of a multiwrite, one area per writing thread
+static thread_local vector<char> packArea;
+// page a value of a multiread is decompressed into, one per reading thread
+static thread_local char unpackArea[PAGE_SIZE];
+
+static inline uint64_t now_nsecs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ *** compressedClient::compressedClient() ***
+ *  wrap backend, which keeps ownership of its connections
+ **********************************************
+ */
+compressedClient::compressedClient(externRAMClient * backend_client)
+{
+  backend = backend_client;
+}
+
+/*
+ *** compressedClient::~compressedClient() ***
+ *  the backend was created by externRAMClient::create() and is not freed here
+ **********************************************
+ */
+compressedClient::~compressedClient()
+{
+}
+
+/*
+ *** compressedClient::packPage() ***
+ *
+ * compress a page into packed, behind a header. LZ4 gives up as soon as
+ * the output would not fit in COMPRESSED_PAGE_MAX bytes, which is the
+ * quick way out for a page that does not compress
+ *
+ @ page: the page to compress
+ @ packed: buffer of at least COMPRESSED_PAGE_MAX bytes
+ -> returns: length of the packed value, or 0 if the page is stored raw
+ **********************************************
+ */
+int compressedClient::packPage(void * page, char * packed)
+{
+  compressed_page_header hdr;
+  int length;
+
+  length = LZ4_compress_default((const char *) page, packed + sizeof(hdr), PAGE_SIZE,
+                                COMPRESSED_PAGE_MAX - sizeof(hdr));
+  if( length<=0 )
+    return 0;
+
+  hdr.magic = COMPRESSED_PAGE_MAGIC;
+  hdr.format = COMPRESSED_PAGE_LZ4;
+  hdr.reserved = 0;
+  hdr.length = length;
+  // values of a multiwrite are packed back to back, so the header may be unaligned
+  memcpy(packed, &hdr, sizeof(hdr));
+  return length + sizeof(hdr);
+}
+
+/*
+ *** compressedClient::unpackPage() ***
+ *
+ * decompress a value read from the backend into page
+ *
+ @ value: the value as stored, shorter than a page
+ @ length: length of value
+ @ page: buffer of PAGE_SIZE bytes
+ -> returns: PAGE_SIZE, or -1 if the value is malformed
+ **********************************************
+ */
+int compressedClient::unpackPage(void * value, int length, void * page)
+{
+  compressed_page_header hdr;
+
+  if( length<(int) sizeof(hdr) ) {
+    log_err("%s: value of %d bytes is too short for a compressed page", __func__, length);
+    return -1;
+  }
+  memcpy(&hdr, value, sizeof(hdr));
+  if( hdr.magic!=COMPRESSED_PAGE_MAGIC || hdr.format!=COMPRESSED_PAGE_LZ4 ||
+      hdr.length!=(uint32_t) length - sizeof(hdr) ) {
+    log_err("%s: malformed compressed page of %d bytes, format %u", __func__, length, hdr.format);
+    return -1;
+  }
+  if( LZ4_decompress_safe((const char *) value + sizeof(hdr), (char *) page, hdr.length, PAGE_SIZE)!=PAGE_SIZE ) {
+    log_err("%s: compressed page of %d bytes does not decompress to a page", __func__, length);
+    return -1;
+  }
+  return PAGE_SIZE;
+}
+
+/*
+ *** compressedClient::unpackRead() ***
+ *
+ * decompress the value of a single read into the caller's page. A backend
+ * either copies the value into the caller's page or points *recvBuf at a
+ * buffer of its own
+ *
+ @ recvBuf: buffer the backend returned
+ @ length: length returned by the backend
+ @ page: the caller's page, as passed to the read
+ -> returns: length of the page in *recvBuf
+ **********************************************
+ */
+int compressedClient::unpackRead(void ** recvBuf, int length, void * page)
+{
+  char value[COMPRESSED_PAGE_MAX];
+  void * src = *recvBuf;
+#ifdef MONITORSTATS
+  uint64_t start;
+#endif
+
+  if( length<=0 || length==PAGE_SIZE )
+    return length;
+  if( page==NULL || length>(int) COMPRESSED_PAGE_MAX ) {
+    log_err("%s: can't decompress a value of %d bytes into %p", __func__, length, page);
+    return -1;
+  }
+
+#ifdef MONITORSTATS
+  start = now_nsecs();
+#endif
+  if( src==page ) {
+    memcpy(value, src, length);
+    src = value;
+  }
+  length = unpackPage(src, length, page);
+  *recvBuf = page;
+#ifdef MONITORSTATS
+  StatsAddDecompressionTime_notlocked(now_nsecs() - start);
+#endif
+
+  return length;
+}
+
+/*
+ *** compressedClient::unpackReads() ***
+ *
+ * decompress the values of a multiread. A backend that hands the caller
+ * a page for each value, as memcached does, gets the value decompressed
+ * into the area of the calling thread and copied back over itself. The
+ * buffers of other backends are only as long as the values, so a value is
+ * decompressed into a page allocated for the caller, which frees it as it
+ * frees memcached's. A value that can't be decompressed is returned as a
+ * miss
+ *
+ @ num: number of values
+ @ recvBufs: buffers returned by the backend
+ @ lengths: lengths returned by the backend
+ -> returns: void
+ **********************************************
+ */
+void compressedClient::unpackReads(int num, void ** recvBufs, int * lengths)
+{
+  bool in_place = backend->readsIntoPages();
+  void * page;
+#ifdef MONITORSTATS
+  uint64_t start = 0;
+#endif
+
+  for( int j=0; j<num; j++ )
+  {
+    if( recvBufs[j]==NULL || lengths[j]<=0 || lengths[j]==PAGE_SIZE )
+      continue;
+
+#ifdef MONITORSTATS
+    if( start==0 )
+      start = now_nsecs();
+#endif
+    page = in_place ? unpackArea : malloc(PAGE_SIZE);
+    if( page!=NULL && unpackPage(recvBufs[j], lengths[j], page)==PAGE_SIZE ) {
+      if( in_place )
+        memcpy(recvBufs[j], unpackArea, PAGE_SIZE);
+      else
+        recvBufs[j] = page;
+      lengths[j] = PAGE_SIZE;
+    }
+    else {
+      if( !in_place )
+        free(page);
+      lengths[j] = 0;
+    }
+  }
+
+#ifdef MONITORSTATS
+  if( start!=0 )
+    StatsAddDecompressionTime_notlocked(now_nsecs() - start);
+#endif
+}
+
+void compressedClient::releaseReadChannel(int channel)
+{
+  backend->releaseReadChannel(channel);
+}
+
+/*
+ *** compressedClient::packedMultiWrite() ***
+ *
+ * compress the pages of a multiwrite into the area of the calling thread
+ * and write them on channel, or on the backend's own connection if
+ * channel is negative. The caller gets its pages back in data, so it frees
+ * and keeps copies of them as it would without compression
+ **********************************************
+ */
+bool compressedClient::packedMultiWrite(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err)
+{
+  void * pages[num_write];
+  int page_lengths[num_write];
+  unsigned long num_packed = 0, packed_bytes = 0;
+#ifdef MONITORSTATS
+  uint64_t start = now_nsecs();
+#endif
+  bool should_free;
+  char * packed;
+  int i, length;
+
+  if( packArea.size()<(size_t) num_write * COMPRESSED_PAGE_MAX )
+    packArea.resize((size_t) num_write * COMPRESSED_PAGE_MAX);
+  packed = packArea.data();
+
+  for( i=0; i<num_write; i++ )
+  {
+    pages[i] = data[i];
+    page_lengths[i] = lengths[i];
+    length = (data[i]!=NULL && lengths[i]==PAGE_SIZE) ? packPage(data[i], packed) : 0;
+    if( length>0 ) {
+      data[i] = packed;
+      lengths[i] = length;
+      packed += length;
+      num_packed++;
+      packed_bytes += length;
+    }
+  }
+#ifdef MONITORSTATS
+  StatsAddCompressionTime_notlocked(now_nsecs() - start);
+  StatsAddCompressedPages_notlocked(num_packed, packed_bytes);
+  StatsAddIncompressiblePages_notlocked(num_write - num_packed);
+#endif
+
+  if( channel<0 )
+    should_free = backend->multiWrite(hashcodes, num_write, data, lengths, err);
+  else
+    should_free = backend->multiWriteChannel(channel, hashcodes, num_write, data, lengths, err);
+
+  for( i=0; i<num_write; i++ )
+  {
+    // a backend clears the buffers that must not be freed
+    if( data[i]!=NULL )
+      data[i] = pages[i];
+    lengths[i] = page_lengths[i];
+  }
+
+  return should_free;
+}
+
+/*
+ *** compressedClient::write() ***
+ *
+ * compress a page and write it to the backend
+ *
+ @ key: unique key
+ @ data: buffer pointing to the page
+ @ size: length in bytes of the data to be stored
+ -> returns: pointer of buffer to free
+ **********************************************
+ */
+void * compressedClient::write(uint64_t key, void **data, int size, int *err)
+{
+  char packed[COMPRESSED_PAGE_MAX];
+  void * value = packed;
+  void * ret;
+#ifdef MONITORSTATS
+  uint64_t start = now_nsecs();
+#endif
+  int length;
+
+  length = size==PAGE_SIZE ? packPage(*data, packed) : 0;
+#ifdef MONITORSTATS
+  StatsAddCompressionTime_notlocked(now_nsecs() - start);
+#endif
+  if( length==0 ) {
+#ifdef MONITORSTATS
+    StatsAddIncompressiblePages_notlocked(1);
+#endif
+    return backend->write(key, data, size, err);
+  }
+#ifdef MONITORSTATS
+  StatsAddCompressedPages_notlocked(1, length);
+#endif
+
+  ret = backend->write(key, &value, length, err);
+  // the backend copied the value, so the page is freed as it would have
+  // been without compression
+  if( ret==packed )
+    ret = *data;
+  return ret;
+}
+
+bool compressedClient::multiWrite(uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err)
+{
+  return packedMultiWrite(-1, hashcodes, num_write, data, lengths, err);
+}
+
+bool compressedClient::multiWriteChannel(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err)
+{
+  return packedMultiWrite(channel, hashcodes, num_write, data, lengths, err);
+}
+
+/*
+ *** compressedClient::read() ***
+ *
+ * read a page from the backend and decompress it
+ *
+ @ key: unique key
+ @ value: already allocated page
+ -> returns: length of value
+ **********************************************
+ */
+int compressedClient::read(uint64_t key, void ** value)
+{
+  void * page = *value;
+  return unpackRead(value, backend->read(key, value), page);
+}
+
+int compressedClient::multiRead(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  int ret = backend->multiRead(hashcodes, num_prefetch, recvBufs, lengths);
+  unpackReads(num_prefetch, recvBufs, lengths);
+  return ret;
+}
+
+#ifdef ASYNREAD
+void compressedClient::read_top(uint64_t key, void ** value)
+{
+  backend->read_top(key, value);
+}
+
+int compressedClient::read_bottom(uint64_t key, void ** value)
+{
+  void * page = *value;
+  return unpackRead(value, backend->read_bottom(key, value), page);
+}
+
+void compressedClient::multiRead_top(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  backend->multiRead_top(hashcodes, num_prefetch, recvBufs, lengths);
+}
+
+int compressedClient::multiRead_bottom(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  int ret = backend->multiRead_bottom(hashcodes, num_prefetch, recvBufs, lengths);
+  unpackReads(num_prefetch, recvBufs, lengths);
+  return ret;
+}
+#endif
+
+int compressedClient::openReadChannels(int num_channels)
+{
+  return backend->openReadChannels(num_channels);
+}
+
+int compressedClient::multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  int ret = backend->multiReadChannel(channel, hashcodes, num_prefetch, recvBufs, lengths);
+  unpackReads(num_prefetch, recvBufs, lengths);
+  return ret;
+}
+
+void compressedClient::multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  backend->multiReadChannel_top(channel, hashcodes, num_prefetch, recvBufs, lengths);
+}
+
+/*
+ *** compressedClient::multiReadChannel_bottom() ***
+ *
+ * wait for the multiread of a channel and decompress its values. A
+ * backend without asynchronous channel reads finished the read in
+ * multiReadChannel_top(), so the values are decompressed either way
+ **********************************************
+ */
+int compressedClient::multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths)
+{
+  int ret = backend->multiReadChannel_bottom(channel, hashcodes, num_prefetch, recvBufs, lengths);
+  unpackReads(num_prefetch, recvBufs, lengths);
+  return ret;
+}
+
+bool compressedClient::readsIntoPages()
+{
+  return backend->readsIntoPages();
+}
+
+bool compressedClient::isReadChannelReady(int channel)
+{
+  return backend->isReadChannelReady(channel);
+}
+
+int compressedClient::openWriteChannels(int num_channels)
+{
+  return backend->openWriteChannels(num_channels);
+}
+
+int compressedClient::remove(uint64_t key)
+{
+  return backend->remove(key);
+}
+
+int compressedClient::multiRemove(uint64_t * hashcodes, int num)
+{
+  return backend->multiRemove(hashcodes, num);
+}
+
+bool compressedClient::isFull(uint64_t key)
+{
+  return backend->isFull(key);
+}
+
+bool compressedClient::isFullAll()
+{
+  return backend->isFullAll();
+}
+
+int compressedClient::getUsage(ServerUsage ** usage)
+{
+  return backend->getUsage(usage);
+}
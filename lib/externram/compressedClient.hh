@@ -0,0 +1,78 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * compressedClient.hh
+ *
+ * This defines a client of the interface externRAMClient that compresses
+ * pages with LZ4 before handing them to another client, and decompresses
+ * them when they are read back
+*/
+
+
+#ifndef _COMPRESSEDCLIENT_H_
+#define _COMPRESSEDCLIENT_H_
+#include "externRAMClient.hh"
+#include <sys/user.h>
+
+/*
+ * A compressed value is a header followed by the LZ4 block, and is always
+ * shorter than a page. A page that does not shrink to COMPRESSED_PAGE_MAX
+ * is stored as is, so a value of PAGE_SIZE bytes is always a raw page,
+ * including those written before compression was enabled
+ */
+#define COMPRESSED_PAGE_MAGIC   0x5a46
+#define COMPRESSED_PAGE_LZ4     1
+#define COMPRESSED_PAGE_MAX     (PAGE_SIZE - PAGE_SIZE / 8)
+
+typedef struct compressed_page_header {
+  uint16_t magic;
+  uint8_t  format;
+  uint8_t  reserved;
+  uint32_t length;        // bytes of compressed data after the header
+} compressed_page_header;
+
+class compressedClient: public externRAMClient
+{
+private:
+  externRAMClient * backend;
+
+  int       packPage(void * page, char * packed);
+  int       unpackPage(void * value, int length, void * page);
+  int       unpackRead(void ** recvBuf, int length, void * page);
+  void      unpackReads(int num, void ** recvBufs, int * lengths);
+  bool      packedMultiWrite(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err);
+
+public:
+  virtual ~compressedClient();
+  compressedClient(externRAMClient * backend);
+
+  virtual void *      write(uint64_t key, void **data, int size, int * err);
+  virtual bool        multiWrite(uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err);
+  virtual int         read(uint64_t key, void ** value);
+  virtual int         multiRead(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+#ifdef ASYNREAD
+  virtual void        read_top(uint64_t key, void ** value);
+  virtual int         read_bottom(uint64_t key, void ** value);
+  virtual void        multiRead_top(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+  virtual int         multiRead_bottom(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+#endif
+  virtual int         openReadChannels(int num_channels);
+  virtual int         multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+  virtual void        multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+  virtual int         multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+  virtual bool        readsIntoPages();
+  virtual bool        isReadChannelReady(int channel);
+  virtual void        releaseReadChannel(int channel);
+  virtual int         openWriteChannels(int num_channels);
+  virtual bool        multiWriteChannel(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err);
+  virtual int         remove(uint64_t key);
+  virtual int         multiRemove(uint64_t * hashcodes, int num);
+  virtual bool        isFull(uint64_t key);
+  virtual bool        isFullAll();
+  virtual int         getUsage(ServerUsage ** usage);
+};
+#endif
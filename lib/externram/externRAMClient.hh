@@ -18,6 +18,8 @@
 #include <iostream>
 
 #define NUM_ERRORS_TO_CHECK_ISFULL 10
+#define MAX_READ_CHANNELS 16
+#define MAX_WRITE_CHANNELS 16
 
 // Abstract interface for extern RAM client.
 class externRAMClient
@@ -39,7 +41,36 @@ public:
     virtual void        multiRead_top(uint64_t *,int,void **,int *){};
     virtual int         multiRead_bottom(uint64_t *,int,void **,int *){};
 #endif
+    // Read channels are connections reserved for speculative reads so that
+    // a prefetch never sits in front of a demand read on the same connection
+    virtual int         openReadChannels(int){return 0;};
+    virtual int         multiReadChannel(int, uint64_t * hashcodes, int num, void ** bufs, int * lengths)
+                          {return multiRead(hashcodes, num, bufs, lengths);};
+    // Asynchronous reads on a channel. One read may be outstanding per
+    // channel; by default top completes the read and bottom has nothing to do
+    virtual void        multiReadChannel_top(int channel, uint64_t * hashcodes, int num, void ** bufs, int * lengths)
+                          {multiReadChannel(channel, hashcodes, num, bufs, lengths);};
+    virtual int         multiReadChannel_bottom(int, uint64_t *, int, void **, int *){return 0;};
+    virtual bool        isReadChannelReady(int){return true;};
+    // Whether a multiread returns each value in a page allocated for the
+    // caller, as memcached does. Otherwise the buffers may be only as long
+    // as the values
+    virtual bool        readsIntoPages(){return false;};
+    // Free the pages of the last read on a channel that were allocated for
+    // the caller, once it has copied them. Pages handed to the page cache
+    // are kept by it and must not be released
+    virtual void        releaseReadChannel(int){};
+    // Write channels are connections reserved for bulk flushes, so several
+    // multiwrites of one client can be in flight at once, one thread each.
+    // With no channels open, flushes write on the client's own connection
+    virtual int         openWriteChannels(int){return 0;};
+    virtual bool        multiWriteChannel(int, uint64_t * hashcodes, int num, void ** data, int * lengths, int * err)
+                          {return multiWrite(hashcodes, num, data, lengths, err);};
     virtual int         remove(uint64_t){};
+    // remove several keys, returns the number removed. Clients without a
+    // batched delete remove the keys one at a time
+    virtual int         multiRemove(uint64_t * hashcodes, int num)
+                          {int n = 0; for( int i=0; i<num; i++ ) n += remove(hashcodes[i]); return n;};
     virtual bool        isFull(uint64_t){return false;};
     virtual bool        isFullAll(){return false;};
     virtual int         getUsage(ServerUsage**){};
@@ -9,6 +9,9 @@
 
 #include "externRAMClientWrapper.h"
 #include "externRAMClient.hh"
+#ifdef COMPRESSION
+#include "compressedClient.hh"
+#endif
 #include <stdio.h>
 #include <sys/user.h>
 #include <unistd.h>
@@ -21,6 +24,10 @@ extern "C" {
   externRAMClient * client;
   externRAMClient * newExternRAMClient(int type, char * config, uint64_t upid) {
     client = externRAMClient::create(type, config, upid);
+#ifdef COMPRESSION
+    if( client )
+      client = new compressedClient(client);
+#endif
     return client;
   }
 
@@ -68,6 +75,10 @@ extern "C" {
     return c->remove(key);
   }
 
+  int removePages(externRAMClient* c, uint64_t * keys, int num_remove) {
+    return c->multiRemove(keys, num_remove);
+  }
+
   int readPage(externRAMClient *c, uint64_t key, void ** recvBuf) {
     return c->read(key,recvBuf);
   }
@@ -76,6 +87,53 @@ extern "C" {
     c->multiRead(keys, num_prefetch, recvBufs, lengths);
   }
 
+  int openReadChannels(externRAMClient *c, int num_channels) {
+    return c->openReadChannels(num_channels);
+  }
+
+  void readPagesOnChannel(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths) {
+    c->multiReadChannel(channel, keys, num_prefetch, recvBufs, lengths);
+  }
+
+  void readPagesOnChannel_top(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths) {
+    c->multiReadChannel_top(channel, keys, num_prefetch, recvBufs, lengths);
+  }
+
+  int readPagesOnChannel_bottom(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths) {
+    return c->multiReadChannel_bottom(channel, keys, num_prefetch, recvBufs, lengths);
+  }
+
+  bool isReadChannelReady(externRAMClient *c, int channel) {
+    return c->isReadChannelReady(channel);
+  }
+
+  void releasePagesOnChannel(externRAMClient *c, int channel) {
+    c->releaseReadChannel(channel);
+  }
+
+  int openWriteChannels(externRAMClient *c, int num_channels) {
+    return c->openWriteChannels(num_channels);
+  }
+
+  bool writePagesOnChannel(externRAMClient *c, int channel, uint64_t * keys, int num_write, void ** data, int * lengths) {
+    bool ret;
+    int err = 0;
+    int cnt = 0;
+    while( true ) {
+      ret = c->multiWriteChannel(channel, keys, num_write, data, lengths, &err);
+      if( err < 0 ) {
+        if( cnt%NUM_ERRORS_TO_CHECK_ISFULL==0 && isFullAll(c) )
+          log_recoverable_err( "The externRAM is full." );
+        sleep(1);
+      }
+      else {
+        break;
+      }
+      cnt++;
+    }
+    return ret;
+  }
+
 #ifdef ASYNREAD
   void readPage_top(externRAMClient *c, uint64_t key, void ** recvBuf) {
     c->read_top(key,recvBuf);
@@ -31,6 +31,15 @@ bool writePages(externRAMClient *c, uint64_t * keys, int num_write, void ** data
 int readPage(externRAMClient *c, uint64_t key, void ** recvBuf);
 void readPages(externRAMClient *c, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths);
 int removePage(externRAMClient* c, uint64_t key);
+int removePages(externRAMClient* c, uint64_t * keys, int num_remove);
+int openReadChannels(externRAMClient *c, int num_channels);
+void readPagesOnChannel(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths);
+void readPagesOnChannel_top(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths);
+int readPagesOnChannel_bottom(externRAMClient *c, int channel, uint64_t * keys, int num_prefetch, void ** recvBufs, int * lengths);
+bool isReadChannelReady(externRAMClient *c, int channel);
+void releasePagesOnChannel(externRAMClient *c, int channel);
+int openWriteChannels(externRAMClient *c, int num_channels);
+bool writePagesOnChannel(externRAMClient *c, int channel, uint64_t * keys, int num_write, void ** data, int * lengths);
 #ifdef ASYNREAD
 void readPage_top(externRAMClient *c, uint64_t key, void ** recvBuf);
 int readPage_bottom(externRAMClient *c, uint64_t key, void ** recvBuf);
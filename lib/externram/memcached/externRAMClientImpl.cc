@@ -62,6 +62,7 @@ externRAMClientImpl::externRAMClientImpl()
 {
   log_trace_in("%s", __func__);
 
+  numReadChannels = 0;
   hashcodeStrings = (char**) malloc( MAX_MULTI_READ * sizeof(char*) );
   key_lengths = (size_t*) malloc( MAX_MULTI_READ  * sizeof(size_t) );
   for( int j=0; j<MAX_MULTI_READ; j++ )
@@ -125,6 +126,16 @@ externRAMClientImpl::~externRAMClientImpl()
 #ifdef THREADED_PREFETCH
   memcached_pool_destroy(pool_multiread);
 #endif
+
+  for( int i=0; i<numReadChannels; i++ )
+  {
+    memcached_free(readChannels[i]);
+    for( int j=0; j<MAX_MULTI_READ; j++ )
+    {
+      free(readChannelStrings[i][j]);
+    }
+    free(readChannelStrings[i]);
+  }
   log_trace_out("%s", __func__);
 
   for( int j=0; j<MAX_MULTI_READ; j++ )
@@ -135,6 +146,145 @@ externRAMClientImpl::~externRAMClientImpl()
   free(key_lengths);
 }
 
+/*
+ *** externRAMClientImpl::openReadChannels() ***
+ *
+ * open one memcached connection per read channel, separate from the
+ * connections used by demand reads and writes
+ *
+ @ num_channels: number of channels requested
+ -> returns: number of channels opened
+ **********************************************
+ */
+int externRAMClientImpl::openReadChannels(int num_channels) {
+  log_trace_in("%s", __func__);
+
+  while( numReadChannels<num_channels && numReadChannels<MAX_READ_CHANNELS )
+  {
+    memcached_st *memc = memcached(locator.c_str(), locator.length());
+    if (memc == NULL)
+    {
+      log_err("%s: failed to open read channel %d with locator %s", __func__, numReadChannels, locator.c_str());
+      break;
+    }
+    readChannels[numReadChannels] = memc;
+    readChannelStrings[numReadChannels] = (char**) malloc( MAX_MULTI_READ * sizeof(char*) );
+    for( int j=0; j<MAX_MULTI_READ; j++ )
+    {
+      readChannelStrings[numReadChannels][j] = (char*) malloc( KEYSTR_LEN+1 );
+    }
+    numReadChannels++;
+  }
+
+  log_trace_out("%s", __func__);
+  return numReadChannels;
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel() ***
+ *
+ * read multiple keys with the connection of a read channel. Channels
+ * may be used concurrently by different threads, one thread per channel
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths to be recoreded by this function
+ -> returns: void
+ **********************************************
+ */
+int externRAMClientImpl::multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+
+  multiReadChannel_top(channel, hashcodes, num_prefetch, recvBufs, lengths);
+  multiReadChannel_bottom(channel, hashcodes, num_prefetch, recvBufs, lengths);
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel_top() ***
+ *
+ * send an mget for multiple keys on a read channel without waiting for
+ * the values. The buffers are allocated here and filled by
+ * multiReadChannel_bottom()
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths
+ -> returns: void
+ **********************************************
+ */
+void externRAMClientImpl::multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+  memcached_return_t error;
+
+  if( channel<0 || channel>=numReadChannels )
+  {
+    log_err("%s: read channel %d is not open", __func__, channel);
+    return;
+  }
+
+  for( int i=0; i<num_prefetch; i++ )
+  {
+    recvBufs[i] = malloc(PAGE_SIZE);
+  }
+
+  buildHashStrings( hashcodes, num_prefetch, readChannelStrings[channel] );
+  error = memcached_mget( readChannels[channel], readChannelStrings[channel], key_lengths, num_prefetch );
+  if (error != MEMCACHED_SUCCESS)
+  {
+    log_err("%s: memcached error, code: %u, string: %s", __func__, error, memcached_strerror(readChannels[channel], error));
+  }
+
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel_bottom() ***
+ *
+ * wait for the values of the mget sent by multiReadChannel_top()
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths to be recoreded by this function
+ -> returns: 0
+ **********************************************
+ */
+int externRAMClientImpl::multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+
+  if( channel<0 || channel>=numReadChannels )
+  {
+    memset(lengths, 0, sizeof(int) * num_prefetch);
+    return 0;
+  }
+  fetchMultiRead( readChannels[channel], readChannelStrings[channel], hashcodes, num_prefetch, recvBufs, lengths );
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+/*
+ *** externRAMClientImpl::isReadChannelReady() ***
+ *
+ * libmemcached has no way to test for a pending mget response without
+ * blocking, so a channel read is only completed when its values are needed
+ *
+ @ channel: index of the channel
+ -> returns: false
+ **********************************************
+ */
+bool externRAMClientImpl::isReadChannelReady(int channel) {
+  return false;
+}
+
 /*
  *** externRAMClientImpl::write() ***
  *
@@ -243,16 +393,76 @@ int externRAMClientImpl::read(uint64_t hashcode, void ** recvBuf) {
 }
 
 void externRAMClientImpl::buildHashStrings(uint64_t * hashcodes, int num_prefetch) {
+  buildHashStrings( hashcodes, num_prefetch, hashcodeStrings );
+}
+
+void externRAMClientImpl::buildHashStrings(uint64_t * hashcodes, int num_prefetch, char ** strings) {
   log_trace_in("%s", __func__);
 
   for( int j=0; j<num_prefetch; j++ )
   {
-    sprintf( hashcodeStrings[j], "%lx", hashcodes[j] );
+    sprintf( strings[j], "%lx", hashcodes[j] );
   }
   log_trace_out("%s", __func__);
   return;
 }
 
+/*
+ *** externRAMClientImpl::fetchMultiRead() ***
+ *
+ * collect the values of an mget issued on client into recvBufs
+ *
+ @ client: connection the mget was issued on
+ @ strings: key strings the mget was issued with
+ -> returns: void
+ **********************************************
+ */
+int externRAMClientImpl::fetchMultiRead(memcached_st * client, char ** strings, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+  memcached_return_t rc;
+  uint32_t flags;
+  char return_key[MEMCACHED_MAX_KEY];
+  size_t return_key_length;
+  char *return_value;
+  size_t return_value_length;
+  unsigned int i = 0;
+  declare_timers();
+
+  memset(lengths, 0, sizeof(int) * num_prefetch);
+  while ((return_value = memcached_fetch( client, return_key, &return_key_length,
+                                    &return_value_length, &flags, &rc)))
+  {
+    // return_value != NULL
+    if(( rc == MEMCACHED_SUCCESS ) && ( return_value != NULL ))
+    {
+      if( i == num_prefetch ) {
+        log_err("%s: memcached returned too many keys", __func__);
+        break;
+      }
+
+      if( memcmp(return_key,strings[i],return_key_length)!=0 )
+      {
+        log_err("memcached could not retrieve the value for key %lx, expected %s, but got %s", hashcodes[i], strings[i], return_key);
+      }
+      lengths[i] = return_value_length;
+      start_timing_bucket(start, KVCOPY);
+      memcpy(recvBufs[i], return_value, lengths[i]);
+      stop_timing(start, end, KVCOPY);
+    }
+    else if( rc != MEMCACHED_SUCCESS )
+    {
+      log_err("%s: memcached error, code: %u, string: %s", __func__, rc, memcached_strerror(client, rc));
+    }
+    if ( return_value != NULL ) {
+      free( return_value );
+    }
+    i++;
+  }
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
 /*
  *** externRAMClientImpl::MultiRead() ***
  *
@@ -320,51 +530,12 @@ void externRAMClientImpl::multiRead_top(uint64_t * hashcodes, int num_prefetch,
 
 int externRAMClientImpl::multiRead_bottom(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
   log_trace_in("%s", __func__);
-  size_t key_length[num_prefetch];
-  memcached_return_t error;
-  memcached_return_t rc;
-  uint32_t flags;
-  char return_key[MEMCACHED_MAX_KEY];
-  size_t return_key_length;
-  char *return_value;
-  size_t return_value_length;
   memcached_st * client = myClient;
-  unsigned int i = 0;
 #ifdef THREADED_PREFETCH
   client = myClient_multiread;
 #endif
-  declare_timers();
-
-  memset(lengths, 0, sizeof(int) * num_prefetch);
-  while ((return_value = memcached_fetch( client, return_key, &return_key_length,
-                                    &return_value_length, &flags, &rc)))
-  {
-    // return_value != NULL
-    if(( rc == MEMCACHED_SUCCESS ) && ( return_value != NULL ))
-    {
-      if( i == num_prefetch ) {
-        log_err("%s: memcached returned too many keys", __func__);
-        break;
-      }
 
-      if( memcmp(return_key,hashcodeStrings[i],return_key_length)!=0 )
-      {
-        log_err("memcached could not retrieve the value for key %lx, expected %s, but got %s", hashcodes[i], hashcodeStrings[i], return_key);
-      }
-      lengths[i] = return_value_length;
-      start_timing_bucket(start, KVCOPY);
-      memcpy(recvBufs[i], return_value, lengths[i]);
-      stop_timing(start, end, KVCOPY);
-    }
-    else if( rc != MEMCACHED_SUCCESS )
-    {
-      log_err("%s: memcached error, code: %u, string: %s", __func__, error, memcached_strerror(client, rc));
-    }
-    if ( return_value != NULL ) {
-      free( return_value );
-    }
-    i++;
-  }
+  fetchMultiRead( client, hashcodeStrings, hashcodes, num_prefetch, recvBufs, lengths );
 
   log_trace_out("%s", __func__);
   return 0;
@@ -486,4 +657,5 @@ int externRAMClientImpl::remove(uint64_t hashcode) {
   }
 
   log_trace_out("%s", __func__);
+  return ret;
 }
@@ -45,7 +45,14 @@ private:
 #ifdef THREADED_PREFETCH
     memcached_st * myClient_multiread;
 #endif
+    // connections reserved for speculative reads, each with its own keys
+    memcached_st * readChannels[MAX_READ_CHANNELS];
+    char ** readChannelStrings[MAX_READ_CHANNELS];
+    int numReadChannels;
+
     void buildHashStrings(uint64_t * hashcodes, int num_prefetch);
+    void buildHashStrings(uint64_t * hashcodes, int num_prefetch, char ** strings);
+    int  fetchMultiRead(memcached_st * client, char ** strings, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
     char ** hashcodeStrings;
     size_t *key_lengths;
 
@@ -62,6 +69,12 @@ public:
     virtual int         read_bottom(uint64_t key, void ** value);
     virtual void        multiRead_top(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
     virtual int         multiRead_bottom(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    virtual int         openReadChannels(int num_channels);
+    virtual int         multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    virtual void        multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    virtual int         multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    virtual bool        isReadChannelReady(int channel);
+    virtual bool        readsIntoPages(){return true;};
     virtual int         remove(uint64_t hashcode);
 };
 #endif
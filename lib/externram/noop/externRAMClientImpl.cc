@@ -270,6 +270,36 @@ int externRAMClientImpl::multiRead_bottom(uint64_t * hashcodes, int num_prefetch
 }
 #endif
 
+/*
+ *** externRAMClientImpl::openReadChannels() ***
+ *
+ * the map is protected by noop_mutex, so every channel can share it
+ *
+ @ num_channels: number of channels requested
+ -> returns: number of channels available
+ **********************************************
+ */
+int externRAMClientImpl::openReadChannels(int num_channels) {
+  return num_channels;
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel() ***
+ *
+ * read multiple keys on behalf of a read channel
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths to be recoreded by this function
+ -> returns: number of successfully read keys
+ **********************************************
+ */
+int externRAMClientImpl::multiReadChannel(int, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  return multiRead(hashcodes, num_prefetch, recvBufs, lengths);
+}
+
 /*
  *** externRAMClientImpl::MultiWrite() ***
  *
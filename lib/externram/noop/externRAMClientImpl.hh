@@ -53,6 +53,8 @@ public:
   virtual void        multiRead_top(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
   virtual int         multiRead_bottom(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
 #endif
+  virtual int         openReadChannels(int num_channels);
+  virtual int         multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
   virtual int         remove(uint64_t key);
 
 };
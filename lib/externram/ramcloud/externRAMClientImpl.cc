@@ -72,6 +72,8 @@ externRAMClientImpl::externRAMClientImpl()
   myClient_multiread = new RamCloud(&context_multiread,locator.c_str());
 #endif
 
+  numReadChannels = 0;
+  numWriteChannels = 0;
   snprintf(clientId, sizeof(clientId), "%llu", upid);
   log_debug("externRAMClientImpl: clientId=%s", clientId);
 
@@ -103,6 +105,20 @@ externRAMClientImpl::~externRAMClientImpl()
 #ifdef THREADED_PREFETCH
   delete myClient_multiread;
 #endif
+  for( int i=0; i<numReadChannels; i++ )
+  {
+    if( readChannels[i]->rpc )
+      delete readChannels[i]->rpc;
+    delete readChannels[i]->client;
+    delete readChannels[i]->context;
+    delete readChannels[i];
+  }
+  for( int i=0; i<numWriteChannels; i++ )
+  {
+    delete writeChannels[i]->client;
+    delete writeChannels[i]->context;
+    delete writeChannels[i];
+  }
   log_trace_out("%s", __func__);
 }
 
@@ -302,6 +318,183 @@ int externRAMClientImpl::multiRead(uint64_t * hashcodes, int num_prefetch, void
   return 0;
 }
 
+/*
+ *** externRAMClientImpl::openReadChannels() ***
+ *
+ * open one RAMCloud client per read channel, separate from the clients
+ * used by demand reads and writes
+ *
+ @ num_channels: number of channels requested
+ -> returns: number of channels opened
+ **********************************************
+ */
+int externRAMClientImpl::openReadChannels(int num_channels) {
+  log_trace_in("%s", __func__);
+
+  while( numReadChannels<num_channels && numReadChannels<MAX_READ_CHANNELS )
+  {
+    read_channel * ch = new read_channel();
+    try {
+      ch->context = new RAMCloud::Context(false);
+      ch->client = new RamCloud(ch->context, locator.c_str());
+      ch->tableId = ch->client->getTableId(clientId);
+      ch->rpc = NULL;
+      readChannels[numReadChannels++] = ch;
+    }
+    catch (RAMCloud::Exception& e) {
+      log_err("%s: failed to open read channel %d: %s", __func__, numReadChannels, e.str().c_str());
+      delete ch;
+      break;
+    }
+  }
+
+  log_trace_out("%s", __func__);
+  return numReadChannels;
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel() ***
+ *
+ * read multiple keys with the client of a read channel. Channels
+ * may be used concurrently by different threads, one thread per channel
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths to be recoreded by this function
+ -> returns: 0
+ **********************************************
+ */
+int externRAMClientImpl::multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+
+  multiReadChannel_top(channel, hashcodes, num_prefetch, recvBufs, lengths);
+  multiReadChannel_bottom(channel, hashcodes, num_prefetch, recvBufs, lengths);
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel_top() ***
+ *
+ * start an asynchronous multiread on a read channel. The keys are copied
+ * so the caller's array does not have to outlive the rpc
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths
+ -> returns: void
+ **********************************************
+ */
+void externRAMClientImpl::multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+
+  if( channel<0 || channel>=numReadChannels )
+  {
+    log_err("%s: read channel %d is not open", __func__, channel);
+    return;
+  }
+
+  read_channel * ch = readChannels[channel];
+  try {
+    for( int i=0; i<num_prefetch; i++ )
+    {
+      ch->keys[i] = hashcodes[i];
+      ch->values[i].destroy();
+      MultiReadObject r(ch->tableId, &ch->keys[i],
+                                 sizeof(uint64_t), &ch->values[i] );
+      ch->requests[i] = r;
+      ch->requests_ptr[i] = &(ch->requests[i]);
+    }
+    ch->rpc = new MultiRead( ch->client, &ch->requests_ptr[0], num_prefetch );
+  }
+  catch (RAMCloud::ClientException& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+  catch (RAMCloud::Exception& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** externRAMClientImpl::multiReadChannel_bottom() ***
+ *
+ * wait for the multiread started by multiReadChannel_top()
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_prefetch: number of keys to read
+ @ recvBufs: pointer to an array of receive buffers
+ @ lengths: pointer to an array of lengths to be recoreded by this function
+ -> returns: 0
+ **********************************************
+ */
+int externRAMClientImpl::multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+  log_trace_in("%s", __func__);
+
+  memset(lengths, 0, sizeof(int) * num_prefetch);
+  if( channel<0 || channel>=numReadChannels || readChannels[channel]->rpc==NULL )
+  {
+    return 0;
+  }
+
+  read_channel * ch = readChannels[channel];
+  try {
+    while (!ch->rpc->isReady()) {
+      ch->context->dispatch->poll();
+    }
+    ch->rpc->wait();
+    for( int j=0; j<num_prefetch; j++ )
+    {
+      if( ch->requests_ptr[j]->status != STATUS_OK )
+      {
+        log_err("%s: RAMCloud error: cannot read a value for key %lx", __func__, hashcodes[j]);
+        continue;
+      }
+      uint32_t length = 0;
+      recvBufs[j] = (void *) ch->values[j].get()->getValue(&length);
+      lengths[j] = length;
+      if (recvBufs[j] == NULL) {
+        log_err("%s: value from MultiRead is malformed", __func__);
+      }
+    }
+  }
+  catch (RAMCloud::ClientException& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+  catch (RAMCloud::Exception& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+  delete ch->rpc;
+  ch->rpc = NULL;
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+/*
+ *** externRAMClientImpl::isReadChannelReady() ***
+ *
+ * poll a read channel once and report whether its multiread has completed
+ *
+ @ channel: index of the channel
+ -> returns: true if multiReadChannel_bottom() will not block
+ **********************************************
+ */
+bool externRAMClientImpl::isReadChannelReady(int channel) {
+  if( channel<0 || channel>=numReadChannels || readChannels[channel]->rpc==NULL )
+    return true;
+
+  readChannels[channel]->context->dispatch->poll();
+  return readChannels[channel]->rpc->isReady();
+}
+
 /*
  *** externRAMClientImpl::MultiWrite() ***
  *
@@ -317,11 +510,7 @@ int externRAMClientImpl::multiRead(uint64_t * hashcodes, int num_prefetch, void
 bool externRAMClientImpl::multiWrite(uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err ) {
   log_trace_in("%s", __func__);
 
-  bool should_free = false;
-  void * ret_addr;
-  int read_err;
-  *err = 0;
-
+  bool should_free;
   RAMCloud::RamCloud * client = myClient;
   uint64_t tid = tableId;
 #ifdef THREADED_WRITE_TO_EXTERNRAM
@@ -329,6 +518,79 @@ bool externRAMClientImpl::multiWrite(uint64_t * hashcodes, int num_write, void *
   tid = tableId_write;
 #endif
 
+  should_free = multiWriteOn(client, tid, hashcodes, num_write, data, lengths, err);
+
+  log_trace_out("%s", __func__);
+  return should_free;
+}
+
+/*
+ *** externRAMClientImpl::openWriteChannels() ***
+ *
+ * open one RAMCloud client per write channel, separate from the clients
+ * used by demand reads and evictions
+ *
+ @ num_channels: number of channels requested
+ -> returns: number of channels opened
+ **********************************************
+ */
+int externRAMClientImpl::openWriteChannels(int num_channels) {
+  log_trace_in("%s", __func__);
+
+  while( numWriteChannels<num_channels && numWriteChannels<MAX_WRITE_CHANNELS )
+  {
+    write_channel * ch = new write_channel();
+    try {
+      ch->context = new RAMCloud::Context(false);
+      ch->client = new RamCloud(ch->context, locator.c_str());
+      ch->tableId = ch->client->getTableId(clientId);
+      writeChannels[numWriteChannels++] = ch;
+    }
+    catch (RAMCloud::Exception& e) {
+      log_err("%s: failed to open write channel %d: %s", __func__, numWriteChannels, e.str().c_str());
+      delete ch;
+      break;
+    }
+  }
+
+  log_trace_out("%s", __func__);
+  return numWriteChannels;
+}
+
+/*
+ *** externRAMClientImpl::multiWriteChannel() ***
+ *
+ * write multiple keys with the client of a write channel. Channels
+ * may be used concurrently by different threads, one thread per channel
+ *
+ @ channel: index of the channel
+ @ hashcodes: pointer to an array of unique keys
+ @ num_write: number of keys to write
+ @ data: pointer to an array of buffers to write
+ @ lengths: pointer to an array of lengths to write
+ -> returns: should free be called
+ **********************************************
+ */
+bool externRAMClientImpl::multiWriteChannel(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err) {
+  if( channel<0 || channel>=numWriteChannels )
+    return multiWrite(hashcodes, num_write, data, lengths, err);
+
+  return multiWriteOn(writeChannels[channel]->client, writeChannels[channel]->tableId,
+                      hashcodes, num_write, data, lengths, err);
+}
+
+/*
+ *** externRAMClientImpl::multiWriteOn() ***
+ *
+ * issue a multiwrite with the given client and table
+ **********************************************
+ */
+bool externRAMClientImpl::multiWriteOn(RAMCloud::RamCloud * client, uint64_t tid, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err) {
+  log_trace_in("%s", __func__);
+
+  bool should_free = false;
+  *err = 0;
+
   try {
     /* Create a new container for all RPCs associated with this key */
     MultiWriteObject * requests_ptr[num_write];
@@ -598,6 +860,44 @@ int externRAMClientImpl::remove(uint64_t hashcode) {
   return ret;
 }
 
+/*
+ *** externRAMClientImpl::multiRemove() ***
+ *
+ * remove the data associated with multiple keys in RAMCloud
+ *
+ @ hashcodes: pointer to an array of unique keys
+ @ num_remove: number of keys to remove
+ -> returns: number of keys removed
+ **********************************************
+ */
+int externRAMClientImpl::multiRemove(uint64_t * hashcodes, int num_remove) {
+  log_trace_in("%s", __func__);
+  int ret = 0;
+  RAMCloud::RamCloud * client = myClient;
+  uint64_t tid = tableId;
+
+  try {
+    MultiRemoveObject * requests_ptr[num_remove];
+    Tub<MultiRemoveObject> requests[num_remove];
+    for( int i=0; i<num_remove; i++ )
+    {
+      requests[i].construct(tid, &hashcodes[i], sizeof(uint64_t));
+      requests_ptr[i] = requests[i].get();
+    }
+    client->multiRemove( requests_ptr, num_remove );
+    ret = num_remove;
+  }
+  catch (RAMCloud::ClientException& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+  catch (RAMCloud::Exception& e) {
+    log_err("%s: RAMCloud exception: %s", __func__, e.str().c_str());
+  }
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
 /*
  *** externRAMClientImpl::getPerfStats() ***
  *
@@ -67,6 +67,32 @@ private:
 
     void dropTable(const char *);
 
+    // connections reserved for speculative reads, one context each
+    struct read_channel {
+      RAMCloud::Context * context;
+      RAMCloud::RamCloud * client;
+      uint64_t tableId;
+      // state of the outstanding asynchronous multiread
+      RAMCloud::MultiRead * rpc;
+      uint64_t keys[MAX_MULTI_READ];
+      RAMCloud::MultiReadObject requests[MAX_MULTI_READ];
+      RAMCloud::MultiReadObject * requests_ptr[MAX_MULTI_READ];
+      RAMCloud::Tub<RAMCloud::ObjectBuffer> values[MAX_MULTI_READ];
+    };
+    read_channel * readChannels[MAX_READ_CHANNELS];
+    int numReadChannels;
+
+    // connections reserved for bulk flushes, one context each
+    struct write_channel {
+      RAMCloud::Context * context;
+      RAMCloud::RamCloud * client;
+      uint64_t tableId;
+    };
+    write_channel * writeChannels[MAX_WRITE_CHANNELS];
+    int numWriteChannels;
+
+    bool multiWriteOn(RAMCloud::RamCloud * client, uint64_t tid, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err);
+
 public:
     RAMCloud::Context context;
 #ifdef THREADED_WRITE_TO_EXTERNRAM
@@ -88,7 +114,14 @@ public:
     virtual void *      write(uint64_t hashcode, void **data, int size, int *err);
     virtual int         read(uint64_t hashcode, void ** recvBuf);
     int                 multiRead(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    int                 openReadChannels(int num_channels);
+    int                 multiReadChannel(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    void                multiReadChannel_top(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    int                 multiReadChannel_bottom(int channel, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths);
+    bool                isReadChannelReady(int channel);
     bool                multiWrite(uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err);
+    int                 openWriteChannels(int num_channels);
+    bool                multiWriteChannel(int channel, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int *err);
 #ifdef ASYNREAD
     virtual void        read_top(uint64_t hashcode, void ** recvBuf);
     virtual int         read_bottom(uint64_t hashcode, void ** recvBuf);
@@ -97,6 +130,7 @@ public:
 #endif
     void                multiReadTest();
     int                 remove(uint64_t hashcode);
+    int                 multiRemove(uint64_t * hashcodes, int num_remove);
     void                getPerfStats(RAMCloud::PerfStats* out);
     bool                isFull(uint64_t hashcode);
     bool                isFullAll();
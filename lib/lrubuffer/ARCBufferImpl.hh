@@ -0,0 +1,424 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * ARCBufferImpl.hh
+ *
+ * This defines and implements an Adaptive Replacement Cache class of the
+ * interface LRUBuffer. It is built as part of LRUBufferImpl.cc
+*/
+
+
+#ifndef _ARCBUFFERIMPL_H_
+#define _ARCBUFFERIMPL_H_
+#include <LRUBuffer.hh>
+#include "lru_list.hh"
+#include "lru_partitions.hh"
+#include <dbg.h>
+#include <pagehash.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <monitorstats.h>
+
+/*
+ * Resident pages are on t1 when they have faulted in once and on t2 when
+ * they have faulted in again since. Pages evicted from t1 and t2 are
+ * remembered as keys on the ghost lists b1 and b2. A fault on a ghost
+ * moves target_t1, the share of the buffer given to t1, towards the list
+ * that would have kept the page, and brings the page back on t2. A guest
+ * scanning its memory once only cycles pages through t1, so the pages on
+ * t2 survive it.
+ */
+class ARCBufferImpl: public LRUBuffer
+{
+private:
+    struct c_cache_node popLRU(void);
+    int                 getSize();
+    int                 getMaxSize();
+    int                 setSize(int size);
+    bool                evictFromT1();
+    void                trimGhosts();
+
+    lru_list t1;
+    lru_list t2;
+    lru_list b1;
+    lru_list b2;
+    lru_partitions partitions;
+    int      max_num_items;
+    int      target_t1;
+
+public:
+    virtual ~ARCBufferImpl();
+    ARCBufferImpl(bool shadow=false);
+
+    virtual void                referenceCachedNode(uint64_t key, int ufd);
+    virtual struct c_cache_node insertCacheNode(uint64_t key, int ufd, bool evict);
+    virtual int                 popNLRU(int num_pop, c_cache_node ** node_list);
+    virtual int                 isLRUSizeExceeded(void);
+    virtual struct c_cache_node getLRU();
+    virtual int                 getLRUCandidates(int num, c_cache_node ** node_list);
+    virtual uint64_t *          removeUFDFromLRU(int ufd, int max_pages, int *numPages);
+    virtual uint64_t *          removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages);
+    virtual void                setPartition(int ufd, int min_pages, int weight);
+    virtual int                 listPartitions(c_lru_partition ** list);
+    virtual void                setRebalance(int ghost_pages);
+    virtual int                 rebalance(int *from_ufd, int *to_ufd);
+    virtual int                 getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points);
+    virtual int                 isCached(uint64_t key, int ufd);
+    virtual void                printLRUBuffer(FILE * file=NULL);
+};
+
+/*
+ *** ARCBufferImpl::ARCBufferImpl() ***
+ *  default parameterless constructor
+ **********************************************
+ */
+ARCBufferImpl::ARCBufferImpl(bool shadow):LRUBuffer(shadow),max_num_items(cache_size),target_t1(0)
+{
+  if (shadow)
+    partitions.disableTracking();
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)this->getMaxSize());
+  if (!shadow)
+    StatsSetLRUBufferSize(0);
+#endif
+
+  log_debug("%s: created instance of ARC Buffer", __func__);
+}
+
+
+/*
+ *** ARCBufferImpl::~ARCBufferImpl() ***
+ *  default parameterless constructor
+ **********************************************
+ */
+ARCBufferImpl::~ARCBufferImpl()
+{
+  log_debug("%s: deleted instance of ARC Buffer", __func__);
+}
+
+void ARCBufferImpl::referenceCachedNode(uint64_t key, int ufd) {
+  log_trace_in("%s", __func__);
+
+  cache_node node;
+
+  node.hashcode = hash_page_key(key, ufd);
+  node.ufd = ufd;
+
+  if (t1.contains(node.hashcode)) {
+    t1.erase(node.hashcode);
+    t2.insert(node);
+  }
+  else if (t2.contains(node.hashcode))
+    t2.insert(node);
+
+  log_trace_out("%s", __func__);
+}
+
+c_cache_node ARCBufferImpl::insertCacheNode(uint64_t key, int ufd, bool evict) {
+  log_trace_in("%s", __func__);
+
+  cache_node node;
+  c_cache_node return_node;
+  memset(&return_node, 0, sizeof(c_cache_node));
+
+  node.hashcode = hash_page_key(key, ufd);
+  node.ufd = ufd;
+
+  partitions.inserted(node.hashcode, node.ufd);
+  if (t1.contains(node.hashcode)) {
+    // already resident, it has now been seen twice
+    t1.erase(node.hashcode);
+    t2.insert(node);
+  }
+  else if (t2.contains(node.hashcode)) {
+    t2.insert(node);
+  }
+  else {
+    if (b1.contains(node.hashcode)) {
+      // evicted from t1 too early: give t1 more room
+      int delta = std::max(b2.getSize() / std::max(b1.getSize(), 1), 1);
+      target_t1 = std::min(target_t1 + delta, max_num_items);
+      b1.erase(node.hashcode);
+      t2.insert(node);
+      log_debug("%s: ghost hit on b1, t1 target is now %d", __func__, target_t1);
+    }
+    else if (b2.contains(node.hashcode)) {
+      // evicted from t2 too early: give t2 more room
+      int delta = std::max(b1.getSize() / std::max(b2.getSize(), 1), 1);
+      target_t1 = std::max(target_t1 - delta, 0);
+      b2.erase(node.hashcode);
+      t2.insert(node);
+      log_debug("%s: ghost hit on b2, t1 target is now %d", __func__, target_t1);
+    }
+    else
+      t1.insert(node);
+
+#ifdef MONITORSTATS
+    if (!shadow)
+      StatsIncrLRUBufferSize();
+#endif
+  }
+
+  if (evict && isLRUSizeExceeded()) {
+    log_debug("%s: ARC size exceeded. Calling popLRU", __func__);
+    return_node = popLRU();
+  }
+  trimGhosts();
+
+#ifdef DEBUG
+  int new_size = getSize();
+  log_debug("%s: new ARC size is %d (t1 %d, t2 %d)", __func__, new_size, t1.getSize(), t2.getSize());
+#endif
+  log_trace_out("%s", __func__);
+  return return_node;
+}
+
+int ARCBufferImpl::popNLRU(int num_pop, c_cache_node ** node_list) {
+  log_trace_in("%s", __func__);
+
+  int i = 0;
+  int lru_size = getSize();
+
+  if (num_pop > lru_size)
+    num_pop = lru_size;
+
+  *node_list = (c_cache_node *) malloc(sizeof(c_cache_node) * num_pop);
+
+  for (i = 0; i < num_pop; i++) {
+    c_cache_node node = popLRU();
+    (*node_list)[i].ufd = node.ufd;
+    (*node_list)[i].hashcode = node.hashcode;
+  }
+  trimGhosts();
+
+  log_trace_out("%s", __func__);
+  return num_pop;
+}
+
+// the next victim comes from t1 while t1 is over its target share
+bool ARCBufferImpl::evictFromT1() {
+  return t1.getSize() > 0 && (t1.getSize() >= std::max(target_t1, 1) || t2.getSize() == 0);
+}
+
+c_cache_node ARCBufferImpl::popLRU() {
+  log_trace_in("%s", __func__);
+
+  cache_node node;
+  c_cache_node return_node;
+
+  bool fromT1 = evictFromT1();
+  lru_list * lists[] = { &t1, &t2 };
+
+  node = fromT1 ? t1.back() : t2.back();
+  int ufd = partitions.victimUFD(node.ufd, lists, 2, max_num_items);
+  if (ufd != node.ufd) {
+    // the other ufd's page from the list ARC wants to shrink, if it has one
+    log_debug("%s: ufd %d is within its share, evicting from ufd %d", __func__, node.ufd, ufd);
+    if ((fromT1 ? t1.ufdSize(ufd) : t2.ufdSize(ufd)) == 0)
+      fromT1 = !fromT1;
+    node = fromT1 ? t1.ufdBack(ufd) : t2.ufdBack(ufd);
+  }
+
+  if (fromT1) {
+    t1.erase(node.hashcode);
+    b1.insert(node);
+  }
+  else {
+    t2.erase(node.hashcode);
+    b2.insert(node);
+  }
+  partitions.evicted(node);
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsDecrLRUBufferSize();
+#endif
+
+  return_node.hashcode = node.hashcode;
+  return_node.ufd = node.ufd;
+
+  log_trace_out("%s", __func__);
+  return return_node;
+}
+
+// keep each ghost list within the buffer size
+void ARCBufferImpl::trimGhosts() {
+  while (b1.getSize() > max_num_items)
+    b1.pop_back();
+  while (b2.getSize() > max_num_items)
+    b2.pop_back();
+}
+
+struct c_cache_node ARCBufferImpl::getLRU() {
+  log_trace_in("%s", __func__);
+
+  struct c_cache_node ret;
+  cache_node node = evictFromT1() ? t1.back() : t2.back();
+  ret.hashcode = node.hashcode;
+  ret.ufd = node.ufd;
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+// the pages at the ends of t1 and t2, which are evicted next
+int ARCBufferImpl::getLRUCandidates(int num, c_cache_node ** node_list) {
+  log_trace_in("%s", __func__);
+
+  std::vector<cache_node> tail_nodes;
+  t1.tailNodes(num, tail_nodes);
+  t2.tailNodes(num, tail_nodes);
+
+  *node_list = (c_cache_node *) malloc(sizeof(c_cache_node) * tail_nodes.size());
+  for (std::vector<cache_node>::size_type i = 0; i < tail_nodes.size(); i++) {
+    (*node_list)[i].hashcode = tail_nodes[i].hashcode;
+    (*node_list)[i].ufd = tail_nodes[i].ufd;
+  }
+
+  log_trace_out("%s", __func__);
+  return tail_nodes.size();
+}
+
+int ARCBufferImpl::isLRUSizeExceeded() {
+  int ret;
+  log_trace_in("%s", __func__);
+  if( getSize() > max_num_items )
+    ret = 1;
+  else
+    ret = 0;
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int ARCBufferImpl::getSize() {
+  return t1.getSize() + t2.getSize();
+}
+
+int ARCBufferImpl::getMaxSize() {
+  return max_num_items;
+}
+
+int ARCBufferImpl::setSize(int size) {
+  log_trace_in("%s", __func__);
+
+  max_num_items = size;
+  target_t1 = std::min(target_t1, max_num_items);
+  trimGhosts();
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)size);
+#endif
+
+  log_trace_out("%s", __func__);
+  return max_num_items;
+}
+
+uint64_t * ARCBufferImpl::removeUFDFromLRU(int ufd, int max_pages, int *numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  std::vector<uint64_t> ghostVector;
+  uint64_t *keyList;
+
+  t1.eraseUFD(ufd, max_pages, keyVector);
+  if (max_pages == 0 || (int)keyVector.size() < max_pages)
+    t2.eraseUFD(ufd, max_pages ? max_pages - keyVector.size() : 0, keyVector);
+  *numPages = keyVector.size();
+
+  // forget the evicted pages of ufd once its resident pages are gone
+  if (max_pages == 0 || *numPages < max_pages) {
+    b1.eraseUFD(ufd, 0, ghostVector);
+    b2.eraseUFD(ufd, 0, ghostVector);
+    partitions.remove(ufd);
+  }
+
+  // populate the memory region to be returned to libuserfault
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
+#endif
+
+  log_debug("%s: new ARC size is %d", __func__, getSize());
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+uint64_t * ARCBufferImpl::removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  std::vector<uint64_t> ghostVector;
+  uint64_t *keyList;
+
+  t1.eraseUFDRange(ufd, start, end, keyVector);
+  t2.eraseUFDRange(ufd, start, end, keyVector);
+  *numPages = keyVector.size();
+
+  // a fault in the range is on a new page, not a ghost hit
+  b1.eraseUFDRange(ufd, start, end, ghostVector);
+  b2.eraseUFDRange(ufd, start, end, ghostVector);
+
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
+#endif
+
+  log_debug("%s: new ARC size is %d", __func__, getSize());
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+void ARCBufferImpl::setPartition(int ufd, int min_pages, int weight) {
+  partitions.set(ufd, min_pages, weight);
+}
+
+int ARCBufferImpl::listPartitions(c_lru_partition ** list) {
+  lru_list * lists[] = { &t1, &t2 };
+  return partitions.list(lists, 2, max_num_items, list);
+}
+
+void ARCBufferImpl::setRebalance(int ghost_pages) {
+  partitions.setGhostPages(ghost_pages);
+}
+
+int ARCBufferImpl::rebalance(int *from_ufd, int *to_ufd) {
+  lru_list * lists[] = { &t1, &t2 };
+  return partitions.rebalance(lists, 2, max_num_items, from_ufd, to_ufd);
+}
+
+int ARCBufferImpl::getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points) {
+  return partitions.curve(ufd, sampled, points);
+}
+
+int ARCBufferImpl::isCached(uint64_t key, int ufd) {
+  uint64_t hashcode = hash_page_key(key, ufd);
+  return t1.contains(hashcode) || t2.contains(hashcode);
+}
+
+void ARCBufferImpl::printLRUBuffer(FILE * file) {
+  FILE * out = (file != NULL) ? file : stderr;
+  fprintf(out, "%s: t1 target %d, t1 %d, t2 %d, b1 %d, b2 %d\n", __func__,
+          target_t1, t1.getSize(), t2.getSize(), b1.getSize(), b2.getSize());
+  t1.printCache("t1", __func__, file);
+  t2.printCache("t2", __func__, file);
+}
+#endif
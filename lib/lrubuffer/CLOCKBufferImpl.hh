@@ -0,0 +1,348 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * CLOCKBufferImpl.hh
+ *
+ * This defines and implements a CLOCK class of the interface LRUBuffer.
+ * It is built as part of LRUBufferImpl.cc
+*/
+
+
+#ifndef _CLOCKBUFFERIMPL_H_
+#define _CLOCKBUFFERIMPL_H_
+#include <LRUBuffer.hh>
+#include "lru_list.hh"
+#include "lru_partitions.hh"
+#include <dbg.h>
+#include <pagehash.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <vector>
+#include <boost/unordered_set.hpp>
+#include <monitorstats.h>
+
+/*
+ * Pages sit on a ring in fault order. referenceCachedNode() sets the
+ * reference bit of a resident page, which the page_idle sampler in
+ * libuserfault does for pages the guest has touched since the last
+ * sample. The sweep looking for a victim gives a referenced page a second
+ * chance: its bit is cleared and it goes back to the front of the ring.
+ */
+class CLOCKBufferImpl: public LRUBuffer
+{
+private:
+    struct c_cache_node popLRU(void);
+    int                 getSize();
+    int                 getMaxSize();
+    int                 setSize(int size);
+
+    lru_list                          ring;
+    boost::unordered_set<uint64_t>    referenced;
+    lru_partitions                    partitions;
+
+public:
+    virtual ~CLOCKBufferImpl();
+    CLOCKBufferImpl(bool shadow=false);
+
+    virtual void                referenceCachedNode(uint64_t key, int ufd);
+    virtual struct c_cache_node insertCacheNode(uint64_t key, int ufd, bool evict);
+    virtual int                 popNLRU(int num_pop, c_cache_node ** node_list);
+    virtual int                 isLRUSizeExceeded(void);
+    virtual struct c_cache_node getLRU();
+    virtual int                 getLRUCandidates(int num, c_cache_node ** node_list);
+    virtual uint64_t *          removeUFDFromLRU(int ufd, int max_pages, int *numPages);
+    virtual uint64_t *          removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages);
+    virtual void                setPartition(int ufd, int min_pages, int weight);
+    virtual int                 listPartitions(c_lru_partition ** list);
+    virtual void                setRebalance(int ghost_pages);
+    virtual int                 rebalance(int *from_ufd, int *to_ufd);
+    virtual int                 getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points);
+    virtual int                 isCached(uint64_t key, int ufd);
+    virtual void                printLRUBuffer(FILE * file=NULL);
+};
+
+/*
+ *** CLOCKBufferImpl::CLOCKBufferImpl() ***
+ *  default parameterless constructor
+ **********************************************
+ */
+CLOCKBufferImpl::CLOCKBufferImpl(bool shadow):LRUBuffer(shadow)
+{
+  if (shadow)
+    partitions.disableTracking();
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)this->getMaxSize());
+  if (!shadow)
+    StatsSetLRUBufferSize(0);
+#endif
+
+  log_debug("%s: created instance of CLOCK Buffer", __func__);
+}
+
+
+/*
+ *** CLOCKBufferImpl::~CLOCKBufferImpl() ***
+ *  default parameterless constructor
+ **********************************************
+ */
+CLOCKBufferImpl::~CLOCKBufferImpl()
+{
+  log_debug("%s: deleted instance of CLOCK Buffer", __func__);
+}
+
+void CLOCKBufferImpl::referenceCachedNode(uint64_t key, int ufd) {
+  log_trace_in("%s", __func__);
+
+  uint64_t hashcode = hash_page_key(key, ufd);
+
+  if (ring.contains(hashcode))
+    referenced.insert(hashcode);
+
+  log_trace_out("%s", __func__);
+}
+
+c_cache_node CLOCKBufferImpl::insertCacheNode(uint64_t key, int ufd, bool evict) {
+  log_trace_in("%s", __func__);
+
+  cache_node node;
+  c_cache_node return_node;
+  memset(&return_node, 0, sizeof(c_cache_node));
+
+  node.hashcode = hash_page_key(key, ufd);
+  node.ufd = ufd;
+
+  partitions.inserted(node.hashcode, node.ufd);
+  if (ring.contains(node.hashcode))
+    referenced.insert(node.hashcode);
+  else {
+    ring.insert(node);
+#ifdef MONITORSTATS
+    if (!shadow)
+      StatsIncrLRUBufferSize();
+#endif
+  }
+
+  if (evict && isLRUSizeExceeded()) {
+    log_debug("%s: CLOCK size exceeded. Calling popLRU", __func__);
+    return_node = popLRU();
+  }
+
+#ifdef DEBUG
+  int new_size = getSize();
+  log_debug("%s: new CLOCK size is %d", __func__, new_size);
+#endif
+  log_trace_out("%s", __func__);
+  return return_node;
+}
+
+int CLOCKBufferImpl::popNLRU(int num_pop, c_cache_node ** node_list) {
+  log_trace_in("%s", __func__);
+
+  int i = 0;
+  int lru_size = getSize();
+
+  if (num_pop > lru_size)
+    num_pop = lru_size;
+
+  *node_list = (c_cache_node *) malloc(sizeof(c_cache_node) * num_pop);
+
+  for (i = 0; i < num_pop; i++) {
+    c_cache_node node = popLRU();
+    (*node_list)[i].ufd = node.ufd;
+    (*node_list)[i].hashcode = node.hashcode;
+  }
+
+  log_trace_out("%s", __func__);
+  return num_pop;
+}
+
+c_cache_node CLOCKBufferImpl::popLRU() {
+  log_trace_in("%s", __func__);
+
+  cache_node node = ring.back();
+  c_cache_node return_node;
+  int second_chances = 0;
+
+  // after one full turn every reference bit is clear
+  while (referenced.erase(node.hashcode) && second_chances <= ring.getSize()) {
+    ring.insert(node);
+    node = ring.back();
+    second_chances++;
+  }
+
+  lru_list * lists[] = { &ring };
+  int ufd = partitions.victimUFD(node.ufd, lists, 1, getMaxSize());
+  if (ufd != node.ufd) {
+    log_debug("%s: ufd %d is within its share, evicting from ufd %d", __func__, node.ufd, ufd);
+    node = ring.ufdBack(ufd);
+    referenced.erase(node.hashcode);
+  }
+  ring.erase(node.hashcode);
+  partitions.evicted(node);
+  log_debug("%s: evicting %lx after %d second chances", __func__, node.hashcode, second_chances);
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsDecrLRUBufferSize();
+#endif
+
+  return_node.hashcode = node.hashcode;
+  return_node.ufd = node.ufd;
+
+  log_trace_out("%s", __func__);
+  return return_node;
+}
+
+struct c_cache_node CLOCKBufferImpl::getLRU() {
+  log_trace_in("%s", __func__);
+
+  struct c_cache_node ret;
+  cache_node node = ring.back();
+  ret.hashcode = node.hashcode;
+  ret.ufd = node.ufd;
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+// the pages the sweep reaches next
+int CLOCKBufferImpl::getLRUCandidates(int num, c_cache_node ** node_list) {
+  log_trace_in("%s", __func__);
+
+  std::vector<cache_node> tail_nodes;
+  ring.tailNodes(num, tail_nodes);
+
+  *node_list = (c_cache_node *) malloc(sizeof(c_cache_node) * tail_nodes.size());
+  for (std::vector<cache_node>::size_type i = 0; i < tail_nodes.size(); i++) {
+    (*node_list)[i].hashcode = tail_nodes[i].hashcode;
+    (*node_list)[i].ufd = tail_nodes[i].ufd;
+  }
+
+  log_trace_out("%s", __func__);
+  return tail_nodes.size();
+}
+
+int CLOCKBufferImpl::isLRUSizeExceeded() {
+  int ret;
+  log_trace_in("%s", __func__);
+  if( ring.isSizeExceeded() )
+    ret = 1;
+  else
+    ret = 0;
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int CLOCKBufferImpl::getSize() {
+  return ring.getSize();
+}
+
+int CLOCKBufferImpl::getMaxSize() {
+  return ring.getMaxSize();
+}
+
+int CLOCKBufferImpl::setSize(int size) {
+  log_trace_in("%s", __func__);
+
+  int ret = ring.setSize(size);
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)size);
+#endif
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+uint64_t * CLOCKBufferImpl::removeUFDFromLRU(int ufd, int max_pages, int *numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  uint64_t *keyList;
+
+  ring.eraseUFD(ufd, max_pages, keyVector);
+  *numPages = keyVector.size();
+  if (max_pages == 0 || *numPages < max_pages)
+    partitions.remove(ufd);
+
+  // populate the memory region to be returned to libuserfault
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     referenced.erase(hash_page_key(keyVector[i], ufd));
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
+#endif
+
+  log_debug("%s: new CLOCK size is %d", __func__, getSize());
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+uint64_t * CLOCKBufferImpl::removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  uint64_t *keyList;
+
+  ring.eraseUFDRange(ufd, start, end, keyVector);
+  *numPages = keyVector.size();
+
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     referenced.erase(hash_page_key(keyVector[i], ufd));
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
+#endif
+
+  log_debug("%s: new CLOCK size is %d", __func__, getSize());
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+void CLOCKBufferImpl::setPartition(int ufd, int min_pages, int weight) {
+  partitions.set(ufd, min_pages, weight);
+}
+
+int CLOCKBufferImpl::listPartitions(c_lru_partition ** list) {
+  lru_list * lists[] = { &ring };
+  return partitions.list(lists, 1, getMaxSize(), list);
+}
+
+void CLOCKBufferImpl::setRebalance(int ghost_pages) {
+  partitions.setGhostPages(ghost_pages);
+}
+
+int CLOCKBufferImpl::rebalance(int *from_ufd, int *to_ufd) {
+  lru_list * lists[] = { &ring };
+  return partitions.rebalance(lists, 1, getMaxSize(), from_ufd, to_ufd);
+}
+
+int CLOCKBufferImpl::getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points) {
+  return partitions.curve(ufd, sampled, points);
+}
+
+int CLOCKBufferImpl::isCached(uint64_t key, int ufd) {
+  return ring.contains(hash_page_key(key, ufd));
+}
+
+void CLOCKBufferImpl::printLRUBuffer(FILE * file) {
+  FILE * out = (file != NULL) ? file : stderr;
+  fprintf(out, "%s: %d pages, %d referenced\n", __func__, getSize(), (int)referenced.size());
+  ring.printCache("after", __func__, file);
+}
+#endif
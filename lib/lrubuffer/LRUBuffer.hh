@@ -25,21 +25,33 @@ public:
 
     // Pimpl pattern
     static LRUBuffer *        create();
+    static LRUBuffer *        createShadow(int policy, int size);
 
     // API with clients
     virtual struct c_cache_node insertCacheNode(uint64_t key, int ufd, bool evict){};
     virtual void                referenceCachedNode(uint64_t key, int ufd){};
     virtual int                 popNLRU(int num_pop, c_cache_node ** node_list){};
     virtual struct c_cache_node getLRU(){};
+    virtual int                 getLRUCandidates(int num, c_cache_node ** node_list){};
     virtual int                 isLRUSizeExceeded(void){};
     virtual int                 getSize(){};
     virtual int                 getMaxSize(){};
     virtual int                 setSize(int size){};
-    virtual uint64_t *          removeUFDFromLRU(int ufd, int *numPages){};
+    virtual uint64_t *          removeUFDFromLRU(int ufd, int max_pages, int *numPages){};
+    virtual uint64_t *          removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages){};
+    virtual void                setPartition(int ufd, int min_pages, int weight){};
+    virtual int                 listPartitions(c_lru_partition ** list){};
+    virtual void                setRebalance(int ghost_pages){};
+    virtual int                 rebalance(int *from_ufd, int *to_ufd){};
+    virtual int                 getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points){};
+    virtual int                 isCached(uint64_t key, int ufd){};
+    virtual int                 protectCachedNode(uint64_t key, int ufd){return 0;};
     virtual void                printLRUBuffer(FILE * file=NULL){};
 
 protected:
-    LRUBuffer(){};
+    LRUBuffer(bool shadow=false):shadow(shadow){};
+    bool shadow;    // a copy fed a sample of the faults, kept out of the stats
+
     LRUBuffer(const LRUBuffer &o);
     const LRUBuffer & operator =(const LRUBuffer &o);
 };
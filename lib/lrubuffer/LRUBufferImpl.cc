@@ -13,6 +13,8 @@
 */
 
 #include "LRUBufferImpl.hh"
+#include "ARCBufferImpl.hh"
+#include "CLOCKBufferImpl.hh"
 #include <dbg.h>
 #include <pagehash.h>
 #include <stdio.h>
@@ -24,32 +26,73 @@
 
 /*
  *** LRUBuffer::create() ****
- * This is the Pointer to Implementation Pattern
+ * This is the Pointer to Implementation Pattern. lru_policy selects
+ * the implementation
  ********************************
  */
 LRUBuffer * LRUBuffer::create()
 {
   log_trace_in("%s", __func__);
+  LRUBuffer * buffer;
+
+  if (lru_policy == LRU_POLICY_ARC) {
+    log_info("%s: using the ARC replacement policy", __func__);
+    buffer = new ARCBufferImpl();
+  }
+  else if (lru_policy == LRU_POLICY_CLOCK) {
+    log_info("%s: using the CLOCK replacement policy", __func__);
+    buffer = new CLOCKBufferImpl();
+  }
+  else {
+    log_info("%s: using the LRU replacement policy", __func__);
+    buffer = new LRUBufferImpl();
+  }
+
   /*
    * Necesssary to use null_deleter or object will get implicitly deleted.
    */
-  boost::shared_ptr<LRUBuffer> impl(new LRUBufferImpl(),null_deleter());
+  boost::shared_ptr<LRUBuffer> impl(buffer,null_deleter());
 
   log_trace_out("%s", __func__);
   return (impl.get());
 }
 
 
+/*
+ *** LRUBuffer::createShadow() ****
+ * A buffer of the given policy and size that only keeps page keys, for
+ * comparing the policies on a sample of the faults
+ ********************************
+ */
+LRUBuffer * LRUBuffer::createShadow(int policy, int size)
+{
+  LRUBuffer * buffer;
+
+  if (policy == LRU_POLICY_ARC)
+    buffer = new ARCBufferImpl(true);
+  else if (policy == LRU_POLICY_CLOCK)
+    buffer = new CLOCKBufferImpl(true);
+  else
+    buffer = new LRUBufferImpl(true);
+  buffer->setSize(size);
+
+  return buffer;
+}
+
 /*
  *** LRUBufferImpl::LRUBufferImpl() ***
  *  default parameterless constructor
  **********************************************
  */
-LRUBufferImpl::LRUBufferImpl()
+LRUBufferImpl::LRUBufferImpl(bool shadow):LRUBuffer(shadow)
 {
+  if (shadow)
+    partitions.disableTracking();
 #ifdef MONITORSTATS
-  StatsSetLRUBufferCap((unsigned long)this->getMaxSize());
-  StatsSetLRUBufferSize(0);
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)this->getMaxSize());
+  if (!shadow)
+    StatsSetLRUBufferSize(0);
 #endif
 
   log_debug("%s: created instance of LRU Buffer", __func__);
@@ -67,15 +110,18 @@ LRUBufferImpl::~LRUBufferImpl()
 }
 
 void LRUBufferImpl::referenceCachedNode(uint64_t key, int ufd) {
-  /**** NOT USED ****/
   log_trace_in("%s", __func__);
 
-  uint64_t hashcode;
+  cache_node node;
 
-  hashcode = hash_page_key(key, ufd);
+  node.hashcode = hash_page_key(key, ufd);
+  node.ufd = ufd;
 
   // move the referenced cache to the front
-  cache.insert(*cache.find(hashcode));
+  if (cache.contains(node.hashcode))
+    cache.insert(node);
+  else if (hot.contains(node.hashcode))
+    hot.insert(node);
 
   log_trace_out("%s", __func__);
 }
@@ -90,10 +136,15 @@ c_cache_node LRUBufferImpl::insertCacheNode(uint64_t key, int ufd, bool evict) {
   node.hashcode = hash_page_key(key, ufd);
   node.ufd = ufd;
 
-  cache.insert(node);
+  partitions.inserted(node.hashcode, node.ufd);
+  if (hot.contains(node.hashcode))
+    hot.insert(node);
+  else
+    cache.insert(node);
 
 #ifdef MONITORSTATS
-  StatsIncrLRUBufferSize();
+  if (!shadow)
+    StatsIncrLRUBufferSize();
 #endif
 
   if (evict && isLRUSizeExceeded()) {
@@ -134,13 +185,27 @@ c_cache_node LRUBufferImpl::popLRU() {
   log_trace_in("%s", __func__);
 
   uint64_t key;
-  cache_node node = cache.back();
+  cache_node node = cache.getSize() > 0 ? cache.back() : hot.back();
   c_cache_node return_node;
+  lru_list * lists[] = { &cache, &hot };
+  int ufd = partitions.victimUFD(node.ufd, lists, 2, getMaxSize());
+
+  if (ufd != node.ufd) {
+    log_debug("%s: ufd %d is within its share, evicting from ufd %d", __func__, node.ufd, ufd);
+    node = cache.ufdBack(ufd);
+    if (node.hashcode == 0)
+      node = hot.ufdBack(ufd);
+  }
   key = node.hashcode;
-  cache.pop_back();
+  if (cache.contains(key))
+    cache.erase(key);
+  else
+    hot.erase(key);
+  partitions.evicted(node);
 
 #ifdef MONITORSTATS
-  StatsDecrLRUBufferSize();
+  if (!shadow)
+    StatsDecrLRUBufferSize();
 #endif
 
   return_node.hashcode = node.hashcode;
@@ -154,7 +219,7 @@ struct c_cache_node LRUBufferImpl::getLRU() {
   log_trace_in("%s", __func__);
 
   struct c_cache_node ret;
-  cache_node node = cache.back();
+  cache_node node = cache.getSize() > 0 ? cache.back() : hot.back();
   ret.hashcode = node.hashcode;
   ret.ufd = node.ufd;
 
@@ -163,10 +228,34 @@ struct c_cache_node LRUBufferImpl::getLRU() {
 }
 
 
+/*
+ *** LRUBufferImpl::getLRUCandidates() ***
+ *  returns up to num pages that are next to be evicted, least recently
+ *  used first
+ **********************************************
+ */
+int LRUBufferImpl::getLRUCandidates(int num, c_cache_node ** node_list) {
+  log_trace_in("%s", __func__);
+
+  std::vector<cache_node> tail_nodes;
+  cache.tailNodes(num, tail_nodes);
+  if ((int)tail_nodes.size() < num)
+    hot.tailNodes(num - tail_nodes.size(), tail_nodes);
+
+  *node_list = (c_cache_node *) malloc(sizeof(c_cache_node) * tail_nodes.size());
+  for (std::vector<cache_node>::size_type i = 0; i < tail_nodes.size(); i++) {
+    (*node_list)[i].hashcode = tail_nodes[i].hashcode;
+    (*node_list)[i].ufd = tail_nodes[i].ufd;
+  }
+
+  log_trace_out("%s", __func__);
+  return tail_nodes.size();
+}
+
 int LRUBufferImpl::isLRUSizeExceeded() {
   int ret;
   log_trace_in("%s", __func__);
-  if( cache.isSizeExceeded() )
+  if( getSize() > getMaxSize() )
     ret = 1;
   else
     ret = 0;
@@ -177,7 +266,7 @@ int LRUBufferImpl::isLRUSizeExceeded() {
 int LRUBufferImpl::getSize() {
   int ret;
   log_trace_in("%s", __func__);
-  ret = cache.getSize();
+  ret = cache.getSize() + hot.getSize();
   log_trace_out("%s", __func__);
   return ret;
 }
@@ -195,31 +284,35 @@ int LRUBufferImpl::setSize(int size) {
 
   int ret;
   ret = cache.setSize(size);
+  trimProtected();
 
 #ifdef MONITORSTATS
-  StatsSetLRUBufferCap((unsigned long)size);
+  if (!shadow)
+    StatsSetLRUBufferCap((unsigned long)size);
 #endif
 
   log_trace_out("%s", __func__);
   return ret;
 }
 
-uint64_t * LRUBufferImpl::removeUFDFromLRU(int ufd, int *numPages) {
+/*
+ *** LRUBufferImpl::removeUFDFromLRU() ***
+ *  removes up to max_pages pages of ufd, or all of them if max_pages is 0,
+ *  and returns their addresses. Only the pages of ufd are visited
+ **********************************************
+ */
+uint64_t * LRUBufferImpl::removeUFDFromLRU(int ufd, int max_pages, int *numPages) {
   log_trace_in("%s", __func__);
 
   std::vector<uint64_t> keyVector;
   uint64_t *keyList;
 
-  lru_list::iterator itr = cache.begin();
-  int i=0;
-  for ( ; itr!= cache.end(); itr++, i++ ) {
-    if (itr->ufd == ufd) {
-      // this cache_node will be removed
-      keyVector.push_back(itr->hashcode & (uint64_t)(PAGE_MASK));
-      cache.erase(itr->hashcode);
-    }
-  }
+  cache.eraseUFD(ufd, max_pages, keyVector);
+  if (max_pages == 0 || (int)keyVector.size() < max_pages)
+    hot.eraseUFD(ufd, max_pages == 0 ? 0 : max_pages - keyVector.size(), keyVector);
   *numPages = keyVector.size();
+  if (max_pages == 0 || *numPages < max_pages)
+    partitions.remove(ufd);
 
   // populate the memory region to be returned to libuserfault
   keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
@@ -228,7 +321,8 @@ uint64_t * LRUBufferImpl::removeUFDFromLRU(int ufd, int *numPages) {
   }
 
 #ifdef MONITORSTATS
-  StatsSetLRUBufferSize((unsigned long)this->getSize());
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
 #endif
 
   log_debug("%s: new LRU size is %d", __func__, (unsigned long)getSize());
@@ -236,7 +330,121 @@ uint64_t * LRUBufferImpl::removeUFDFromLRU(int ufd, int *numPages) {
   return keyList;
 }
 
+/*
+ *** LRUBufferImpl::removeRangeFromLRU() ***
+ *  removes the pages of ufd in [start, end) and returns their addresses
+ **********************************************
+ */
+uint64_t * LRUBufferImpl::removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  uint64_t *keyList;
+
+  cache.eraseUFDRange(ufd, start, end, keyVector);
+  hot.eraseUFDRange(ufd, start, end, keyVector);
+  *numPages = keyVector.size();
+
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+#ifdef MONITORSTATS
+  if (!shadow)
+    StatsSetLRUBufferSize((unsigned long)this->getSize());
+#endif
+
+  log_debug("%s: new LRU size is %d", __func__, (unsigned long)getSize());
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+/*
+ *** LRUBufferImpl::setPartition() ***
+ *  reserves min_pages of the buffer for ufd and sets its weight in the
+ *  sharing of the rest
+ **********************************************
+ */
+void LRUBufferImpl::setPartition(int ufd, int min_pages, int weight) {
+  partitions.set(ufd, min_pages, weight);
+}
+
+int LRUBufferImpl::listPartitions(c_lru_partition ** list) {
+  lru_list * lists[] = { &cache, &hot };
+  return partitions.list(lists, 2, getMaxSize(), list);
+}
+
+void LRUBufferImpl::setRebalance(int ghost_pages) {
+  partitions.setGhostPages(ghost_pages);
+}
+
+/*
+ *** LRUBufferImpl::rebalance() ***
+ *  moves share from the ufd with the fewest faults on recently evicted
+ *  pages to the one with the most, returns the number of pages moved
+ **********************************************
+ */
+int LRUBufferImpl::rebalance(int *from_ufd, int *to_ufd) {
+  lru_list * lists[] = { &cache, &hot };
+  return partitions.rebalance(lists, 2, getMaxSize(), from_ufd, to_ufd);
+}
+
+/*
+ *** LRUBufferImpl::getMissRatioCurve() ***
+ *  returns the estimated miss ratio of ufd at a range of buffer sizes
+ **********************************************
+ */
+int LRUBufferImpl::getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points) {
+  return partitions.curve(ufd, sampled, points);
+}
+
+int LRUBufferImpl::isCached(uint64_t key, int ufd) {
+  uint64_t hashcode = hash_page_key(key, ufd);
+  return cache.contains(hashcode) || hot.contains(hashcode);
+}
+
+/*
+ *** LRUBufferImpl::protectCachedNode() ***
+ *  moves a cached page to the protected segment, returns 1 if it was
+ *  moved. The least recently used protected pages beyond the bound go
+ *  back to the front of cache
+ **********************************************
+ */
+int LRUBufferImpl::protectCachedNode(uint64_t key, int ufd) {
+  log_trace_in("%s", __func__);
+
+  cache_node node;
+  int ret = 0;
+
+  node.hashcode = hash_page_key(key, ufd);
+  node.ufd = ufd;
+
+  if (getProtectedMaxSize() > 0 && cache.contains(node.hashcode)) {
+    cache.erase(node.hashcode);
+    hot.insert(node);
+    trimProtected();
+    ret = 1;
+  }
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int LRUBufferImpl::getProtectedMaxSize() {
+  return (int)((long)getMaxSize() * hot_pages_pct / 100);
+}
+
+void LRUBufferImpl::trimProtected() {
+  while (hot.getSize() > getProtectedMaxSize()) {
+    cache_node node = hot.back();
+    hot.pop_back();
+    cache.insert(node);
+  }
+}
+
 void LRUBufferImpl::printLRUBuffer(FILE * file) {
   cache.printCache("after", __func__, file);
+  hot.printCache("protected", __func__, file);
 }
 
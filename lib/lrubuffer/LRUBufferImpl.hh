@@ -15,107 +15,15 @@
 #ifndef _LRUBUFFERIMPL_H_
 #define _LRUBUFFERIMPL_H_
 #include <LRUBuffer.hh>
-#include <boost/unordered_map.hpp>    // for hash of RPCData entries
-#include <boost/container/vector.hpp> // for list of RPCRecords
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/mem_fun.hpp>
-#include <iterator>
-
-using namespace boost::multi_index;
+#include "lru_list.hh"
+#include "lru_partitions.hh"
 
 #define LOOKAHEAD_SIZE 4
 int cache_size = 20000;
-
-typedef struct cache_node
-{
-    uint64_t hashcode;
-    int ufd;
-    bool operator==(const cache_node& e)const{return hashcode==e.hashcode;}
-    bool operator<(const cache_node& e)const{return hashcode<e.hashcode;}
-    const uint64_t & _hashcode() const { return hashcode; }
-    struct ByHashcode {};
-} cache_node;
-
-class lru_list
-{
-	typedef multi_index_container<
-		cache_node,
-		indexed_by<
-			sequenced<>,
-			hashed_unique<
-				tag<cache_node::ByHashcode>,
-				 const_mem_fun<
-					cache_node, const uint64_t&, &cache_node::_hashcode
-				>
-			>
-		>
-	> item_list;
-
-public:
-  typedef item_list::iterator iterator;
-  typedef item_list::index<cache_node::ByHashcode>::type List;
-
-  lru_list():max_num_items(cache_size){}
-
-  void insert(const cache_node& item)
-  {
-    std::pair<iterator,bool> p=il.push_front(item);
-
-    if(!p.second){                     /* duplicate item */
-      il.relocate(il.begin(),p.first); /* put in front */
-    }
-  }
-  bool isSizeExceeded()
-  {
-    return il.size()>max_num_items;
-  }
-  void printCache(const char * info, const char * func, FILE * file=NULL)
-  {
-    FILE * out=NULL;
-    if( file!=NULL )
-      out = file;
-    else
-      out = stderr;
-    fprintf(out,"%s: %s %s\n", __func__, info, func);
-    iterator itr = begin();
-    int i=0;
-    for( ; itr!= end(); itr++, i++ )
-    {
-        if (i > 99)
-          continue;
-        fprintf(out, "%d : key=%lx\n", i, itr->hashcode);
-    }
-    itr--;
-    i--;
-    if (i > 99)
-    {
-        fprintf(out, "%d : key=%lx\n", i, itr->hashcode);
-    }
-  }
-  void pop_back() {il.pop_back();}
-  int getSize() {return il.size();}
-  int setSize(int size) {max_num_items=size; return max_num_items;}
-  int getMaxSize() {return max_num_items;}
-
-  List::iterator find( uint64_t key ) {return il.get<cache_node::ByHashcode>().find(key);}
-  iterator begin() {return il.begin();}
-  iterator end() {return il.end();}
-  cache_node back() {return il.back();}
-  List::iterator findEnd() {return il.get<cache_node::ByHashcode>().end();}
-
-  void erase( uint64_t key ) {
-    List::iterator it = find(key);
-    if( it!=findEnd() )
-      il.get<cache_node::ByHashcode>().erase(it);
-  }
-
-private:
-  item_list   il;
-  std::size_t max_num_items;
-};
+int lru_policy = LRU_POLICY_LRU;
+int mrc_sampling = 100;    // 1 in mrc_sampling pages of a ufd is tracked, 0 disables
+int hot_pages_pct = 0;     // percent of the buffer protected for pages that
+                           // fault back soon after eviction, 0 disables
 
 // we use this to replace some detructors.
 struct null_deleter
@@ -132,24 +40,41 @@ private:
     int                 getSize();
     int                 getMaxSize();
     int                 setSize(int size);
+    int                 getProtectedMaxSize();
+    void                trimProtected();
 
     class PageInfo {
 public:
       int ref_count;
     };
 
+    // pages are evicted from cache first. Pages promoted by
+    // protectCachedNode() are kept on hot, which is bounded by
+    // hot_pages_pct of the buffer and only evicted from when cache has
+    // nothing of the victim ufd
     lru_list cache;
+    lru_list hot;
+    lru_partitions partitions;
 
 public:
     virtual ~LRUBufferImpl();
-    LRUBufferImpl();
+    LRUBufferImpl(bool shadow=false);
 
     virtual void                referenceCachedNode(uint64_t key, int ufd);
     virtual struct c_cache_node insertCacheNode(uint64_t key, int ufd, bool evict);
     virtual int                 popNLRU(int num_pop, c_cache_node ** node_list);
     virtual int                 isLRUSizeExceeded(void);
     virtual struct c_cache_node getLRU();
-    virtual uint64_t *          removeUFDFromLRU(int ufd, int *numPages);
+    virtual int                 getLRUCandidates(int num, c_cache_node ** node_list);
+    virtual uint64_t *          removeUFDFromLRU(int ufd, int max_pages, int *numPages);
+    virtual uint64_t *          removeRangeFromLRU(int ufd, uint64_t start, uint64_t end, int *numPages);
+    virtual void                setPartition(int ufd, int min_pages, int weight);
+    virtual int                 listPartitions(c_lru_partition ** list);
+    virtual void                setRebalance(int ghost_pages);
+    virtual int                 rebalance(int *from_ufd, int *to_ufd);
+    virtual int                 getMissRatioCurve(int ufd, uint64_t *sampled, c_mrc_point ** points);
+    virtual int                 isCached(uint64_t key, int ufd);
+    virtual int                 protectCachedNode(uint64_t key, int ufd);
     virtual void                printLRUBuffer(FILE * file=NULL);
 };
 #endif
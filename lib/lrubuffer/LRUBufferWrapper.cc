@@ -21,6 +21,9 @@ extern "C" {
     lrubuf = LRUBuffer::create();
     return lrubuf;
   }
+  LRUBuffer * newShadowLRUBuffer(int policy, int size) {
+    return LRUBuffer::createShadow(policy, size);
+  }
 
   void referenceCachedNode(LRUBuffer *l, uint64_t key, int ufd) {
     l->referenceCachedNode(key, ufd);
@@ -37,6 +40,30 @@ extern "C" {
   c_cache_node getLRU(LRUBuffer *l) {
     return l->getLRU();
   }
+  int getLRUCandidates(LRUBuffer *l, int num, c_cache_node ** node_list) {
+    return l->getLRUCandidates(num, node_list);
+  }
+  void setLRUPartition(LRUBuffer *l, int ufd, int min_pages, int weight) {
+    l->setPartition(ufd, min_pages, weight);
+  }
+  int listLRUPartitions(LRUBuffer *l, c_lru_partition ** list) {
+    return l->listPartitions(list);
+  }
+  void setLRURebalance(LRUBuffer *l, int ghost_pages) {
+    l->setRebalance(ghost_pages);
+  }
+  int rebalanceLRU(LRUBuffer *l, int *from_ufd, int *to_ufd) {
+    return l->rebalance(from_ufd, to_ufd);
+  }
+  int getLRUMissRatioCurve(LRUBuffer *l, int ufd, uint64_t *sampled, c_mrc_point ** points) {
+    return l->getMissRatioCurve(ufd, sampled, points);
+  }
+  int isCachedInLRU(LRUBuffer *l, uint64_t key, int ufd) {
+    return l->isCached(key, ufd);
+  }
+  int protectCachedNode(LRUBuffer *l, uint64_t key, int ufd) {
+    return l->protectCachedNode(key, ufd);
+  }
   int isLRUSizeExceeded(LRUBuffer *l) {
     return l->isLRUSizeExceeded();
   }
@@ -49,8 +76,11 @@ extern "C" {
   int setLRUBufferSize(LRUBuffer *l, int size) {
     return l->setSize(size);
   }
-  uint64_t * removeUFDFromLRU(LRUBuffer *l, int ufd, int * numPages) {
-    return l->removeUFDFromLRU(ufd, numPages);
+  uint64_t * removeUFDFromLRU(LRUBuffer *l, int ufd, int max_pages, int * numPages) {
+    return l->removeUFDFromLRU(ufd, max_pages, numPages);
+  }
+  uint64_t * removeRangeFromLRU(LRUBuffer *l, int ufd, uint64_t start, uint64_t end, int * numPages) {
+    return l->removeRangeFromLRU(ufd, start, end, numPages);
   }
   void printLRUBuffer(LRUBuffer *l, FILE * file) {
     l->printLRUBuffer(file);
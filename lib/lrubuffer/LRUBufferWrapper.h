@@ -18,20 +18,32 @@ extern "C" {
 
 typedef struct LRUBuffer LRUBuffer;
 typedef struct c_cache_node c_cache_node;
+typedef struct c_lru_partition c_lru_partition;
+typedef struct c_mrc_point c_mrc_point;
 
 LRUBuffer* newLRUBuffer();
+LRUBuffer* newShadowLRUBuffer(int policy, int size);
 
 c_cache_node insertCacheNodeAndEvict(LRUBuffer *l, uint64_t key, int ufd);
 void insertCacheNode(LRUBuffer *l, uint64_t key, int ufd);
 void referenceCachedNode(LRUBuffer *l, uint64_t key, int ufd);
 int popNLRU(LRUBuffer *l, int num_pop, c_cache_node ** node_list);
 c_cache_node getLRU(LRUBuffer *l);
+int getLRUCandidates(LRUBuffer *l, int num, c_cache_node ** node_list);
 int isLRUSizeExceeded(LRUBuffer *l);
 int getLRUBufferSize(LRUBuffer *l);
 int getLRUBufferMaxSize(LRUBuffer *l);
 int setLRUBufferSize(LRUBuffer *l, int size);
 void printLRUBuffer(LRUBuffer *l, FILE * file);
-uint64_t * removeUFDFromLRU(LRUBuffer *l, int ufd, int *num_pages);
+uint64_t * removeUFDFromLRU(LRUBuffer *l, int ufd, int max_pages, int *num_pages);
+uint64_t * removeRangeFromLRU(LRUBuffer *l, int ufd, uint64_t start, uint64_t end, int *num_pages);
+void setLRUPartition(LRUBuffer *l, int ufd, int min_pages, int weight);
+int listLRUPartitions(LRUBuffer *l, c_lru_partition ** list);
+void setLRURebalance(LRUBuffer *l, int ghost_pages);
+int rebalanceLRU(LRUBuffer *l, int *from_ufd, int *to_ufd);
+int getLRUMissRatioCurve(LRUBuffer *l, int ufd, uint64_t *sampled, c_mrc_point ** points);
+int isCachedInLRU(LRUBuffer *l, uint64_t key, int ufd);
+int protectCachedNode(LRUBuffer *l, uint64_t key, int ufd);
 
 #ifdef __cplusplus
 }
@@ -1,7 +1,30 @@
 #ifndef C_CACHE_NODE_HH
 #define C_CACHE_NODE_HH
+
+// replacement policies of LRUBuffer::create(), selected by lru_policy
+#define LRU_POLICY_LRU  0
+#define LRU_POLICY_ARC  1
+#define LRU_POLICY_CLOCK 2
+
 struct c_cache_node {
   uint64_t hashcode;
   int ufd;
 };
+
+// a partition of the buffer and its current use, in pages
+struct c_lru_partition {
+  int ufd;
+  int min_pages;
+  int weight;
+  int resident;
+  int share;
+  unsigned long faults;       // recent faults, when rebalancing
+  unsigned long ghost_hits;   // recent faults on pages just evicted
+};
+
+// a point of the miss ratio curve of a ufd
+struct c_mrc_point {
+  int cache_pages;
+  int miss_permille;
+};
 #endif
@@ -0,0 +1,403 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * lru_list.hh
+ *
+ * This defines the list of page keys used by the LRUBuffer implementations
+*/
+
+
+#ifndef _LRU_LIST_H_
+#define _LRU_LIST_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/user.h> /* for PAGE_MASK */
+#include <vector>
+#include <boost/unordered_map.hpp>
+
+extern int cache_size;
+
+typedef struct cache_node
+{
+    uint64_t hashcode;
+    int ufd;
+} cache_node;
+
+/*
+ * lru_list is a flat LRU list of page keys. Nodes live in one array and are
+ * linked by 32-bit indices, and an open addressing table of node indices
+ * finds a key. A key is hash_page_key(), the page address with the ufd
+ * modulo PAGE_SIZE in its low bits. Nodes of a ufd are also linked on a
+ * list of their own, in the same recency order, so that a ufd is removed
+ * or its least recently used page found without walking the pages of
+ * others. The lists of the ufds with nodes are in a small array, found by
+ * ufd through ufd_slots, and each keeps its ufd. A node only keeps the
+ * page number and the slot of its ufd, and the key is made from the two.
+ * A node costs 24 bytes plus 4 to 8 bytes of table.
+ */
+#define LRU_NIL             0xffffffffU
+#define LRU_INITIAL_NODES   1024
+#define LRU_INITIAL_SLOTS   2048
+#define LRU_PAGE_BITS       44  // page numbers of addresses below 2^56
+#define LRU_UFD_SLOT_BITS   20  // ufds with pages at once
+
+class lru_list
+{
+  struct lru_node {
+    uint32_t prev;      // towards the most recently used end
+    uint32_t next;      // towards the least recently used end, or the next free node
+    uint32_t ufd_prev;  // neighbours on the list of the same ufd
+    uint32_t ufd_next;
+    uint64_t page : LRU_PAGE_BITS;
+    uint64_t ufd_slot : LRU_UFD_SLOT_BITS;  // of the list of the ufd
+  };
+
+  struct ufd_list {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+    uint32_t active_pos;  // index of the ufd in active_ufds
+    int      ufd;
+  };
+
+public:
+
+  lru_list():max_num_items(cache_size),head(LRU_NIL),tail(LRU_NIL),
+             free_head(LRU_NIL),num_items(0)
+  {
+    nodes.reserve(LRU_INITIAL_NODES);
+    slots.assign(LRU_INITIAL_SLOTS, LRU_NIL);
+  }
+
+  // add item at the most recently used end, or move it there if present
+  void insert(const cache_node& item)
+  {
+    uint32_t slot = findSlot(item.hashcode);
+    uint32_t idx = slots[slot];
+
+    if( idx!=LRU_NIL ) {               /* duplicate item */
+      if( idx!=head ) {                /* put in front */
+        unlink(idx);
+        linkFront(idx);
+      }
+      if( idx!=ufd_lists[nodes[idx].ufd_slot].head ) {
+        unlinkUFD(idx);
+        linkUFD(idx);
+      }
+      return;
+    }
+
+    idx = allocNode();
+    nodes[idx].page = item.hashcode >> PAGE_SHIFT;
+    nodes[idx].ufd_slot = ufdSlot(item.ufd);
+    linkFront(idx);
+    linkUFD(idx);
+    countUFD(nodes[idx].ufd_slot, 1);
+    slots[slot] = idx;
+    num_items++;
+    if( 2 * num_items > slots.size() )
+      rehash(2 * slots.size());
+  }
+  bool isSizeExceeded()
+  {
+    return num_items>max_num_items;
+  }
+  void printCache(const char * info, const char * func, FILE * file=NULL)
+  {
+    FILE * out=NULL;
+    if( file!=NULL )
+      out = file;
+    else
+      out = stderr;
+    fprintf(out,"%s: %s %s\n", __func__, info, func);
+    int i=0;
+    for( uint32_t idx=head; idx!=LRU_NIL; idx=nodes[idx].next, i++ )
+    {
+        if (i > 99 && idx!=tail)
+          continue;
+        fprintf(out, "%d : key=%lx\n", i, nodeKey(idx));
+    }
+  }
+  void pop_back()
+  {
+    if( tail!=LRU_NIL )
+      remove(tail);
+  }
+  int getSize() {return num_items;}
+  int setSize(int size) {max_num_items=size; return max_num_items;}
+  int getMaxSize() {return max_num_items;}
+
+  bool contains( uint64_t key ) {return slots[findSlot(key)]!=LRU_NIL;}
+  cache_node back()
+  {
+    cache_node node = { 0, 0 };
+    if( tail!=LRU_NIL ) {
+      node.hashcode = nodeKey(tail);
+      node.ufd = nodeUFD(tail);
+    }
+    return node;
+  }
+
+  // resident pages of ufd, and the ufds with any
+  int ufdSize( int ufd )
+  {
+    ufd_list * list = findUFD(ufd);
+    return list ? list->count : 0;
+  }
+  const std::vector<int> & activeUFDs() {return active_ufds;}
+
+  // the least recently used page of ufd
+  cache_node ufdBack( int ufd )
+  {
+    cache_node node = { 0, 0 };
+    ufd_list * list = findUFD(ufd);
+    if( list ) {
+      node.hashcode = nodeKey(list->tail);
+      node.ufd = ufd;
+    }
+    return node;
+  }
+
+  void erase( uint64_t key ) {
+    uint32_t idx = slots[findSlot(key)];
+    if( idx!=LRU_NIL )
+      remove(idx);
+  }
+
+  // up to num nodes, starting from the least recently used
+  void tailNodes( int num, std::vector<cache_node> & tail_nodes ) {
+    for( uint32_t idx=tail; idx!=LRU_NIL && num>0; idx=nodes[idx].prev, num-- ) {
+      cache_node node = { nodeKey(idx), nodeUFD(idx) };
+      tail_nodes.push_back(node);
+    }
+  }
+
+  // remove up to max_pages pages of ufd (all if max_pages is 0),
+  // appending the page addresses to keys
+  void eraseUFD( int ufd, int max_pages, std::vector<uint64_t> & keys ) {
+    ufd_list * list = findUFD(ufd);
+    uint32_t idx = list ? list->head : LRU_NIL;
+    int num = 0;
+    while( idx!=LRU_NIL && (max_pages==0 || num<max_pages) ) {
+      uint32_t next = nodes[idx].ufd_next;
+      keys.push_back((uint64_t)nodes[idx].page << PAGE_SHIFT);
+      remove(idx);
+      idx = next;
+      num++;
+    }
+  }
+
+  // remove the pages of ufd with an address in [start, end), appending
+  // the page addresses to keys
+  void eraseUFDRange( int ufd, uint64_t start, uint64_t end, std::vector<uint64_t> & keys ) {
+    ufd_list * list = findUFD(ufd);
+    uint32_t idx = list ? list->head : LRU_NIL;
+    while( idx!=LRU_NIL ) {
+      uint32_t next = nodes[idx].ufd_next;
+      uint64_t addr = (uint64_t)nodes[idx].page << PAGE_SHIFT;
+      if( addr>=start && addr<end ) {
+        keys.push_back(addr);
+        remove(idx);
+      }
+      idx = next;
+    }
+  }
+
+private:
+  std::vector<lru_node> nodes;  // node slab, unused nodes are on free_head
+  std::vector<uint32_t> slots;  // open addressing table of node indices
+  std::vector<ufd_list> ufd_lists;       // by slot, unused ones are on free_ufd_slots
+  std::vector<uint32_t> free_ufd_slots;
+  boost::unordered_map<int, uint32_t> ufd_slots;  // slot of each ufd with nodes
+  std::vector<int>      active_ufds;     // ufds with nodes
+  std::size_t max_num_items;
+  uint32_t    head;             // most recently used
+  uint32_t    tail;             // least recently used
+  uint32_t    free_head;
+  uint32_t    num_items;
+
+  int nodeUFD( uint32_t idx ) const
+  {
+    return ufd_lists[nodes[idx].ufd_slot].ufd;
+  }
+
+  // hash_page_key() of the page of a node
+  uint64_t nodeKey( uint32_t idx ) const
+  {
+    return ((uint64_t)nodes[idx].page << PAGE_SHIFT) + nodeUFD(idx) % PAGE_SIZE;
+  }
+
+  ufd_list * findUFD( int ufd )
+  {
+    boost::unordered_map<int, uint32_t>::iterator it = ufd_slots.find(ufd);
+    return it!=ufd_slots.end() ? &ufd_lists[it->second] : NULL;
+  }
+
+  // slot of the list of ufd, taking a free one for a ufd without nodes
+  uint32_t ufdSlot( int ufd )
+  {
+    boost::unordered_map<int, uint32_t>::iterator it = ufd_slots.find(ufd);
+    if( it!=ufd_slots.end() )
+      return it->second;
+
+    uint32_t slot;
+    if( !free_ufd_slots.empty() ) {
+      slot = free_ufd_slots.back();
+      free_ufd_slots.pop_back();
+    }
+    else {
+      slot = ufd_lists.size();
+      ufd_lists.push_back(ufd_list());
+    }
+    ufd_list empty = { LRU_NIL, LRU_NIL, 0, 0, ufd };
+    ufd_lists[slot] = empty;
+    ufd_slots[ufd] = slot;
+    return slot;
+  }
+
+  // fibonacci hashing spreads the page aligned keys over the table
+  uint32_t hashSlot( uint64_t key ) const
+  {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (slots.size() - 1);
+  }
+
+  // slot holding key, or the empty slot where it would be added
+  uint32_t findSlot( uint64_t key ) const
+  {
+    uint32_t mask = slots.size() - 1;
+    uint32_t slot = hashSlot(key);
+    while( slots[slot]!=LRU_NIL && nodeKey(slots[slot])!=key )
+      slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  void rehash( std::size_t num_slots )
+  {
+    slots.assign(num_slots, LRU_NIL);
+    uint32_t mask = num_slots - 1;
+    for( uint32_t idx=head; idx!=LRU_NIL; idx=nodes[idx].next ) {
+      uint32_t slot = hashSlot(nodeKey(idx));
+      while( slots[slot]!=LRU_NIL )
+        slot = (slot + 1) & mask;
+      slots[slot] = idx;
+    }
+  }
+
+  // linear probing deletion without tombstones: shift later entries of
+  // the probe sequence back into the hole
+  void removeSlot( uint32_t hole )
+  {
+    uint32_t mask = slots.size() - 1;
+    uint32_t slot = hole;
+    slots[hole] = LRU_NIL;
+    for(;;) {
+      slot = (slot + 1) & mask;
+      if( slots[slot]==LRU_NIL )
+        break;
+      uint32_t home = hashSlot(nodeKey(slots[slot]));
+      if( ((slot - home) & mask) >= ((slot - hole) & mask) ) {
+        slots[hole] = slots[slot];
+        slots[slot] = LRU_NIL;
+        hole = slot;
+      }
+    }
+  }
+
+  uint32_t allocNode()
+  {
+    uint32_t idx;
+    if( free_head!=LRU_NIL ) {
+      idx = free_head;
+      free_head = nodes[idx].next;
+    }
+    else {
+      idx = nodes.size();
+      nodes.push_back(lru_node());
+    }
+    return idx;
+  }
+
+  void linkFront( uint32_t idx )
+  {
+    nodes[idx].prev = LRU_NIL;
+    nodes[idx].next = head;
+    if( head!=LRU_NIL )
+      nodes[head].prev = idx;
+    head = idx;
+    if( tail==LRU_NIL )
+      tail = idx;
+  }
+
+  void unlink( uint32_t idx )
+  {
+    if( nodes[idx].prev!=LRU_NIL )
+      nodes[nodes[idx].prev].next = nodes[idx].next;
+    else
+      head = nodes[idx].next;
+    if( nodes[idx].next!=LRU_NIL )
+      nodes[nodes[idx].next].prev = nodes[idx].prev;
+    else
+      tail = nodes[idx].prev;
+  }
+
+  void linkUFD( uint32_t idx )
+  {
+    ufd_list & list = ufd_lists[nodes[idx].ufd_slot];
+    nodes[idx].ufd_prev = LRU_NIL;
+    nodes[idx].ufd_next = list.head;
+    if( list.head!=LRU_NIL )
+      nodes[list.head].ufd_prev = idx;
+    else
+      list.tail = idx;
+    list.head = idx;
+  }
+
+  void unlinkUFD( uint32_t idx )
+  {
+    ufd_list & list = ufd_lists[nodes[idx].ufd_slot];
+    if( nodes[idx].ufd_prev!=LRU_NIL )
+      nodes[nodes[idx].ufd_prev].ufd_next = nodes[idx].ufd_next;
+    else
+      list.head = nodes[idx].ufd_next;
+    if( nodes[idx].ufd_next!=LRU_NIL )
+      nodes[nodes[idx].ufd_next].ufd_prev = nodes[idx].ufd_prev;
+    else
+      list.tail = nodes[idx].ufd_prev;
+  }
+
+  // a ufd leaves active_ufds and gives its slot back with its last node
+  void countUFD( uint32_t slot, int delta )
+  {
+    ufd_list & list = ufd_lists[slot];
+    int ufd = list.ufd;
+    if( list.count==0 ) {
+      list.active_pos = active_ufds.size();
+      active_ufds.push_back(ufd);
+    }
+    list.count += delta;
+    if( list.count==0 ) {
+      int last = active_ufds.back();
+      active_ufds[list.active_pos] = last;
+      ufd_lists[ufd_slots[last]].active_pos = list.active_pos;
+      active_ufds.pop_back();
+      ufd_slots.erase(ufd);
+      free_ufd_slots.push_back(slot);
+    }
+  }
+
+  void remove( uint32_t idx )
+  {
+    removeSlot(findSlot(nodeKey(idx)));
+    unlink(idx);
+    unlinkUFD(idx);
+    countUFD(nodes[idx].ufd_slot, -1);
+    nodes[idx].next = free_head;
+    free_head = idx;
+    num_items--;
+  }
+};
+#endif
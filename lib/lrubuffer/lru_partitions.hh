@@ -0,0 +1,293 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * lru_partitions.hh
+ *
+ * This defines the per-ufd partitions of the LRUBuffer implementations
+*/
+
+
+#ifndef _LRU_PARTITIONS_H_
+#define _LRU_PARTITIONS_H_
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
+#include "lru_list.hh"
+#include "c_cache_node.h"
+#include "shards_mrc.hh"
+
+/*
+ * Each ufd with resident pages is entitled to a share of the buffer: its
+ * reserved minimum plus a part of what is left after all minimums, in
+ * proportion to its weight. A ufd without a configured partition has no
+ * minimum and weight 1. When the page a policy would evict belongs to a
+ * ufd within its share, the least recently used page of the ufd furthest
+ * over its share is evicted instead. Until a partition is configured or
+ * rebalancing is enabled the policy's choice is never overridden.
+ *
+ * With rebalancing, the last ghost_pages pages evicted from each ufd are
+ * remembered. A fault on one of them would have been a hit had the ufd
+ * held ghost_pages more pages, so rebalance() moves that many pages of
+ * share, as weight, from the ufd with the fewest such ghost hits to the
+ * one with the most.
+ *
+ * The miss ratio curve of each ufd is also estimated from its faults here,
+ * see shards_mrc.hh.
+ */
+#define PARTITION_UNITS_PER_WEIGHT 1000
+
+typedef struct lru_partition
+{
+    int min_pages;
+    int weight;
+    bool configured;          // set by set(), not only tracked
+    long units;               // weight as moved by rebalance()
+    unsigned long faults;     // since the last rebalance()
+    unsigned long ghost_hits;
+    shards_mrc * mrc;
+} lru_partition;
+
+class lru_partitions
+{
+public:
+
+  lru_partitions():num_configured(0),ghost_pages(0),tracking(true) {}
+  ~lru_partitions()
+  {
+    for( boost::unordered_map<int, lru_partition>::iterator it=parts.begin(); it!=parts.end(); ++it )
+      delete it->second.mrc;
+  }
+
+  void set( int ufd, int min_pages, int weight )
+  {
+    lru_partition & part = get(ufd);
+    if( !part.configured )
+      num_configured++;
+    part.configured = true;
+    part.min_pages = min_pages;
+    part.weight = weight;
+    part.units = (long)weight * PARTITION_UNITS_PER_WEIGHT;
+  }
+  void remove( int ufd )
+  {
+    std::vector<uint64_t> keys;
+    boost::unordered_map<int, lru_partition>::iterator it = parts.find(ufd);
+    if( it!=parts.end() ) {
+      if( it->second.configured )
+        num_configured--;
+      delete it->second.mrc;
+      parts.erase(it);
+    }
+    ghosts.eraseUFD(ufd, 0, keys);
+  }
+  bool empty() {return num_configured==0 && ghost_pages==0;}
+
+  // no fault accounting, for shadow buffers
+  void disableTracking() {tracking = false;}
+
+  // remember the last ghost_pages evictions of each ufd, 0 stops it
+  void setGhostPages( int pages )
+  {
+    std::vector<uint64_t> keys;
+    ghost_pages = pages;
+    if( ghost_pages==0 )
+      for( std::vector<int>::size_type i=ghosts.activeUFDs().size(); i>0; i-- )
+        ghosts.eraseUFD(ghosts.activeUFDs()[i-1], 0, keys);
+  }
+
+  // a page of ufd was faulted in
+  void inserted( uint64_t key, int ufd )
+  {
+    if( !tracking || (ghost_pages==0 && mrc_sampling==0) )
+      return;
+    lru_partition & part = get(ufd);
+    if( mrc_sampling ) {
+      if( part.mrc==NULL )
+        part.mrc = new shards_mrc();
+      part.mrc->access(key);
+    }
+    if( ghost_pages==0 )
+      return;
+    part.faults++;
+    if( ghosts.contains(key) ) {
+      part.ghost_hits++;
+      ghosts.erase(key);
+    }
+  }
+
+  void evicted( const cache_node & node )
+  {
+    if( ghost_pages==0 )
+      return;
+    ghosts.insert(node);
+    if( ghosts.ufdSize(node.ufd) > ghost_pages )
+      ghosts.erase(ghosts.ufdBack(node.ufd).hashcode);
+  }
+
+  // the ufd to evict from, given the ufd of the policy's victim and the
+  // lists holding resident pages
+  int victimUFD( int lru_ufd, lru_list ** lists, int num_lists, int capacity )
+  {
+    if( empty() )
+      return lru_ufd;
+
+    std::vector<c_lru_partition> shares;
+    computeShares(lists, num_lists, capacity, shares);
+
+    int victim = lru_ufd;
+    int most_over = 0;
+    for( std::vector<c_lru_partition>::size_type i=0; i<shares.size(); i++ ) {
+      int over = shares[i].resident - shares[i].share;
+      if( shares[i].ufd==lru_ufd && over>0 )
+        return lru_ufd;
+      if( over>most_over ) {
+        most_over = over;
+        victim = shares[i].ufd;
+      }
+    }
+    return victim;
+  }
+
+  // moves ghost_pages of share from the ufd that would lose the fewest
+  // hits to the one that would gain the most, returns the pages moved
+  int rebalance( lru_list ** lists, int num_lists, int capacity, int * from, int * to )
+  {
+    std::vector<c_lru_partition> shares;
+    lru_partition * gainer = NULL, * donor = NULL;
+    long total_units = 0, reserved = 0;
+    int moved = 0;
+
+    if( ghost_pages==0 )
+      return 0;
+    computeShares(lists, num_lists, capacity, shares);
+
+    for( std::vector<c_lru_partition>::size_type i=0; i<shares.size(); i++ ) {
+      lru_partition & part = get(shares[i].ufd);
+      total_units += part.units;
+      reserved += part.min_pages;
+      if( part.ghost_hits>0 && (gainer==NULL || part.ghost_hits>gainer->ghost_hits) ) {
+        gainer = &part;
+        *to = shares[i].ufd;
+      }
+    }
+    long remainder = capacity>reserved ? capacity - reserved : 0;
+
+    for( std::vector<c_lru_partition>::size_type i=0; gainer && i<shares.size(); i++ ) {
+      lru_partition & part = get(shares[i].ufd);
+      if( &part==gainer || shares[i].share - shares[i].min_pages <= ghost_pages )
+        continue;
+      if( donor==NULL || part.ghost_hits<donor->ghost_hits ) {
+        donor = &part;
+        *from = shares[i].ufd;
+      }
+    }
+
+    if( donor && remainder>0 && donor->ghost_hits<gainer->ghost_hits ) {
+      long units = std::max((long)ghost_pages * total_units / remainder, 1L);
+      units = std::min(units, donor->units);
+      donor->units -= units;
+      gainer->units += units;
+      moved = units * remainder / total_units;
+    }
+
+    // older intervals count half as much
+    for( boost::unordered_map<int, lru_partition>::iterator it=parts.begin(); it!=parts.end(); ++it ) {
+      it->second.faults /= 2;
+      it->second.ghost_hits /= 2;
+    }
+    return moved;
+  }
+
+  // the estimated miss ratio curve of ufd, returns the number of points
+  int curve( int ufd, uint64_t * sampled, c_mrc_point ** points )
+  {
+    boost::unordered_map<int, lru_partition>::iterator it = parts.find(ufd);
+    *points = NULL;
+    *sampled = 0;
+    if( it==parts.end() || it->second.mrc==NULL )
+      return 0;
+    *sampled = it->second.mrc->sampled();
+    return it->second.mrc->curve(points);
+  }
+
+  // the configured and the active ufds, returns the number in list
+  int list( lru_list ** lists, int num_lists, int capacity, c_lru_partition ** list )
+  {
+    std::vector<c_lru_partition> shares;
+    computeShares(lists, num_lists, capacity, shares);
+
+    for( boost::unordered_map<int, lru_partition>::iterator it=parts.begin(); it!=parts.end(); ++it ) {
+      if( it->second.configured && findShare(shares, it->first)==NULL ) {
+        c_lru_partition idle = { it->first, it->second.min_pages, it->second.weight, 0, 0,
+                                 it->second.faults, it->second.ghost_hits };
+        shares.push_back(idle);
+      }
+    }
+
+    *list = (c_lru_partition *) malloc(sizeof(c_lru_partition) * (shares.size() + 1));
+    std::copy(shares.begin(), shares.end(), *list);
+    return shares.size();
+  }
+
+private:
+  boost::unordered_map<int, lru_partition> parts;
+  int      num_configured;
+  int      ghost_pages;
+  bool     tracking;
+  lru_list ghosts;              // recently evicted pages, per ufd
+
+  lru_partition & get( int ufd )
+  {
+    boost::unordered_map<int, lru_partition>::iterator it = parts.find(ufd);
+    if( it==parts.end() ) {
+      lru_partition part = { 0, 1, false, PARTITION_UNITS_PER_WEIGHT, 0, 0, NULL };
+      it = parts.insert(std::make_pair(ufd, part)).first;
+    }
+    return it->second;
+  }
+
+  static c_lru_partition * findShare( std::vector<c_lru_partition> & shares, int ufd )
+  {
+    for( std::vector<c_lru_partition>::size_type i=0; i<shares.size(); i++ )
+      if( shares[i].ufd==ufd )
+        return &shares[i];
+    return NULL;
+  }
+
+  // one entry per ufd with resident pages, there are a few per host
+  void computeShares( lru_list ** lists, int num_lists, int capacity,
+                      std::vector<c_lru_partition> & shares )
+  {
+    long reserved = 0, units = 0;
+    std::vector<long> ufd_units;
+
+    for( int l=0; l<num_lists; l++ ) {
+      const std::vector<int> & ufds = lists[l]->activeUFDs();
+      for( std::vector<int>::size_type i=0; i<ufds.size(); i++ ) {
+        c_lru_partition * share = findShare(shares, ufds[i]);
+        if( share==NULL ) {
+          lru_partition & part = get(ufds[i]);
+          c_lru_partition entry = { ufds[i], part.min_pages, part.weight, 0, 0,
+                                    part.faults, part.ghost_hits };
+          shares.push_back(entry);
+          ufd_units.push_back(part.units);
+          share = &shares.back();
+          reserved += part.min_pages;
+          units += part.units;
+        }
+        share->resident += lists[l]->ufdSize(ufds[i]);
+      }
+    }
+
+    long remainder = capacity>reserved ? capacity - reserved : 0;
+    for( std::vector<c_lru_partition>::size_type i=0; i<shares.size(); i++ )
+      shares[i].share = shares[i].min_pages +
+                        (units ? remainder * ufd_units[i] / units : 0);
+  }
+};
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * shards_mrc.hh
+ *
+ * This defines the miss ratio curve estimated from the faults of a ufd
+*/
+
+
+#ifndef _SHARDS_MRC_H_
+#define _SHARDS_MRC_H_
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <boost/unordered_map.hpp>
+#include "c_cache_node.h"
+
+extern int cache_size;
+extern int mrc_sampling;
+
+/*
+ * shards_mrc follows the approach of SHARDS: only the pages whose hashed
+ * key falls below a threshold are tracked, and the reuse distance of a
+ * tracked page, the number of distinct tracked pages faulted since its
+ * last fault, is scaled up by the sampling rate. A Fenwick tree over the
+ * fault times of the tracked pages gives the distance in O(log n). When
+ * more than SHARDS_MAX_KEYS pages are tracked the threshold is lowered
+ * and the pages above it are dropped, so memory and CPU per ufd stay
+ * bounded. A hot page that happens to be tracked skews the curve towards
+ * hits, so as in SHARDS-adj the difference between the expected and the
+ * actual number of tracked faults is taken from the shortest distances.
+ *
+ * Hits on resident pages are not seen and the buffer orders pages by
+ * fault, so a page faulting again after d other distinct pages would have
+ * been a hit with more than d pages of buffer. Below the current share of
+ * the ufd the short distances were hits and are missing, so there the
+ * curve overstates the misses.
+ */
+#define SHARDS_MODULUS      (1 << 24)
+#define SHARDS_MAX_KEYS     4096
+#define SHARDS_TIMES        (4 * SHARDS_MAX_KEYS)
+#define SHARDS_BINS         32
+#define SHARDS_SPAN         4    // the curve covers up to SHARDS_SPAN * cache_size
+
+class shards_mrc
+{
+public:
+
+  shards_mrc():now(0),cold(0),total(0),expected(0)
+  {
+    threshold = SHARDS_MODULUS / std::max(mrc_sampling, 1);
+    bin_pages = std::max(SHARDS_SPAN * cache_size / SHARDS_BINS, 1);
+    memset(hist, 0, sizeof(hist));
+    tree.assign(SHARDS_TIMES + 1, 0);
+  }
+
+  void access( uint64_t key )
+  {
+    uint32_t hash = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 40);
+    expected += (double)threshold / SHARDS_MODULUS;
+    if( hash>=threshold )
+      return;
+
+    total++;
+    boost::unordered_map<uint64_t, uint32_t>::iterator it = last.find(key);
+    if( it!=last.end() ) {
+      // distinct pages faulted since, scaled to all pages
+      uint64_t distance = sum(now) - sum(it->second + 1);
+      distance = distance * SHARDS_MODULUS / threshold;
+      int bin = std::min((uint64_t)(distance / bin_pages), (uint64_t)SHARDS_BINS);
+      hist[bin]++;
+      add(it->second, -1);
+    }
+    else
+      cold++;
+
+    if( now==SHARDS_TIMES )
+      renumber();
+    add(now, 1);
+    last[key] = now++;
+
+    if( last.size() > SHARDS_MAX_KEYS )
+      lowerThreshold();
+  }
+
+  // miss ratio, in per mille of faults, with each multiple of bin_pages
+  int curve( c_mrc_point ** points )
+  {
+    // the adjustment moves expected - total into hist[0], which leaves the
+    // misses as they are and the faults as expected
+    int64_t adjusted = (int64_t)expected;
+    int64_t misses = total;
+    *points = (c_mrc_point *) malloc(sizeof(c_mrc_point) * SHARDS_BINS);
+    for( int i=0; i<SHARDS_BINS; i++ ) {
+      misses -= hist[i];
+      (*points)[i].cache_pages = (i + 1) * bin_pages;
+      (*points)[i].miss_permille = adjusted>0 ? std::max(std::min(misses * 1000 / adjusted, (int64_t)1000), (int64_t)0) : 1000;
+    }
+    return SHARDS_BINS;
+  }
+
+  uint64_t sampled() {return total;}
+
+private:
+  boost::unordered_map<uint64_t, uint32_t> last;  // fault time of each tracked page
+  std::vector<int> tree;        // Fenwick tree of the times in last
+  uint32_t threshold;
+  uint32_t now;
+  int      bin_pages;
+  uint64_t hist[SHARDS_BINS + 1];  // the last bin holds longer distances
+  uint64_t cold;
+  uint64_t total;
+  double   expected;     // tracked faults expected at the sampling rate
+
+  void add( uint32_t time, int delta )
+  {
+    for( uint32_t i=time + 1; i<=SHARDS_TIMES; i += i & -i )
+      tree[i] += delta;
+  }
+
+  // tracked pages last faulted before time
+  uint64_t sum( uint32_t time )
+  {
+    uint64_t s = 0;
+    for( uint32_t i=time; i>0; i -= i & -i )
+      s += tree[i];
+    return s;
+  }
+
+  // compact the fault times once they reach the end of the tree
+  void renumber()
+  {
+    std::vector<std::pair<uint32_t, uint64_t> > order;
+    for( boost::unordered_map<uint64_t, uint32_t>::iterator it=last.begin(); it!=last.end(); ++it )
+      order.push_back(std::make_pair(it->second, it->first));
+    std::sort(order.begin(), order.end());
+
+    tree.assign(SHARDS_TIMES + 1, 0);
+    for( now=0; now<order.size(); now++ ) {
+      last[order[now].second] = now;
+      add(now, 1);
+    }
+  }
+
+  void lowerThreshold()
+  {
+    threshold = threshold * 3 / 4;
+    for( boost::unordered_map<uint64_t, uint32_t>::iterator it=last.begin(); it!=last.end(); ) {
+      if( (uint32_t)((it->first * 0x9E3779B97F4A7C15ULL) >> 40) >= threshold ) {
+        add(it->second, -1);
+        it = last.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+};
+#endif
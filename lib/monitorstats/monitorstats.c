@@ -50,6 +50,7 @@ void MonitorStatsInit()
 
         StatsInitLocks();
         StatsClear();
+        _pstats->resize_pending = 0;
 
         log_trace_out("%s", __func__);
 }
@@ -66,6 +67,25 @@ void StatsClear()
 	_pstats->last_page_fault = (struct timeval){ 0 };
         _pstats->writes_skipped_zero = 0;
         _pstats->writes_skipped_invalid = 0;
+        _pstats->prefetched_pages_count = 0;
+        _pstats->prefetch_hits_count = 0;
+        _pstats->prefetch_unused_count = 0;
+        _pstats->prefetch_cancelled_count = 0;
+        _pstats->resize_evicted = 0;
+        _pstats->flushed_pages = 0;
+        _pstats->restored_pages = 0;
+        _pstats->precopied_pages = 0;
+        _pstats->clean_evictions = 0;
+        _pstats->idle_swapped_out = 0;
+        _pstats->hot_promoted = 0;
+        _pstats->zero_parked = 0;
+        _pstats->victim_hits = 0;
+        _pstats->discarded_pages = 0;
+        _pstats->compressed_pages = 0;
+        _pstats->compressed_bytes = 0;
+        _pstats->incompressible_pages = 0;
+        _pstats->compression_nsecs = 0;
+        _pstats->decompression_nsecs = 0;
         _StatsSetLastTime();
 
 #ifdef TIMING
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/user.h>
 
 /*
  *
@@ -40,7 +41,30 @@ typedef enum _StatisticToRetreive
     NUM_UFDS,
     WRITES_AVOIDED,
     WRITES_SKIPPED_ZERO,
-    WRITES_SKIPPED_INVALID
+    WRITES_SKIPPED_INVALID,
+    PREFETCHED_PAGES,
+    PREFETCH_HITS,
+    PREFETCH_UNUSED,
+    PREFETCH_ACCURACY,
+    PREFETCH_WINDOW,
+    PREFETCH_CANCELLED,
+    RESIZE_PENDING,
+    RESIZE_EVICTED,
+    FLUSHED_PAGES,
+    RESTORED_PAGES,
+    PRECOPIED_PAGES,
+    CLEAN_EVICTIONS,
+    IDLE_SWAPPED_OUT,
+    HOT_PROMOTED,
+    ZERO_PARKED,
+    VICTIM_HITS,
+    DISCARDED_PAGES,
+    COMPRESSED_PAGES,
+    INCOMPRESSIBLE_PAGES,
+    COMPRESSION_SAVED_BYTES,
+    COMPRESSION_PERCENTAGE,
+    COMPRESSION_USECS,
+    DECOMPRESSION_USECS
 } StatisticToRetreive;
 
 
@@ -55,8 +79,32 @@ typedef struct _MonitorStats
     unsigned long writes_skipped_invalid;
     unsigned long page_cache_hits_count;
     unsigned long page_cache_miss_count;
-    char pad_0[40];
-    /* inserted to place the other items on a separate cache line */
+    unsigned long prefetched_pages_count;
+    unsigned long prefetch_hits_count;
+    unsigned long prefetch_unused_count;
+    unsigned long prefetch_window;
+    unsigned long prefetch_cancelled_count;
+    unsigned long resize_pending;
+    unsigned long resize_evicted;
+    unsigned long flushed_pages;
+    unsigned long restored_pages;
+    unsigned long precopied_pages;
+    unsigned long clean_evictions;
+    unsigned long idle_swapped_out;
+    unsigned long hot_promoted;
+    unsigned long zero_parked;
+    unsigned long victim_hits;
+    unsigned long discarded_pages;
+
+    // updated by the threads writing to externRAM, atomically
+    unsigned long compressed_pages;
+    unsigned long compressed_bytes;
+    unsigned long incompressible_pages;
+    unsigned long compression_nsecs;
+    unsigned long decompression_nsecs;
+    char pad_0[24];
+    /* the counters above fill four cache lines, so the other items are
+       on a separate one. Resize the pad when adding a counter */
 
     // updated by main_thread, ui_processing threaad, and reaperthread
     unsigned long LRU_Buffer_size;
@@ -124,6 +172,124 @@ static inline void StatsIncrWriteSkippedInvalid_notlocked()
         _pstats->writes_skipped_invalid++;
 }
 
+static inline void StatsIncrPrefetchedPages_notlocked()
+{
+        // increment pages stored in the page cache by prefetch
+        _pstats->prefetched_pages_count++;
+}
+
+static inline void StatsIncrPrefetchHit_notlocked()
+{
+        // increment prefetched pages used by the application
+        _pstats->prefetch_hits_count++;
+}
+
+static inline void StatsIncrPrefetchUnused_notlocked()
+{
+        // increment prefetched pages dropped without being used
+        _pstats->prefetch_unused_count++;
+}
+
+static inline void StatsIncrPrefetchCancelled_notlocked()
+{
+        // increment queued prefetches dropped before being read
+        _pstats->prefetch_cancelled_count++;
+}
+
+static inline void StatsSetPrefetchWindow(unsigned long window)
+{
+        _pstats->prefetch_window = window;
+}
+
+static inline void StatsSetResizePending(unsigned long pending)
+{
+        // pages above the LRU buffer capacity still to be evicted after a shrink
+        _pstats->resize_pending = pending;
+}
+
+static inline void StatsAddResizeEvicted_notlocked(unsigned long evicted)
+{
+        // pages evicted to bring the LRU buffer down to a shrunk capacity
+        _pstats->resize_evicted += evicted;
+}
+
+static inline void StatsAddFlushedPages_notlocked(unsigned long flushed)
+{
+        // pages written to externRAM by a flush of a ufd's resident pages
+        _pstats->flushed_pages += flushed;
+}
+
+static inline void StatsAddRestoredPages_notlocked(unsigned long restored)
+{
+        // pages read back from externRAM by a restore ahead of their faults
+        _pstats->restored_pages += restored;
+}
+
+static inline void StatsAddPrecopiedPages_notlocked(unsigned long precopied)
+{
+        // cold resident pages written to externRAM ahead of their eviction
+        _pstats->precopied_pages += precopied;
+}
+
+static inline void StatsIncrCleanEviction_notlocked()
+{
+        // evictions that needed no write, the page was unchanged since its precopy
+        _pstats->clean_evictions++;
+}
+
+static inline void StatsAddIdleSwappedOut_notlocked(unsigned long swapped)
+{
+        // pages written to externRAM from ufds that stopped faulting
+        _pstats->idle_swapped_out += swapped;
+}
+
+static inline void StatsIncrHotPromoted_notlocked()
+{
+        // pages moved to the protected segment of the LRU buffer
+        _pstats->hot_promoted++;
+}
+
+static inline void StatsIncrZeroParked_notlocked()
+{
+        // zero pages taken off the LRU buffer without a write
+        _pstats->zero_parked++;
+}
+
+static inline void StatsIncrVictimHit_notlocked()
+{
+        // faults served from the clean copies of the victim cache
+        _pstats->victim_hits++;
+}
+
+static inline void StatsAddDiscardedPages_notlocked(unsigned long discarded)
+{
+        // pages the VM gave back, dropped from the LRU buffer or externRAM
+        _pstats->discarded_pages += discarded;
+}
+
+static inline void StatsAddCompressedPages_notlocked(unsigned long pages, unsigned long bytes)
+{
+        // pages stored compressed, and the bytes they took
+        __sync_fetch_and_add(&_pstats->compressed_pages, pages);
+        __sync_fetch_and_add(&_pstats->compressed_bytes, bytes);
+}
+
+static inline void StatsAddIncompressiblePages_notlocked(unsigned long pages)
+{
+        // pages stored raw because they did not compress well enough
+        __sync_fetch_and_add(&_pstats->incompressible_pages, pages);
+}
+
+static inline void StatsAddCompressionTime_notlocked(unsigned long nsecs)
+{
+        __sync_fetch_and_add(&_pstats->compression_nsecs, nsecs);
+}
+
+static inline void StatsAddDecompressionTime_notlocked(unsigned long nsecs)
+{
+        __sync_fetch_and_add(&_pstats->decompression_nsecs, nsecs);
+}
+
 static inline void StatsIncrLRUBufferSize()
 {
         pthread_mutex_lock(&_pstats->LRU_Buffer_size_lock);
@@ -217,6 +383,101 @@ static inline unsigned long StatsGetWriteSkippedInvalid_notlocked()
         return _pstats->writes_skipped_invalid;
 }
 
+static inline unsigned long StatsGetPrefetchedPages_notlocked()
+{
+        return _pstats->prefetched_pages_count;
+}
+
+static inline unsigned long StatsGetPrefetchHit_notlocked()
+{
+        return _pstats->prefetch_hits_count;
+}
+
+static inline unsigned long StatsGetPrefetchUnused_notlocked()
+{
+        return _pstats->prefetch_unused_count;
+}
+
+static inline unsigned long StatsGetPrefetchCancelled_notlocked()
+{
+        return _pstats->prefetch_cancelled_count;
+}
+
+static inline unsigned long StatsGetResizeEvicted_notlocked()
+{
+        return _pstats->resize_evicted;
+}
+
+static inline unsigned long StatsGetFlushedPages_notlocked()
+{
+        return _pstats->flushed_pages;
+}
+
+static inline unsigned long StatsGetRestoredPages_notlocked()
+{
+        return _pstats->restored_pages;
+}
+
+static inline unsigned long StatsGetPrecopiedPages_notlocked()
+{
+        return _pstats->precopied_pages;
+}
+
+static inline unsigned long StatsGetCleanEvictions_notlocked()
+{
+        return _pstats->clean_evictions;
+}
+
+static inline unsigned long StatsGetIdleSwappedOut_notlocked()
+{
+        return _pstats->idle_swapped_out;
+}
+
+static inline unsigned long StatsGetHotPromoted_notlocked()
+{
+        return _pstats->hot_promoted;
+}
+
+static inline unsigned long StatsGetZeroParked_notlocked()
+{
+        return _pstats->zero_parked;
+}
+
+static inline unsigned long StatsGetVictimHits_notlocked()
+{
+        return _pstats->victim_hits;
+}
+
+static inline unsigned long StatsGetDiscardedPages_notlocked()
+{
+        return _pstats->discarded_pages;
+}
+
+static inline unsigned long StatsGetCompressedPages_notlocked()
+{
+        return _pstats->compressed_pages;
+}
+
+static inline unsigned long StatsGetCompressedBytes_notlocked()
+{
+        return _pstats->compressed_bytes;
+}
+
+static inline unsigned long StatsGetIncompressiblePages_notlocked()
+{
+        return _pstats->incompressible_pages;
+}
+
+static inline unsigned long StatsGetCompressionTime_notlocked()
+{
+        return _pstats->compression_nsecs;
+}
+
+static inline unsigned long StatsGetDecompressionTime_notlocked()
+{
+        return _pstats->decompression_nsecs;
+}
+
 static inline unsigned long StatsGetLRUBufferSize()
 {
         unsigned long ret;
@@ -359,6 +620,132 @@ static inline unsigned long StatsGetStat(StatisticToRetreive statToRetrieve)
                         ret = StatsGetWriteSkippedInvalid_notlocked();
                         break;
                 }
+                case PREFETCHED_PAGES:
+                {
+                        ret = StatsGetPrefetchedPages_notlocked();
+                        break;
+                }
+                case PREFETCH_HITS:
+                {
+                        ret = StatsGetPrefetchHit_notlocked();
+                        break;
+                }
+                case PREFETCH_UNUSED:
+                {
+                        ret = StatsGetPrefetchUnused_notlocked();
+                        break;
+                }
+                case PREFETCH_ACCURACY:
+                {
+                        unsigned long hits = StatsGetPrefetchHit_notlocked();
+                        unsigned long total = hits + StatsGetPrefetchUnused_notlocked();
+                        if (total != 0)
+                        {
+                                ret = ceil(100 * ((double)(hits)/(double)(total)));
+                        }
+                        break;
+                }
+                case PREFETCH_WINDOW:
+                {
+                        ret = _pstats->prefetch_window;
+                        break;
+                }
+                case PREFETCH_CANCELLED:
+                {
+                        ret = StatsGetPrefetchCancelled_notlocked();
+                        break;
+                }
+                case RESIZE_PENDING:
+                {
+                        ret = _pstats->resize_pending;
+                        break;
+                }
+                case RESIZE_EVICTED:
+                {
+                        ret = StatsGetResizeEvicted_notlocked();
+                        break;
+                }
+                case FLUSHED_PAGES:
+                {
+                        ret = StatsGetFlushedPages_notlocked();
+                        break;
+                }
+                case RESTORED_PAGES:
+                {
+                        ret = StatsGetRestoredPages_notlocked();
+                        break;
+                }
+                case PRECOPIED_PAGES:
+                {
+                        ret = StatsGetPrecopiedPages_notlocked();
+                        break;
+                }
+                case CLEAN_EVICTIONS:
+                {
+                        ret = StatsGetCleanEvictions_notlocked();
+                        break;
+                }
+                case IDLE_SWAPPED_OUT:
+                {
+                        ret = StatsGetIdleSwappedOut_notlocked();
+                        break;
+                }
+                case HOT_PROMOTED:
+                {
+                        ret = StatsGetHotPromoted_notlocked();
+                        break;
+                }
+                case ZERO_PARKED:
+                {
+                        ret = StatsGetZeroParked_notlocked();
+                        break;
+                }
+                case VICTIM_HITS:
+                {
+                        ret = StatsGetVictimHits_notlocked();
+                        break;
+                }
+                case DISCARDED_PAGES:
+                {
+                        ret = StatsGetDiscardedPages_notlocked();
+                        break;
+                }
+                case COMPRESSED_PAGES:
+                {
+                        ret = StatsGetCompressedPages_notlocked();
+                        break;
+                }
+                case INCOMPRESSIBLE_PAGES:
+                {
+                        ret = StatsGetIncompressiblePages_notlocked();
+                        break;
+                }
+                case COMPRESSION_SAVED_BYTES:
+                {
+                        ret = StatsGetCompressedPages_notlocked() * PAGE_SIZE - StatsGetCompressedBytes_notlocked();
+                        break;
+                }
+                case COMPRESSION_PERCENTAGE:
+                {
+                        // bytes stored as a percentage of the bytes of the pages written
+                        unsigned long raw = StatsGetIncompressiblePages_notlocked() * PAGE_SIZE;
+                        unsigned long total = StatsGetCompressedPages_notlocked() * PAGE_SIZE + raw;
+                        if (total != 0)
+                        {
+                                ret = ceil(100 * ((double)(StatsGetCompressedBytes_notlocked() + raw)/(double)(total)));
+                        }
+                        break;
+                }
+                case COMPRESSION_USECS:
+                {
+                        ret = StatsGetCompressionTime_notlocked() / 1000;
+                        break;
+                }
+                case DECOMPRESSION_USECS:
+                {
+                        ret = StatsGetDecompressionTime_notlocked() / 1000;
+                        break;
+                }
         }
 
         return ret;
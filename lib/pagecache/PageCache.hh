@@ -31,16 +31,26 @@ public:
     static PageCache *          create(struct LRUBuffer *lru);
 
     // API with clients
-    virtual int                 readPageIfInPageCache( uint64_t hashcode, int fd, void** buf ){};
-    virtual void                readPageIfInPageCache_top( uint64_t hashcode, int fd, void** buf ){};
+    virtual int                 readPageIfInPageCache( uint64_t hashcode, int fd, void** buf, uint32_t ptid ){};
+    virtual void                readPageIfInPageCache_top( uint64_t hashcode, int fd, void** buf, uint32_t ptid ){};
     virtual int                 readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void** buf ){};
     virtual void                updatePageCacheAfterWrite( uint64_t hashcode, int fd, bool zeroPage ){};
     virtual void                updatePageCacheAfterSkippedRead( uint64_t hashcode, int fd ){};
     virtual void                invalidatePageCache( uint64_t hashcode, int fd ){};
     virtual void                addPageHashNode( uint64_t hashcode, int fd, int ownership ){};
     virtual void                storePagesInPageCache( uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths){};
-    virtual void                removeUFDFromPageCache(int fd, int * numPages){};
-    virtual uint64_t *          removeUFDFromPageHash(int fd, int * numPages){};
+    virtual void                updatePrefetchLatency( int fd, int num_pages, uint64_t usec ){};
+    virtual void                removeUFDFromPageCache(int fd, int max_pages, int * numPages){};
+    virtual void *              detachUFDFromPageHash(int fd){};
+    virtual uint64_t *          removeDetachedPageHash(void * detached, int * numPages){};
+    virtual uint64_t *          listExternRAMPages(int fd, uint64_t start, uint64_t end, int * numPages){};
+    virtual bool                claimRestoredPage(uint64_t hashcode, int fd){return false;};
+    virtual int                 countRefault(uint64_t hashcode, int fd){return 0;};
+    virtual void                markZeroPage(uint64_t hashcode, int fd, bool parked){};
+    virtual void                setPageWriting(uint64_t hashcode, int fd, bool writing){};
+    virtual bool                isPageWriting(uint64_t hashcode, int fd){return false;};
+    virtual void                storeVictimPages( uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths){};
+    virtual uint64_t *          discardPageRange(int fd, uint64_t start, uint64_t end, int * numPages){};
 
 //protected:
     PageCache(){};
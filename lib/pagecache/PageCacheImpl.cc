@@ -33,6 +33,7 @@
 #include <threaded_io.h>
 #include <sys/user.h> /* for PAGE_SIZE */
 #include <buffer_allocator_array.h>
+#include <algorithm>   /* for std::min, std::max */
 
 struct LRUBuffer *           PageCache::lruBuffer=NULL;
 
@@ -50,6 +51,19 @@ PageCache * PageCache::create( struct LRUBuffer *lru )
   boost::shared_ptr<PageCache> impl(new PageCacheImpl(),null_deleter());
   lruBuffer = lru;
 
+  // a prefetch batch is sent as a single multiread
+  if( max_prefetch_size<1 || max_prefetch_size>MAX_MULTI_READ-1 )
+    max_prefetch_size = MAX_MULTI_READ-1;
+  if( prefetch_size>max_prefetch_size )
+    prefetch_size = max_prefetch_size;
+  log_info("%s: prefetch window starts at %d pages, grows up to %d pages within %d usec",
+           __func__, prefetch_size, max_prefetch_size, prefetch_latency_budget);
+#ifndef THREADED_PREFETCH
+  if( prefetch_depth<1 || prefetch_depth>MAX_PREFETCH_DEPTH )
+    prefetch_depth = std::max(std::min(prefetch_depth, MAX_PREFETCH_DEPTH), 1);
+  log_info("%s: up to %d prefetch batches in flight per ufd", __func__, prefetch_depth);
+#endif
+
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
   log_info("%s: page cache zero page optimization enabled.", __func__);
 #else
@@ -65,7 +79,7 @@ PageCache * PageCache::create( struct LRUBuffer *lru )
  *  default parameterless constructor
  **********************************************
  */
-PageCacheImpl::PageCacheImpl()
+PageCacheImpl::PageCacheImpl():evictions(0),victimCache(victim_cache_size)
 {
   log_debug("%s: PageCache: created instance of PageCache", __func__);
 }
@@ -78,6 +92,12 @@ PageCacheImpl::PageCacheImpl()
  */
 PageCacheImpl::~PageCacheImpl()
 {
+  for( page_state_map::iterator itr = pageStates.begin(); itr!=pageStates.end(); itr++ )
+  {
+    page_state_windows & windows = itr->second.windows;
+    for( page_state_windows::iterator witr = windows.begin(); witr!=windows.end(); witr++ )
+      free( witr->second );
+  }
   log_debug("%s: PageCache: deleted instance of LRU Buffer", __func__);
 }
 
@@ -94,6 +114,9 @@ void PageCacheImpl::cleanup()
 
   log_debug("%s: pageCache size after cleanup :%d", __func__, pageCache.getSize());
 
+  while( victimCache.getSize()>0 )
+    popVictim();
+
   log_trace_out("%s", __func__);
 }
 
@@ -144,6 +167,9 @@ uint64_t PageCacheImpl::popLRU() {
   pageCache.pop_back();
   changeOwnership( key, fd, OWNERSHIP_EXTERNRAM, false);
 
+  // the prefetched page was never used
+  resolvePrefetch( fd, false );
+
   log_debug("%s: LRU pop from page cache, hashcode=%lx, fd=%d, buf=%lx, length=%d", __func__, key, fd, (long unsigned int)address, size);
 
   log_trace_out("%s", __func__);
@@ -165,71 +191,72 @@ inline void PageCacheImpl::changeOwnership( uint64_t hashcode, int fd, int owner
 {
   log_trace_in("%s", __func__);
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
-  if( itr!=pagehash.end() )
+  uint16_t * state = findPageState( hashcode, fd );
+  if( state )
   {
-    itr->second->ownership = ownership;
-    itr->second->is_zeropage = is_zeropage;
+    setPageOwnership( state, ownership, is_zeropage );
     log_debug("%s: The ownership of page %lx fd %d has changed to %d (is_zeropage : %d)", __func__, hashcode, fd, ownership, is_zeropage );
   }
   else
   {
-    log_err("%s: Cannot find the entry for page %lx fd %d in pagehash", __func__, hashcode, fd );
+    log_err("%s: Cannot find the state of page %lx fd %d", __func__, hashcode, fd );
   }
 
   log_trace_out("%s", __func__);
 }
 
-inline void PageCacheImpl::changeOwnershipWithItr( page_hash::iterator itr, int ownership, bool is_zeropage=false )
+inline void PageCacheImpl::changeOwnershipWithState( uint16_t * state, int ownership, bool is_zeropage=false )
 {
   log_trace_in("%s", __func__);
 
-  if( itr!=pagehash.end() )
+  if( state )
   {
-    itr->second->ownership = ownership;
-    itr->second->is_zeropage = is_zeropage;
+    setPageOwnership( state, ownership, is_zeropage );
   }
   else
   {
-      log_err("%s: Cannot find the entry for page in pagehash", __func__);
+      log_err("%s: Cannot find the state of page", __func__);
   }
 
   log_trace_out("%s", __func__);
 }
 
-int PageCacheImpl::readPageIfInPageCache( uint64_t hashcode, int fd, void ** buf )
+int PageCacheImpl::readPageIfInPageCache( uint64_t hashcode, int fd, void ** buf, uint32_t ptid )
 {
   log_trace_in("%s", __func__);
   int size = 0;
-  readPageIfInPageCache_top( hashcode, fd, buf );
+  readPageIfInPageCache_top( hashcode, fd, buf, ptid );
   size = readPageIfInPageCache_bottom( hashcode, fd, buf );
   log_trace_out("%s", __func__);
   return size;
 }
 
-void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void ** buf )
+void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void ** buf, uint32_t ptid )
 {
   log_trace_in("%s", __func__);
+#ifndef ASYNREAD
+  // only an asynchronous read of the faulting page fills buf here
+  (void) buf;
+#endif
 
-  static uint64_t prevAddr = 0; // previously accessed address
-  static int numConseqAcc = 0; // number of consequtive accesses
+  prefetch_stream & stream = getPrefetchStream(fd);
+  access_stream & access = getAccessStream(fd, ptid);
 
-  if(prevAddr + PAGE_SIZE == hashcode)
-    numConseqAcc++;
+  if(access.prevAddr + PAGE_SIZE == hashcode)
+    access.numConseqAcc++;
   else
-    numConseqAcc=0;
-  prevAddr = hashcode;
+    access.numConseqAcc=0;
+  access.prevAddr = hashcode;
+  stream.numConseqAcc = access.numConseqAcc;
+
+#ifndef THREADED_PREFETCH
+  // land the prefetch batches that have arrived, and the one carrying this page
+  if( enable_prefetch )
+    completePrefetchBatches( hashcode, fd, stream );
+#endif
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
-  if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_PAGE_CACHE )
+  uint16_t * state = findPageState( hashcode, fd );
+  if( state && pageOwnership(*state)==OWNERSHIP_PAGE_CACHE )
   {
 
     // increment the page cache hit stat
@@ -238,7 +265,7 @@ void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void *
 #endif
 
   }
-  else if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_EXTERNRAM )
+  else if( state && pageOwnership(*state)==OWNERSHIP_EXTERNRAM )
   {
     // increment the page cache miss stat
 #ifdef MONITORSTATS
@@ -249,7 +276,7 @@ void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void *
     if( !enable_prefetch )
     {
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
-      if( itr->second->is_zeropage==true )
+      if( pageIsZero(*state) )
       {
       }
       else
@@ -275,110 +302,95 @@ void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void *
     {
       // prefetch is enabled
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
-      if( itr->second->is_zeropage==true )
+      if( pageIsZero(*state) )
       {
         goto read_page_if_in_page_cache_out_top;
       }
 #endif
 
-      // prepare prefetch structures
-      float avgSequentialAccessNum = 10;
+#ifdef THREADED_PREFETCH
+      // queue the prefetches for the prefetch threads
+      int window = getPrefetchWindow(stream);
       int i=1;
-      numPrefetch = 0;
-      keys_for_mread[0] = hashcode;
+      int numPrefetch = 0;
 
-#if defined(THREADED_WRITE_TO_EXTERNRAM) || defined(THREADED_PREFETCH)
-      log_lock("%s: unlocking list_lock", __func__);
+      log_lock("%s: locking list_lock", __func__);
       pthread_mutex_lock(&list_lock);
-      log_lock("%s: unlocked list_lock", __func__);
-#endif
-#ifdef THREADED_PREFETCH
-      bool waiting = isPrefetcherWaiting;
+      log_lock("%s: locked list_lock", __func__);
+
+      if( stream.numConseqAcc==0 )
+      {
+        // the stream broke, so what is still queued for it will not be used
+        int cancelled = cancel_prefetch_info( fd, ptid, hashcode, hashcode + 2 * window * PAGE_SIZE );
+        if( cancelled>0 ) {
+          log_debug("%s: cancelled %d queued prefetches for fd %d", __func__, cancelled, fd);
+        }
+#ifdef MONITORSTATS
+        for( int c=0; c<cancelled; c++ )
+          StatsIncrPrefetchCancelled_notlocked();
 #endif
-      while( numPrefetch<numConseqAcc )
+      }
+      while( numPrefetch<stream.numConseqAcc )
       {
-        log_debug("%s: passed criteria for prefetch: will fetch %d keys after %d consecutive accesses", __func__, numPrefetch, numConseqAcc);
+        log_debug("%s: passed criteria for prefetch: will fetch %d keys after %d consecutive accesses", __func__, numPrefetch, stream.numConseqAcc);
 
         uint64_t testaddr = hashcode + i * PAGE_SIZE;
-        char t[sizeof(uint64_t)+sizeof(int)];
-        *((uint64_t*) &t[0]) = testaddr;
-        *((int*) &t[sizeof(uint64_t)]) = fd;
-        std::string k(t,sizeof(uint64_t)+sizeof(int));
-        page_hash::iterator itr2 = pagehash.find(k);
+        uint16_t * state2 = findPageState( testaddr, fd );
 #ifdef THREADED_WRITE_TO_EXTERNRAM
         bool existInWriteList = exist_write_info(fd,testaddr);
 #endif
-#ifdef THREADED_PREFETCH
         bool existInPrefetchList = exist_prefetch_info(fd,testaddr);
-#endif
-        if( itr2!=pagehash.end() && itr2->second->ownership==OWNERSHIP_EXTERNRAM
+        if( state2 && pageOwnership(*state2)==OWNERSHIP_EXTERNRAM
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
           // Let's not bring zero pages to the cache since they will
           // be quickly retrieved if needed
-          && itr2->second->is_zeropage==false
+          && !pageIsZero(*state2)
 #endif
 #ifdef THREADED_WRITE_TO_EXTERNRAM
           && !existInWriteList
 #endif
-#ifdef THREADED_PREFETCH
           && !existInPrefetchList
-#endif
           )
         {
-#ifdef THREADED_PREFETCH
-          add_prefetch_info( fd, testaddr );
-#else
-          keys_for_mread[numPrefetch+1] = testaddr;
-
-#endif // THREADED_PREFETCH
+          add_prefetch_info( fd, testaddr, ptid );
           numPrefetch++;
           log_debug("%s: Prefetching a page %lx fd %d.", __func__, testaddr, fd);
         }
 
-        if( numPrefetch>=prefetch_size ) {
-          log_debug("%s: breaking prefetch up because numPrefetch has reached prefetch_size", __func__, prefetch_size);
+        if( numPrefetch>=window ) {
+          log_debug("%s: breaking prefetch up because numPrefetch has reached the prefetch window %d", __func__, window);
           break;
         }
-        if ( i>100 ) {
-          // TODO: can this be removed?
-          log_debug("%s: breaking prefetch up because %d pages have been added already", __func__, i);
+        if ( i>=2*window ) {
+          // don't scan further ahead than twice the window for pages that are already resident
+          log_debug("%s: breaking prefetch up because %d pages have been scanned already", __func__, i);
           break;
         }
         i++;
       }
-      buf = bufs_for_mread;
-      // prefetch structures prepared
+      bool waiting = numPrefetch>0 && claim_waiting_prefetcher();
 
-#if defined(THREADED_WRITE_TO_EXTERNRAM) || defined(THREADED_PREFETCH)
-#ifdef THREADED_PREFETCH
-      int list_size = get_prefetch_list_size();
-#endif
       log_lock("%s: unlocking list_lock", __func__);
       pthread_mutex_unlock(&list_lock);
       log_lock("%s: unlocked list_lock", __func__);
-#endif // defined(THREADED_WRITE_TO_EXTERNRAM) || defined(THREADED_PREFETCH)
 
-      // start the prefetch in externram
+      if( waiting )
+        sem_post(&prefetcher_sem);
+#endif // THREADED_PREFETCH
+
+      // the faulting page is read on its own, ahead of any prefetch
       struct externRAMClient *client = get_client_by_fd(fd);
       if (client) {
-#ifdef THREADED_PREFETCH
-        if( waiting )
-          sem_post(&prefetcher_sem);
-
         start_timing_bucket(g_start, READ_PAGE);
 #ifdef ASYNREAD
         readPage_top( client, hashcode, buf );
 #endif
-#else
-        start_timing_bucket(g_start, READ_PAGES);
-#ifdef ASYNREAD
-        readPages_top( client, keys_for_mread, numPrefetch+1, (void**) bufs_for_mread, lengths_for_mread );
-#endif
-#endif // THREADED_PREFETCH
       }
+      else
+        log_err("%s: failed to read page %lx for invalid fd %d", __func__, hashcode, fd);
     }
   }
-  else if( itr==pagehash.end() )
+  else if( !state )
   {
 
     // increment the page cache miss stat
@@ -388,6 +400,11 @@ void PageCacheImpl::readPageIfInPageCache_top( uint64_t hashcode, int fd, void *
   }
 
 read_page_if_in_page_cache_out_top:
+#if !defined(THREADED_PREFETCH) && defined(ASYNREAD)
+  // the faulting page has been requested, now keep the prefetch pipeline full
+  if( enable_prefetch )
+    issuePrefetchBatch( hashcode, fd, stream );
+#endif
 
   log_trace_out("%s", __func__);
 }
@@ -398,14 +415,10 @@ int PageCacheImpl::readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void
 
   int size = 0;
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
+  uint16_t * state = findPageState( hashcode, fd );
 
-  // TODO this second pagehash lookup could be avoided
-  if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_PAGE_CACHE )
+  // TODO this second page state lookup could be avoided
+  if( state && pageOwnership(*state)==OWNERSHIP_PAGE_CACHE )
   {
     // If the page is in the cache, return the page in cache
     List::iterator itr2 = pageCache.find( hashcode, fd );
@@ -413,18 +426,34 @@ int PageCacheImpl::readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void
     {
       *buf = itr2->address;
       size = itr2->size;
+      pageCache.erase( hashcode, fd );
+      resolvePrefetch( fd, true );
+    }
+    else
+    {
+      // a clean copy kept after eviction, copied so the buffer can be freed
+      List::iterator vitr = victimCache.find( hashcode, fd );
+      if( vitr!=victimCache.findEnd() )
+      {
+        memcpy( *buf, vitr->address, PAGE_SIZE );
+        size = PAGE_SIZE;
+        free( vitr->address );
+        victimCache.erase( hashcode, fd );
+#ifdef MONITORSTATS
+        StatsIncrVictimHit_notlocked();
+#endif
+      }
     }
-    pageCache.erase( hashcode, fd );
-    changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION );
+    changeOwnershipWithState( state, OWNERSHIP_APPLICATION );
     log_debug("%s: Cache hit for page %lx fd %d.", __func__, hashcode, fd);
   }
-  else if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_EXTERNRAM )
+  else if( state && pageOwnership(*state)==OWNERSHIP_EXTERNRAM )
   {
     // If the page is in externRAM, return the page in externRAM
     if( !enable_prefetch )
     {
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
-      if( itr->second->is_zeropage==true )
+      if( pageIsZero(*state) )
       {
         log_debug("%s: Skipping reading the page %lx fd %d from externRAM.", __func__, hashcode, fd);
       }
@@ -445,22 +474,21 @@ int PageCacheImpl::readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
       }
 #endif
-      changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION );
+      changeOwnershipWithState( state, OWNERSHIP_APPLICATION );
     }
     else
     {
       // prefetch is enabled
 #ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
-      if( itr->second->is_zeropage==true )
+      if( pageIsZero(*state) )
       {
         log_debug("%s: Skipping reading the all-zero page %lx fd %d from externRAM.", __func__, hashcode, fd);
-        changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION );
+        changeOwnershipWithState( state, OWNERSHIP_APPLICATION );
         goto read_page_if_in_page_cache_out_bottom;
       }
 #endif
       struct externRAMClient *client = get_client_by_fd(fd);
       if (client) {
-#ifdef THREADED_PREFETCH
 #ifdef ASYNREAD
         size = readPage_bottom( client, hashcode, buf );
 #else
@@ -468,43 +496,22 @@ int PageCacheImpl::readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void
 #endif // ASYNREAD
         stop_timing(g_start, g_end, READ_PAGE);
 
-        changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION );
-#else
-#ifdef ASYNREAD
-        readPages_bottom( client, keys_for_mread, numPrefetch+1, (void**) bufs_for_mread, lengths_for_mread );
-#else
-        readPages( client, keys_for_mread, numPrefetch+1, (void**) bufs_for_mread, lengths_for_mread );
-#endif // ASYNREAD
-        stop_timing(g_start, g_end, READ_PAGES);
-
-        if( bufs_for_mread[0]!=NULL )
-        {
-          size = lengths_for_mread[0];
-          *buf = bufs_for_mread[0];
-          changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION );
-        }
-        else {
-          log_err("%s: failed to get the first page %p in multiread which is page faulted on by %d",
-                  __func__, keys_for_mread[0], fd);
-        }
-#ifdef DEBUG
-        for(int i=0; i<numPrefetch+1; i++)
-        {
-          log_debug("%s: multiRead [%d] bufs_for_mread %lx lenths_for_mread %d", __func__, i,(uint64_t)bufs_for_mread[i], lengths_for_mread[i]);
-        }
-#endif
-        if( numPrefetch>0 )
-        {
-          storePagesInPageCache(&keys_for_mread[1], fd, numPrefetch, (char**) &bufs_for_mread[1], &lengths_for_mread[1]);
-        }
-#endif // THREADED_PREFETCH
+        changeOwnershipWithState( state, OWNERSHIP_APPLICATION );
       }
       else
         log_warn("%s: failed to read page %lx with invalid fd %d", __func__, hashcode, fd);
     }
     log_debug("%s: Cache miss! Read the page %lx fd %d from externRAM.", __func__, hashcode, fd);
   }
-  else if( itr==pagehash.end() )
+  else if( state && pageOwnership(*state)==OWNERSHIP_APPLICATION && pageIsZero(*state) )
+  {
+    // a zero page parked off the LRU buffer has lost its mapping, nothing
+    // was written for it so place a zero page again
+    changeOwnershipWithState( state, OWNERSHIP_APPLICATION );
+    size = 0;
+    log_debug("%s: Parked zero page %lx fd %d faulted.", __func__, hashcode, fd);
+  }
+  else if( !state )
   {
     // zeropage if the page is not either in cache or externRAM
     start_timing_bucket(g_start, INSERT_PAGE_HASH_NODE);
@@ -520,6 +527,11 @@ int PageCacheImpl::readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void
   }
 
 read_page_if_in_page_cache_out_bottom:
+#if !defined(THREADED_PREFETCH) && !defined(ASYNREAD)
+  // the faulting page has been read, now keep the prefetch pipeline full
+  if( enable_prefetch )
+    issuePrefetchBatch( hashcode, fd, getPrefetchStream(fd) );
+#endif
 
   log_trace_out("%s", __func__);
   return size;
@@ -529,19 +541,17 @@ void PageCacheImpl::updatePageCacheAfterWrite( uint64_t hashcode, int fd, bool z
 {
   log_trace_in("%s", __func__);
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
+  uint16_t * state = findPageState( hashcode, fd );
 
-  if( itr!=pagehash.end() && ( itr->second->ownership==OWNERSHIP_PAGE_CACHE || itr->second->ownership==OWNERSHIP_EXTERNRAM ))
+  if( state && ( pageOwnership(*state)==OWNERSHIP_PAGE_CACHE || pageOwnership(*state)==OWNERSHIP_EXTERNRAM ))
   {
     log_err("%s: Trying to write a page whose ownership location is pagecache or enternram!", __func__);
   }
-  else if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_APPLICATION )
+  else if( state && pageOwnership(*state)==OWNERSHIP_APPLICATION )
   {
-      changeOwnershipWithItr( itr, OWNERSHIP_EXTERNRAM, zeroPage );
+      changeOwnershipWithState( state, OWNERSHIP_EXTERNRAM, zeroPage );
+      evictions++;
+      setPageEvictEpoch( state, evictEpoch() );
   }
   else
   {
@@ -555,19 +565,15 @@ void PageCacheImpl::updatePageCacheAfterSkippedRead( uint64_t hashcode, int fd)
 {
   log_trace_in("%s", __func__);
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
+  uint16_t * state = findPageState( hashcode, fd );
 
-  if( itr!=pagehash.end() && ( itr->second->ownership==OWNERSHIP_PAGE_CACHE || itr->second->ownership==OWNERSHIP_APPLICATION))
+  if( state && ( pageOwnership(*state)==OWNERSHIP_PAGE_CACHE || pageOwnership(*state)==OWNERSHIP_APPLICATION))
   {
     log_err("%s: Trying to update a page that didn't have ownership externram!", __func__);
   }
-  else if( itr!=pagehash.end() && itr->second->ownership==OWNERSHIP_EXTERNRAM )
+  else if( state && pageOwnership(*state)==OWNERSHIP_EXTERNRAM )
   {
-    changeOwnershipWithItr( itr, OWNERSHIP_APPLICATION, false );
+    changeOwnershipWithState( state, OWNERSHIP_APPLICATION, false );
   }
   else
   {
@@ -581,15 +587,14 @@ void PageCacheImpl::addPageHashNode( uint64_t hashcode, int fd, int ownership )
 {
   log_trace_in("%s", __func__);
 
-  boost::shared_ptr<PageInfo> pi(new PageInfo(),null_deleter());
-  pi->ref_count = 0;
-  pi->ownership = ownership;
-
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  pagehash[k] = pi;
+  uint16_t * state = getPageState( hashcode, fd );
+  if( state==NULL )
+  {
+    log_err("%s: failed to allocate page state for page %lx fd %d", __func__, hashcode, fd);
+    return;
+  }
+  *state = 0;
+  setPageOwnership( state, ownership, false );
 
   log_debug("%s: Adding a new page hash node for page %lx fd %d with ownership %d", __func__, hashcode, fd, ownership);
 
@@ -605,16 +610,20 @@ void PageCacheImpl::storePageInPageCache(uint64_t hashcode, int fd, void * buf,
   }
   assert( buf!=NULL );
 
-  char t[sizeof(uint64_t)+sizeof(int)];
-  *((uint64_t*) &t[0]) = hashcode;
-  *((int*) &t[sizeof(uint64_t)]) = fd;
-  std::string k(t,sizeof(uint64_t)+sizeof(int));
-  page_hash::iterator itr = pagehash.find(k);
+  uint16_t * state = findPageState( hashcode, fd );
 
-  if( itr!=pagehash.end() )
+  if( state )
   {
     List::iterator itr2 = pageCache.find( hashcode, fd );
 
+    // a prefetched copy replaces a clean copy kept after eviction
+    List::iterator vitr = victimCache.find( hashcode, fd );
+    if( vitr!=victimCache.findEnd() )
+    {
+      free( vitr->address );
+      victimCache.erase( hashcode, fd );
+    }
+
     if( itr2!=pageCache.findEnd() )
     {
       free( itr2->address );
@@ -624,15 +633,21 @@ void PageCacheImpl::storePageInPageCache(uint64_t hashcode, int fd, void * buf,
     else
     {
       insertPageCacheNode( hashcode, fd, buf, length );
+#ifdef MONITORSTATS
+      StatsIncrPrefetchedPages_notlocked();
+#endif
       log_debug("%s: Adding a page cache, hashcode=%lx, fd=%d, buf=%lx, length=%d", __func__, hashcode, fd, (uint64_t) buf, length);
     }
 
-    changeOwnershipWithItr( itr, OWNERSHIP_PAGE_CACHE );
+    changeOwnershipWithState( state, OWNERSHIP_PAGE_CACHE );
   }
   else
   {
     addPageHashNode( hashcode, fd, OWNERSHIP_PAGE_CACHE );
     insertPageCacheNode( hashcode, fd, buf, length );
+#ifdef MONITORSTATS
+    StatsIncrPrefetchedPages_notlocked();
+#endif
     log_debug("%s: Adding a page cache, hashcode=%lx, fd=%d, buf=%lx, length=%d", __func__, hashcode, fd, (uint64_t) buf, length);
   }
 
@@ -656,6 +671,379 @@ void PageCacheImpl::storePagesInPageCache(uint64_t * hashcodes, int fd, int num_
   log_trace_out("%s", __func__);
 }
 
+/*
+ *** PageCacheImpl::getPrefetchStream() ***
+ *  returns the prefetch window and accuracy state of fd,
+ *  creating it with the initial window of prefetch_size on first use
+ **********************************************
+ */
+PageCacheImpl::prefetch_stream & PageCacheImpl::getPrefetchStream( int fd )
+{
+  prefetch_stream_map::iterator itr = prefetchStreams.find(fd);
+  if( itr==prefetchStreams.end() )
+  {
+    prefetch_stream stream = { 0, std::max(prefetch_size, 1), 0, 0, 0, 0
+#ifndef THREADED_PREFETCH
+                               , -1, 0, {}
+#endif
+                             };
+    itr = prefetchStreams.insert( std::make_pair(fd, stream) ).first;
+  }
+  return itr->second;
+}
+
+/*
+ *** PageCacheImpl::getPageState() ***
+ *  returns the state of page hashcode of fd, allocating the array for its
+ *  window of address space on first use. Returns NULL if that fails
+ **********************************************
+ */
+uint16_t * PageCacheImpl::getPageState( uint64_t hashcode, int fd )
+{
+  page_state_table & table = pageStates[fd];
+  uint64_t window = hashcode >> PAGE_STATE_WINDOW_SHIFT;
+
+  if( table.last_states==NULL || table.last_window!=window )
+  {
+    page_state_windows::iterator itr = table.windows.find(window);
+    if( itr==table.windows.end() )
+    {
+      uint16_t * states = (uint16_t *) calloc( PAGE_STATE_WINDOW_PAGES, sizeof(uint16_t) );
+      if( states==NULL )
+        return NULL;
+      itr = table.windows.insert( std::make_pair(window, states) ).first;
+      log_debug("%s: allocated page states for window %lx of fd %d", __func__,
+                window << PAGE_STATE_WINDOW_SHIFT, fd);
+    }
+    table.last_window = window;
+    table.last_states = itr->second;
+  }
+  return &table.last_states[(hashcode >> PAGE_SHIFT) & (PAGE_STATE_WINDOW_PAGES - 1)];
+}
+
+/*
+ *** PageCacheImpl::findPageState() ***
+ *  returns the state of page hashcode of fd, or NULL if the page is not
+ *  tracked
+ **********************************************
+ */
+uint16_t * PageCacheImpl::findPageState( uint64_t hashcode, int fd )
+{
+  page_state_map::iterator itr = pageStates.find(fd);
+  if( itr==pageStates.end() )
+    return NULL;
+
+  page_state_table & table = itr->second;
+  uint64_t window = hashcode >> PAGE_STATE_WINDOW_SHIFT;
+  uint16_t * states;
+  if( table.last_states!=NULL && table.last_window==window )
+    states = table.last_states;
+  else
+  {
+    page_state_windows::iterator witr = table.windows.find(window);
+    if( witr==table.windows.end() )
+      return NULL;
+    table.last_window = window;
+    table.last_states = states = witr->second;
+  }
+
+  uint16_t * state = &states[(hashcode >> PAGE_SHIFT) & (PAGE_STATE_WINDOW_PAGES - 1)];
+  return pageOwnership(*state)!=0 ? state : NULL;
+}
+
+/*
+ *** PageCacheImpl::getAccessStream() ***
+ *  returns the sequential access state of thread ptid of fd. ptid is 0
+ *  for every fault when the ufd does not report thread ids
+ **********************************************
+ */
+PageCacheImpl::access_stream & PageCacheImpl::getAccessStream( int fd, uint32_t ptid )
+{
+  uint64_t key = ((uint64_t)ptid << 32) | (uint32_t)fd;
+  access_stream_map::iterator itr = accessStreams.find(key);
+  if( itr==accessStreams.end() )
+  {
+    access_stream access = { 0, 0 };
+    itr = accessStreams.insert( std::make_pair(key, access) ).first;
+  }
+  return itr->second;
+}
+
+/*
+ *** PageCacheImpl::getPrefetchWindow() ***
+ *  the number of pages that may be prefetched for a stream. This is the
+ *  accuracy driven window, further limited to the number of pages the
+ *  backend is expected to return within prefetch_latency_budget
+ **********************************************
+ */
+int PageCacheImpl::getPrefetchWindow( prefetch_stream & stream )
+{
+  int window = stream.window;
+
+  if( prefetch_latency_budget>0 && stream.batch_pages>0 && stream.batch_usec>0 )
+  {
+    double usec_per_page = stream.batch_usec / stream.batch_pages;
+    int latency_window = (int)(prefetch_latency_budget / usec_per_page);
+    if( latency_window<window )
+    {
+      log_debug("%s: limiting prefetch window from %d to %d pages (%.1f usec per page)",
+                __func__, window, latency_window, usec_per_page);
+      window = latency_window;
+    }
+  }
+
+  return std::max(window, 1);
+}
+
+/*
+ *** PageCacheImpl::resolvePrefetch() ***
+ *  records whether a prefetched page of fd was used by the application
+ *  or dropped from the page cache. Every PREFETCH_ACCURACY_EPOCH resolved
+ *  pages the window is doubled when prefetching is accurate or halved
+ *  when most prefetched pages are wasted
+ **********************************************
+ */
+void PageCacheImpl::resolvePrefetch( int fd, bool used )
+{
+  log_trace_in("%s", __func__);
+
+  prefetch_stream_map::iterator itr = prefetchStreams.find(fd);
+  if( itr==prefetchStreams.end() )
+    goto resolve_prefetch_out;
+
+#ifdef MONITORSTATS
+  if( used )
+    StatsIncrPrefetchHit_notlocked();
+  else
+    StatsIncrPrefetchUnused_notlocked();
+#endif
+
+  {
+    prefetch_stream & stream = itr->second;
+    if( used )
+      stream.hits++;
+    else
+      stream.unused++;
+
+    if( stream.hits + stream.unused < PREFETCH_ACCURACY_EPOCH )
+      goto resolve_prefetch_out;
+
+    int accuracy = 100 * stream.hits / (stream.hits + stream.unused);
+    if( accuracy>=PREFETCH_GROW_ACCURACY )
+      stream.window = std::min(stream.window * 2, max_prefetch_size);
+    else if( accuracy<PREFETCH_SHRINK_ACCURACY )
+      stream.window = std::max(stream.window / 2, 1);
+
+    log_debug("%s: prefetch accuracy of fd %d is %d%%, window is now %d pages",
+              __func__, fd, accuracy, stream.window);
+#ifdef MONITORSTATS
+    StatsSetPrefetchWindow(stream.window);
+#endif
+    stream.hits = 0;
+    stream.unused = 0;
+  }
+
+resolve_prefetch_out:
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** PageCacheImpl::updatePrefetchLatency() ***
+ *  folds the latency of a multiread of num_pages pages from the backend
+ *  into the moving averages used to bound the prefetch window of fd
+ **********************************************
+ */
+void PageCacheImpl::updatePrefetchLatency( int fd, int num_pages, uint64_t usec )
+{
+  log_trace_in("%s", __func__);
+
+  if( num_pages>0 )
+  {
+    prefetch_stream & stream = getPrefetchStream(fd);
+    if( stream.batch_pages==0 )
+    {
+      stream.batch_usec = usec;
+      stream.batch_pages = num_pages;
+    }
+    else
+    {
+      stream.batch_usec += PREFETCH_LATENCY_WEIGHT * ((double)usec - stream.batch_usec);
+      stream.batch_pages += PREFETCH_LATENCY_WEIGHT * ((double)num_pages - stream.batch_pages);
+    }
+    log_debug("%s: multiread of %d pages for fd %d took %lu usec", __func__, num_pages, fd, usec);
+  }
+
+  log_trace_out("%s", __func__);
+}
+
+#ifndef THREADED_PREFETCH
+/*
+ *** PageCacheImpl::issuePrefetchBatch() ***
+ *  scans ahead of hashcode for pages of fd that are in externram and not
+ *  already being read, and sends them as one asynchronous multiread on an
+ *  idle read channel. When every channel of fd is busy, the oldest batch
+ *  is completed first. A backend such as memcached never reports a
+ *  channel ready, so a batch the guest does not fault on would otherwise
+ *  hold its channel for good
+ **********************************************
+ */
+void PageCacheImpl::issuePrefetchBatch( uint64_t hashcode, int fd, prefetch_stream & stream )
+{
+  log_trace_in("%s", __func__);
+
+  int window, channel, oldest, i;
+  prefetch_stream::prefetch_batch * batch;
+  struct externRAMClient *client;
+
+  if( stream.numConseqAcc==0 )
+    goto issue_prefetch_batch_out;
+
+  client = get_client_by_fd(fd);
+  if( !client )
+    goto issue_prefetch_batch_out;
+
+  if( stream.channels<0 )
+    stream.channels = openReadChannels( client, prefetch_depth );
+
+  if( stream.channels<=0 )
+    goto issue_prefetch_batch_out;
+
+  oldest = 0;
+  for( channel=0; channel<stream.channels; channel++ )
+  {
+    if( stream.batches[channel].num==0 )
+      break;
+    if( stream.batches[channel].seq<stream.batches[oldest].seq )
+      oldest = channel;
+  }
+  if( channel==stream.channels )
+  {
+    log_debug("%s: all %d read channels of fd %d are busy, completing channel %d",
+              __func__, stream.channels, fd, oldest);
+    completePrefetchBatch( fd, stream, oldest );
+    channel = oldest;
+  }
+
+  batch = &stream.batches[channel];
+  window = getPrefetchWindow(stream);
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+#endif
+  // don't scan further ahead than twice the window for pages that are already resident
+  for( i=1; batch->num<stream.numConseqAcc && batch->num<window && i<=2*window; i++ )
+  {
+    uint64_t testaddr = hashcode + i * PAGE_SIZE;
+    uint16_t * state = findPageState( testaddr, fd );
+    if( state && pageOwnership(*state)==OWNERSHIP_EXTERNRAM
+        && pageInFlight(*state)==0
+#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+        && !pageIsZero(*state)
+#endif
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+        && !exist_write_info(fd,testaddr)
+#endif
+      )
+    {
+      setPageInFlight( state, channel + 1 );
+      batch->keys[batch->num] = testaddr;
+      batch->bufs[batch->num] = NULL;
+      batch->num++;
+    }
+  }
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+#endif
+
+  if( batch->num>0 )
+  {
+    log_debug("%s: prefetching %d pages of fd %d after %lx on read channel %d",
+              __func__, batch->num, fd, hashcode, channel);
+    batch->seq = stream.issued++;
+    readPagesOnChannel_top( client, channel, batch->keys, batch->num, batch->bufs, batch->lengths );
+  }
+
+issue_prefetch_batch_out:
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** PageCacheImpl::completePrefetchBatch() ***
+ *  waits for the multiread on a read channel of fd and stores the pages
+ *  that are still expected from it in the page cache
+ **********************************************
+ */
+void PageCacheImpl::completePrefetchBatch( int fd, prefetch_stream & stream, int channel )
+{
+  log_trace_in("%s", __func__);
+
+  prefetch_stream::prefetch_batch * batch = &stream.batches[channel];
+  struct externRAMClient *client = get_client_by_fd(fd);
+
+  start_timing_bucket(g_start, READ_PAGES);
+  if( client )
+    readPagesOnChannel_bottom( client, channel, batch->keys, batch->num, batch->bufs, batch->lengths );
+  else
+    memset( batch->lengths, 0, sizeof(int) * batch->num );
+  stop_timing(g_start, g_end, READ_PAGES);
+
+  // the buffers of the pages that are not stored in the page cache are ours to free
+  for( int j=0; j<batch->num; j++ )
+  {
+    uint16_t * state = findPageState( batch->keys[j], fd );
+    if( !state || pageInFlight(*state)!=channel+1 )
+    {
+      free( batch->bufs[j] );
+      continue;
+    }
+
+    setPageInFlight( state, 0 );
+    if( pageOwnership(*state)==OWNERSHIP_EXTERNRAM && batch->bufs[j]!=NULL )
+      storePageInPageCache( batch->keys[j], fd, batch->bufs[j], batch->lengths[j] );
+    else
+    {
+      log_debug("%s: dropping prefetched page %lx fd %d", __func__, batch->keys[j], fd);
+      free( batch->bufs[j] );
+    }
+  }
+  batch->num = 0;
+
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** PageCacheImpl::completePrefetchBatches() ***
+ *  completes the prefetch batches of fd that have already arrived, and
+ *  waits for the one carrying hashcode if it is still in flight
+ **********************************************
+ */
+void PageCacheImpl::completePrefetchBatches( uint64_t hashcode, int fd, prefetch_stream & stream )
+{
+  log_trace_in("%s", __func__);
+
+  if( stream.channels>0 )
+  {
+    struct externRAMClient *client = get_client_by_fd(fd);
+    uint16_t * state = findPageState( hashcode, fd );
+    int carrying = (state) ? pageInFlight(*state) - 1 : -1;
+
+    for( int c=0; c<stream.channels; c++ )
+    {
+      if( stream.batches[c].num==0 )
+        continue;
+      if( c==carrying || (client && isReadChannelReady(client, c)) )
+        completePrefetchBatch( fd, stream, c );
+    }
+  }
+
+  log_trace_out("%s", __func__);
+}
+#endif // THREADED_PREFETCH
+
 void PageCacheImpl::invalidatePageCache( uint64_t hashcode, int fd )
 {
   log_trace_in("%s", __func__);
@@ -665,6 +1053,10 @@ void PageCacheImpl::invalidatePageCache( uint64_t hashcode, int fd )
     free( itr->address );
 
   pageCache.erase( hashcode, fd );
+  itr = victimCache.find( hashcode, fd );
+  if( itr!=victimCache.findEnd() )
+    free( itr->address );
+  victimCache.erase( hashcode, fd );
   changeOwnership( hashcode, fd, OWNERSHIP_EXTERNRAM );
 
   log_debug("%s: removed page cache entry for %lx fd %d", __func__, hashcode, fd);
@@ -672,30 +1064,57 @@ void PageCacheImpl::invalidatePageCache( uint64_t hashcode, int fd )
   log_trace_out("%s", __func__);
 }
 
-uint64_t * PageCacheImpl::removeUFDFromPageHash(int fd, int * numPages) {
+/*
+ *** PageCacheImpl::detachUFDFromPageHash() ***
+ *  takes the page states of fd out of the page cache so that they can be
+ *  scanned by removeDetachedPageHash() without holding the page cache lock.
+ *  Returns NULL if fd has no pages
+ **********************************************
+ */
+void * PageCacheImpl::detachUFDFromPageHash(int fd) {
+  log_trace_in("%s", __func__);
+
+  page_state_table * detached = NULL;
+  page_state_map::iterator itr = pageStates.find(fd);
+  if( itr!=pageStates.end() )
+  {
+    detached = new page_state_table();
+    detached->windows.swap(itr->second.windows);
+    pageStates.erase(itr);
+  }
+
+  log_trace_out("%s", __func__);
+  return detached;
+}
+
+/*
+ *** PageCacheImpl::removeDetachedPageHash() ***
+ *  frees page states returned by detachUFDFromPageHash() and returns the
+ *  addresses of the pages that were stored in externram
+ **********************************************
+ */
+uint64_t * PageCacheImpl::removeDetachedPageHash(void * detached, int * numPages) {
   log_trace_in("%s", __func__);
 
   std::vector<uint64_t> keyVector;
   uint64_t * keyList;
-  const char * t;
-  uint64_t hashcode;
-  int ufd;
-
-  page_hash::iterator itr = pagehash.begin();
-  while (itr != pagehash.end()) {
-    t = itr->first.c_str();
-    hashcode = *((uint64_t*) &t[0]);
-    ufd = *((int*) &t[sizeof(uint64_t)]);
-    if (ufd == fd) {
-      // only put on keyVector if it is in externram
-      if( itr->second->ownership==OWNERSHIP_EXTERNRAM ) {
-        keyVector.push_back(hashcode & (uint64_t)(PAGE_MASK));
+  page_state_table * table = (page_state_table *) detached;
+
+  if( table!=NULL )
+  {
+    page_state_windows & windows = table->windows;
+    for( page_state_windows::iterator witr = windows.begin(); witr!=windows.end(); witr++ )
+    {
+      uint64_t base = witr->first << PAGE_STATE_WINDOW_SHIFT;
+      for( uint64_t i=0; i<PAGE_STATE_WINDOW_PAGES; i++ )
+      {
+        // only put on keyVector if it is in externram
+        if( pageOwnership(witr->second[i])==OWNERSHIP_EXTERNRAM )
+          keyVector.push_back(base + (i << PAGE_SHIFT));
       }
-      itr = pagehash.erase(itr);
-    }
-    else {
-      itr++;
+      free( witr->second );
     }
+    delete table;
   }
   *numPages = keyVector.size();
 
@@ -709,24 +1128,337 @@ uint64_t * PageCacheImpl::removeUFDFromPageHash(int fd, int * numPages) {
   return keyList;
 }
 
-void PageCacheImpl::removeUFDFromPageCache(int fd, int * numPages) {
+/*
+ *** PageCacheImpl::listExternRAMPages() ***
+ *  returns the addresses of the pages of fd in [start, end) that are stored
+ *  in externram with data, for a restore to read back. end 0 means no limit.
+ *  All-zero pages and pages being prefetched are left out
+ **********************************************
+ */
+uint64_t * PageCacheImpl::listExternRAMPages(int fd, uint64_t start, uint64_t end, int * numPages) {
   log_trace_in("%s", __func__);
 
   std::vector<uint64_t> keyVector;
+  uint64_t * keyList;
+  page_state_map::iterator itr = pageStates.find(fd);
+
+  if( itr!=pageStates.end() )
+  {
+    page_state_windows & windows = itr->second.windows;
+    for( page_state_windows::iterator witr = windows.begin(); witr!=windows.end(); witr++ )
+    {
+      uint64_t base = witr->first << PAGE_STATE_WINDOW_SHIFT;
+      if( (end && base>=end) || base + (PAGE_STATE_WINDOW_PAGES << PAGE_SHIFT)<=start )
+        continue;
+      for( uint64_t i=0; i<PAGE_STATE_WINDOW_PAGES; i++ )
+      {
+        uint64_t addr = base + (i << PAGE_SHIFT);
+        uint16_t state = witr->second[i];
+        if( addr<start || (end && addr>=end) )
+          continue;
+        if( pageOwnership(state)==OWNERSHIP_EXTERNRAM && !pageIsZero(state) && pageInFlight(state)==0 )
+          keyVector.push_back(addr);
+      }
+    }
+  }
+  *numPages = keyVector.size();
+
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+/*
+ *** PageCacheImpl::claimRestoredPage() ***
+ *  hands a page read back by a restore to the application. Returns false,
+ *  leaving the page alone, if it is no longer only in externram: it was
+ *  faulted in, prefetched or is being prefetched since it was listed
+ **********************************************
+ */
+bool PageCacheImpl::claimRestoredPage(uint64_t hashcode, int fd) {
+  uint16_t * state = findPageState( hashcode, fd );
+
+  if( !state || pageOwnership(*state)!=OWNERSHIP_EXTERNRAM || pageIsZero(*state) || pageInFlight(*state)!=0 )
+    return false;
+
+  changeOwnershipWithState( state, OWNERSHIP_APPLICATION, false );
+  return true;
+}
+
+/*
+ *** PageCacheImpl::discardPageRange() ***
+ *  forgets the pages of fd in [start, end) that the application gave back,
+ *  so that the next fault on one of them places a new zero page. Cached
+ *  copies are freed. Returns the addresses of the pages that have a copy
+ *  in externram
+ **********************************************
+ */
+uint64_t * PageCacheImpl::discardPageRange(int fd, uint64_t start, uint64_t end, int * numPages) {
+  log_trace_in("%s", __func__);
+
+  std::vector<uint64_t> keyVector;
+  uint64_t * keyList;
+
+#ifndef THREADED_PREFETCH
+  // land the batches in flight, their pages in the range are freed below
+  prefetch_stream_map::iterator sitr = prefetchStreams.find(fd);
+  if( sitr!=prefetchStreams.end() )
+  {
+    for( int c=0; c<sitr->second.channels; c++ )
+    {
+      if( sitr->second.batches[c].num>0 )
+        completePrefetchBatch( fd, sitr->second, c );
+    }
+  }
+#endif
 
-  page_item_list::iterator itr = pageCache.begin();
-  int i=0;
-  for ( ; itr!= pageCache.end(); itr++, i++ ) {
-    if (itr->fd == fd) {
-      // this node will be removed
-      keyVector.push_back(itr->hashcode & (uint64_t)(PAGE_MASK));
-      log_debug("%s: freeing %p from ufd %d page cache entry for 0x%lx", __func__,
-               itr->address, fd, itr->hashcode, fd);
-      free( itr->address );
-      pageCache.erase(itr->hashcode, fd);
+  page_state_map::iterator itr = pageStates.find(fd);
+  if( itr!=pageStates.end() )
+  {
+    page_state_table & table = itr->second;
+    page_state_windows::iterator witr = table.windows.begin();
+    while( witr!=table.windows.end() )
+    {
+      uint64_t base = witr->first << PAGE_STATE_WINDOW_SHIFT;
+      if( base>=end || base + (PAGE_STATE_WINDOW_PAGES << PAGE_SHIFT)<=start )
+      {
+        witr++;
+        continue;
+      }
+      uint64_t first = start>base ? (start - base) >> PAGE_SHIFT : 0;
+      uint64_t last = std::min( (end - base) >> PAGE_SHIFT, (uint64_t)PAGE_STATE_WINDOW_PAGES );
+      for( uint64_t i=first; i<last; i++ )
+      {
+        uint64_t addr = base + (i << PAGE_SHIFT);
+        uint16_t state = witr->second[i];
+        if( pageOwnership(state)==OWNERSHIP_PAGE_CACHE )
+        {
+          List::iterator citr = pageCache.find( addr, fd );
+          if( citr!=pageCache.findEnd() )
+          {
+            free( citr->address );
+            pageCache.erase( addr, fd );
+            resolvePrefetch( fd, false );
+          }
+          citr = victimCache.find( addr, fd );
+          if( citr!=victimCache.findEnd() )
+          {
+            free( citr->address );
+            victimCache.erase( addr, fd );
+          }
+          keyVector.push_back(addr);
+        }
+        else if( pageOwnership(state)==OWNERSHIP_EXTERNRAM && !pageIsZero(state) )
+          keyVector.push_back(addr);
+        witr->second[i] = 0;
+      }
+
+      // a window given back as a whole is not kept around
+      if( first==0 && last==PAGE_STATE_WINDOW_PAGES )
+      {
+        if( table.last_states==witr->second )
+          table.last_states = NULL;
+        free( witr->second );
+        witr = table.windows.erase(witr);
+      }
+      else
+        witr++;
     }
   }
   *numPages = keyVector.size();
+  log_debug("%s: discarded pages %lx-%lx of fd %d, %d in externram", __func__, start, end, fd, *numPages);
+
+  keyList = (uint64_t *)malloc(keyVector.size() * sizeof(uint64_t));
+  for(std::vector<uint64_t>::size_type i = 0; i != keyVector.size(); i++) {
+     memcpy(&keyList[i], &keyVector[i], sizeof(uint64_t));
+  }
+
+  log_trace_out("%s", __func__);
+  return keyList;
+}
+
+/*
+ *** PageCacheImpl::evictEpoch() ***
+ *  the current eviction epoch, it advances every quarter of the LRU
+ *  buffer worth of pages written to externram
+ **********************************************
+ */
+int PageCacheImpl::evictEpoch() {
+  uint64_t epoch_pages = 1;
+
+  if( lruBuffer && lruBuffer->getMaxSize()>=REFAULT_EPOCHS_PER_BUFFER )
+    epoch_pages = lruBuffer->getMaxSize() / REFAULT_EPOCHS_PER_BUFFER;
+  return (int)((evictions / epoch_pages) & (PAGE_STATE_EVICT_EPOCH >> PAGE_STATE_EVICT_EPOCH_SHIFT));
+}
+
+/*
+ *** PageCacheImpl::countRefault() ***
+ *  called on a fault of a page before it is read. Counts the fault if the
+ *  page was evicted within the last REFAULT_WINDOW_EPOCHS, otherwise
+ *  starts the count over. Returns the count, 0 if the page was not evicted
+ **********************************************
+ */
+int PageCacheImpl::countRefault(uint64_t hashcode, int fd) {
+  log_trace_in("%s", __func__);
+
+  uint16_t * state = findPageState( hashcode, fd );
+  int refaults = 0;
+  int age;
+
+  if( state && ( pageOwnership(*state)==OWNERSHIP_EXTERNRAM || pageOwnership(*state)==OWNERSHIP_PAGE_CACHE ))
+  {
+    // the epoch wraps every 16 epochs, so a page out for longer than that
+    // may be taken for a recent one. That only costs a spurious count
+    age = (evictEpoch() - pageEvictEpoch(*state)) &
+          (PAGE_STATE_EVICT_EPOCH >> PAGE_STATE_EVICT_EPOCH_SHIFT);
+    if( age<REFAULT_WINDOW_EPOCHS )
+      refaults = std::min(pageRefaults(*state) + 1, MAX_REFAULTS);
+    setPageRefaults( state, refaults );
+    log_debug("%s: page %lx fd %d refaulted %d epochs after eviction, count %d", __func__, hashcode, fd, age, refaults);
+  }
+
+  log_trace_out("%s", __func__);
+  return refaults;
+}
+
+/*
+ *** PageCacheImpl::storeVictimPages() ***
+ *  keeps clean copies of pages that were just written to externram, so
+ *  that a fault soon after is served locally. Only pages that are still
+ *  evicted are kept. The least recently stored copy beyond
+ *  victim_cache_size is dropped, externram has the page
+ **********************************************
+ */
+void PageCacheImpl::storeVictimPages(uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths)
+{
+  log_trace_in("%s", __func__);
+
+  for( int i=0; i<num_pages && victim_cache_size>0; i++ )
+  {
+    if( bufs[i]==NULL || lengths[i]!=PAGE_SIZE )
+      continue;
+
+    uint16_t * state = findPageState( hashcodes[i], fd );
+    if( !state || pageOwnership(*state)!=OWNERSHIP_EXTERNRAM || pageIsZero(*state) || pageInFlight(*state)!=0 )
+      continue;
+
+    page_cache_node node;
+    node.hashcode = hashcodes[i];
+    node.fd = fd;
+    node.address = malloc( PAGE_SIZE );
+    node.size = PAGE_SIZE;
+    if( node.address==NULL )
+      break;
+    memcpy( node.address, bufs[i], PAGE_SIZE );
+
+    victimCache.insert( node );
+    changeOwnershipWithState( state, OWNERSHIP_PAGE_CACHE );
+    log_debug("%s: Keeping a clean copy of page %lx fd %d", __func__, hashcodes[i], fd);
+
+    if( victimCache.isSizeExceeded() )
+      popVictim();
+  }
+
+  log_trace_out("%s", __func__);
+}
+
+void PageCacheImpl::popVictim()
+{
+  page_cache_node node = victimCache.back();
+
+  // clean, so dropping it only changes where the page is read from
+  free( node.address );
+  victimCache.pop_back();
+  uint16_t * state = findPageState( node.hashcode, node.fd );
+  if( state && pageOwnership(*state)==OWNERSHIP_PAGE_CACHE &&
+      pageCache.find( node.hashcode, node.fd )==pageCache.findEnd() )
+    changeOwnershipWithState( state, OWNERSHIP_EXTERNRAM );
+}
+
+/*
+ *** PageCacheImpl::markZeroPage() ***
+ *  records that a zero page of the application was parked off the LRU
+ *  buffer without a write to externram, or that it is back on it
+ **********************************************
+ */
+void PageCacheImpl::markZeroPage(uint64_t hashcode, int fd, bool parked) {
+  log_trace_in("%s", __func__);
+
+  uint16_t * state = findPageState( hashcode, fd );
+  if( state && pageOwnership(*state)==OWNERSHIP_APPLICATION )
+    changeOwnershipWithState( state, OWNERSHIP_APPLICATION, parked );
+
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** PageCacheImpl::setPageWriting() ***
+ *  marks a page of the application in flight while it is taken out of fd
+ *  and written to externram without the page cache lock held, or clears
+ *  the mark once the write has been recorded
+ **********************************************
+ */
+void PageCacheImpl::setPageWriting(uint64_t hashcode, int fd, bool writing) {
+  log_trace_in("%s", __func__);
+
+  uint16_t * state = findPageState( hashcode, fd );
+  if( state && writing && pageOwnership(*state)==OWNERSHIP_APPLICATION )
+    setPageInFlight( state, PAGE_WRITE_IN_FLIGHT );
+  else if( state && !writing && pageInFlight(*state)==PAGE_WRITE_IN_FLIGHT )
+    setPageInFlight( state, 0 );
+
+  log_trace_out("%s", __func__);
+}
+
+/*
+ *** PageCacheImpl::isPageWriting() ***
+ *  whether a page is marked in flight by setPageWriting()
+ **********************************************
+ */
+bool PageCacheImpl::isPageWriting(uint64_t hashcode, int fd) {
+  uint16_t * state = findPageState( hashcode, fd );
+
+  return state && pageInFlight(*state)==PAGE_WRITE_IN_FLIGHT;
+}
+
+/*
+ *** PageCacheImpl::removeUFDFromPageCache() ***
+ *  frees up to max_pages cached pages of fd, or all of them if max_pages
+ *  is 0. The prefetch state of fd is dropped with its first batch
+ **********************************************
+ */
+void PageCacheImpl::removeUFDFromPageCache(int fd, int max_pages, int * numPages) {
+  log_trace_in("%s", __func__);
+
+  prefetch_stream_map::iterator sitr = prefetchStreams.find(fd);
+  if( sitr!=prefetchStreams.end() )
+  {
+#ifndef THREADED_PREFETCH
+    // land the batches still in flight so their pages are released below
+    for( int c=0; c<sitr->second.channels; c++ )
+    {
+      if( sitr->second.batches[c].num>0 )
+        completePrefetchBatch( fd, sitr->second, c );
+    }
+#endif
+    prefetchStreams.erase(sitr);
+    for( access_stream_map::iterator aitr = accessStreams.begin(); aitr!=accessStreams.end(); )
+    {
+      if( (int)(uint32_t)aitr->first == fd )
+        aitr = accessStreams.erase(aitr);
+      else
+        aitr++;
+    }
+  }
+
+  *numPages = pageCache.eraseFd(fd, max_pages);
+  if( max_pages==0 || *numPages<max_pages )
+    *numPages += victimCache.eraseFd(fd, max_pages==0 ? 0 : max_pages - *numPages);
+  log_debug("%s: freed %d page cache entries of ufd %d", __func__, *numPages, fd);
 
   log_trace_out("%s", __func__);
 }
@@ -32,8 +32,21 @@
 using namespace boost::multi_index;
 
 int page_cache_size = 1000;
+int victim_cache_size = 0;  // clean copies of pages written to externram, 0 disables
 int prefetch_size = 10;
 int enable_prefetch = 0;
+int max_prefetch_size = MAX_MULTI_READ - 1;
+int prefetch_latency_budget = 2000; // usec allowed for one prefetch multiread
+int prefetch_depth = 2; // prefetch multireads in flight per ufd without THREADED_PREFETCH
+
+#define MAX_PREFETCH_DEPTH 8
+
+// The prefetch window of each ufd starts at prefetch_size and is adjusted
+// every PREFETCH_ACCURACY_EPOCH resolved prefetches (used or evicted unused)
+#define PREFETCH_ACCURACY_EPOCH   16
+#define PREFETCH_GROW_ACCURACY    75 // percent of prefetched pages used
+#define PREFETCH_SHRINK_ACCURACY  40
+#define PREFETCH_LATENCY_WEIGHT   0.125
 
 typedef struct page_cache_node
 {
@@ -43,6 +56,7 @@ typedef struct page_cache_node
     int size;
 
     struct ByHashcodeAndFd {};
+    struct ByFd {};
     struct AddressChange : public std::unary_function<page_cache_node,void> {
         void * p; AddressChange(void * &_p) : p(_p) {}
         void operator()(page_cache_node & r) { r.address = p; }
@@ -64,18 +78,24 @@ typedef multi_index_container<
         member<page_cache_node, uint64_t, &page_cache_node::hashcode>,
         member<page_cache_node, int, &page_cache_node::fd>
       >
+    >,
+    hashed_non_unique<
+      tag<page_cache_node::ByFd>,
+      member<page_cache_node, int, &page_cache_node::fd>
     >
   >
 > page_item_list;
 
 typedef page_item_list::iterator iterator;
 typedef page_item_list::index<page_cache_node::ByHashcodeAndFd>::type List;
+typedef page_item_list::index<page_cache_node::ByFd>::type FdList;
 
 class page_cache_lru_list
 {
 public:
 
   page_cache_lru_list():max_num_items(page_cache_size){}
+  page_cache_lru_list(int size):max_num_items(size){}
 
   void insert(const page_cache_node& item)
   {
@@ -137,6 +157,19 @@ public:
   }
   int getSize() {return il.size();}
 
+  // remove up to max_nodes nodes of fd (all if max_nodes is 0), freeing
+  // their pages. Only the nodes of fd are visited
+  int eraseFd( int fd, int max_nodes ) {
+    FdList & index = il.get<page_cache_node::ByFd>();
+    std::pair<FdList::iterator,FdList::iterator> range = index.equal_range(fd);
+    int num = 0;
+    for( FdList::iterator it = range.first; it!=range.second && (max_nodes==0 || num<max_nodes); num++ ) {
+      free( it->address );
+      it = index.erase(it);
+    }
+    return num;
+  }
+
 private:
   page_item_list il;
   std::size_t max_num_items;
@@ -158,27 +191,119 @@ struct null_deleter
 #define OWNERSHIP_PAGE_CACHE  2
 #define OWNERSHIP_EXTERNRAM   3
 
+// page state bits. Ownership 0 means the page is not tracked
+#define PAGE_STATE_OWNERSHIP        0x0003
+#define PAGE_STATE_ZEROPAGE         0x0004 // valid only when the page is stored
+                                           // in externram (OWNERSHIP_EXTERNRAM),
+                                           // or for OWNERSHIP_APPLICATION a zero
+                                           // page parked off the LRU buffer
+#define PAGE_STATE_IN_FLIGHT        0x00f0 // read channel + 1 of the prefetch batch
+#define PAGE_STATE_IN_FLIGHT_SHIFT  4      // reading this page, 0 if none
+#define PAGE_WRITE_IN_FLIGHT        (PAGE_STATE_IN_FLIGHT >> PAGE_STATE_IN_FLIGHT_SHIFT)
+                                           // in flight value of a page being
+                                           // written to externram, above any
+                                           // read channel + 1
+#define PAGE_STATE_REFAULTS         0x0f00 // saturating count of faults that
+#define PAGE_STATE_REFAULTS_SHIFT   8      // came soon after an eviction
+#define PAGE_STATE_EVICT_EPOCH      0xf000 // eviction epoch (mod 16) the page
+#define PAGE_STATE_EVICT_EPOCH_SHIFT 12    // was last written out in
+
+// An eviction epoch is a quarter of the LRU buffer worth of pages written
+// to externram. A fault within REFAULT_WINDOW_EPOCHS of the eviction of the
+// page would have been a hit in a buffer twice the size
+#define REFAULT_EPOCHS_PER_BUFFER   4
+#define REFAULT_WINDOW_EPOCHS       4
+#define MAX_REFAULTS                (PAGE_STATE_REFAULTS >> PAGE_STATE_REFAULTS_SHIFT)
+
+#define PAGE_STATE_WINDOW_SHIFT     30     // 1GB of address space per state array
+#define PAGE_STATE_WINDOW_PAGES     (1UL << (PAGE_STATE_WINDOW_SHIFT - PAGE_SHIFT))
+
 class PageCacheImpl: public PageCache
 {
 private:
-    class PageInfo {
-public:
-      int ref_count;
-      int ownership;
-      int is_zeropage; // valid only when the page is stored
-                       // in externram (ownership is OWNERSHIP_EXTERNRAM)
+    // The state of each page is 16 bits in an array covering a window of
+    // address space of one fd. Arrays are allocated as pages of a window
+    // are first seen, so they grow with the regions registered by the fd.
+    typedef boost::unordered_map<uint64_t, uint16_t *> page_state_windows;
+    struct page_state_table {
+      page_state_windows windows;   // state arrays indexed by window number
+      uint64_t last_window;         // the most recently used window
+      uint16_t * last_states;
+      page_state_table():last_window(0),last_states(NULL){}
+    };
+    typedef boost::unordered_map<int, page_state_table> page_state_map;
+    page_state_map pageStates;
+
+    static int  pageOwnership( uint16_t state ) {return state & PAGE_STATE_OWNERSHIP;}
+    static bool pageIsZero( uint16_t state ) {return state & PAGE_STATE_ZEROPAGE;}
+    static int  pageInFlight( uint16_t state ) {return (state & PAGE_STATE_IN_FLIGHT) >> PAGE_STATE_IN_FLIGHT_SHIFT;}
+    static void setPageOwnership( uint16_t * state, int ownership, bool is_zeropage )
+    {
+      *state = (*state & ~(PAGE_STATE_OWNERSHIP | PAGE_STATE_ZEROPAGE)) |
+               ownership | (is_zeropage ? PAGE_STATE_ZEROPAGE : 0);
+    }
+    static void setPageInFlight( uint16_t * state, int channel )
+    {
+      *state = (*state & ~PAGE_STATE_IN_FLIGHT) | (channel << PAGE_STATE_IN_FLIGHT_SHIFT);
+    }
+    static int  pageRefaults( uint16_t state ) {return (state & PAGE_STATE_REFAULTS) >> PAGE_STATE_REFAULTS_SHIFT;}
+    static int  pageEvictEpoch( uint16_t state ) {return (state & PAGE_STATE_EVICT_EPOCH) >> PAGE_STATE_EVICT_EPOCH_SHIFT;}
+    static void setPageRefaults( uint16_t * state, int refaults )
+    {
+      *state = (*state & ~PAGE_STATE_REFAULTS) | (refaults << PAGE_STATE_REFAULTS_SHIFT);
+    }
+    static void setPageEvictEpoch( uint16_t * state, int epoch )
+    {
+      *state = (*state & ~PAGE_STATE_EVICT_EPOCH) |
+               ((epoch << PAGE_STATE_EVICT_EPOCH_SHIFT) & PAGE_STATE_EVICT_EPOCH);
+    }
+
+    uint64_t    evictions;      // pages written to externram, for the epochs
+    int         evictEpoch();
+
+    uint16_t *  getPageState( uint64_t hashcode, int fd );
+    uint16_t *  findPageState( uint64_t hashcode, int fd );
+
+    // sequential access detection of one faulting thread of a ufd. With
+    // UFFD_FEATURE_THREAD_ID each vCPU is tracked on its own, so
+    // interleaved faults do not break each other's runs
+    struct access_stream {
+      uint64_t prevAddr;   // previously accessed address
+      int numConseqAcc;    // number of consequtive accesses
     };
+    // keyed by ptid in the upper and fd in the lower 32 bits
+    typedef boost::unordered_map<uint64_t, access_stream> access_stream_map;
+    access_stream_map accessStreams;
 
-    // hash structure that holds map of PageInfo indexed by hash key
-    typedef boost::unordered_map<std::string, boost::shared_ptr<PageInfo> > page_hash;
-    page_hash pagehash;
+    // prefetch window and accuracy of one ufd
+    struct prefetch_stream {
+      int numConseqAcc;    // consequtive accesses of the thread that faulted last
+      int window;          // maximum number of pages to prefetch
+      int hits;            // prefetched pages used since the last adjustment
+      int unused;          // prefetched pages evicted without being used
+      double batch_usec;   // moving average of multiread latency
+      double batch_pages;  // moving average of pages per multiread
+#ifndef THREADED_PREFETCH
+      int channels;        // read channels opened, -1 before the first batch
+      uint64_t issued;     // batches sent so far
+      // asynchronous multireads, one per read channel. num is 0 when idle
+      struct prefetch_batch {
+        int num;
+        uint64_t seq;      // value of issued when the batch was sent
+        uint64_t keys[MAX_MULTI_READ];
+        void * bufs[MAX_MULTI_READ];
+        int lengths[MAX_MULTI_READ];
+      } batches[MAX_PREFETCH_DEPTH];
+#endif
+    };
+    typedef boost::unordered_map<int, prefetch_stream> prefetch_stream_map;
+    prefetch_stream_map prefetchStreams;
 
     page_cache_lru_list pageCache;
+    // clean copies of pages after their write to externram, which keeps
+    // the authoritative copy. Their ownership is OWNERSHIP_PAGE_CACHE
+    page_cache_lru_list victimCache;
 
-    uint64_t keys_for_mread[MAX_MULTI_READ];
-    void * bufs_for_mread[MAX_MULTI_READ];
-    int lengths_for_mread[MAX_MULTI_READ];
-    int numPrefetch;
     uint64_t g_start;
     uint64_t g_end;
 
@@ -186,25 +311,46 @@ public:
     void        referencePageCachedNode(uint64_t key,int fd);
     uint64_t    popLRU(void);
     int         isLRUSizeExceeded(void);
+    void        popVictim(void);
 
     void        addPageHashNode( uint64_t hashcode, int fd, int ownership );
     void        changeOwnership( uint64_t hashcode, int fd, int ownership, bool is_zeropage );
-    void        changeOwnershipWithItr( page_hash::iterator itr, int ownership, bool is_zeropage );
+    void        changeOwnershipWithState( uint16_t * state, int ownership, bool is_zeropage );
 
     void        storePageInPageCache(uint64_t hashcode, int fd, void * buf, int length);
     void        storePagesInPageCache(uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths);
+
+    prefetch_stream & getPrefetchStream( int fd );
+    access_stream & getAccessStream( int fd, uint32_t ptid );
+    int         getPrefetchWindow( prefetch_stream & stream );
+    void        resolvePrefetch( int fd, bool used );
+#ifndef THREADED_PREFETCH
+    void        issuePrefetchBatch( uint64_t hashcode, int fd, prefetch_stream & stream );
+    void        completePrefetchBatch( int fd, prefetch_stream & stream, int channel );
+    void        completePrefetchBatches( uint64_t hashcode, int fd, prefetch_stream & stream );
+#endif
 public:
     virtual ~PageCacheImpl();
     PageCacheImpl();
     void cleanup();
 
-    virtual int  readPageIfInPageCache( uint64_t hashcode, int fd, void ** buf );
-    virtual void  readPageIfInPageCache_top( uint64_t hashcode, int fd, void ** buf );
+    virtual int  readPageIfInPageCache( uint64_t hashcode, int fd, void ** buf, uint32_t ptid );
+    virtual void  readPageIfInPageCache_top( uint64_t hashcode, int fd, void ** buf, uint32_t ptid );
     virtual int  readPageIfInPageCache_bottom( uint64_t hashcode, int fd, void ** buf );
     virtual void updatePageCacheAfterWrite( uint64_t hashcode, int fd, bool zeroPage );
     virtual void updatePageCacheAfterSkippedRead( uint64_t hashcode, int fd);
     virtual void invalidatePageCache( uint64_t hashcode, int fd );
-    virtual void removeUFDFromPageCache( int fd, int * numPages );
-    virtual uint64_t * removeUFDFromPageHash( int fd, int * numPages );
+    virtual void updatePrefetchLatency( int fd, int num_pages, uint64_t usec );
+    virtual void removeUFDFromPageCache( int fd, int max_pages, int * numPages );
+    virtual void * detachUFDFromPageHash( int fd );
+    virtual uint64_t * removeDetachedPageHash( void * detached, int * numPages );
+    virtual uint64_t * listExternRAMPages( int fd, uint64_t start, uint64_t end, int * numPages );
+    virtual bool claimRestoredPage( uint64_t hashcode, int fd );
+    virtual int  countRefault( uint64_t hashcode, int fd );
+    virtual void markZeroPage( uint64_t hashcode, int fd, bool parked );
+    virtual void setPageWriting( uint64_t hashcode, int fd, bool writing );
+    virtual bool isPageWriting( uint64_t hashcode, int fd );
+    virtual void storeVictimPages( uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths );
+    virtual uint64_t * discardPageRange( int fd, uint64_t start, uint64_t end, int * numPages );
 };
 #endif
@@ -22,14 +22,14 @@ extern "C" {
     return pageCache;
   }
 
-  int readPageIfInPageCache( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf )
+  int readPageIfInPageCache( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf, uint32_t ptid )
   {
-    return pageCache->readPageIfInPageCache( hashcode, ufd, buf );
+    return pageCache->readPageIfInPageCache( hashcode, ufd, buf, ptid );
   }
 #ifdef ASYNREAD
-  void readPageIfInPageCache_top( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf )
+  void readPageIfInPageCache_top( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf, uint32_t ptid )
   {
-    pageCache->readPageIfInPageCache_top( hashcode, ufd, buf );
+    pageCache->readPageIfInPageCache_top( hashcode, ufd, buf, ptid );
   }
   int readPageIfInPageCache_bottom( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf )
   {
@@ -64,12 +64,55 @@ extern "C" {
   {
     pageCache->storePagesInPageCache( hashcodes, fd, num_pages, bufs, lengths);
   }
-  void removeUFDFromPageCache( PageCache * pageCache, int fd, int * numPages )
+  void updatePrefetchLatency( PageCache * pageCache, int fd, int num_pages, uint64_t usec )
   {
-    pageCache->removeUFDFromPageCache( fd, numPages);
+    pageCache->updatePrefetchLatency( fd, num_pages, usec );
   }
-  uint64_t * removeUFDFromPageHash( PageCache * pageCache, int fd, int * numPages )
+  void removeUFDFromPageCache( PageCache * pageCache, int fd, int max_pages, int * numPages )
   {
-    pageCache->removeUFDFromPageHash( fd, numPages);
+    pageCache->removeUFDFromPageCache( fd, max_pages, numPages);
+  }
+  void * detachUFDFromPageHash( PageCache * pageCache, int fd )
+  {
+    return pageCache->detachUFDFromPageHash( fd );
+  }
+  uint64_t * removeDetachedPageHash( PageCache * pageCache, void * detached, int * numPages )
+  {
+    return pageCache->removeDetachedPageHash( detached, numPages );
+  }
+  uint64_t * listExternRAMPages( PageCache * pageCache, int fd, uint64_t start, uint64_t end, int * numPages )
+  {
+    return pageCache->listExternRAMPages( fd, start, end, numPages );
+  }
+  bool claimRestoredPage( PageCache * pageCache, int fd, uint64_t hashcode )
+  {
+    return pageCache->claimRestoredPage( hashcode, fd );
+  }
+
+  int countRefault( PageCache * pageCache, int fd, uint64_t hashcode )
+  {
+    return pageCache->countRefault( hashcode, fd );
+  }
+
+  void markZeroPage( PageCache * pageCache, int fd, uint64_t hashcode, bool parked )
+  {
+    pageCache->markZeroPage( hashcode, fd, parked );
+  }
+  void setPageWriting( PageCache * pageCache, int fd, uint64_t hashcode, bool writing )
+  {
+    pageCache->setPageWriting( hashcode, fd, writing );
+  }
+  bool isPageWriting( PageCache * pageCache, int fd, uint64_t hashcode )
+  {
+    return pageCache->isPageWriting( hashcode, fd );
+  }
+
+  void storeVictimPages( PageCache * pageCache, uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths)
+  {
+    pageCache->storeVictimPages( hashcodes, fd, num_pages, bufs, lengths );
+  }
+  uint64_t * discardPageRange( PageCache * pageCache, int fd, uint64_t start, uint64_t end, int * numPages )
+  {
+    return pageCache->discardPageRange( fd, start, end, numPages );
   }
 }
@@ -26,9 +26,9 @@ extern "C" {
 typedef struct PageCache PageCache;
 PageCache* newPageCache(struct LRUBuffer *lru);
 
-int readPageIfInPageCache( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf );
+int readPageIfInPageCache( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf, uint32_t ptid );
 #ifdef ASYNREAD
-void readPageIfInPageCache_top( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf );
+void readPageIfInPageCache_top( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf, uint32_t ptid );
 int readPageIfInPageCache_bottom( PageCache * pageCache, int ufd, uint64_t hashcode, void** buf );
 #endif
 void updatePageCacheAfterWrite( PageCache * pageCache, int ufd, uint64_t hashcode);
@@ -38,8 +38,18 @@ void invalidatePageCache( PageCache * pageCache, int ufd, uint64_t hashcode );
 void addPageHashNode( uint64_t hashcode, int fd, int ownership );
 void pageCacheCleanup();
 void storePagesInPageCache( PageCache * pageCache, uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths);
-void removeUFDFromPageCache( PageCache * pageCache, int fd, int * numPages );
-uint64_t * removeUFDFromPageHash( PageCache * pageCache, int fd, int * numPages );
+void updatePrefetchLatency( PageCache * pageCache, int fd, int num_pages, uint64_t usec );
+void removeUFDFromPageCache( PageCache * pageCache, int fd, int max_pages, int * numPages );
+void * detachUFDFromPageHash( PageCache * pageCache, int fd );
+uint64_t * removeDetachedPageHash( PageCache * pageCache, void * detached, int * numPages );
+uint64_t * listExternRAMPages( PageCache * pageCache, int fd, uint64_t start, uint64_t end, int * numPages );
+bool claimRestoredPage( PageCache * pageCache, int fd, uint64_t hashcode );
+int countRefault( PageCache * pageCache, int fd, uint64_t hashcode );
+void markZeroPage( PageCache * pageCache, int fd, uint64_t hashcode, bool parked );
+void setPageWriting( PageCache * pageCache, int fd, uint64_t hashcode, bool writing );
+bool isPageWriting( PageCache * pageCache, int fd, uint64_t hashcode );
+void storeVictimPages( PageCache * pageCache, uint64_t * hashcodes, int fd, int num_pages, char ** bufs, int * lengths);
+uint64_t * discardPageRange( PageCache * pageCache, int fd, uint64_t start, uint64_t end, int * numPages );
 
 #ifdef __cplusplus
 }
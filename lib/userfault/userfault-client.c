@@ -12,8 +12,11 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/user.h> /* for PAGE_SIZE */
+#include <netinet/in.h>
+#include <arpa/inet.h>
 
 #define MAX_PENDING 100
+#define UI_PORT 5001 /* port of the monitor's ui_processing_thread */
 
 /* for sending unix domain sockets */
 /* http://www.thomasstover.com/uds.html */
@@ -53,6 +56,72 @@ int send_fd(int socket, int fd_to_send) {
   return sendmsg(socket, &socket_message, 0);
 }
 
+/* sends a command to the ui of the monitor at monitor_addr and reads its reply */
+static int ui_request(char * monitor_addr, char * command, int len, char * reply, int size) {
+  struct sockaddr_in serv_addr;
+  int sockfd, n = -1;
+
+  sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sockfd < 0) {
+    log_err("%s: could not create socket", __func__);
+    return -1;
+  }
+
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_port = htons(UI_PORT);
+  if (inet_pton(AF_INET, monitor_addr, &serv_addr.sin_addr) <= 0 ||
+      connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    log_err("%s: could not connect to monitor at %s", __func__, monitor_addr);
+    close(sockfd);
+    return -1;
+  }
+
+  if (write(sockfd, command, len) != len) {
+    log_err("%s: write failed", __func__);
+  }
+  else if ((n = read(sockfd, reply, size - 1)) > 0) {
+    reply[n] = '\0';
+  }
+
+  close(sockfd);
+  return n;
+}
+
+int request_restore(char * monitor_addr, pid_t pid, uint64_t start, uint64_t end) {
+  char command[128], reply[256];
+  int len, restored = -1;
+
+  if (end)
+    len = snprintf(command, sizeof(command), "restore %d %lx:%lx\n", (int)pid, start, end);
+  else
+    len = snprintf(command, sizeof(command), "restore %d\n", (int)pid);
+
+  if (ui_request(monitor_addr, command, len, reply, sizeof(reply)) > 0 &&
+      sscanf(reply, "restored %d pages", &restored) != 1)
+    log_err("%s: %s", __func__, reply);
+
+  return restored;
+}
+
+int request_idle_exempt(char * monitor_addr, pid_t pid, bool exempt) {
+  char command[64], reply[256];
+  int len, ret = -1;
+  unsigned int replied_pid;
+  int replied_exempt;
+
+  len = snprintf(command, sizeof(command), "idle %d:%d\n", (int)pid, exempt ? 1 : 0);
+
+  if (ui_request(monitor_addr, command, len, reply, sizeof(reply)) > 0) {
+    if (sscanf(reply, "pid %u: exempt %d", &replied_pid, &replied_exempt) == 2)
+      ret = 0;
+    else
+      log_err("%s: %s", __func__, reply);
+  }
+
+  return ret;
+}
+
 int connect_monitor(char * socket_path) {
   int socket_fd;
   struct sockaddr_un address;
@@ -88,16 +157,32 @@ bool ufd_version_check(int ufd)
 {
   struct uffdio_api api_struct;
   uint64_t ioctl_mask;
+  __u64 features = UFFD_FEATURE_EVENT_FORK |
+                   UFFD_FEATURE_EVENT_REMAP |
+                   UFFD_FEATURE_EVENT_REMOVE |
+                   UFFD_FEATURE_EVENT_UNMAP;
 
   api_struct.api = UFFD_API;
-  api_struct.features = UFFD_FEATURE_EVENT_FORK |
-                        UFFD_FEATURE_EVENT_REMAP |
-                        UFFD_FEATURE_EVENT_REMOVE |
-                        UFFD_FEATURE_EVENT_UNMAP;
+  api_struct.features = features;
+#ifdef UFFD_FEATURE_THREAD_ID
+  /* lets the monitor tell apart the faults of each vCPU */
+  api_struct.features |= UFFD_FEATURE_THREAD_ID;
+  if (ioctl(ufd, UFFDIO_API, &api_struct)) {
+      log_warn("%s: UFFD_FEATURE_THREAD_ID not supported, faults will not carry a thread id", __func__);
+      /* a failed UFFDIO_API clears api_struct, so ask again from scratch */
+      api_struct.api = UFFD_API;
+      api_struct.features = features;
+      if (ioctl(ufd, UFFDIO_API, &api_struct)) {
+          log_err("%s: UFFDIO_API failed", __func__);
+          return false;
+      }
+  }
+#else
   if (ioctl(ufd, UFFDIO_API, &api_struct)) {
       log_err("%s: UFFDIO_API failed", __func__);
       return false;
   }
+#endif
 
   if (api_struct.api != UFFD_API) {
       log_err("%s: Result of looking up UFFDIO_API does not match: %Lu\n", __func__, api_struct.api);
@@ -17,6 +17,7 @@
 #include <linux/userfaultfd.h>
 #include <stdint.h>      /* for uint64_t */
 #include <stdbool.h>
+#include <sys/types.h>    /* for pid_t */
 
 /* Client API for sending FD's */
 char * get_home_socket_path(void);
@@ -24,6 +25,17 @@ int connect_monitor(char * socket_path);
 int send_fd(int socket, int fd_to_send);
 void * allocate_userfault(int *ufd, uint64_t size);
 
+/* Ask the monitor at monitor_addr (its ui address) to read the pages of pid
+ * in [start, end) back from externram ahead of their faults, all of them if
+ * end is 0. Returns the number of pages restored, or -1
+ */
+int request_restore(char * monitor_addr, pid_t pid, uint64_t start, uint64_t end);
+
+/* Ask the monitor at monitor_addr to never swap pid out when it stops
+ * faulting (exempt true), or to do so again. Returns 0, or -1
+ */
+int request_idle_exempt(char * monitor_addr, pid_t pid, bool exempt);
+
 /* internal implementation functions */
 int ufd_syscall(void);
 
@@ -32,8 +32,13 @@
 #include <string.h>      /* for __func__ */
 #include <fcntl.h>
 #include <stdlib.h>
+#include <time.h>        /* for clock_gettime */
+#include <sys/uio.h>     /* for process_vm_readv */
 #include <linux/un.h>
 #include <bits/socket.h>
+#if defined(__x86_64__)
+#include <immintrin.h>   /* for the zero page checks */
+#endif
 
 #include <LRUBufferWrapper.h>
 #include <PageCacheWrapper.h>
@@ -55,14 +60,263 @@ struct LRUBuffer *lru;
 #ifdef PAGECACHE
 struct PageCache * pageCache;
 extern int prefetch_size;
+extern int victim_cache_size;
 #endif
 #define MAX_PENDING 100
+#define MAX_UFDS_PER_PID 16
 
 pthread_mutex_t lru_lock;
 #ifdef PAGECACHE
 pthread_mutex_t pagecache_lock;
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+// signalled with pagecache_lock when pages marked as being written are in externRAM
+pthread_cond_t pagecache_written_cond;
+#endif
+#endif
+#ifdef THREADED_PREFETCH
+// number of prefetch_thread workers, each with its own read channel
+int prefetch_workers = 2;
+#endif
+
+// fault counts per ufd and faulting thread
+typedef struct thread_faults_entry {
+  UT_hash_handle hh;
+  uint64_t key;      // ptid in the upper, ufd in the lower 32 bits
+  thread_faults stats;
+} thread_faults_entry;
+thread_faults_entry * threadFaultsMap = NULL;
+pthread_mutex_t thread_faults_lock;
+
+// last fault of each ufd, to find the idle ones. Protected by thread_faults_lock
+typedef struct ufd_activity {
+  UT_hash_handle hh;
+  int ufd;
+  struct timespec last_fault;
+  bool exempt;        // never swapped out when idle
+  bool idle;          // being swapped out
+  bool swapped;       // some pages were swapped out since it went idle
+} ufd_activity;
+ufd_activity * ufdActivity = NULL;
+
+// swapping out of ufds that have not faulted for a while
+int idle_timeout = 0;         // s without a fault before a ufd is swapped out, 0 disables
+int idle_swapout_rate = 1024; // pages per second written out of idle ufds
+
+// protection of pages that keep faulting back in soon after eviction
+int hot_refaults = 3;         // quick refaults before a page is protected, 0 disables
+
+// page_idle sampling of the pages next in line for eviction
+int page_idle_interval = 0;   // ms between samples, 0 disables the sampler
+int page_idle_sample = 4096;  // pages checked per sample
+
+// the sampled pages marked idle by the last sample, only used by page_idle_thread
+typedef struct idle_page {
+  UT_hash_handle hh;
+  info_key_t key;     // page address and ufd
+  uint64_t pfn;       // pfn that was marked idle
+  int pass;           // sample that marked it
+} idle_page;
+idle_page * idlePages = NULL;
+
+// moving of LRU buffer share between ufds by their faults on evicted pages
+int rebalance_interval = 0;   // ms between moves, 0 disables rebalancing
+int rebalance_pages = 0;      // pages moved at a time, 0 for 1% of cache_size
+extern int cache_size;
+extern int lru_policy;
+
+// sizing of the LRU buffer by host memory pressure
+int autosize_interval = 0;    // ms between adjustments, 0 keeps cache_size fixed
+int autosize_min = 0;         // pages, 0 for cache_size / 4
+int autosize_max = 0;         // pages, 0 for cache_size
+int autosize_step = 0;        // pages per adjustment, 0 for 1% of autosize_max
+int autosize_psi = 10;        // shrink above this % of time stalled on memory (some avg10)
+int autosize_low_mb = 1024;   // shrink below this much MemAvailable
+int autosize_high_mb = 0;     // grow above this much MemAvailable, 0 for 2 * autosize_low_mb
+
+// draining of the pages above the LRU buffer capacity after a shrink
+sem_t resize_sem;
+#define RESIZE_BATCH_PAGES 256        // pages popped per hold of lru_lock
+
+// flushing of the resident pages of a ufd to externRAM
+int flush_workers = 4;        // writers in parallel, each with its own write channel
+
+typedef struct flush_slice {
+  struct externRAMClient * client;
+  int channel;
+  uint64_t * keys;
+  void ** bufs;
+  int * lengths;
+  int num;
+} flush_slice;
+
+// restoring of the pages of a ufd from externRAM
+int restore_workers = 4;      // readers in parallel, each on its own read channel
+#ifdef PAGECACHE
+#ifndef THREADED_PREFETCH
+extern int prefetch_depth;
+#endif
+
+// the LRU order of the pages of a ufd when it was last flushed, so that a
+// restore can bring the hottest pages back first. Protected by lru_lock
+typedef struct restore_order {
+  UT_hash_handle hh;
+  int ufd;
+  uint64_t * pages;   // most recently used first
+  int num;
+} restore_order;
+restore_order * restoreOrders = NULL;
+
+typedef struct restore_job {
+  int ufd;
+  struct externRAMClient * client;
+  uint64_t * pages;
+  int num;
+  int next;           // next page to be read by a reader
+  int restored;
+} restore_job;
+
+typedef struct restore_reader {
+  restore_job * job;
+  int channel;
+} restore_reader;
 #endif
 
+// writing of cold resident pages to externRAM ahead of their eviction
+int precopy_interval = 0;     // ms between passes, 0 disables precopy
+int precopy_pages = 1024;     // pages next in line for eviction looked at per pass
+
+enum precopy_state {
+  PRECOPY_SEEN,       // among the pages looked at by the last pass
+  PRECOPY_IN_FLIGHT,  // being written by precopy_thread
+  PRECOPY_CLEAN       // externRAM holds a copy with fingerprint
+};
+
+// the resident pages known to precopy, until they leave the LRU buffer.
+// Protected by lru_lock
+typedef struct precopied_page {
+  UT_hash_handle hh;
+  info_key_t key;     // page address and ufd
+  enum precopy_state state;
+  int pass;           // pass that last saw the page
+  uint64_t fingerprint;
+} precopied_page;
+precopied_page * precopiedPages = NULL;
+bool precopy_busy = false;    // a batch is being written
+pthread_cond_t precopy_cond;  // signalled with lru_lock when a batch is written
+
+// zero pages are mapped to the kernel zero page, which UFFDIO_REMAP cannot
+// move. One found on eviction is parked off the LRU buffer instead of being
+// put back on it, and zero_sweep_thread returns it there once the VM has
+// written to it. Protected by lru_lock
+typedef struct zero_page {
+  UT_hash_handle hh;
+  info_key_t key;     // ufd and page address
+} zero_page;
+zero_page * zeroPages = NULL;
+int zero_sweep_interval = 100;  // ms between sweeps of the parked pages, 0 disables parking
+uint64_t zero_pfn = 0;          // pfn of the zero page, 0 until zero_sweep_thread finds it
+
+// other replacement policies run over a sample of the faults, metadata only
+typedef struct shadow_buffer {
+  struct LRUBuffer * lru;
+  shadow_info stats;
+} shadow_buffer;
+shadow_buffer shadows[MAX_SHADOW_POLICIES];
+int num_shadows = 0;
+char * shadow_policies = NULL; // comma separated, e.g. "lru,arc,clock"
+int shadow_sampling = 10;      // 1 in shadow_sampling pages is fed to the shadows
+
+static int shadow_size(int size) {
+  return size / shadow_sampling > 0 ? size / shadow_sampling : 1;
+}
+
+static void create_shadows(void) {
+  char *policies, *policy, *saveptr = NULL;
+
+  if (!shadow_policies || shadow_sampling <= 0)
+    return;
+
+  policies = strdup(shadow_policies);
+  for (policy = strtok_r(policies, ",", &saveptr); policy && num_shadows < MAX_SHADOW_POLICIES;
+       policy = strtok_r(NULL, ",", &saveptr)) {
+    int p;
+    if (strcmp(policy, "arc") == 0)
+      p = LRU_POLICY_ARC;
+    else if (strcmp(policy, "clock") == 0)
+      p = LRU_POLICY_CLOCK;
+    else if (strcmp(policy, "lru") == 0)
+      p = LRU_POLICY_LRU;
+    else {
+      log_warn("%s: unknown shadow policy %s", __func__, policy);
+      continue;
+    }
+
+    shadow_buffer *s = &shadows[num_shadows];
+    memset(s, 0, sizeof(shadow_buffer));
+    s->lru = newShadowLRUBuffer(p, shadow_size(cache_size));
+    strncpy(s->stats.policy, policy, sizeof(s->stats.policy) - 1);
+    s->stats.active = (p == lru_policy);
+    s->stats.size = shadow_size(cache_size);
+    num_shadows++;
+    log_info("%s: shadowing the %s policy with %d pages", __func__, policy, s->stats.size);
+  }
+  free(policies);
+}
+
+/* a page is either always or never sampled, so the shadows see every
+ * reuse of the pages they hold */
+static inline bool shadow_sampled(uint64_t key, int ufd) {
+  return ((((key ^ (uint64_t)ufd) * 0x9E3779B97F4A7C15ULL) >> 40) % shadow_sampling) == 0;
+}
+
+/* the shadow functions below are called with lru_lock held */
+static void feed_shadows(uint64_t key, int ufd) {
+  int i;
+
+  if (num_shadows == 0 || !shadow_sampled(key, ufd))
+    return;
+
+  for (i = 0; i < num_shadows; i++) {
+    shadows[i].stats.faults++;
+    if (isCachedInLRU(shadows[i].lru, key, ufd))
+      shadows[i].stats.hits++;
+    insertCacheNodeAndEvict(shadows[i].lru, key, ufd);
+  }
+}
+
+static void reference_shadows(uint64_t key, int ufd) {
+  int i;
+
+  if (num_shadows == 0 || !shadow_sampled(key, ufd))
+    return;
+
+  for (i = 0; i < num_shadows; i++)
+    referenceCachedNode(shadows[i].lru, key, ufd);
+}
+
+static void resize_shadows(int size) {
+  int i;
+
+  for (i = 0; i < num_shadows; i++) {
+    c_cache_node * node_list = NULL;
+    int excess = getLRUBufferSize(shadows[i].lru) - shadow_size(size);
+
+    setLRUBufferSize(shadows[i].lru, shadow_size(size));
+    shadows[i].stats.size = shadow_size(size);
+    if (excess > 0) {
+      popNLRU(shadows[i].lru, excess, &node_list);
+      free(node_list);
+    }
+  }
+}
+
+static void remove_ufd_from_shadows(int ufd) {
+  int i, num_pages;
+
+  for (i = 0; i < num_shadows; i++)
+    free(removeUFDFromLRU(shadows[i].lru, ufd, 0, &num_pages));
+}
+
 #ifdef THREADED_REINIT
 extern page_buffer_info* buf_readpage;
 extern page_buffer_info* buf_evictpage;
@@ -110,6 +364,9 @@ void *write_into_externram_thread(void * tmp) {
       int isFirst=1;
       HASH_ITER( hh2, write_list, current, tmp )
       {
+        // being written by flush_pages
+        if( current->in_flight )
+          continue;
         if( isFirst==1 )
         {
           ufd = current->key.ufd;
@@ -167,6 +424,22 @@ void *write_into_externram_thread(void * tmp) {
         free_values = writePages(client, keys, numWrite, (void**) bufs, lengths);
         stop_timing(start, end, WRITE_PAGES);
 
+#ifdef PAGECACHE
+        // keep clean copies while the pages are still on the write list, a
+        // fault on one of them waits until they are taken off it below
+        if (free_values && victim_cache_size > 0) {
+          log_lock("%s: locking pagecache_lock", __func__);
+          pthread_mutex_lock(&pagecache_lock);
+          log_lock("%s: locked pagecache_lock", __func__);
+
+          storeVictimPages(pageCache, keys, ufd, numWrite, (char **) bufs, lengths);
+
+          log_lock("%s: unlocking pagecache_lock", __func__);
+          pthread_mutex_unlock(&pagecache_lock);
+          log_lock("%s: unlocked pagecache_lock", __func__);
+        }
+#endif
+
 #ifdef DEBUG
         for( j=0 ; j<numWrite; j++ ) {
           if (lengths[j] < 0)
@@ -242,7 +515,8 @@ void *write_into_externram_thread(void * tmp) {
 #ifdef THREADED_PREFETCH
 void *prefetch_thread(void * tmp) {
   log_trace_in("%s", __func__);
-  setThreadCPUAffinity(CPU_FOR_PREFETCH_THREAD, "prefetch_thread", TID());
+  int channel = (int)(intptr_t) tmp;
+  setThreadCPUAffinity(spreadCPUIndex(CPU_FOR_PREFETCH_THREAD, channel), "prefetch_thread", TID());
 
   declare_timers();
 
@@ -251,93 +525,90 @@ void *prefetch_thread(void * tmp) {
     uint64_t keys[MAX_MULTI_READ];
     void * bufs[MAX_MULTI_READ];
     int lengths[MAX_MULTI_READ];
-    bool toPrefetch = false;
-    int size = 0;
     int numPrefetch = 0;
+    int remaining = 0;
     int ufd = 0;
     int i = 0;
+    bool wakeOther = false;
 
     log_lock("%s: locking list_lock", __func__);
     pthread_mutex_lock(&list_lock);
     log_lock("%s: locked list_lock", __func__);
-    size = get_prefetch_list_size();
-    if( size>0 )
+
+    // demand faults go first: don't put another batch on the wire while one is pending
+    while( demand_reads_pending>0 )
     {
-      prefetch_info *current, *tmp;
-      int isFirst=1;
-      HASH_ITER( hh3, prefetch_list, current, tmp )
-      {
-        if( isFirst==1 )
-        {
-          ufd = current->key.ufd;
-          isFirst = 0;
-        }
-        if( current->key.ufd == ufd && numPrefetch<MAX_MULTI_READ ) // we can do multiread for only one ufd
-        {
-          keys[numPrefetch] = *((uint64_t*)current->key.pageaddr);
-          numPrefetch++;
-          log_debug("%s: prepared info to fetch page %p. prefetch_list_size : %d", __func__, *((uint64_t*)current->key.pageaddr), size );
-        }
-      }
-      toPrefetch = true;
-      isPrefetcherWaiting = false;
+      log_lock("%s: waiting on demand_reads_cond", __func__);
+      pthread_cond_wait(&demand_reads_cond, &list_lock);
+      log_lock("%s: waited on demand_reads_cond", __func__);
+    }
+
+    numPrefetch = take_prefetch_batch( keys, &ufd, MAX_MULTI_READ, &remaining );
+    if( numPrefetch>0 )
+    {
+      // let another worker start on what is left while this batch is read
+      if( remaining>0 )
+        wakeOther = claim_waiting_prefetcher();
     }
     else {
       // nothing on prefetch_list
-      isPrefetcherWaiting = true;
+      numPrefetchersWaiting++;
     }
 
     log_lock("%s: unlocking list_lock", __func__);
     pthread_mutex_unlock(&list_lock);
     log_lock("%s: unlocked list_lock", __func__);
-    if(toPrefetch)
+
+    if(wakeOther)
+    {
+      sem_post(&prefetcher_sem);
+      log_lock("%s: sem_posted prefetcher_sem", __func__);
+    }
+
+    if(numPrefetch>0)
     {
-      log_debug("%s: starting %d prefetches with key %lx", __func__, numPrefetch, keys[0]);
+      log_debug("%s: worker %d starting %d prefetches with key %lx", __func__, channel, numPrefetch, keys[0]);
 
       bool waiting = false;
-      int i=0;
+      bool valid = false;
+      struct timespec mread_start, mread_end;
       struct externRAMClient *client = get_client_by_fd(ufd);
       if (client) {
-
-#ifdef ASYNREAD
-        log_lock("%s: locking read_lock", __func__);
-        pthread_mutex_lock(&read_lock);
-        log_lock("%s: locked read_lock", __func__);
-#endif
-
         start_timing_bucket(start, READ_PAGES);
-        readPages(client, keys, numPrefetch, (void**) bufs, lengths );
+        clock_gettime(CLOCK_MONOTONIC, &mread_start);
+        readPagesOnChannel(client, channel, keys, numPrefetch, (void**) bufs, lengths );
+        clock_gettime(CLOCK_MONOTONIC, &mread_end);
         stop_timing(start, end, READ_PAGES);
-
-#ifdef ASYNREAD
-        log_lock("%s: unlocking read_lock", __func__);
-        pthread_mutex_unlock(&read_lock);
-        log_lock("%s: unlocked read_lock", __func__);
-#endif
+        valid = true;
       }
       else {
-        log_warn("%s: skipping prefetching for invalid fd %d", ufd);
-        sem_wait(&prefetcher_sem);
-        continue;
+        log_warn("%s: skipping prefetching for invalid fd %d", __func__, ufd);
       }
 #ifdef DEBUG
-      for( i=0; i<numPrefetch; i++ ) {
+      for( i=0; valid && i<numPrefetch; i++ ) {
         if ((lengths[i] != PAGE_SIZE) || (bufs[i] == NULL)) {
           log_err("%s: prefetch failed for key %lx with length %lx, index %u", __func__, keys[i], lengths[i], i);
         }
       }
 #endif
-      log_lock("%s: locking pagecache_lock", __func__);
-      pthread_mutex_lock(&pagecache_lock);
-      log_lock("%s: locked pagecache_lock", __func__);
+      if(valid)
+      {
+        log_lock("%s: locking pagecache_lock", __func__);
+        pthread_mutex_lock(&pagecache_lock);
+        log_lock("%s: locked pagecache_lock", __func__);
 
-      start_timing_bucket(start, STORE_PAGES_IN_PAGE_CACHE);
-      storePagesInPageCache( pageCache, &keys[0], ufd, numPrefetch, (char**) &bufs[0], &lengths[0]);
-      stop_timing(start, end, STORE_PAGES_IN_PAGE_CACHE);
+        start_timing_bucket(start, STORE_PAGES_IN_PAGE_CACHE);
+        storePagesInPageCache( pageCache, &keys[0], ufd, numPrefetch, (char**) &bufs[0], &lengths[0]);
+        stop_timing(start, end, STORE_PAGES_IN_PAGE_CACHE);
 
-      log_lock("%s: unlocking pagecache_lock", __func__);
-      pthread_mutex_unlock(&pagecache_lock);
-      log_lock("%s: unlocked pagecache_lock", __func__);
+        updatePrefetchLatency( pageCache, ufd, numPrefetch,
+                               (mread_end.tv_sec - mread_start.tv_sec) * 1000000 +
+                               (mread_end.tv_nsec - mread_start.tv_nsec) / 1000 );
+
+        log_lock("%s: unlocking pagecache_lock", __func__);
+        pthread_mutex_unlock(&pagecache_lock);
+        log_lock("%s: unlocked pagecache_lock", __func__);
+      }
 
       log_lock("%s: locking list_lock", __func__);
       pthread_mutex_lock(&list_lock);
@@ -348,7 +619,10 @@ void *prefetch_thread(void * tmp) {
         del_prefetch_info( ufd, keys[i] );
         log_debug("%s: prefetching the page %p completed by prefetch_thread.", __func__, keys[i]);
       }
+      // one post per wait, a handler whose page is in another batch waits again
       waiting = isUfhandlerWaiting;
+      if( waiting )
+        isUfhandlerWaiting = false;
 
       log_lock("%s: unlocking list_lock", __func__);
       pthread_mutex_unlock(&list_lock);
@@ -370,1067 +644,3212 @@ void *prefetch_thread(void * tmp) {
 }
 #endif
 
-int evict_if_needed(int ufd, void * dst, int page_type) {
-  log_trace_in("%s", __func__);
-  declare_timers();
-
-  int ret = 0, ret2 = 0;
-  uint64_t key;
-
-#ifdef CACHE
-  log_lock("%s: locking lru_lock", __func__);
-  pthread_mutex_lock(&lru_lock);
-  log_lock("%s: locked lru_lock", __func__);
+static info_key_t page_key(uint64_t pageaddr, int ufd) {
+  info_key_t key;
 
-  start_timing_bucket(start, INSERT_LRU_CACHE_NODE);
-  struct c_cache_node evict_node = insertCacheNodeAndEvict(lru, (uint64_t)dst, ufd);
-  stop_timing(start, end, INSERT_LRU_CACHE_NODE);
+  key.ufd = ufd;
+  memcpy(key.pageaddr, &pageaddr, sizeof(pageaddr));
+  return key;
+}
 
-  log_lock("%s: unlocking lru_lock", __func__);
-  pthread_mutex_unlock(&lru_lock);
-  log_lock("%s: unlocked lru_lock", __func__);
+/* returns the pid registered with fd, or 0 if fd belongs to another node */
+static uint32_t get_pid_by_fd(int fd) {
+  uint8_t upid[8];
+  uint64_t u = get_upid_by_fd(fd);
 
-  if (evict_node.hashcode != 0) {
-    key = evict_node.hashcode & (uint64_t)(PAGE_MASK);
+  memcpy(upid, &u, 8);
+  if (u && *((uint16_t*) &upid[0]) == get_node_id())
+    return *((uint32_t*) &upid[2]);
+  return 0;
+}
 
-    switch(page_type) {
-      case COPY_PAGE:
-#ifdef TIMING
-        strcpy(timing_label, "COPY_EVICT");
-        bucket_index=1;
-#endif
-        break;
-      case ZERO_PAGE:
-#ifdef TIMING
-        strcpy(timing_label, "ZERO_EVICT");
-        bucket_index=3;
-#endif
-        break;
-      case MOVE_PAGE:
-#ifdef TIMING
-        strcpy(timing_label, "MOVE_EVICT");
-        bucket_index=5;
-#endif
-      case ASYN_PAGE:
-#ifdef TIMING
-        strcpy(timing_label, "ASYN_EVICT");
-        bucket_index=6;
-#endif
-        break;
+/* reads the pagemap entries of num pages from addr in the address space of
+ * pid, returns the number read. pagemap_fd caches the pagemap of *pagemap_pid */
+static int read_pagemap(uint32_t pid, uint64_t addr, int num, uint64_t * entries,
+                        int *pagemap_fd, uint32_t *pagemap_pid) {
+  char path[64];
+  ssize_t len;
+
+  if (*pagemap_fd < 0 || *pagemap_pid != pid) {
+    if (*pagemap_fd >= 0)
+      close(*pagemap_fd);
+    snprintf(path, sizeof(path), "/proc/%u/pagemap", pid);
+    *pagemap_fd = open(path, O_RDONLY);
+    *pagemap_pid = pid;
+    if (*pagemap_fd < 0) {
+      log_debug("%s: could not open %s: %s", __func__, path, strerror(errno));
+      return 0;
     }
+  }
 
-    start_timing_bucket(start, EVICT_TO_EXTERNRAM);
-    ret2 = evict_to_externram(evict_node.ufd, (void*)(uintptr_t)key);
-    stop_timing(start, end, EVICT_TO_EXTERNRAM);
+  len = pread(*pagemap_fd, entries, num * sizeof(uint64_t), (addr >> PAGE_SHIFT) * sizeof(uint64_t));
+  return len > 0 ? len / sizeof(uint64_t) : 0;
+}
 
-    if (ret2 == 0) {
-      log_debug("%s: eviction of page %p succeeded", __func__,  (void*)(uintptr_t)key);
-    }
-    else if (ret2 == 1) {
-#ifdef MONITORSTATS
-      StatsIncrWriteSkippedInvalid_notlocked();
-#endif
-      log_debug("%s: eviction of page %p skipped", __func__, (void*)(uintptr_t)key);
+/* returns the pfn backing addr in the address space of pid, or 0 if the
+ * page is not present. pagemap_fd caches the pagemap of *pagemap_pid */
+static uint64_t page_idle_pfn(uint32_t pid, uint64_t addr, int *pagemap_fd, uint32_t *pagemap_pid) {
+  uint64_t entry = 0;
 
-      // return ufd of skipped page to caller
-      ret = evict_node.ufd;
-    }
-    else if (ret2 == 2) {
-#ifdef MONITORSTATS
-      StatsIncrWriteSkippedZero_notlocked();
-#endif
-      log_debug("%s: tried evicting zeropage %p from ufd %d, putting it back on lrubuffer", __func__, (void*)(uintptr_t)key, evict_node.ufd);
-      log_lock("%s: locking lru_lock", __func__);
-      pthread_mutex_lock(&lru_lock);
-      log_lock("%s: locked lru_lock", __func__);
+  if (read_pagemap(pid, addr, 1, &entry, pagemap_fd, pagemap_pid) != 1)
+    return 0;
 
-      start_timing_bucket(start, INSERT_LRU_CACHE_NODE);
-      insertCacheNode(lru, key, evict_node.ufd);
-      stop_timing(start, end, INSERT_LRU_CACHE_NODE);
+  // bit 63 is present, bits 0-54 the pfn (zero without CAP_SYS_ADMIN)
+  if (!(entry & (1ULL << 63)))
+    return 0;
+  return entry & ((1ULL << 55) - 1);
+}
 
-      log_lock("%s: unlocking lru_lock", __func__);
-      pthread_mutex_unlock(&lru_lock);
-      log_lock("%s: unlocked lru_lock", __func__);
-    }
-    else {
-      log_err("%s: eviction of page %p failed", __func__, (void*)(uintptr_t)key);
-      ret = ret2;
-    }
+void *page_idle_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_PAGE_IDLE_THREAD, "page_idle_thread", TID());
+
+  int bitmap_fd = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR);
+  if (bitmap_fd < 0) {
+    log_err("%s: could not open /sys/kernel/mm/page_idle/bitmap: %s", __func__, strerror(errno));
+    log_trace_out("%s", __func__);
+    return NULL;
   }
 
-#endif
+  int pass = 0;
 
-  log_trace_out("%s", __func__);
-  return ret;
-}
+  while(true)
+  {
+    c_cache_node * candidates = NULL;
+    idle_page * page, * tmp_page;
+    info_key_t key;
+    bool marked;
+    int num_candidates, i, num_referenced = 0;
+    int pagemap_fd = -1;
+    uint32_t pagemap_pid = 0;
+    int last_ufd = -1;
+    uint32_t pid = 0;
 
-int place_data_page(int ufd, void * dst, void * src) {
-  log_trace_in("%s", __func__);
-  declare_timers();
+    usleep(page_idle_interval * 1000);
+    pass++;
 
-  int ret = 0, rc = 0;
-  struct uffdio_copy copy_struct;
-  copy_struct.dst = (uint64_t)(uintptr_t)dst;
-  copy_struct.src = (uint64_t)(uintptr_t)src;
-  copy_struct.len = PAGE_SIZE;
-  copy_struct.mode = 0;
-  copy_struct.copy = 0;
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
 
-#ifdef TIMING
-  strcpy(timing_label, "COPY");
-  bucket_index=0;
-#endif
+    num_candidates = getLRUCandidates(lru, page_idle_sample, &candidates);
 
-  start_timing_bucket(start, UFFD_COPY);
-  rc = ioctl(ufd, UFFDIO_COPY, &copy_struct);
-  stop_timing(start, end, UFFD_COPY);
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
 
-  if (rc) {
-    if (copy_struct.copy != PAGE_SIZE) {
-    ret = copy_struct.copy;
-      switch(copy_struct.copy) {
-        case EBUSY:
-        case ENOENT:
-        case ESRCH:
-          log_warn("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
-          break;
-        default:
-          log_err("%s: src: %p, dst: %p, ufd: %d, size: %Lu", __func__, src, dst, ufd, copy_struct.copy);
-          break;
+    for (i = 0; i < num_candidates; i++) {
+      uint64_t addr = candidates[i].hashcode & (uint64_t)(PAGE_MASK);
+      uint64_t pfn, word;
+
+      if (candidates[i].ufd != last_ufd) {
+        pid = get_pid_by_fd(candidates[i].ufd);
+        last_ufd = candidates[i].ufd;
       }
-    }
-  }
-  else {
-    log_debug("%s: src: %p, dst %p", __func__, src, dst);
-  }
+      if (!pid)
+        continue;
 
-#ifndef ASYNREAD
-  ret = evict_if_needed(ufd, dst, COPY_PAGE);
-#endif
+      pfn = page_idle_pfn(pid, addr, &pagemap_fd, &pagemap_pid);
+      if (!pfn)
+        continue;
 
-  // ret passed through in case this ufd needs to be removed from polling
+      // the idle bit of a page is only ours once this thread has marked it,
+      // a page placed since then has a clear bit without being referenced
+      key = page_key(addr, candidates[i].ufd);
+      HASH_FIND(hh, idlePages, &key, sizeof(info_key_t), page);
+      if (!page) {
+        page = calloc(1, sizeof(idle_page));
+        page->key = key;
+        HASH_ADD(hh, idlePages, key, sizeof(info_key_t), page);
+      }
+      marked = page->pass == pass - 1 && page->pfn == pfn;
 
-#ifdef MONITORSTATS
-  StatsIncrPlacedPage_notlocked();
-#endif
+      if (pread(bitmap_fd, &word, sizeof(word), (pfn / 64) * sizeof(word)) != sizeof(word))
+        continue;
+
+      // a clear idle bit means the page was accessed since it was last marked
+      if (marked && !(word & (1ULL << (pfn % 64)))) {
+        log_lock("%s: locking lru_lock", __func__);
+        pthread_mutex_lock(&lru_lock);
+        log_lock("%s: locked lru_lock", __func__);
+
+        referenceCachedNode(lru, addr, candidates[i].ufd);
+        reference_shadows(addr, candidates[i].ufd);
+
+        log_lock("%s: unlocking lru_lock", __func__);
+        pthread_mutex_unlock(&lru_lock);
+        log_lock("%s: unlocked lru_lock", __func__);
+        num_referenced++;
+      }
+
+      word = 1ULL << (pfn % 64);
+      if (pwrite(bitmap_fd, &word, sizeof(word), (pfn / 64) * sizeof(word)) != sizeof(word)) {
+        log_debug("%s: could not mark pfn %lx idle: %s", __func__, pfn, strerror(errno));
+        continue;
+      }
+      page->pfn = pfn;
+      page->pass = pass;
+    }
+
+    // pages that were not marked by this sample start over when sampled again
+    HASH_ITER(hh, idlePages, page, tmp_page) {
+      if (page->pass != pass) {
+        HASH_DEL(idlePages, page);
+        free(page);
+      }
+    }
 
+    if (pagemap_fd >= 0)
+      close(pagemap_fd);
+    free(candidates);
+    log_debug("%s: %d of %d sampled pages were referenced", __func__, num_referenced, num_candidates);
+  }
+  close(bitmap_fd);
   log_trace_out("%s", __func__);
-  return ret;
 }
 
-int place_zero_page(int ufd, void * dst) {
+void *rebalance_thread(void * tmp) {
   log_trace_in("%s", __func__);
-  declare_timers();
+  setThreadCPUAffinity(CPU_FOR_REBALANCE_THREAD, "rebalance_thread", TID());
 
-  int ret = 0, rc = 0;
+  if (rebalance_pages <= 0)
+    rebalance_pages = cache_size / 100 > 0 ? cache_size / 100 : 1;
 
-  struct uffdio_zeropage zero_struct;
-  zero_struct.range.start = (uint64_t)(uintptr_t)dst & (uint64_t)(PAGE_MASK);
-  zero_struct.range.len = PAGE_SIZE;
-  zero_struct.mode = 0;
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
 
-#ifdef TIMING
-  strcpy(timing_label, "ZERO");
-  bucket_index=2;
-#endif
+  setLRURebalance(lru, rebalance_pages);
 
-  start_timing_bucket(start, UFFD_ZEROPAGE);
-  rc = ioctl(ufd, UFFDIO_ZEROPAGE, &zero_struct);
-  stop_timing(start, end, UFFD_ZEROPAGE);
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
 
-  if (rc) {
-    ret = errno;
-    switch(errno) {
-      case EBUSY:
-      case ENOENT:
-      case EINVAL:
-      case ESRCH:
-        log_warn("%s: dst: %p, ufd: %d", __func__, dst, ufd);
-        break;
-      default:
-        log_err("%s: dst: %p, ufd: %d", __func__, dst, ufd);
-        break;
-    }
-  }
-#ifdef DEBUG
-  else {
-    log_debug("%s: dst %p", __func__, dst);
-  }
-#endif
+  while(true)
+  {
+    int from_ufd = -1, to_ufd = -1;
+    int moved;
 
-#ifndef ASYNREAD
-  ret = evict_if_needed(ufd, dst, ZERO_PAGE);
-#endif
+    usleep(rebalance_interval * 1000);
 
-  // ret passed through in case this ufd needs to be removed from polling
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    moved = rebalanceLRU(lru, &from_ufd, &to_ufd);
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
 
+    if (moved > 0) {
+      log_debug("%s: moved %d pages of share from ufd %d to ufd %d", __func__, moved, from_ufd, to_ufd);
+    }
+  }
   log_trace_out("%s", __func__);
+}
+
+/* returns the avg10 value of the "some" line of /proc/pressure/memory,
+ * the share of the last 10 seconds in which some task stalled on memory,
+ * in hundredths of a percent, or -1 without PSI */
+static int read_memory_pressure(void) {
+  FILE *f = fopen("/proc/pressure/memory", "r");
+  float avg10;
+  int ret = -1;
+
+  if (!f)
+    return -1;
+  if (fscanf(f, "some avg10=%f", &avg10) == 1)
+    ret = (int)(avg10 * 100);
+  fclose(f);
   return ret;
 }
 
-int move_page(int ufd, void * dst, void * src) {
-  log_trace_in("%s", __func__);
-  declare_timers();
+/* returns MemAvailable of /proc/meminfo in MB, or -1 */
+static long read_mem_available(void) {
+  FILE *f = fopen("/proc/meminfo", "r");
+  char line[128];
+  long kb = -1;
 
-  struct uffdio_remap move_struct;
-  int ret = 0, rc = 0;
+  if (!f)
+    return -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1)
+      break;
+  }
+  fclose(f);
+  return kb < 0 ? -1 : kb / 1024;
+}
 
-  move_struct.dst = (uint64_t)(uintptr_t)dst & (uint64_t)(PAGE_MASK);
-  move_struct.src = (uint64_t)(uintptr_t)src;
-  move_struct.len = PAGE_SIZE;
-  move_struct.mode = 0;
-  move_struct.mode |= UFFDIO_REMAP_MODE_DIRECTION_IN;
+void *autosize_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_AUTOSIZE_THREAD, "autosize_thread", TID());
+
+  if (autosize_max <= 0)
+    autosize_max = cache_size;
+  if (autosize_min <= 0)
+    autosize_min = cache_size / 4;
+  if (autosize_min > autosize_max)
+    autosize_min = autosize_max;
+  if (autosize_step <= 0)
+    autosize_step = autosize_max / 100 > 0 ? autosize_max / 100 : 1;
+  if (autosize_high_mb <= autosize_low_mb)
+    autosize_high_mb = 2 * autosize_low_mb;
+
+  if (read_memory_pressure() < 0)
+    log_warn("%s: /proc/pressure/memory is not available, sizing by MemAvailable only", __func__);
 
-#ifdef TIMING
-  strcpy(timing_label, "MOVE");
-  bucket_index=4;
-#endif
+  while(true)
+  {
+    int pressure, size, new_size;
+    long available;
 
-  start_timing_bucket(start, UFFD_REMAP);
-  rc = ioctl(ufd, UFFDIO_REMAP, &move_struct);
-  stop_timing(start, end, UFFD_REMAP);
+    usleep(autosize_interval * 1000);
 
-  if (rc) {
-    ret = errno;
-    switch(errno) {
-      case EBUSY:
-        log_info("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
-        break;
-      case ENOENT:
-      case EINVAL:
-      case ESRCH:
-        log_warn("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
-        break;
-      default:
-        log_err("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
-        break;
+    pressure = read_memory_pressure();
+    available = read_mem_available();
+    if (available < 0) {
+      log_warn("%s: could not read MemAvailable", __func__);
+      continue;
     }
-  }
-#ifdef DEBUG
-  else {
-    log_debug("%s: src: %p, dst %p", __func__, src, dst);
-  }
-#endif
 
-#ifndef ASYNREAD
-  ret = evict_if_needed(ufd, dst, MOVE_PAGE);
-#endif
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
 
-  // ret passed through in case this ufd needs to be removed from polling
+    size = getLRUBufferMaxSize(lru);
 
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+
+    new_size = size;
+    if (pressure > autosize_psi * 100 || available < autosize_low_mb)
+      new_size = size - autosize_step > autosize_min ? size - autosize_step : autosize_min;
+    else if (pressure < autosize_psi * 50 && available > autosize_high_mb)
+      new_size = size + autosize_step < autosize_max ? size + autosize_step : autosize_max;
+
+    // one step at a time, the pages above a shrunk size are drained by resize_drain_thread
+    if (new_size != size) {
+      log_debug("%s: memory pressure %d.%02d%%, %ld MB available: resizing from %d to %d pages",
+                __func__, pressure / 100, pressure % 100, available, size, new_size);
+      resizeLRUBuffer(new_size);
+    }
+  }
   log_trace_out("%s", __func__);
-  return ret;
 }
 
-int evict_page(int ufd, void * dst, void * src) {
-  log_trace_in("%s", __func__);
+/*
+ * The page_is_zero_* functions return true if a page is all zeroes. They
+ * OR together four vectors (or words) at a time and return at the first
+ * block that is not zero, so a page with data usually costs a cache line
+ * or two. page_is_zero points to the best one the CPU supports, picked on
+ * the first call
+ */
+#if defined(__x86_64__)
+static bool page_is_zero_sse2(const void * page) {
+  const __m128i * v = (const __m128i *)page;
+  __m128i acc;
+  int i;
 
-  struct uffdio_remap move_struct;
-  int ret = 0, rc = 0;
-  declare_timers();
+  for (i = 0; i < (int)(PAGE_SIZE / 16); i += 4) {
+    acc = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(v + i), _mm_loadu_si128(v + i + 1)),
+                       _mm_or_si128(_mm_loadu_si128(v + i + 2), _mm_loadu_si128(v + i + 3)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+      return false;
+  }
+  return true;
+}
 
-  move_struct.src = (uint64_t)(uintptr_t)src & (uint64_t)(PAGE_MASK);
-  move_struct.dst = (uint64_t)(uintptr_t)dst;
-  move_struct.len = PAGE_SIZE;
-  move_struct.mode = UFFDIO_REMAP_MODE_DONTWAKE | UFFDIO_REMAP_MODE_ALLOW_SRC_HOLES;
+__attribute__((target("avx2")))
+static bool page_is_zero_avx2(const void * page) {
+  const __m256i * v = (const __m256i *)page;
+  __m256i acc;
+  int i;
 
-  start_timing_bucket(start, UFFD_REMAP);
-  rc = ioctl(ufd, UFFDIO_REMAP, &move_struct);
-  stop_timing(start, end, UFFD_REMAP);
+  for (i = 0; i < (int)(PAGE_SIZE / 32); i += 4) {
+    acc = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(v + i), _mm256_loadu_si256(v + i + 1)),
+                          _mm256_or_si256(_mm256_loadu_si256(v + i + 2), _mm256_loadu_si256(v + i + 3)));
+    if (!_mm256_testz_si256(acc, acc))
+      return false;
+  }
+  return true;
+}
 
-  if (rc) {
-    if (errno != PAGE_SIZE) {
-      ret = errno;
-      switch(errno) {
-        case EBUSY:
-          // tried evicting zeropage
-          log_debug("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
-          break;
-        case EEXIST:
-          log_warn("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
-          break;
-        case EINVAL:
-        case ESRCH:
-          // tried evicting page from invalid userfault region (ufd closed or pid dead)
-          log_debug("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
-          break;
-        default:
-          log_err("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
-          break;
-      }
-    }
+__attribute__((target("avx512f")))
+static bool page_is_zero_avx512(const void * page) {
+  const __m512i * v = (const __m512i *)page;
+  __m512i acc;
+  int i;
+
+  for (i = 0; i < (int)(PAGE_SIZE / 64); i += 4) {
+    acc = _mm512_or_si512(_mm512_or_si512(_mm512_loadu_si512(v + i), _mm512_loadu_si512(v + i + 1)),
+                          _mm512_or_si512(_mm512_loadu_si512(v + i + 2), _mm512_loadu_si512(v + i + 3)));
+    if (_mm512_test_epi64_mask(acc, acc))
+      return false;
   }
-#ifdef DEBUG
-  else {
-    log_debug("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+  return true;
+}
+#else
+static bool page_is_zero_generic(const void * page) {
+  const uint64_t * w = (const uint64_t *)page;
+  int i;
+
+  for (i = 0; i < (int)(PAGE_SIZE / 8); i += 4) {
+    if (w[i] | w[i + 1] | w[i + 2] | w[i + 3])
+      return false;
   }
+  return true;
+}
 #endif
 
-  log_trace_out("%s", __func__);
-  return ret;
+static bool page_is_zero_select(const void * page);
+static bool (*page_is_zero)(const void * page) = page_is_zero_select;
+
+/* picks the zero page check on the first call. Threads racing here all
+ * store the same pointer */
+static bool page_is_zero_select(const void * page) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    page_is_zero = page_is_zero_avx512;
+  else if (__builtin_cpu_supports("avx2"))
+    page_is_zero = page_is_zero_avx2;
+  else
+    page_is_zero = page_is_zero_sse2;
+#else
+  page_is_zero = page_is_zero_generic;
+#endif
+  return page_is_zero(page);
 }
 
-int ack_userfault(int ufd, void *addr, size_t len)
-{
-  log_trace_in("%s", __func__);
-
-  struct uffdio_range range_struct;
+// key of page_fingerprint, drawn from /dev/urandom when precopy_thread starts
+static uint64_t fingerprint_key[2];
 
-  range_struct.start = (uint64_t)(uintptr_t)addr;
-  range_struct.len = (uint64_t)len;
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
 
-  errno = 0;
-  int rc = 0;
-  declare_timers();
+static inline void sip_round(uint64_t * v) {
+  v[0] += v[1]; v[1] = ROTL64(v[1], 13); v[1] ^= v[0]; v[0] = ROTL64(v[0], 32);
+  v[2] += v[3]; v[3] = ROTL64(v[3], 16); v[3] ^= v[2];
+  v[0] += v[3]; v[3] = ROTL64(v[3], 21); v[3] ^= v[0];
+  v[2] += v[1]; v[1] = ROTL64(v[1], 17); v[1] ^= v[2]; v[2] = ROTL64(v[2], 32);
+}
 
-  rc = ioctl(ufd, UFFDIO_WAKE, &range_struct);
+/*
+ * returns a 64 bit fingerprint of the contents of a page, SipHash-2-4 keyed
+ * with fingerprint_key. A match lets eviction skip the write, so the guest,
+ * which controls the contents, must not be able to make two pages collide.
+ * Without the key it cannot, and two pages match by chance with odds of
+ * 2^-64
+ */
+static uint64_t page_fingerprint(const void * page) {
+  const uint64_t * w = (const uint64_t *)page;
+  uint64_t v[4] = { fingerprint_key[0] ^ 0x736f6d6570736575ULL, fingerprint_key[1] ^ 0x646f72616e646f6dULL,
+                    fingerprint_key[0] ^ 0x6c7967656e657261ULL, fingerprint_key[1] ^ 0x7465646279746573ULL };
+  int i;
 
-  if (rc) {
-      if (errno == ENOENT) {
-          /* Kernel said it wasn't waiting - one case where this can
-           * happen is where two threads triggered the userfault
-           * and we receive the page and ack it just after we received
-           * the 2nd request and that ends up deciding it should ack it
-           * We could optimise it out, but it's rare.
-           */
-          log_info("%s: %p/%zx ENOENT", __func__, addr, len);
-          return 0;
-      }
-      log_err("%s: failed to notify kernel for %p/%zx", __func__,
-              addr, len);
-      return -errno;
+  for (i = 0; i < (int)(PAGE_SIZE / 8); i++) {
+    v[3] ^= w[i];
+    sip_round(v);
+    sip_round(v);
+    v[0] ^= w[i];
   }
-
-  log_trace_out("%s", __func__);
-  return 0;
+  // the last block holds only the length, which is 0 modulo 256
+  sip_round(v);
+  sip_round(v);
+  v[2] ^= 0xff;
+  for (i = 0; i < 4; i++)
+    sip_round(v);
+  return v[0] ^ v[1] ^ v[2] ^ v[3];
 }
 
-int create_buffers()
-{
-  log_trace_in("%s", __func__);
+static int evict_precopied_to_externram(int ufd, void * pageaddr, const uint64_t * fingerprint);
 
-  int ret = 0;
+/* the precopy functions below are called with lru_lock held */
+static void wait_for_precopy(void) {
+  while (precopy_busy) {
+    log_lock("%s: waiting on precopy_cond", __func__);
+    pthread_cond_wait(&precopy_cond, &lru_lock);
+    log_lock("%s: waited on precopy_cond", __func__);
+  }
+}
 
-  if (pthread_mutex_init(&zh_lock, NULL) != 0)
-  {
-    log_err("%s: zh lock init failed", __func__);
-    ret = -1;
+/*
+ * take_precopied forgets a page that leaves the LRU buffer. A write of the
+ * page by precopy_thread is waited for, so that it cannot land after the
+ * write of the eviction. Returns true with the fingerprint of the copy in
+ * externRAM if the page is clean
+ */
+static bool take_precopied(uint64_t pageaddr, int ufd, uint64_t * fingerprint) {
+  info_key_t key = page_key(pageaddr, ufd);
+  precopied_page * page;
+  bool clean = false;
+
+  HASH_FIND(hh, precopiedPages, &key, sizeof(info_key_t), page);
+  if (page && page->state == PRECOPY_IN_FLIGHT) {
+    wait_for_precopy();
+    HASH_FIND(hh, precopiedPages, &key, sizeof(info_key_t), page);
   }
+  if (!page)
+    return false;
 
-  if (pthread_mutex_init(&fdUpidMap_lock, NULL) != 0)
-  {
-    log_err("%s: fd map lock init failed", __func__);
-    ret = -1;
+  if (page->state == PRECOPY_CLEAN) {
+    *fingerprint = page->fingerprint;
+    clean = true;
   }
+  HASH_DEL(precopiedPages, page);
+  free(page);
+  return clean;
+}
 
-  if (pthread_mutex_init(&lru_lock, NULL) != 0)
-  {
-    log_err("%s: lru lock init failed", __func__);
-    ret = -1;
+/* forgets the pages of ufd in page_list, taken off the LRU buffer together */
+static void drop_precopied(int ufd, uint64_t * page_list, int num_pages) {
+  uint64_t fingerprint;
+  int i;
+
+  for (i = 0; i < num_pages; i++)
+    take_precopied(page_list[i], ufd, &fingerprint);
+}
+
+/* take_zero_page forgets a parked zero page of ufd that is back on the LRU
+ * buffer. Called with lru_lock held */
+static void take_zero_page(uint64_t pageaddr, int ufd) {
+  zero_page * page;
+  info_key_t key = page_key(pageaddr, ufd);
+
+  HASH_FIND(hh, zeroPages, &key, sizeof(info_key_t), page);
+  if (page) {
+    HASH_DEL(zeroPages, page);
+    free(page);
   }
-  lru = newLRUBuffer();
-  if (!lru) {
-    log_err("%s: creating LRUBuffer", __func__);
-    ret = -1;
+}
+
+/* take_ufd_zero_pages takes all parked zero pages of ufd and returns their
+ * addresses. Called with lru_lock held */
+static uint64_t * take_ufd_zero_pages(int ufd, int * num_pages) {
+  zero_page * page, * tmp;
+  uint64_t * page_list = malloc((HASH_COUNT(zeroPages) + 1) * sizeof(uint64_t));
+
+  *num_pages = 0;
+  HASH_ITER(hh, zeroPages, page, tmp) {
+    if (page->key.ufd == ufd) {
+      page_list[(*num_pages)++] = *((uint64_t*)page->key.pageaddr);
+      HASH_DEL(zeroPages, page);
+      free(page);
+    }
   }
+  return page_list;
+}
 
-#ifdef THREADED_WRITE_TO_EXTERNRAM
-  pthread_mutex_init(&flush_write_needed_lock, NULL);
-  sem_init(&flushed_write_sem, 0, 0);
-#endif
+/*
+ * park_zero_page takes a zero page of ufd that was popped off the LRU buffer
+ * for eviction. The page is parked if zero_sweep_thread can tell when it
+ * gets written, otherwise it is put back on the LRU buffer if reinsert is set
+ */
+static void park_zero_page(int ufd, uint64_t key, bool reinsert) {
+  zero_page * page = NULL;
+  bool parked = false;
 
-#ifdef PAGECACHE
-  if (pthread_mutex_init(&pagecache_lock, NULL) != 0)
-  {
-    log_err("%s: pagecache lock init failed", __func__);
-    ret = -1;
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  if (zero_sweep_interval > 0 && zero_pfn != 0) {
+    // the page may have been put back on the LRU buffer meanwhile
+    if (!isCachedInLRU(lru, key, ufd)) {
+      page = malloc(sizeof(zero_page));
+      page->key = page_key(key, ufd);
+      HASH_ADD(hh, zeroPages, key, sizeof(info_key_t), page);
+      parked = true;
+    }
   }
-  pageCache = newPageCache(lru);
-  if (!pageCache) {
-    log_err("%s: creating PageCache", __func__);
-    ret = -1;
+  else if (reinsert) {
+    insertCacheNode(lru, key, ufd);
   }
-#endif
 
-#ifdef THREADED_PREFETCH
-#ifdef ASYNREAD
-  if (pthread_mutex_init(&read_lock, NULL) != 0)
-  {
-    log_err("%s: read lock init failed", __func__);
-    ret = -1;
-  }
-#endif
-#endif
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
 
-  read_tmp_page = get_local_tmp_page();
-  if (!read_tmp_page) {
-    log_err("failed to get evict tmp page");
-    ret = -1;
-  }
+  if (parked) {
+    log_debug("%s: parked zeropage %p of ufd %d", __func__, (void*)(uintptr_t)key, ufd);
+#ifdef MONITORSTATS
+    StatsIncrZeroParked_notlocked();
+#endif
+#ifdef PAGECACHE
+    log_lock("%s: locking pagecache_lock", __func__);
+    pthread_mutex_lock(&pagecache_lock);
+    log_lock("%s: locked pagecache_lock", __func__);
 
-  log_trace_out("%s", __func__);
+    markZeroPage(pageCache, ufd, key, true);
 
-  return ret;
+    log_lock("%s: unlocking pagecache_lock", __func__);
+    pthread_mutex_unlock(&pagecache_lock);
+    log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+  }
 }
 
-/* evict_to_externram_multi is called with lru_lock held */
-int evict_to_externram_multi(int size)
-{
-  log_trace_in("%s", __func__);
+/* moves a page that keeps faulting back in soon after its eviction to the
+ * protected segment of the LRU buffer */
+static void protect_hot_page(int ufd, void * pageaddr) {
+#ifdef CACHE
+  int ret;
 
-  uint64_t key;
-  int cnt = 0; // number of actually evicted pages
-  struct c_cache_node * node_list;
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
 
-  int num_to_evict = popNLRU(lru, size, &node_list);
-  if (size > num_to_evict) {
-    log_warn("%s: the LRUBuffer has %d pages, less than the number of pages to be evicted (%d).",
-            __func__, num_to_evict, size);
-  }
+  ret = protectCachedNode(lru, (uint64_t)(uintptr_t)pageaddr, ufd);
 
-  int i;
-  for( i=0; i < size; i++)
-  {
-    key = node_list[i].hashcode & (uint64_t)(PAGE_MASK);
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
 
-    int ret = evict_to_externram(node_list[i].ufd, (void*)(uintptr_t)key);
-    if (ret == 0) {
-      log_debug("%s: eviction of page %p succeeded", __func__, (void*)(uintptr_t)key);
-      cnt++;
-    }
-    else if (ret == 1) {
+  if (ret == 1) {
+    log_debug("%s: protected page %p of ufd %d", __func__, pageaddr, ufd);
 #ifdef MONITORSTATS
-      StatsIncrWriteSkippedInvalid_notlocked();
+    StatsIncrHotPromoted_notlocked();
 #endif
-      log_debug("%s: eviction of page %p skipped", __func__, (void*)(uintptr_t)key);
-    }
-    else if (ret == 2) {
-      log_debug("%s: eviction of page %p delayed", __func__, (void*)(uintptr_t)key);
-    }
-    else {
-      log_err("%s: eviction of page %p failed.", __func__, (void*)(uintptr_t)key);
-    }
   }
-
-  free(node_list);
-  log_trace_out("%s", __func__);
-  return cnt;
+#endif
 }
 
-int resizeLRUBuffer(int size)
-{
+int evict_if_needed(int ufd, void * dst, int page_type) {
   log_trace_in("%s", __func__);
+  declare_timers();
 
-  /* Take lru_lock and hold until resize operation is finished,
-   * which includes calls to evict_to_externram_multi()
-   */
+  int ret = 0, ret2 = 0;
+  uint64_t key;
+  uint64_t fingerprint;
+  bool precopied = false;
 
+#ifdef CACHE
   log_lock("%s: locking lru_lock", __func__);
   pthread_mutex_lock(&lru_lock);
   log_lock("%s: locked lru_lock", __func__);
 
-  int lru_size = getLRUBufferSize(lru);
+  start_timing_bucket(start, INSERT_LRU_CACHE_NODE);
+  struct c_cache_node evict_node = insertCacheNodeAndEvict(lru, (uint64_t)dst, ufd);
+  stop_timing(start, end, INSERT_LRU_CACHE_NODE);
+  feed_shadows((uint64_t)dst, ufd);
+  if (zeroPages)
+    take_zero_page((uint64_t)(uintptr_t)dst & (uint64_t)(PAGE_MASK), ufd);
+  if (evict_node.hashcode != 0)
+    precopied = take_precopied(evict_node.hashcode & (uint64_t)(PAGE_MASK), evict_node.ufd, &fingerprint);
 
-  if (size > lru_size) {
-    setLRUBufferSize(lru,size);
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
 
-    log_lock("%s: unlocking lru_lock", __func__);
-    pthread_mutex_unlock(&lru_lock);
-    log_lock("%s: unlocked lru_lock", __func__);
-  }
-  else
-  {
-    int numToEvict = lru_size - size;
+  if (evict_node.hashcode != 0) {
+    key = evict_node.hashcode & (uint64_t)(PAGE_MASK);
 
-    // evict_to_externram_multi must evict numToEvict, so not allowed to skip pages
-    int ret = evict_to_externram_multi(numToEvict);
+    switch(page_type) {
+      case COPY_PAGE:
+#ifdef TIMING
+        strcpy(timing_label, "COPY_EVICT");
+        bucket_index=1;
+#endif
+        break;
+      case ZERO_PAGE:
+#ifdef TIMING
+        strcpy(timing_label, "ZERO_EVICT");
+        bucket_index=3;
+#endif
+        break;
+      case MOVE_PAGE:
+#ifdef TIMING
+        strcpy(timing_label, "MOVE_EVICT");
+        bucket_index=5;
+#endif
+      case ASYN_PAGE:
+#ifdef TIMING
+        strcpy(timing_label, "ASYN_EVICT");
+        bucket_index=6;
+#endif
+        break;
+    }
 
-    setLRUBufferSize(lru,size);
+    start_timing_bucket(start, EVICT_TO_EXTERNRAM);
+    ret2 = evict_precopied_to_externram(evict_node.ufd, (void*)(uintptr_t)key,
+                                        precopied ? &fingerprint : NULL);
+    stop_timing(start, end, EVICT_TO_EXTERNRAM);
 
-    log_lock("%s: unlocking lru_lock", __func__);
-    pthread_mutex_unlock(&lru_lock);
-    log_lock("%s: unlocked lru_lock", __func__);
+    if (ret2 == 0) {
+      log_debug("%s: eviction of page %p succeeded", __func__,  (void*)(uintptr_t)key);
+    }
+    else if (ret2 == 1) {
+#ifdef MONITORSTATS
+      StatsIncrWriteSkippedInvalid_notlocked();
+#endif
+      log_debug("%s: eviction of page %p skipped", __func__, (void*)(uintptr_t)key);
 
-    // print log message outside of lock scope
-    if(ret != numToEvict) {
-      log_warn(
-               "%s: failed to evict all pages during resizing. attempted=%d, evicted=%d",
-              __func__, numToEvict, ret);
+      // return ufd of skipped page to caller
+      ret = evict_node.ufd;
+    }
+    else if (ret2 == 2) {
+#ifdef MONITORSTATS
+      StatsIncrWriteSkippedZero_notlocked();
+#endif
+      log_debug("%s: tried evicting zeropage %p from ufd %d, parking it", __func__, (void*)(uintptr_t)key, evict_node.ufd);
+      park_zero_page(evict_node.ufd, key, true);
+    }
+    else {
+      log_err("%s: eviction of page %p failed", __func__, (void*)(uintptr_t)key);
+      ret = ret2;
     }
   }
 
+#endif
+
   log_trace_out("%s", __func__);
+  return ret;
 }
 
-/*
- * evict_to_externram store
- * This function will evict the page at pageaddr from the userfault
- * region described by ufd and the write the page to externram
- *
- * lru_lock may or may not be held by caller
- */
-int evict_to_externram(int ufd, void * pageaddr) {
+int place_data_page(int ufd, void * dst, void * src) {
   log_trace_in("%s", __func__);
-
   declare_timers();
-  int ret = -1;
-  void *write_ret = NULL;
-  int free_ret = -1;
-  int retry = 5;
-  bool skip_clean = false;
-  void *evict_tmp_page;
-  void **evict_tmp_page_ptr;
 
-  // this page contains data (non zero byte), evict it
-  while (retry > 0) {
-#ifdef THREADED_REINIT
-    evict_tmp_page = get_tmp_page(buf_evictpage);
-#else
-    evict_tmp_page = get_local_tmp_page();
+  int ret = 0, rc = 0;
+  struct uffdio_copy copy_struct;
+  copy_struct.dst = (uint64_t)(uintptr_t)dst;
+  copy_struct.src = (uint64_t)(uintptr_t)src;
+  copy_struct.len = PAGE_SIZE;
+  copy_struct.mode = 0;
+  copy_struct.copy = 0;
+
+#ifdef TIMING
+  strcpy(timing_label, "COPY");
+  bucket_index=0;
 #endif
-    evict_tmp_page_ptr = &evict_tmp_page;
 
-    if (!evict_tmp_page) {
-      log_err("failed to get evict tmp page");
-      return -1;
-    }
+  start_timing_bucket(start, UFFD_COPY);
+  rc = ioctl(ufd, UFFDIO_COPY, &copy_struct);
+  stop_timing(start, end, UFFD_COPY);
 
-    ret = evict_page(ufd, evict_tmp_page, (void *)pageaddr);
-    if (ret != 0) {
-      switch (ret) {
+  if (rc) {
+    if (copy_struct.copy != PAGE_SIZE) {
+    ret = copy_struct.copy;
+      switch(copy_struct.copy) {
         case EBUSY:
-          // tried evicting zeropage. delay eviction
-          log_debug("%s: delaying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
-          ret = 2;
-          retry = 0;
-          break;
-        case EAGAIN:
-          log_warn("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
-          ret = 1;
-          retry--;
-          break;
         case ENOENT:
-          log_recoverable_err("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
-          ret = -1;
-          retry--;
-          break;
-        case EEXIST:
-          log_warn("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
-          ret = -1;
-          retry--;
-          break;
-        case EINVAL:
         case ESRCH:
-          // tried evicting page from invalid userfault region (ufd closed or pid dead)
-          log_debug("%s: skipping page for invalid fd %d, rc: %d, pageaddr: %p", __func__, ufd, ret, pageaddr);
-          ret = 1;
-          retry = 0;
+          log_warn("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
           break;
         default:
-          log_err("%s: rc: %d, pageaddr: %p", __func__,  ret, pageaddr);
-          ret = -1;
-          retry = 0;
+          log_err("%s: src: %p, dst: %p, ufd: %d, size: %Lu", __func__, src, dst, ufd, copy_struct.copy);
           break;
       }
-      // If retrying, need to free page. If done, page will be freed before returning
-      if (retry > 0) {
-        // fell through and about to retry. must munmap old evict_tmp_page
-#ifdef THREADED_REINIT
-        free_ret = return_free_page(buf_evictpage, evict_tmp_page);
-#else
-        free_ret = munmap(evict_tmp_page,PAGE_SIZE);
-#endif
-        if (free_ret < 0) {
-          log_err("%s: munmap to %p", __func__, evict_tmp_page);
-        }
-        else {
-          log_debug("%s: munmap to %p", __func__, evict_tmp_page);
-        }
-      }
     }
-    // if ret is 0, then we are all good
-    else
-      retry = 0;
+  }
+  else {
+    log_debug("%s: src: %p, dst %p", __func__, src, dst);
   }
 
-  // check to make sure page was evicted
-  if (ret == 0) {
-    // Always increase evicted stat even if EVICT fails
-#ifdef MONITORSTATS
-    StatsIncrPageEvicted_notlocked();
+#ifndef ASYNREAD
+  ret = evict_if_needed(ufd, dst, COPY_PAGE);
 #endif
-#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
-    int cmp = -1;
-    start_timing_bucket(start, ZEROPAGE_COMPARE);
-    cmp = memcmp((void*)zeroPage, evict_tmp_page, PAGE_SIZE);
-    stop_timing(start, end, ZEROPAGE_COMPARE);
 
-    if (cmp ==0 )
-    {
+  // ret passed through in case this ufd needs to be removed from polling
+
 #ifdef MONITORSTATS
-      StatsIncrWriteAvoided_notlocked();
-#endif
-#ifdef PAGECACHE
-      start_timing_bucket(start, UPDATE_PAGE_CACHE);
-      updatePageCacheAfterSkippedWrite(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr);
-      stop_timing(start, end, UPDATE_PAGE_CACHE);
-#endif
-      skip_clean = true;
-      log_debug("%s: Skipping writing the page (%p fd %d) of all zeroes to externRAM.", __func__,
-                pageaddr, ufd);
-    }
-    else
-    {
+  StatsIncrPlacedPage_notlocked();
 #endif
-      skip_clean = true;
-      // write page to externram
-#ifdef THREADED_WRITE_TO_EXTERNRAM
-      log_lock("%s: locking list_lock", __func__);
-      pthread_mutex_lock(&list_lock);
-      log_lock("%s: locked list_lock", __func__);
 
-      bool waiting = isWriterWaiting;
-      add_write_info( ufd, (uint64_t)(uintptr_t)pageaddr, evict_tmp_page );
-      log_debug("%s: the page %p was put on the write list", __func__, pageaddr);
+  log_trace_out("%s", __func__);
+  return ret;
+}
 
-      int list_size = get_write_list_size();
+int place_zero_page(int ufd, void * dst) {
+  log_trace_in("%s", __func__);
+  declare_timers();
 
-      log_lock("%s: unlocking list_lock", __func__);
-      pthread_mutex_unlock(&list_lock);
-      log_lock("%s: unlocked list_lock", __func__);
+  int ret = 0, rc = 0;
 
-      if( waiting && list_size>=WRITE_BATCH_SIZE ) {
-        sem_post(&writer_sem);
-        log_lock("%s: sem_posted writer_sem", __func__);
-      }
+  struct uffdio_zeropage zero_struct;
+  zero_struct.range.start = (uint64_t)(uintptr_t)dst & (uint64_t)(PAGE_MASK);
+  zero_struct.range.len = PAGE_SIZE;
+  zero_struct.mode = 0;
+
+#ifdef TIMING
+  strcpy(timing_label, "ZERO");
+  bucket_index=2;
+#endif
+
+  start_timing_bucket(start, UFFD_ZEROPAGE);
+  rc = ioctl(ufd, UFFDIO_ZEROPAGE, &zero_struct);
+  stop_timing(start, end, UFFD_ZEROPAGE);
+
+  if (rc) {
+    ret = errno;
+    switch(errno) {
+      case EBUSY:
+      case ENOENT:
+      case EINVAL:
+      case ESRCH:
+        log_warn("%s: dst: %p, ufd: %d", __func__, dst, ufd);
+        break;
+      default:
+        log_err("%s: dst: %p, ufd: %d", __func__, dst, ufd);
+        break;
+    }
+  }
+#ifdef DEBUG
+  else {
+    log_debug("%s: dst %p", __func__, dst);
+  }
+#endif
+
+#ifndef ASYNREAD
+  ret = evict_if_needed(ufd, dst, ZERO_PAGE);
+#endif
+
+  // ret passed through in case this ufd needs to be removed from polling
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int move_page(int ufd, void * dst, void * src) {
+  log_trace_in("%s", __func__);
+  declare_timers();
+
+  struct uffdio_remap move_struct;
+  int ret = 0, rc = 0;
+
+  move_struct.dst = (uint64_t)(uintptr_t)dst & (uint64_t)(PAGE_MASK);
+  move_struct.src = (uint64_t)(uintptr_t)src;
+  move_struct.len = PAGE_SIZE;
+  move_struct.mode = 0;
+  move_struct.mode |= UFFDIO_REMAP_MODE_DIRECTION_IN;
+
+#ifdef TIMING
+  strcpy(timing_label, "MOVE");
+  bucket_index=4;
+#endif
+
+  start_timing_bucket(start, UFFD_REMAP);
+  rc = ioctl(ufd, UFFDIO_REMAP, &move_struct);
+  stop_timing(start, end, UFFD_REMAP);
+
+  if (rc) {
+    ret = errno;
+    switch(errno) {
+      case EBUSY:
+        log_info("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+        break;
+      case ENOENT:
+      case EINVAL:
+      case ESRCH:
+        log_warn("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+        break;
+      default:
+        log_err("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+        break;
+    }
+  }
+#ifdef DEBUG
+  else {
+    log_debug("%s: src: %p, dst %p", __func__, src, dst);
+  }
+#endif
+
+#ifndef ASYNREAD
+  ret = evict_if_needed(ufd, dst, MOVE_PAGE);
+#endif
+
+  // ret passed through in case this ufd needs to be removed from polling
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int evict_page(int ufd, void * dst, void * src) {
+  log_trace_in("%s", __func__);
+
+  struct uffdio_remap move_struct;
+  int ret = 0, rc = 0;
+  declare_timers();
+
+  move_struct.src = (uint64_t)(uintptr_t)src & (uint64_t)(PAGE_MASK);
+  move_struct.dst = (uint64_t)(uintptr_t)dst;
+  move_struct.len = PAGE_SIZE;
+  move_struct.mode = UFFDIO_REMAP_MODE_DONTWAKE | UFFDIO_REMAP_MODE_ALLOW_SRC_HOLES;
+
+  start_timing_bucket(start, UFFD_REMAP);
+  rc = ioctl(ufd, UFFDIO_REMAP, &move_struct);
+  stop_timing(start, end, UFFD_REMAP);
+
+  if (rc) {
+    if (errno != PAGE_SIZE) {
+      ret = errno;
+      switch(errno) {
+        case EBUSY:
+          // tried evicting zeropage
+          log_debug("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
+          break;
+        case EEXIST:
+          log_warn("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
+          break;
+        case EINVAL:
+        case ESRCH:
+          // tried evicting page from invalid userfault region (ufd closed or pid dead)
+          log_debug("%s: src: %p, dst %p, ufd: %d", __func__, src, dst, ufd);
+          break;
+        default:
+          log_err("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+          break;
+      }
+    }
+  }
+#ifdef DEBUG
+  else {
+    log_debug("%s: src: %p, dst: %p, ufd: %d", __func__, src, dst, ufd);
+  }
+#endif
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+int ack_userfault(int ufd, void *addr, size_t len)
+{
+  log_trace_in("%s", __func__);
+
+  struct uffdio_range range_struct;
+
+  range_struct.start = (uint64_t)(uintptr_t)addr;
+  range_struct.len = (uint64_t)len;
+
+  errno = 0;
+  int rc = 0;
+  declare_timers();
+
+  rc = ioctl(ufd, UFFDIO_WAKE, &range_struct);
+
+  if (rc) {
+      if (errno == ENOENT) {
+          /* Kernel said it wasn't waiting - one case where this can
+           * happen is where two threads triggered the userfault
+           * and we receive the page and ack it just after we received
+           * the 2nd request and that ends up deciding it should ack it
+           * We could optimise it out, but it's rare.
+           */
+          log_info("%s: %p/%zx ENOENT", __func__, addr, len);
+          return 0;
+      }
+      log_err("%s: failed to notify kernel for %p/%zx", __func__,
+              addr, len);
+      return -errno;
+  }
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+int create_buffers()
+{
+  log_trace_in("%s", __func__);
+
+  int ret = 0;
+
+  if (pthread_mutex_init(&zh_lock, NULL) != 0)
+  {
+    log_err("%s: zh lock init failed", __func__);
+    ret = -1;
+  }
+
+  if (pthread_mutex_init(&fdUpidMap_lock, NULL) != 0)
+  {
+    log_err("%s: fd map lock init failed", __func__);
+    ret = -1;
+  }
+
+  if (pthread_mutex_init(&lru_lock, NULL) != 0)
+  {
+    log_err("%s: lru lock init failed", __func__);
+    ret = -1;
+  }
+
+  if (pthread_mutex_init(&thread_faults_lock, NULL) != 0)
+  {
+    log_err("%s: thread faults lock init failed", __func__);
+    ret = -1;
+  }
+  lru = newLRUBuffer();
+  if (!lru) {
+    log_err("%s: creating LRUBuffer", __func__);
+    ret = -1;
+  }
+  create_shadows();
+  sem_init(&resize_sem, 0, 0);
+  pthread_cond_init(&precopy_cond, NULL);
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  pthread_mutex_init(&flush_write_needed_lock, NULL);
+  sem_init(&flushed_write_sem, 0, 0);
+#endif
+
+#ifdef PAGECACHE
+  if (pthread_mutex_init(&pagecache_lock, NULL) != 0)
+  {
+    log_err("%s: pagecache lock init failed", __func__);
+    ret = -1;
+  }
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+  pthread_cond_init(&pagecache_written_cond, NULL);
+#endif
+  pageCache = newPageCache(lru);
+  if (!pageCache) {
+    log_err("%s: creating PageCache", __func__);
+    ret = -1;
+  }
+#endif
+
+  read_tmp_page = get_local_tmp_page();
+  if (!read_tmp_page) {
+    log_err("failed to get evict tmp page");
+    ret = -1;
+  }
+
+  log_trace_out("%s", __func__);
+
+  return ret;
+}
+
+static int evict_node_list(struct c_cache_node * node_list, int num)
+{
+  uint64_t key;
+  int cnt = 0; // number of actually evicted pages
+  int i;
+  uint64_t * fingerprints = malloc(num * sizeof(uint64_t));
+  bool * precopied = calloc(num, sizeof(bool));
+
+  if (precopy_interval > 0) {
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    for( i=0; i < num; i++)
+      precopied[i] = take_precopied(node_list[i].hashcode & (uint64_t)(PAGE_MASK), node_list[i].ufd, &fingerprints[i]);
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+  }
+
+  for( i=0; i < num; i++)
+  {
+    key = node_list[i].hashcode & (uint64_t)(PAGE_MASK);
+
+    int ret = evict_precopied_to_externram(node_list[i].ufd, (void*)(uintptr_t)key,
+                                           precopied[i] ? &fingerprints[i] : NULL);
+    if (ret == 0) {
+      log_debug("%s: eviction of page %p succeeded", __func__, (void*)(uintptr_t)key);
+      cnt++;
+    }
+    else if (ret == 1) {
+#ifdef MONITORSTATS
+      StatsIncrWriteSkippedInvalid_notlocked();
+#endif
+      log_debug("%s: eviction of page %p skipped", __func__, (void*)(uintptr_t)key);
+    }
+    else if (ret == 2) {
+      log_debug("%s: eviction of page %p delayed", __func__, (void*)(uintptr_t)key);
+      park_zero_page(node_list[i].ufd, key, false);
+    }
+    else {
+      log_err("%s: eviction of page %p failed.", __func__, (void*)(uintptr_t)key);
+    }
+  }
+  free(fingerprints);
+  free(precopied);
+  return cnt;
+}
+
+/* evict_to_externram_multi takes lru_lock only to pop the pages, not for their eviction */
+int evict_to_externram_multi(int size)
+{
+  log_trace_in("%s", __func__);
+
+  int cnt;
+  struct c_cache_node * node_list;
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  int num_to_evict = popNLRU(lru, size, &node_list);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  if (size > num_to_evict) {
+    log_warn("%s: the LRUBuffer has %d pages, less than the number of pages to be evicted (%d).",
+            __func__, num_to_evict, size);
+  }
+
+  cnt = evict_node_list(node_list, num_to_evict);
+
+  free(node_list);
+  log_trace_out("%s", __func__);
+  return cnt;
+}
+
+/*
+ * evict_excess pops at most max of the pages the LRU buffer holds above its
+ * capacity and evicts them after dropping lru_lock. The excess left over is
+ * returned in pending, so a shrink is worked off in bounded batches
+ */
+static int evict_excess(int max, int * pending)
+{
+  log_trace_in("%s", __func__);
+
+  int excess, num = 0, cnt = 0;
+  struct c_cache_node * node_list;
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  excess = getLRUBufferSize(lru) - getLRUBufferMaxSize(lru);
+  if (excess > 0)
+    num = popNLRU(lru, excess < max ? excess : max, &node_list);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  *pending = excess > num ? excess - num : 0;
+#ifdef MONITORSTATS
+  StatsSetResizePending(*pending);
+#endif
+
+  if (num > 0) {
+    log_debug("%s: the LRUBuffer has %d more pages that it should, evicting %d", __func__, excess, num);
+    cnt = evict_node_list(node_list, num);
+    free(node_list);
+#ifdef MONITORSTATS
+    StatsAddResizeEvicted_notlocked(cnt);
+#endif
+    if (cnt != num) {
+      log_debug("%s: failed to evict some_pages. attempted=%d, evicted=%d", __func__, num, cnt);
+    }
+  }
+
+  log_trace_out("%s", __func__);
+  return cnt;
+}
+
+void *resize_drain_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_RESIZE_DRAIN_THREAD, "resize_drain_thread", TID());
+
+  while(true)
+  {
+    int pending;
+
+    sem_wait(&resize_sem);
+    do {
+      evict_excess(RESIZE_BATCH_PAGES, &pending);
+    } while (pending > 0);
+  }
+  log_trace_out("%s", __func__);
+}
+
+/*
+ * resizeLRUBuffer sets the new capacity right away. When it shrinks, the
+ * pages above it are left to resize_drain_thread instead of being evicted
+ * here with lru_lock held
+ */
+int resizeLRUBuffer(int size)
+{
+  log_trace_in("%s", __func__);
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  int lru_size = getLRUBufferSize(lru);
+
+  resize_shadows(size);
+  setLRUBufferSize(lru,size);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  if (lru_size > size) {
+    log_debug("%s: %d pages above the new size of %d left to drain", __func__, lru_size - size, size);
+    sem_post(&resize_sem);
+  }
+
+  log_trace_out("%s", __func__);
+  return 0;
+}
+
+#if !defined(THREADED_WRITE_TO_EXTERNRAM) && defined(PAGECACHE)
+/*
+ * set_pages_writing marks the pages in flight in the page cache, so that a
+ * fault on one of them waits in read_from_externram while they are written
+ * without pagecache_lock, and wakes the faults once the page cache has them
+ * in externRAM. It is called with pagecache_lock held
+ */
+static void set_pages_writing(int ufd, uint64_t * page_list, int num_pages, bool writing) {
+  int i;
+
+  for (i = 0; i < num_pages; i++)
+    setPageWriting(pageCache, ufd, page_list[i], writing);
+  if (!writing)
+    pthread_cond_broadcast(&pagecache_written_cond);
+}
+#endif
+
+/*
+ * evict_to_externram store
+ * This function will evict the page at pageaddr from the userfault
+ * region described by ufd and the write the page to externram
+ *
+ * lru_lock may or may not be held by caller
+ */
+int evict_to_externram(int ufd, void * pageaddr) {
+  return evict_precopied_to_externram(ufd, pageaddr, NULL);
+}
+
+/*
+ * evict_precopied_to_externram evicts like evict_to_externram, but skips the
+ * write if the page still has the fingerprint of its precopy to externram.
+ * fingerprint is NULL for a page that was not precopied.
+ *
+ * A fault on the page must not find it gone from the ufd before the page
+ * cache has it in externRAM. With the write list, the page is on it in
+ * flight until then. Without it, the page is marked in flight in the page
+ * cache, and pagecache_lock is not held across the eviction or the write
+ */
+static int evict_precopied_to_externram(int ufd, void * pageaddr, const uint64_t * fingerprint) {
+  log_trace_in("%s", __func__);
+
+  declare_timers();
+  int ret = -1;
+  void *write_ret = NULL;
+  int free_ret = -1;
+  int retry = 5;
+  bool skip_clean = false;
+  void *evict_tmp_page = NULL;
+  void **evict_tmp_page_ptr;
+#if !defined(THREADED_WRITE_TO_EXTERNRAM) && defined(PAGECACHE)
+  uint64_t key = (uint64_t)(uintptr_t)pageaddr;
+#endif
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  bool queued = false;
+  bool writer_waiting = false, handler_waiting = false;
+  int list_size = 0;
+
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+
+  add_flushing_write_info( ufd, (uint64_t)(uintptr_t)pageaddr );
+
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+#elif defined(PAGECACHE)
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+
+  set_pages_writing(ufd, &key, 1, true);
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+
+  // this page contains data (non zero byte), evict it
+  while (retry > 0) {
+#ifdef THREADED_REINIT
+    evict_tmp_page = get_tmp_page(buf_evictpage);
+#else
+    evict_tmp_page = get_local_tmp_page();
+#endif
+    evict_tmp_page_ptr = &evict_tmp_page;
+
+    if (!evict_tmp_page) {
+      log_err("failed to get evict tmp page");
+      ret = -1;
+      break;
+    }
+
+    ret = evict_page(ufd, evict_tmp_page, (void *)pageaddr);
+    if (ret != 0) {
+      switch (ret) {
+        case EBUSY:
+          // tried evicting zeropage. delay eviction
+          log_debug("%s: delaying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
+          ret = 2;
+          retry = 0;
+          break;
+        case EAGAIN:
+          log_warn("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
+          ret = 1;
+          retry--;
+          break;
+        case ENOENT:
+          log_recoverable_err("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
+          ret = -1;
+          retry--;
+          break;
+        case EEXIST:
+          log_warn("%s: retrying page, rc: %d, pageaddr: %p", __func__, ret, pageaddr);
+          ret = -1;
+          retry--;
+          break;
+        case EINVAL:
+        case ESRCH:
+          // tried evicting page from invalid userfault region (ufd closed or pid dead)
+          log_debug("%s: skipping page for invalid fd %d, rc: %d, pageaddr: %p", __func__, ufd, ret, pageaddr);
+          ret = 1;
+          retry = 0;
+          break;
+        default:
+          log_err("%s: rc: %d, pageaddr: %p", __func__,  ret, pageaddr);
+          ret = -1;
+          retry = 0;
+          break;
+      }
+      // If retrying, need to free page. If done, page will be freed before returning
+      if (retry > 0) {
+        // fell through and about to retry. must munmap old evict_tmp_page
+#ifdef THREADED_REINIT
+        free_ret = return_free_page(buf_evictpage, evict_tmp_page);
+#else
+        free_ret = munmap(evict_tmp_page,PAGE_SIZE);
+#endif
+        if (free_ret < 0) {
+          log_err("%s: munmap to %p", __func__, evict_tmp_page);
+        }
+        else {
+          log_debug("%s: munmap to %p", __func__, evict_tmp_page);
+        }
+      }
+    }
+    // if ret is 0, then we are all good
+    else
+      retry = 0;
+  }
+
+#ifdef PAGECACHE
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+#endif
+
+  // check to make sure page was evicted
+  if (ret == 0) {
+    // Always increase evicted stat even if EVICT fails
+#ifdef MONITORSTATS
+    StatsIncrPageEvicted_notlocked();
+#endif
+#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+    int cmp = -1;
+    start_timing_bucket(start, ZEROPAGE_COMPARE);
+    cmp = page_is_zero(evict_tmp_page) ? 0 : 1;
+    stop_timing(start, end, ZEROPAGE_COMPARE);
+
+    if (cmp ==0 )
+    {
+#ifdef MONITORSTATS
+      StatsIncrWriteAvoided_notlocked();
+#endif
+#ifdef PAGECACHE
+      start_timing_bucket(start, UPDATE_PAGE_CACHE);
+      updatePageCacheAfterSkippedWrite(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr);
+      stop_timing(start, end, UPDATE_PAGE_CACHE);
+#endif
+      skip_clean = true;
+      log_debug("%s: Skipping writing the page (%p fd %d) of all zeroes to externRAM.", __func__,
+                pageaddr, ufd);
+    }
+    else
+    {
+#endif
+      if (fingerprint && page_fingerprint(evict_tmp_page) == *fingerprint) {
+        // unchanged since precopy_thread wrote it, externram already holds it
+#ifdef MONITORSTATS
+        StatsIncrCleanEviction_notlocked();
+#endif
+        log_debug("%s: Skipping writing the precopied page (%p fd %d) to externRAM.", __func__,
+                  pageaddr, ufd);
+      }
+      else {
+        skip_clean = true;
+        // write page to externram
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+        // the page goes on the write list for write_thread below, once the
+        // page cache has been updated
+        queued = true;
+#else
+        // not THREADED_WRITE_TO_EXTERNRAM
+        struct externRAMClient *client = get_client_by_fd(ufd);
+        if (client) {
+#ifdef PAGECACHE
+          // a fault on the page waits for its mark, not for the lock
+          log_lock("%s: unlocking pagecache_lock", __func__);
+          pthread_mutex_unlock(&pagecache_lock);
+          log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+          start_timing_bucket(start, WRITE_PAGE);
+          write_ret = writePage(client, (uint64_t)(uintptr_t)pageaddr, evict_tmp_page_ptr);
+          stop_timing(start, end, WRITE_PAGE);
+#ifdef PAGECACHE
+          log_lock("%s: locking pagecache_lock", __func__);
+          pthread_mutex_lock(&pagecache_lock);
+          log_lock("%s: locked pagecache_lock", __func__);
+#endif
+          if (write_ret != NULL) {
+            // externram wants us to free the buffer in write_ret, but
+            // leave evict_tmp_page alone
+            skip_clean = false;
+            evict_tmp_page = write_ret;
+          }
+        }
+        else
+          log_err("%s: failed writing page %p for invalid fd %d", __func__, pageaddr, ufd);
+#endif // THREADED_WRITE_TO_EXTERNRAM
+      }
+
+#ifdef PAGECACHE
+      start_timing_bucket(start, UPDATE_PAGE_CACHE);
+      updatePageCacheAfterWrite(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr);
+      stop_timing(start, end, UPDATE_PAGE_CACHE);
+#endif
+#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+    }
+#endif
+  }
+  else if (ret == 2) {
+    // tried evicting zeropage
+    log_debug("%s: Skipping writing the zeropage at (%p fd %d) to externRAM.", __func__,
+              pageaddr, ufd);
+    ret = 2;
+
+    // the page will be put back on LRU list, so don't update page cache
+  }
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+
+  del_flushing_write_info( ufd, (uint64_t)(uintptr_t)pageaddr );
+  if (queued) {
+    writer_waiting = isWriterWaiting;
+    add_write_info( ufd, (uint64_t)(uintptr_t)pageaddr, evict_tmp_page );
+    log_debug("%s: the page %p was put on the write list", __func__, pageaddr);
+    list_size = get_write_list_size();
+  }
+  handler_waiting = isUfhandlerWaiting;
+
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+#elif defined(PAGECACHE)
+  set_pages_writing(ufd, &key, 1, false);
+#endif
+#ifdef PAGECACHE
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  if( writer_waiting && list_size>=WRITE_BATCH_SIZE ) {
+    sem_post(&writer_sem);
+    log_lock("%s: sem_posted writer_sem", __func__);
+  }
+  if (handler_waiting) {
+    sem_post(&ufhandler_sem);
+    log_lock("%s: sem_posted ufhandler_sem", __func__);
+  }
+#endif
+
+  // cleanup
+  if (!skip_clean && evict_tmp_page) {
+#ifdef THREADED_REINIT
+    free_ret = return_free_page(buf_evictpage, evict_tmp_page);
+#else
+    free_ret = munmap(evict_tmp_page,PAGE_SIZE);
+#endif
+    if (free_ret < 0) {
+      log_err("%s: munmap to %p", __func__, evict_tmp_page);
+    }
+    else {
+      log_debug("%s: munmap to %p", __func__, evict_tmp_page);
+    }
+  }
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+static void count_thread_fault(int ufd, uint32_t ptid) {
+  thread_faults_entry *s;
+  ufd_activity *a;
+  uint64_t key = ((uint64_t)ptid << 32) | (uint32_t)ufd;
+
+  log_lock("%s: locking thread_faults_lock", __func__);
+  pthread_mutex_lock(&thread_faults_lock);
+  log_lock("%s: locked thread_faults_lock", __func__);
+
+  HASH_FIND(hh, threadFaultsMap, &key, sizeof(uint64_t), s);
+  if (s == NULL) {
+    s = (thread_faults_entry *) malloc(sizeof(thread_faults_entry));
+    if (s == NULL) {
+      log_err("%s: failed to allocate thread fault entry", __func__);
+      goto unlock;
+    }
+    s->key = key;
+    s->stats.ufd = ufd;
+    s->stats.ptid = ptid;
+    s->stats.faults = 0;
+    HASH_ADD(hh, threadFaultsMap, key, sizeof(uint64_t), s);
+  }
+  s->stats.faults++;
+
+  HASH_FIND_INT(ufdActivity, &ufd, a);
+  if (a == NULL) {
+    a = (ufd_activity *) calloc(1, sizeof(ufd_activity));
+    if (a == NULL) {
+      log_err("%s: failed to allocate activity entry", __func__);
+      goto unlock;
+    }
+    a->ufd = ufd;
+    HASH_ADD_INT(ufdActivity, ufd, a);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &a->last_fault);
+  a->idle = false;
+
+unlock:
+  log_lock("%s: unlocking thread_faults_lock", __func__);
+  pthread_mutex_unlock(&thread_faults_lock);
+  log_lock("%s: unlocked thread_faults_lock", __func__);
+}
+
+static void remove_thread_faults(int ufd) {
+  thread_faults_entry *current, *tmp;
+  ufd_activity *a;
+
+  log_lock("%s: locking thread_faults_lock", __func__);
+  pthread_mutex_lock(&thread_faults_lock);
+  log_lock("%s: locked thread_faults_lock", __func__);
+
+  HASH_ITER(hh, threadFaultsMap, current, tmp) {
+    if (current->stats.ufd == ufd) {
+      HASH_DEL(threadFaultsMap, current);
+      free(current);
+    }
+  }
+  HASH_FIND_INT(ufdActivity, &ufd, a);
+  if (a) {
+    HASH_DEL(ufdActivity, a);
+    free(a);
+  }
+
+  log_lock("%s: unlocking thread_faults_lock", __func__);
+  pthread_mutex_unlock(&thread_faults_lock);
+  log_lock("%s: unlocked thread_faults_lock", __func__);
+}
+
+int read_from_externram(int ufd, void * pageaddr, uint32_t ptid) {
+  log_trace_in("%s", __func__);
+  log_debug("%s: reading page %p for thread %u", __func__, pageaddr, ptid);
+  count_thread_fault(ufd, ptid);
+
+  // initialization & var init
+  declare_timers();
+  int length = -1;
+  int ret = -1;
+#ifdef ASYNREAD
+  int ret2 = -1;
+#endif
+  int ret_munmap = -1;
+#ifdef MONITORSTATS
+  StatsIncrPageFault_notlocked();
+#endif
+  int pending;  // pages above the LRU buffer capacity left after evict_excess
+  void ** read_tmp_page_ptr = NULL;
+  bool skip_read = false;
+  void *temp_ptr = NULL;
+  int refaults = 0;
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  while (true)
+  {
+    bool toWait = false;
+    void *page_from_write_list = NULL;
+
+#ifdef PAGECACHE
+    // evictions on other threads update the page cache under it
+    log_lock("%s: locking pagecache_lock", __func__);
+    pthread_mutex_lock(&pagecache_lock);
+    log_lock("%s: locked pagecache_lock", __func__);
+#endif
+    log_lock("%s: locking list_lock", __func__);
+    pthread_mutex_lock(&list_lock);
+    log_lock("%s: locked list_lock", __func__);
+
+    bool waiting = isWriterWaiting;
+    write_info * w = find_write_info(ufd,(uint64_t)(uintptr_t)pageaddr);
+    if(w != NULL)
+    {
+      temp_ptr = extract_page_from_write_list(w);
+      if (temp_ptr != NULL) {
+        log_debug("%s: the page %p could be pulled off the write list", __func__, pageaddr);
+#ifdef PAGECACHE
+        updatePageCacheAfterSkippedRead( (uint64_t)(uintptr_t) pageaddr, ufd );
+#endif
+        read_tmp_page_ptr = &temp_ptr;
+      }
+      else {
+        // failed to extract page. must be in-flight
+        toWait = true;
+        isUfhandlerWaiting = true;
+      }
+    }
+    else
+      isUfhandlerWaiting = false;
+
+    log_lock("%s: unlocking list_lock", __func__);
+    pthread_mutex_unlock(&list_lock);
+    log_lock("%s: unlocked list_lock", __func__);
+#ifdef PAGECACHE
+    log_lock("%s: unlocking pagecache_lock", __func__);
+    pthread_mutex_unlock(&pagecache_lock);
+    log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+
+    if(toWait)
+    {
+      log_debug("%s: the page %p is on the write list, so should wait for it to be completed", __func__, pageaddr);
+      if(waiting) {
+        sem_post(&writer_sem);
+        log_lock("%s: sem_posted writer_sem", __func__);
+      }
+      log_lock("%s: sem_waiting on ufhandler_sem", __func__);
+      sem_wait(&ufhandler_sem);
+      log_lock("%s: sem_waited on ufhandler_sem", __func__);
+    }
+    else
+    {
+      break;
+    }
+  }
+#endif
+#ifdef THREADED_PREFETCH
+  while(true)
+  {
+    bool toWait = false;
+
+    log_lock("%s: locking list_lock", __func__);
+    pthread_mutex_lock(&list_lock);
+    log_lock("%s: locked list_lock", __func__);
+
+    prefetch_info * p = find_prefetch_info(ufd,(uint64_t)(uintptr_t)pageaddr);
+    if(p != NULL && p->in_flight)
+    {
+      log_debug("%s: found in-flight prefetch info for page %p and ufd %d", __func__, pageaddr, ufd);
+      toWait = true;
+      isUfhandlerWaiting = true;
+    }
+    else
+    {
+      if(p != NULL)
+      {
+        // still queued, so read it in the demand lane instead of behind the prefetches
+        log_debug("%s: cancelling queued prefetch of page %p for ufd %d", __func__, pageaddr, ufd);
+        del_prefetch_info(ufd,(uint64_t)(uintptr_t)pageaddr);
+#ifdef MONITORSTATS
+        StatsIncrPrefetchCancelled_notlocked();
+#endif
+      }
+      isUfhandlerWaiting = false;
+      // hold back new prefetch batches until this page has been placed
+      demand_reads_pending++;
+    }
+
+    log_lock("%s: unlocking list_lock", __func__);
+    pthread_mutex_unlock(&list_lock);
+    log_lock("%s: unlocked list_lock", __func__);
+
+    if(toWait)
+    {
+      log_debug("%s: the page %p is being prefetched, so should wait for it to be completed", __func__, pageaddr);
+      log_lock("%s: sem_waiting on ufhandler_sem", __func__);
+      sem_wait(&ufhandler_sem);
+      log_lock("%s: sem_waited on ufhandler_sem", __func__);
+    }
+    else
+    {
+      break;
+    }
+  }
+#endif
+
+  /*
+     Set read_tmp_page_ptr (will be given to place_data_page()) to:
+       1. the global read_tmp_page buffer
+       2. the page buffer stolen from the write list
+     This may be updated by functions that are passed read_tmp_page_ptr
+   */
+  if (read_tmp_page_ptr == NULL) {
+    read_tmp_page_ptr = &read_tmp_page;
+  }
+  else {
+    skip_read = true;
+    length = PAGE_SIZE;
+#ifdef ASYNREAD
+    ret2 = evict_if_needed(ufd, pageaddr, ASYN_PAGE);
+#endif
+    goto place_page_out;
+  }
+
+#ifdef PAGECACHE
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+  // another thread is taking the page out of the ufd and writing it
+  while (isPageWriting(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr)) {
+    log_debug("%s: the page %p is being written, so should wait for it to be completed", __func__, pageaddr);
+    pthread_cond_wait(&pagecache_written_cond, &pagecache_lock);
+  }
+#endif
+
+  refaults = countRefault(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr);
+
+  start_timing_bucket(start, READ_VIA_PAGE_CACHE);
+#ifdef ASYNREAD
+  readPageIfInPageCache_top(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
+                            (void **)read_tmp_page_ptr, ptid);
+#else
+  length = readPageIfInPageCache(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
+                                 (void **)read_tmp_page_ptr, ptid);
+#endif
+  stop_timing(start, end, READ_VIA_PAGE_CACHE);
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+
+#else
+  // without page cache we don't know whether page has been seen before or not.
+  struct externRAMClient *client = get_client_by_fd(ufd);
+  if (client) {
+    start_timing_bucket(start, READ_PAGE);
+#ifdef ASYNREAD
+    readPage_top(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
+#else
+    length = readPage(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
+    stop_timing(start, end, READ_PAGE);
+#endif
+  }
+  else
+    log_err("%s: failed to read page %p for invalid fd %d", __func__, pageaddr, ufd);
+#endif
+
+#ifdef ASYNREAD
+  // this is the case for when the page is not taken from the write list
+  ret2 = evict_if_needed(ufd, pageaddr, ASYN_PAGE);
+
+#ifdef PAGECACHE
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+  length = readPageIfInPageCache_bottom(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
+                                        (void **)read_tmp_page_ptr);
+  stop_timing(start, end, READ_VIA_PAGE_CACHE);
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+
+#else
+  // already got client
+  if (client) {
+    length = readPage_bottom(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
+    stop_timing(start, end, READ_PAGE);
+  }
+  else
+    log_err("%s: failed to read page %p for invalid fd %d", __func__, pageaddr, ufd);
+#endif
+#endif
+
+place_page_out:
+  if (length == PAGE_SIZE) {
+    ret = place_data_page(ufd, (void*)(uintptr_t)pageaddr, *read_tmp_page_ptr);
+    if (ret < 0) {
+      log_err("%s: place_data_page", __func__);
+    }
+    // ret = ufd if page eviction skipped
+  } else if (length == 0){
+    // place zero page
+    ret = place_zero_page(ufd, (void *)(uintptr_t)pageaddr);
+    if (ret < 0) {
+      log_err("%s: place_zero_page", __func__);
+    }
+    // ret = ufd if page eviction skipped
+  } else {
+    log_err("%s: we don't know how to handle a read of length %s", __func__, length);
+  }
+
+  if (skip_read) {
+    int ret_unmap = munmap(*read_tmp_page_ptr, PAGE_SIZE);
+    if (ret_unmap < 0) {
+      log_err("%s: munmap to %p", __func__, *read_tmp_page_ptr);
+    }
+    else {
+      log_debug("%s: munmap to %p", __func__, *read_tmp_page_ptr);
+    }
+  }
+
+#ifdef ASYNREAD
+  // ret2 = ufd if page eviction skipped
+  ret = ret2;
+#endif
+
+  // the page is on the LRU buffer now
+  if (hot_refaults > 0 && refaults >= hot_refaults)
+    protect_hot_page(ufd, pageaddr);
+
+#ifdef THREADED_PREFETCH
+  // we have returned page back to the faulting applications, so now we can
+  // resume prefetching
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+  demand_reads_pending--;
+  pthread_cond_broadcast(&demand_reads_cond);
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+#endif
+
+  // now is also a good time to try and evict pages to get LRUbuffer to the proper size
+  evict_excess(RESIZE_BATCH_PAGES, &pending);
+
+#ifdef MONITORSTATS
+  StatsSetLastFaultTime();
+#endif
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+/*
+ * Delete_from_externram store
+ * This function will delete the page from externram
+ *
+ */
+static inline int delete_from_externram(int ufd, externRAMClient *client, void * pageaddr) {
+  log_trace_in("%s", __func__);
+
+  int ret = 0;
+  // delete page from externram
+  if (client) {
+    int ret = removePage(client, (uint64_t)(uintptr_t)pageaddr);
+    if (ret != 1) {
+      log_warn("%s: failed deleting page %p", __func__, pageaddr);
+    }
+  }
+  else {
+    log_err("%s: invalid externram client handle", __func__);
+    ret = -1;
+  }
+
+  log_trace_out("%s", __func__);
+  return ret;
+}
+
+
+static int compare_pageaddr(const void * a, const void * b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void free_evict_page(void * page) {
+#ifdef THREADED_REINIT
+  int ret = return_free_page(buf_evictpage, page);
+#else
+  int ret = munmap(page, PAGE_SIZE);
+#endif
+  if (ret < 0)
+    log_err("%s: munmap to %p", __func__, page);
+}
+
+static void *flush_slice_thread(void * arg) {
+  flush_slice * slice = (flush_slice *)arg;
+  int i, j, n;
+
+  for (i = 0; i < slice->num; i += n) {
+    n = slice->num - i < MAX_MULTI_WRITE ? slice->num - i : MAX_MULTI_WRITE;
+    if (!writePagesOnChannel(slice->client, slice->channel, &slice->keys[i], n,
+                             &slice->bufs[i], &slice->lengths[i])) {
+      // externram holds on to these buffers
+      for (j = i; j < i + n; j++)
+        slice->bufs[j] = NULL;
+    }
+  }
+  return NULL;
+}
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+/*
+ * set_pages_flushing puts the pages on the write list in flight, so that a
+ * fault on one of them waits like it does for a write of write_thread, and
+ * takes them off again once flush_pages is done with them
+ */
+static void set_pages_flushing(int ufd, uint64_t * page_list, int num_pages, bool flushing) {
+  bool waiting;
+  int i;
+
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+
+  for (i = 0; i < num_pages; i++) {
+    if (flushing)
+      add_flushing_write_info(ufd, page_list[i]);
+    else
+      del_flushing_write_info(ufd, page_list[i]);
+  }
+  waiting = isUfhandlerWaiting;
+
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+
+  if (!flushing && waiting) {
+    sem_post(&ufhandler_sem);
+    log_lock("%s: sem_posted ufhandler_sem", __func__);
+  }
+}
+#endif
+
+/*
+ * flush_pages moves the pages in page_list out of the ufd and writes them
+ * to externRAM. The pages are sorted so that each multiwrite covers a run of
+ * neighbouring addresses, and the runs are split over the write channels
+ * from first_channel on, one thread each.
+ *
+ * A fault on a page must not find it gone from the ufd before the page
+ * cache says it is in externRAM. With the write list, the pages are on it
+ * in flight until then. Without it, they are marked in flight in the page
+ * cache, and pagecache_lock is only taken to mark them and to record the
+ * writes, not across the remaps and multiwrites
+ */
+static int flush_pages(int ufd, struct externRAMClient * client, uint64_t * page_list, int num_pages,
+                       int first_channel, int channels) {
+  log_trace_in("%s", __func__);
+
+  flush_slice slices[MAX_FLUSH_WORKERS];
+  pthread_t writers[MAX_FLUSH_WORKERS];
+  uint64_t * keys = malloc(num_pages * sizeof(uint64_t));
+  void ** bufs = malloc(num_pages * sizeof(void *));
+  int * lengths = malloc(num_pages * sizeof(int));
+  int num_write = 0, per_slice, num_slices = 0;
+  int i, ret;
+
+  qsort(page_list, num_pages, sizeof(uint64_t), compare_pageaddr);
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  set_pages_flushing(ufd, page_list, num_pages, true);
+#elif defined(PAGECACHE)
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+
+  set_pages_writing(ufd, page_list, num_pages, true);
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+
+  for (i = 0; i < num_pages; i++) {
+#ifdef THREADED_REINIT
+    void * page = get_tmp_page(buf_evictpage);
+#else
+    void * page = get_local_tmp_page();
+#endif
+    if (!page) {
+      log_err("%s: failed to get evict tmp page", __func__);
+      break;
+    }
+
+    ret = evict_page(ufd, page, (void *)(uintptr_t)page_list[i]);
+    if (ret != 0) {
+      if (ret == EBUSY) {
+        log_debug("%s: flush of zeropage %p skipped", __func__, (void*)(uintptr_t)page_list[i]);
+      }
+      else
+        log_err("%s: flush of page %p failed", __func__, (void*)(uintptr_t)page_list[i]);
+      free_evict_page(page);
+      continue;
+    }
+#ifdef MONITORSTATS
+    StatsIncrPageEvicted_notlocked();
+#endif
+#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+    if (page_is_zero(page)) {
+#ifdef MONITORSTATS
+      StatsIncrWriteAvoided_notlocked();
+#endif
+#ifdef PAGECACHE
+      log_lock("%s: locking pagecache_lock", __func__);
+      pthread_mutex_lock(&pagecache_lock);
+      log_lock("%s: locked pagecache_lock", __func__);
+
+      updatePageCacheAfterSkippedWrite(pageCache, ufd, page_list[i]);
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+      set_pages_writing(ufd, &page_list[i], 1, false);
+#endif
+
+      log_lock("%s: unlocking pagecache_lock", __func__);
+      pthread_mutex_unlock(&pagecache_lock);
+      log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+      free_evict_page(page);
+      continue;
+    }
+#endif
+    keys[num_write] = page_list[i];
+    bufs[num_write] = page;
+    lengths[num_write] = PAGE_SIZE;
+    num_write++;
+  }
+
+  per_slice = (num_write + channels - 1) / channels;
+  for (i = 0; i < num_write; i += per_slice) {
+    slices[num_slices].client = client;
+    slices[num_slices].channel = first_channel + num_slices;
+    slices[num_slices].keys = &keys[i];
+    slices[num_slices].bufs = &bufs[i];
+    slices[num_slices].lengths = &lengths[i];
+    slices[num_slices].num = num_write - i < per_slice ? num_write - i : per_slice;
+    num_slices++;
+  }
+
+  // the first slice is written by this thread
+  for (i = 1; i < num_slices; i++) {
+    if (pthread_create(&writers[i], NULL, flush_slice_thread, &slices[i]) != 0) {
+      log_warn("%s: could not start writer %d, writing its pages here", __func__, i);
+      flush_slice_thread(&slices[i]);
+      writers[i] = 0;
+    }
+  }
+  if (num_slices > 0)
+    flush_slice_thread(&slices[0]);
+  for (i = 1; i < num_slices; i++) {
+    if (writers[i])
+      pthread_join(writers[i], NULL);
+  }
+
+#ifdef PAGECACHE
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+
+  for (i = 0; i < num_write; i++)
+    updatePageCacheAfterWrite(pageCache, ufd, keys[i]);
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+  // the pages that failed to be taken out of the ufd are cleared too
+  set_pages_writing(ufd, page_list, num_pages, false);
+#endif
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+#endif
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  set_pages_flushing(ufd, page_list, num_pages, false);
+#endif
+
+  for (i = 0; i < num_write; i++) {
+    if (bufs[i])
+      free_evict_page(bufs[i]);
+  }
+
+  free(keys);
+  free(bufs);
+  free(lengths);
+  log_trace_out("%s", __func__);
+  return num_write;
+}
+
+#ifdef PAGECACHE
+/* record_restore_order is called with lru_lock held */
+static void record_restore_order(int ufd, uint64_t * pages, int num, bool first) {
+  restore_order * order;
+
+  HASH_FIND_INT(restoreOrders, &ufd, order);
+  if (!order) {
+    order = calloc(1, sizeof(restore_order));
+    order->ufd = ufd;
+    HASH_ADD_INT(restoreOrders, ufd, order);
+  }
+  else if (first) {
+    order->num = 0;
+  }
+  order->pages = realloc(order->pages, (order->num + num) * sizeof(uint64_t));
+  memcpy(&order->pages[order->num], pages, num * sizeof(uint64_t));
+  order->num += num;
+}
+
+/* drop_restore_order is called with lru_lock held */
+static void drop_restore_order(int ufd) {
+  restore_order * order;
+
+  HASH_FIND_INT(restoreOrders, &ufd, order);
+  if (order) {
+    HASH_DEL(restoreOrders, order);
+    free(order->pages);
+    free(order);
+  }
+}
+#endif
+
+/*
+ * flush_lru_pages takes all pages of ufd off the LRU buffer and flushes them
+ * to externRAM, a batch per hold of lru_lock
+ */
+int flush_lru_pages(int ufd, struct externRAMClient * client) {
+  log_trace_in("%s", __func__);
+
+  uint64_t * page_list = NULL;
+  int num_pages, num_flushed = 0, num_taken = 0;
+  int channels = 1;
+  struct timespec flush_start, flush_end;
+
+  if (!client) {
+    log_warn("%s: couldn't get externram client handle for fd %d", __func__, ufd);
+    return -1;
+  }
+  if (flush_workers > 1) {
+    channels = openWriteChannels(client, flush_workers);
+    if (channels < 1)
+      channels = 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &flush_start);
+  do {
+    num_pages = 0;
+
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    page_list = removeUFDFromLRU(lru, ufd, TEARDOWN_BATCH_PAGES, &num_pages);
+    if (num_pages > 0)
+      drop_precopied(ufd, page_list, num_pages);
+#ifdef PAGECACHE
+    if (num_pages > 0)
+      record_restore_order(ufd, page_list, num_pages, num_taken == 0);
+#endif
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+
+    if (num_pages < 0) {
+      log_err("%s: failure trying to remove entries from LRU", __func__);
+    }
+    else if (num_pages > 0) {
+      num_taken += num_pages;
+      num_flushed += flush_pages(ufd, client, page_list, num_pages, 0, channels);
+    }
+    free(page_list);
+  } while (num_pages == TEARDOWN_BATCH_PAGES);
+
+  // parked zero pages may have been written since they were last swept.
+  // The ones still zero are skipped by flush_pages
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  page_list = take_ufd_zero_pages(ufd, &num_pages);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  if (num_pages > 0)
+    num_flushed += flush_pages(ufd, client, page_list, num_pages, 0, channels);
+  free(page_list);
+
+  // pages evicted before the flush may still be on the write list
+  flush_write_list();
+#ifdef MONITORSTATS
+  StatsAddFlushedPages_notlocked(num_flushed);
+#endif
+  clock_gettime(CLOCK_MONOTONIC, &flush_end);
+
+  log_info("%s: flushed %d of %d pages of ufd %d over %d channels in %ld ms", __func__,
+           num_flushed, num_taken, ufd, channels,
+           (flush_end.tv_sec - flush_start.tv_sec) * 1000 +
+           (flush_end.tv_nsec - flush_start.tv_nsec) / 1000000);
+
+  log_trace_out("%s", __func__);
+  return num_flushed;
+}
+
+/* orders pages by ufd, then by page address */
+static int compare_cache_node(const void * a, const void * b) {
+  const struct c_cache_node * x = a, * y = b;
+
+  if (x->ufd != y->ufd)
+    return x->ufd < y->ufd ? -1 : 1;
+  return x->hashcode < y->hashcode ? -1 : x->hashcode > y->hashcode;
+}
+
+/*
+ * precopy_batch writes num cold pages of ufd to externRAM while they stay
+ * mapped. The pages are read out of the address space of pid, and written
+ * on a write channel of their own, the one after those of flush_workers.
+ * Returns the number of pages written
+ */
+static int precopy_batch(int ufd, uint32_t pid, uint64_t * pageaddrs, int num) {
+  struct iovec local[MAX_MULTI_WRITE], remote[MAX_MULTI_WRITE];
+  void * bufs[MAX_MULTI_WRITE];
+  bool copied[MAX_MULTI_WRITE];
+  uint64_t fingerprints[MAX_MULTI_WRITE];
+  uint64_t write_keys[MAX_MULTI_WRITE];
+  info_key_t key;
+  void * write_bufs[MAX_MULTI_WRITE];
+  int lengths[MAX_MULTI_WRITE];
+  int i, done = 0, num_write = 0;
+  bool written = false;
+  ssize_t ret;
+  precopied_page * page;
+  struct externRAMClient * client;
+  static bool warned = false;
+
+  for (i = 0; i < num; i++) {
+#ifdef THREADED_REINIT
+    bufs[i] = get_tmp_page(buf_evictpage);
 #else
-      // not THREADED_WRITE_TO_EXTERNRAM
-      struct externRAMClient *client = get_client_by_fd(ufd);
-      if (client) {
-        start_timing_bucket(start, WRITE_PAGE);
-        write_ret = writePage(client, (uint64_t)(uintptr_t)pageaddr, evict_tmp_page_ptr);
-        stop_timing(start, end, WRITE_PAGE);
-        if (write_ret != NULL) {
-          // externram wants us to free the buffer in write_ret, but
-          // leave evict_tmp_page alone
-          skip_clean = false;
-          evict_tmp_page = write_ret;
+    bufs[i] = get_local_tmp_page();
+#endif
+    if (!bufs[i]) {
+      log_err("%s: failed to get evict tmp page", __func__);
+      break;
+    }
+    local[i].iov_base = bufs[i];
+    local[i].iov_len = PAGE_SIZE;
+    remote[i].iov_base = (void *)(uintptr_t)pageaddrs[i];
+    remote[i].iov_len = PAGE_SIZE;
+    copied[i] = false;
+  }
+  num = i;
+
+  // a page that cannot be read ends the readv, go on with the one after it
+  while (done < num) {
+    ret = process_vm_readv(pid, &local[done], num - done, &remote[done], num - done, 0);
+    if (ret < 0 && errno == ESRCH)
+      break;
+    for (i = done; ret > 0 && i < done + (int)(ret / PAGE_SIZE); i++)
+      copied[i] = true;
+    done += (ret > 0 ? ret / PAGE_SIZE : 0) + 1;
+  }
+
+  for (i = 0; i < num; i++) {
+    if (!copied[i])
+      continue;
+#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+    // eviction does not write zero pages anyway
+    if (page_is_zero(bufs[i])) {
+      copied[i] = false;
+      continue;
+    }
+#endif
+    fingerprints[i] = page_fingerprint(bufs[i]);
+  }
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  // only the pages still on the LRU buffer, an eviction of them waits for the write
+  for (i = 0; i < num; i++) {
+    if (!copied[i])
+      continue;
+    key = page_key(pageaddrs[i], ufd);
+    HASH_FIND(hh, precopiedPages, &key, sizeof(info_key_t), page);
+    if (!page || page->state != PRECOPY_SEEN || !isCachedInLRU(lru, pageaddrs[i], ufd))
+      continue;
+    page->state = PRECOPY_IN_FLIGHT;
+    page->fingerprint = fingerprints[i];
+    write_keys[num_write] = pageaddrs[i];
+    write_bufs[num_write] = bufs[i];
+    lengths[num_write] = PAGE_SIZE;
+    bufs[i] = NULL;
+    num_write++;
+  }
+  if (num_write > 0)
+    precopy_busy = true;
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  if (num_write > 0) {
+    client = get_client_by_fd(ufd);
+    if (client && openWriteChannels(client, flush_workers + 1) > flush_workers) {
+      if (!writePagesOnChannel(client, flush_workers, write_keys, num_write, write_bufs, lengths)) {
+        // externram holds on to these buffers
+        for (i = 0; i < num_write; i++)
+          write_bufs[i] = NULL;
+      }
+      written = true;
+    }
+    else if (!warned) {
+      log_warn("%s: externram of fd %d has no write channel to spare, not precopying", __func__, ufd);
+      warned = true;
+    }
+
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    for (i = 0; i < num_write; i++) {
+      key = page_key(write_keys[i], ufd);
+      HASH_FIND(hh, precopiedPages, &key, sizeof(info_key_t), page);
+      if (page && page->state == PRECOPY_IN_FLIGHT)
+        page->state = written ? PRECOPY_CLEAN : PRECOPY_SEEN;
+    }
+    precopy_busy = false;
+    pthread_cond_broadcast(&precopy_cond);
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+  }
+
+  for (i = 0; i < num; i++) {
+    if (bufs[i])
+      free_evict_page(bufs[i]);
+  }
+  for (i = 0; i < num_write; i++) {
+    if (write_bufs[i])
+      free_evict_page(write_bufs[i]);
+  }
+  return written ? num_write : 0;
+}
+
+void *precopy_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_PRECOPY_THREAD, "precopy_thread", TID());
+
+  int pass = 0;
+  int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0 || read(fd, fingerprint_key, sizeof(fingerprint_key)) != (ssize_t)sizeof(fingerprint_key)) {
+    log_err("%s: could not read a fingerprint key from /dev/urandom, not precopying", __func__);
+    if (fd >= 0)
+      close(fd);
+    log_trace_out("%s", __func__);
+    return NULL;
+  }
+  close(fd);
+
+  while(true)
+  {
+    c_cache_node * candidates = NULL, * cold;
+    uint64_t pageaddrs[MAX_MULTI_WRITE];
+    info_key_t key;
+    precopied_page * page;
+    int num_candidates, num_cold = 0, num_written = 0;
+    int i, j, ufd;
+    uint32_t pid;
+
+    usleep(precopy_interval * 1000);
+    pass++;
+
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    num_candidates = getLRUCandidates(lru, precopy_pages, &candidates);
+    cold = malloc(num_candidates * sizeof(c_cache_node));
+
+    // cold are the pages that stayed next in line for eviction over a whole interval
+    for (i = 0; i < num_candidates; i++) {
+      key = page_key(candidates[i].hashcode & (uint64_t)(PAGE_MASK), candidates[i].ufd);
+      HASH_FIND(hh, precopiedPages, &key, sizeof(info_key_t), page);
+      if (!page) {
+        page = calloc(1, sizeof(precopied_page));
+        page->key = key;
+        page->state = PRECOPY_SEEN;
+        HASH_ADD(hh, precopiedPages, key, sizeof(info_key_t), page);
+      }
+      else if (page->state == PRECOPY_SEEN && page->pass == pass - 1) {
+        cold[num_cold] = candidates[i];
+        cold[num_cold++].hashcode &= (uint64_t)(PAGE_MASK);
+      }
+      page->pass = pass;
+    }
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+
+    free(candidates);
+
+    qsort(cold, num_cold, sizeof(c_cache_node), compare_cache_node);
+    for (i = 0; i < num_cold; i = j) {
+      ufd = cold[i].ufd;
+      for (j = i; j < num_cold && j - i < MAX_MULTI_WRITE && cold[j].ufd == ufd; j++)
+        pageaddrs[j - i] = cold[j].hashcode;
+
+      pid = get_pid_by_fd(ufd);
+      if (pid)
+        num_written += precopy_batch(ufd, pid, pageaddrs, j - i);
+    }
+    free(cold);
+
+#ifdef MONITORSTATS
+    StatsAddPrecopiedPages_notlocked(num_written);
+#endif
+    if (num_cold > 0) {
+      log_debug("%s: precopied %d of %d cold pages", __func__, num_written, num_cold);
+    }
+  }
+  log_trace_out("%s", __func__);
+}
+
+/* returns the pfn of the kernel zero page, 0 if pagemap does not show pfns */
+static uint64_t find_zero_pfn(void) {
+  int pagemap_fd = -1;
+  uint32_t pagemap_pid = 0;
+  uint64_t pfn;
+  volatile char * page = mmap(NULL, PAGE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (page == MAP_FAILED)
+    return 0;
+
+  // a read of an untouched private anonymous page maps the zero page
+  (void)page[0];
+  pfn = page_idle_pfn(getpid(), (uint64_t)(uintptr_t)page, &pagemap_fd, &pagemap_pid);
+
+  if (pagemap_fd >= 0)
+    close(pagemap_fd);
+  munmap((void *)page, PAGE_SIZE);
+  return pfn;
+}
+
+/*
+ * zero_sweep_thread checks a batch of the parked zero pages every interval,
+ * oldest first, with the pagemap of their VM. A page no longer backed by the
+ * zero page was written and goes back on the LRU buffer, one that is no
+ * longer mapped is forgotten, and the rest are parked again
+ */
+void *zero_sweep_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_ZERO_SWEEP_THREAD, "zero_sweep_thread", TID());
+
+  zero_pfn = find_zero_pfn();
+  if (zero_pfn == 0) {
+    log_warn("%s: pagemap does not show the zero page pfn, zero pages stay on the LRU buffer", __func__);
+    log_trace_out("%s", __func__);
+    return NULL;
+  }
+  log_info("%s: the zero page is pfn %lx", __func__, zero_pfn);
+
+  while(true)
+  {
+    // the page address of each in hashcode
+    struct c_cache_node * keys;
+    struct c_cache_node * unparked;
+    uint64_t entries[ZERO_SWEEP_RUN];
+    zero_page * page, * tmp_page;
+    int num_keys = 0, num_unparked = 0, num_entries;
+    int i, j, k, ufd, last_ufd = -1;
+    int pagemap_fd = -1;
+    uint32_t pagemap_pid = 0, pid = 0;
+
+    usleep(zero_sweep_interval * 1000);
+
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    keys = malloc(ZERO_SWEEP_PAGES * sizeof(struct c_cache_node));
+    HASH_ITER(hh, zeroPages, page, tmp_page) {
+      if (num_keys == ZERO_SWEEP_PAGES)
+        break;
+      keys[num_keys].hashcode = *((uint64_t*)page->key.pageaddr);
+      keys[num_keys++].ufd = page->key.ufd;
+      HASH_DEL(zeroPages, page);
+      free(page);
+    }
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
+
+    unparked = malloc((num_keys + 1) * sizeof(struct c_cache_node));
+    qsort(keys, num_keys, sizeof(struct c_cache_node), compare_cache_node);
+    for (i = 0; i < num_keys; i = j) {
+      // a run of neighbouring pages of a ufd is read with one pread
+      ufd = keys[i].ufd;
+      for (j = i + 1; j < num_keys && j - i < ZERO_SWEEP_RUN && keys[j].ufd == ufd &&
+                      keys[j].hashcode == keys[j - 1].hashcode + PAGE_SIZE; j++);
+
+      if (ufd != last_ufd) {
+        pid = get_pid_by_fd(ufd);
+        last_ufd = ufd;
+      }
+      // the pages of a ufd that went away are forgotten
+      if (!pid)
+        continue;
+      num_entries = read_pagemap(pid, keys[i].hashcode, j - i, entries,
+                                 &pagemap_fd, &pagemap_pid);
+
+      log_lock("%s: locking lru_lock", __func__);
+      pthread_mutex_lock(&lru_lock);
+      log_lock("%s: locked lru_lock", __func__);
+
+      for (k = i; k < j; k++) {
+        uint64_t addr = keys[k].hashcode;
+        uint64_t entry = k - i < num_entries ? entries[k - i] : 0;
+
+        if (isCachedInLRU(lru, addr, ufd))
+          continue;
+        // bit 63 is present, bit 62 swapped, bits 0-54 the pfn
+        if ((entry & (1ULL << 63)) && (entry & ((1ULL << 55) - 1)) == zero_pfn) {
+          page = malloc(sizeof(zero_page));
+          page->key = page_key(addr, ufd);
+          HASH_ADD(hh, zeroPages, key, sizeof(info_key_t), page);
+        }
+        else if ((entry & (1ULL << 63)) || (entry & (1ULL << 62)) || k - i >= num_entries) {
+          // written since it was parked, or pagemap could not be read
+          insertCacheNode(lru, addr, ufd);
+          unparked[num_unparked++] = keys[k];
         }
       }
-      else
-        log_err("%s: failed writing page %p for invalid fd %d", __func__, pageaddr, ufd);
-#endif // THREADED_WRITE_TO_EXTERNRAM
+
+      log_lock("%s: unlocking lru_lock", __func__);
+      pthread_mutex_unlock(&lru_lock);
+      log_lock("%s: unlocked lru_lock", __func__);
+    }
+
+    if (pagemap_fd >= 0)
+      close(pagemap_fd);
+    free(keys);
 
 #ifdef PAGECACHE
-      start_timing_bucket(start, UPDATE_PAGE_CACHE);
-      updatePageCacheAfterWrite(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr);
-      stop_timing(start, end, UPDATE_PAGE_CACHE);
+    if (num_unparked > 0) {
+      log_lock("%s: locking pagecache_lock", __func__);
+      pthread_mutex_lock(&pagecache_lock);
+      log_lock("%s: locked pagecache_lock", __func__);
+
+      for (i = 0; i < num_unparked; i++)
+        markZeroPage(pageCache, unparked[i].ufd, unparked[i].hashcode, false);
+
+      log_lock("%s: unlocking pagecache_lock", __func__);
+      pthread_mutex_unlock(&pagecache_lock);
+      log_lock("%s: unlocked pagecache_lock", __func__);
+    }
 #endif
-#ifdef PAGECACHE_ZEROPAGE_OPTIMIZATION
+    free(unparked);
+
+    // pages put back may leave the buffer above capacity
+    if (num_unparked > 0) {
+      sem_post(&resize_sem);
+      log_debug("%s: %d of %d parked zero pages were written", __func__, num_unparked, num_keys);
     }
+  }
+  log_trace_out("%s", __func__);
+}
+
+/*
+ * swapout_idle_pages writes up to num pages of an idle ufd to externRAM. One
+ * page is left on the LRU buffer, so that the ufd keeps its partition there.
+ * Returns the number of pages taken off the LRU buffer
+ */
+static int swapout_idle_pages(int ufd, int num, bool first) {
+  struct externRAMClient * client = get_client_by_fd(ufd);
+  c_lru_partition * parts = NULL;
+  uint64_t * page_list = NULL;
+  int num_parts, num_pages = 0, resident = 0, written = 0, i;
+  // the write channel after those of flushes and precopy. Without it the
+  // pages go through the client itself
+  int channel = flush_workers + 1;
+
+  if (!client)
+    return 0;
+  openWriteChannels(client, channel + 1);
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  num_parts = listLRUPartitions(lru, &parts);
+  for (i = 0; i < num_parts; i++) {
+    if (parts[i].ufd == ufd)
+      resident = parts[i].resident;
+  }
+  if (num > resident - 1)
+    num = resident - 1;
+  if (num > 0) {
+    page_list = removeUFDFromLRU(lru, ufd, num, &num_pages);
+    if (num_pages > 0)
+      drop_precopied(ufd, page_list, num_pages);
+#ifdef PAGECACHE
+    if (num_pages > 0)
+      record_restore_order(ufd, page_list, num_pages, first);
+#else
+    (void)first;
 #endif
   }
-  else if (ret == 2) {
-    // tried evicting zeropage
-    log_debug("%s: Skipping writing the zeropage at (%p fd %d) to externRAM.", __func__,
-              pageaddr, ufd);
-    ret = 2;
 
-    // the page will be put back on LRU list, so don't update page cache
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  free(parts);
+  if (num_pages > 0)
+    written = flush_pages(ufd, client, page_list, num_pages, channel, 1);
+  free(page_list);
+
+#ifdef MONITORSTATS
+  StatsAddIdleSwappedOut_notlocked(written);
+#else
+  (void)written;
+#endif
+  log_debug("%s: swapped out %d of %d pages of idle ufd %d", __func__, written, num_pages, ufd);
+  return num_pages;
+}
+
+void *idle_swapout_thread(void * tmp) {
+  log_trace_in("%s", __func__);
+  setThreadCPUAffinity(CPU_FOR_IDLE_SWAPOUT_THREAD, "idle_swapout_thread", TID());
+
+#if !defined(THREADED_WRITE_TO_EXTERNRAM) && !defined(PAGECACHE)
+  // nothing would hold back a fault on a page that flush_pages is writing,
+  // so the VM could read it from externRAM before it got there
+  log_warn("%s: swapping out idle VMs needs the write list or the page cache", __func__);
+  return NULL;
+#endif
+
+  while(true)
+  {
+    ufd_activity * a, * tmp_a;
+    int * fds;
+    bool * first;
+    int num_fds = 0, budget = idle_swapout_rate;
+    int i, n;
+    struct timespec now;
+
+    sleep(1);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    log_lock("%s: locking thread_faults_lock", __func__);
+    pthread_mutex_lock(&thread_faults_lock);
+    log_lock("%s: locked thread_faults_lock", __func__);
+
+    fds = malloc((HASH_COUNT(ufdActivity) + 1) * sizeof(int));
+    first = malloc((HASH_COUNT(ufdActivity) + 1) * sizeof(bool));
+    HASH_ITER(hh, ufdActivity, a, tmp_a) {
+      if (a->exempt || now.tv_sec - a->last_fault.tv_sec < idle_timeout)
+        continue;
+      if (!a->idle) {
+        log_info("%s: ufd %d has not faulted for %d s, swapping it out", __func__, a->ufd, idle_timeout);
+        a->idle = true;
+        a->swapped = false;
+      }
+      fds[num_fds] = a->ufd;
+      first[num_fds++] = !a->swapped;
+    }
+
+    log_lock("%s: unlocking thread_faults_lock", __func__);
+    pthread_mutex_unlock(&thread_faults_lock);
+    log_lock("%s: unlocked thread_faults_lock", __func__);
+
+    // idle_swapout_rate is a budget for all idle ufds together
+    for (i = 0; i < num_fds && budget > 0; i++) {
+      do {
+        n = swapout_idle_pages(fds[i], budget < TEARDOWN_BATCH_PAGES ? budget : TEARDOWN_BATCH_PAGES, first[i]);
+        budget -= n;
+        if (n > 0 && first[i]) {
+          first[i] = false;
+
+          log_lock("%s: locking thread_faults_lock", __func__);
+          pthread_mutex_lock(&thread_faults_lock);
+          log_lock("%s: locked thread_faults_lock", __func__);
+
+          HASH_FIND_INT(ufdActivity, &fds[i], a);
+          if (a)
+            a->swapped = true;
+
+          log_lock("%s: unlocking thread_faults_lock", __func__);
+          pthread_mutex_unlock(&thread_faults_lock);
+          log_lock("%s: unlocked thread_faults_lock", __func__);
+        }
+      } while (n > 0 && budget > 0);
+    }
+
+    free(fds);
+    free(first);
+  }
+  log_trace_out("%s", __func__);
+}
+
+#ifdef PAGECACHE
+/*
+ * copy_restored_run installs num pages from src at dst with one UFFDIO_COPY.
+ * A page that cannot be placed is skipped and marked in installed
+ */
+static int copy_restored_run(int ufd, uint64_t dst, char * src, int num, bool * installed) {
+  struct uffdio_copy copy_struct;
+  int done = 0, num_installed = 0;
+
+  while (done < num) {
+    copy_struct.dst = dst + (uint64_t)done * PAGE_SIZE;
+    copy_struct.src = (uint64_t)(uintptr_t)(src + (uint64_t)done * PAGE_SIZE);
+    copy_struct.len = (uint64_t)(num - done) * PAGE_SIZE;
+    copy_struct.mode = 0;
+    copy_struct.copy = 0;
+
+    if (ioctl(ufd, UFFDIO_COPY, &copy_struct) == 0) {
+      num_installed += num - done;
+      break;
+    }
+    if (copy_struct.copy > 0) {
+      // copied part of the run before stopping at a page
+      num_installed += copy_struct.copy / PAGE_SIZE;
+      done += copy_struct.copy / PAGE_SIZE;
+    }
+    else {
+      log_debug("%s: could not restore page %p of ufd %d: %lld", __func__,
+                (void *)(uintptr_t)copy_struct.dst, ufd, (long long)copy_struct.copy);
+      installed[done] = false;
+      done++;
+    }
+  }
+  return num_installed;
+}
+
+/*
+ * install_restored_pages places the pages read back by a restore that are
+ * still only in externRAM, a run of neighbouring pages per UFFDIO_COPY, and
+ * puts them on the LRU buffer. keys is sorted
+ */
+static int install_restored_pages(int ufd, uint64_t * keys, void ** bufs, int * lengths, int num) {
+  bool installed[MAX_MULTI_READ];
+  char * run = malloc((size_t)num * PAGE_SIZE);
+  int num_installed = 0, i, j;
+
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  log_lock("%s: locking list_lock", __func__);
+  pthread_mutex_lock(&list_lock);
+  log_lock("%s: locked list_lock", __func__);
+#endif
+
+  for (i = 0; i < num; i++) {
+    installed[i] = bufs[i] != NULL && lengths[i] == PAGE_SIZE
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+                   && !exist_write_info(ufd, keys[i])
+#endif
+                   && claimRestoredPage(pageCache, ufd, keys[i]);
+  }
+
+#ifdef THREADED_WRITE_TO_EXTERNRAM
+  log_lock("%s: unlocking list_lock", __func__);
+  pthread_mutex_unlock(&list_lock);
+  log_lock("%s: unlocked list_lock", __func__);
+#endif
+
+  // the pages are placed before pagecache_lock is dropped, so a fault on
+  // one of them finds it either in externRAM or already in place
+  for (i = 0; i < num; i = j) {
+    if (!installed[i]) {
+      j = i + 1;
+      continue;
+    }
+    for (j = i; j < num && installed[j] && keys[j] == keys[i] + (uint64_t)(j - i) * PAGE_SIZE; j++)
+      memcpy(run + (uint64_t)(j - i) * PAGE_SIZE, bufs[j], PAGE_SIZE);
+    num_installed += copy_restored_run(ufd, keys[i], run, j - i, &installed[i]);
+  }
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  for (i = 0; i < num; i++) {
+    if (installed[i])
+      insertCacheNode(lru, keys[i], ufd);
+  }
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  free(run);
+  return num_installed;
+}
+
+static void *restore_reader_thread(void * arg) {
+  restore_reader * reader = (restore_reader *)arg;
+  restore_job * job = reader->job;
+  uint64_t keys[MAX_MULTI_READ];
+  void * bufs[MAX_MULTI_READ];
+  int lengths[MAX_MULTI_READ];
+  int first, num;
+
+  while ((first = __sync_fetch_and_add(&job->next, MAX_MULTI_READ)) < job->num) {
+    num = job->num - first < MAX_MULTI_READ ? job->num - first : MAX_MULTI_READ;
+    memcpy(keys, &job->pages[first], num * sizeof(uint64_t));
+    qsort(keys, num, sizeof(uint64_t), compare_pageaddr);
+    memset(bufs, 0, sizeof(bufs));
+
+    // the buffers belong to the channel until its next read. Pages allocated
+    // for us, e.g. decompressed ones, are released once they are copied
+    readPagesOnChannel(job->client, reader->channel, keys, num, bufs, lengths);
+    __sync_fetch_and_add(&job->restored, install_restored_pages(job->ufd, keys, bufs, lengths, num));
+    releasePagesOnChannel(job->client, reader->channel);
+  }
+  return NULL;
+}
+
+/*
+ * order_restore_pages puts the pages that were in the LRU buffer when ufd
+ * was last flushed first, hottest first, and the rest after them by address.
+ * Called with lru_lock held
+ */
+static void order_restore_pages(int ufd, uint64_t * pages, int num) {
+  restore_order * order;
+  uint64_t * sorted, * found;
+  int i, n = 0;
+
+  HASH_FIND_INT(restoreOrders, &ufd, order);
+  qsort(pages, num, sizeof(uint64_t), compare_pageaddr);
+  if (!order)
+    return;
+
+  sorted = malloc(num * sizeof(uint64_t));
+  memcpy(sorted, pages, num * sizeof(uint64_t));
+  for (i = 0; i < order->num; i++) {
+    found = bsearch(&order->pages[i], sorted, num, sizeof(uint64_t), compare_pageaddr);
+    if (found && *found != 0) {
+      pages[n++] = *found;
+      *found = 0; // taken, page 0 is never in a userfault region
+    }
+  }
+  for (i = 0; i < num; i++) {
+    if (sorted[i] != 0)
+      pages[n++] = sorted[i];
+  }
+  free(sorted);
+  drop_restore_order(ufd);
+}
+#endif
+
+/*
+ * restoreUFD reads the pages of ufd in [start, end) that are in externRAM
+ * back into it ahead of their faults, end 0 for all of them. As many pages
+ * are restored as the LRU buffer has room for, or the share of ufd's
+ * partition, and several read channels are read from in parallel
+ */
+int restoreUFD(int ufd, uint64_t start, uint64_t end) {
+  log_trace_in("%s", __func__);
+
+#ifndef PAGECACHE
+  (void)start;
+  (void)end;
+  log_warn("%s: restoring pages of ufd %d needs the page hash of PAGECACHE", __func__, ufd);
+  log_trace_out("%s", __func__);
+  return -1;
+#else
+  struct externRAMClient * client = get_client_by_fd(ufd);
+  restore_reader readers[MAX_RESTORE_WORKERS];
+  pthread_t reader_threads[MAX_RESTORE_WORKERS];
+  c_lru_partition * parts = NULL;
+  restore_job job;
+  struct timespec restore_start, restore_end;
+  int num_pages = 0, num_parts, allowance, channels, base, i;
+
+  if (!client) {
+    log_warn("%s: couldn't get externram client handle for fd %d", __func__, ufd);
+    log_trace_out("%s", __func__);
+    return -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &restore_start);
+
+  log_lock("%s: locking pagecache_lock", __func__);
+  pthread_mutex_lock(&pagecache_lock);
+  log_lock("%s: locked pagecache_lock", __func__);
+
+  job.pages = listExternRAMPages(pageCache, ufd, start, end, &num_pages);
+
+  log_lock("%s: unlocking pagecache_lock", __func__);
+  pthread_mutex_unlock(&pagecache_lock);
+  log_lock("%s: unlocked pagecache_lock", __func__);
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  allowance = getLRUBufferMaxSize(lru) - getLRUBufferSize(lru);
+  num_parts = listLRUPartitions(lru, &parts);
+  for (i = 0; i < num_parts; i++) {
+    if (parts[i].ufd == ufd && parts[i].share - parts[i].resident > allowance)
+      allowance = parts[i].share - parts[i].resident;
   }
+  free(parts);
+  order_restore_pages(ufd, job.pages, num_pages);
 
-  // cleanup
-  if (!skip_clean) {
-#ifdef THREADED_REINIT
-    free_ret = return_free_page(buf_evictpage, evict_tmp_page);
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  job.ufd = ufd;
+  job.client = client;
+  job.num = num_pages < allowance ? num_pages : (allowance > 0 ? allowance : 0);
+  job.next = 0;
+  job.restored = 0;
+
+  // the first read channels belong to prefetching
+#ifdef THREADED_PREFETCH
+  base = prefetch_workers;
 #else
-    free_ret = munmap(evict_tmp_page,PAGE_SIZE);
+  base = prefetch_depth;
 #endif
-    if (free_ret < 0) {
-      log_err("%s: munmap to %p", __func__, evict_tmp_page);
-    }
-    else {
-      log_debug("%s: munmap to %p", __func__, evict_tmp_page);
+  channels = openReadChannels(client, base + restore_workers) - base;
+  if (channels > restore_workers)
+    channels = restore_workers;
+  if (channels < 1) {
+    // no channels of its own, or a backend without read channels
+    log_warn("%s: no free read channel for fd %d, restoring on channel %d", __func__, ufd, base);
+    channels = 1;
+  }
+
+  for (i = 0; i < channels; i++) {
+    readers[i].job = &job;
+    readers[i].channel = base + i;
+  }
+  for (i = 1; i < channels; i++) {
+    if (pthread_create(&reader_threads[i], NULL, restore_reader_thread, &readers[i]) != 0) {
+      log_warn("%s: could not start reader %d", __func__, i);
+      reader_threads[i] = 0;
     }
   }
+  restore_reader_thread(&readers[0]);
+  for (i = 1; i < channels; i++) {
+    if (reader_threads[i])
+      pthread_join(reader_threads[i], NULL);
+  }
+  free(job.pages);
+
+  // restoring up to the partition share may leave the buffer above capacity
+  sem_post(&resize_sem);
+#ifdef MONITORSTATS
+  StatsAddRestoredPages_notlocked(job.restored);
+#endif
+  clock_gettime(CLOCK_MONOTONIC, &restore_end);
+
+  log_info("%s: restored %d of %d pages of ufd %d (allowance %d) over %d channels in %ld ms", __func__,
+           job.restored, num_pages, ufd, allowance, channels,
+           (restore_end.tv_sec - restore_start.tv_sec) * 1000 +
+           (restore_end.tv_nsec - restore_start.tv_nsec) / 1000000);
 
   log_trace_out("%s", __func__);
-  return ret;
+  return job.restored;
+#endif
 }
 
-int read_from_externram(int ufd, void * pageaddr) {
+/*
+ * discard_range drops the pages of ufd in [start, end) that the VM gave
+ * back with MADV_DONTNEED or MADV_REMOVE (UFFD_EVENT_REMOVE), e.g. on a
+ * balloon inflation or free page reporting. Writes and prefetches of the
+ * pages that are queued are cancelled and those on the wire waited for.
+ * The pages leave the LRU buffer and their copies in externRAM are deleted
+ * in batches, so the next fault on one of them places a zero page.
+ * Returns the number of pages dropped
+ */
+int discard_range(int ufd, uint64_t start, uint64_t end) {
   log_trace_in("%s", __func__);
-  log_debug("%s: reading page %p", __func__, pageaddr);
 
-  // initialization & var init
-  declare_timers();
-  int length = -1;
-  int ret = -1, ret2 = -1;
-  int ret_munmap = -1;
-#ifdef MONITORSTATS
-  StatsIncrPageFault_notlocked();
-#endif
-  int numToEvict;
-  void ** read_tmp_page_ptr = NULL;
-  bool skip_read = false;
-  void *temp_ptr = NULL;
+  struct externRAMClient *client = get_client_by_fd(ufd);
+  uint64_t * page_list = NULL;
+  uint64_t * stale_list = NULL;   // pages with a copy in externRAM
+  uint64_t fingerprint;
+  zero_page * zpage, * ztmp;
+  int num_pages = 0, num_stale = 0, num_parked = 0;
+  int i, n;
+
+  start &= (uint64_t)(PAGE_MASK);
+  end = (end + PAGE_SIZE - 1) & (uint64_t)(PAGE_MASK);
+  log_debug("%s: discarding pages %lx-%lx of ufd %d", __func__, start, end, ufd);
 
 #ifdef THREADED_WRITE_TO_EXTERNRAM
-  while (true)
-  {
+  int num_cancelled = 0;
+
+  while (true) {
+    write_info *current, *tmp;
     bool toWait = false;
-    void *page_from_write_list = NULL;
+    bool waiting;
 
     log_lock("%s: locking list_lock", __func__);
     pthread_mutex_lock(&list_lock);
     log_lock("%s: locked list_lock", __func__);
 
-    bool waiting = isWriterWaiting;
-    write_info * w = find_write_info(ufd,(uint64_t)(uintptr_t)pageaddr);
-    if(w != NULL)
-    {
-      temp_ptr = extract_page_from_write_list(w);
-      if (temp_ptr != NULL) {
-        log_debug("%s: the page %p could be pulled off the write list", __func__, pageaddr);
-#ifdef PAGECACHE
-        updatePageCacheAfterSkippedRead( (uint64_t)(uintptr_t) pageaddr, ufd );
-#endif
-        read_tmp_page_ptr = &temp_ptr;
-      }
-      else {
-        // failed to extract page. must be in-flight
+    waiting = isWriterWaiting;
+    HASH_ITER(hh2, write_list, current, tmp) {
+      uint64_t pageaddr = *((uint64_t*)current->key.pageaddr);
+      if (current->key.ufd != ufd || pageaddr < start || pageaddr >= end)
+        continue;
+      if (current->in_flight) {
         toWait = true;
-        isUfhandlerWaiting = true;
+        continue;
       }
+      // the VM no longer wants the contents, so the write is not needed
+      free_evict_page(current->page);
+      HASH_DELETE(hh2, write_list, current);
+      free(current);
+      num_cancelled++;
     }
-    else
-      isUfhandlerWaiting = false;
+    isUfhandlerWaiting = toWait;
 
     log_lock("%s: unlocking list_lock", __func__);
     pthread_mutex_unlock(&list_lock);
     log_lock("%s: unlocked list_lock", __func__);
 
-    if(toWait)
-    {
-      log_debug("%s: the page %p is on the write list, so should wait for it to be completed", __func__, pageaddr);
-      if(waiting) {
-        sem_post(&writer_sem);
-        log_lock("%s: sem_posted writer_sem", __func__);
-      }
-      log_lock("%s: sem_waiting on ufhandler_sem", __func__);
-      sem_wait(&ufhandler_sem);
-      log_lock("%s: sem_waited on ufhandler_sem", __func__);
-    }
-    else
-    {
+    if (!toWait)
       break;
+
+    // a write on the wire has to land before its page is deleted below
+    log_debug("%s: waiting for writes of ufd %d in flight", __func__, ufd);
+    if (waiting) {
+      sem_post(&writer_sem);
+      log_lock("%s: sem_posted writer_sem", __func__);
     }
+    log_lock("%s: sem_waiting on ufhandler_sem", __func__);
+    sem_wait(&ufhandler_sem);
+    log_lock("%s: sem_waited on ufhandler_sem", __func__);
   }
+  log_debug("%s: cancelled %d writes of ufd %d", __func__, num_cancelled, ufd);
 #endif
 #ifdef THREADED_PREFETCH
-  while(true)
-  {
+  while (true) {
     bool toWait = false;
 
     log_lock("%s: locking list_lock", __func__);
     pthread_mutex_lock(&list_lock);
     log_lock("%s: locked list_lock", __func__);
 
-    bool waiting = isPrefetcherWaiting;
-    if(exist_prefetch_info(ufd,(uint64_t)(uintptr_t)pageaddr))
-    {
-      log_debug("%s: found prefetch info for page %p and ufd %d", __func__, pageaddr, ufd);
-      toWait = true;
-      isUfhandlerWaiting = true;
-    }
-    else
-      isUfhandlerWaiting = false;
+    n = cancel_prefetch_range(ufd, start, end, &toWait);
+#ifdef MONITORSTATS
+    for (i = 0; i < n; i++)
+      StatsIncrPrefetchCancelled_notlocked();
+#endif
+    isUfhandlerWaiting = toWait;
 
     log_lock("%s: unlocking list_lock", __func__);
     pthread_mutex_unlock(&list_lock);
     log_lock("%s: unlocked list_lock", __func__);
 
-    if(toWait)
-    {
-      log_debug("%s: the page %p is on the prefetch list, so should wait for it to be completed", __func__, pageaddr);
-      if(waiting) {
-        sem_post(&prefetcher_sem);
-        log_lock("%s: sem_posted prefetcher_sem", __func__);
-      }
-      log_lock("%s: sem_waiting on ufhandler_sem", __func__);
-      sem_wait(&ufhandler_sem);
-      log_lock("%s: sem_waited on ufhandler_sem", __func__);
-    }
-    else
-    {
+    if (!toWait)
       break;
-    }
+
+    // a prefetch on the wire would put its page back in the page cache
+    log_debug("%s: waiting for prefetches of ufd %d in flight", __func__, ufd);
+    log_lock("%s: sem_waiting on ufhandler_sem", __func__);
+    sem_wait(&ufhandler_sem);
+    log_lock("%s: sem_waited on ufhandler_sem", __func__);
   }
 #endif
 
-#ifdef THREADED_PREFETCH
-#ifdef ASYNREAD
-  // we don't need to wait for prefetch thread, so take the lock
-  log_lock("%s: locking read_lock", __func__);
-  pthread_mutex_lock(&read_lock);
-  log_lock("%s: locked read_lock", __func__);
-#endif
-#endif
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
 
-  /*
-     Set read_tmp_page_ptr (will be given to place_data_page()) to:
-       1. the global read_tmp_page buffer
-       2. the page buffer stolen from the write list
-     This may be updated by functions that are passed read_tmp_page_ptr
-   */
-  if (read_tmp_page_ptr == NULL) {
-    read_tmp_page_ptr = &read_tmp_page;
+  page_list = removeRangeFromLRU(lru, ufd, start, end, &num_pages);
+  stale_list = malloc((num_pages + 1) * sizeof(uint64_t));
+  for (i = 0; i < num_pages; i++) {
+    // a precopied page has a copy in externRAM while it is resident
+    if (take_precopied(page_list[i], ufd, &fingerprint))
+      stale_list[num_stale++] = page_list[i];
   }
-  else {
-    skip_read = true;
-    length = PAGE_SIZE;
-#ifdef ASYNREAD
-    ret2 = evict_if_needed(ufd, pageaddr, ASYN_PAGE);
-#endif
-    goto place_page_out;
+  HASH_ITER(hh, zeroPages, zpage, ztmp) {
+    uint64_t pageaddr = *((uint64_t*)zpage->key.pageaddr);
+    if (zpage->key.ufd == ufd && pageaddr >= start && pageaddr < end) {
+      HASH_DEL(zeroPages, zpage);
+      free(zpage);
+      num_parked++;
+    }
   }
 
-#ifdef PAGECACHE
-  log_lock("%s: locking pagecache_lock", __func__);
-  pthread_mutex_lock(&pagecache_lock);
-  log_lock("%s: locked pagecache_lock", __func__);
-
-  start_timing_bucket(start, READ_VIA_PAGE_CACHE);
-#ifdef ASYNREAD
-  readPageIfInPageCache_top(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
-                            (void **)read_tmp_page_ptr);
-#else
-  length = readPageIfInPageCache(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
-                                 (void **)read_tmp_page_ptr);
-#endif
-  stop_timing(start, end, READ_VIA_PAGE_CACHE);
-
-  log_lock("%s: unlocking pagecache_lock", __func__);
-  pthread_mutex_unlock(&pagecache_lock);
-  log_lock("%s: unlocked pagecache_lock", __func__);
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
 
-#else
-  // without page cache we don't know whether page has been seen before or not.
-  struct externRAMClient *client = get_client_by_fd(ufd);
   if (client) {
-    start_timing_bucket(start, READ_PAGE);
-#ifdef ASYNREAD
-    readPage_top(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
-#else
-    length = readPage(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
-    stop_timing(start, end, READ_PAGE);
-#endif
+    for (i = 0; i < num_stale; i += n) {
+      n = num_stale - i < MAX_MULTI_WRITE ? num_stale - i : MAX_MULTI_WRITE;
+      removePages(client, &stale_list[i], n);
+    }
   }
-  else
-    log_err("%s: failed to read page %p for invalid fd %d", __func__, pageaddr, ufd);
-#endif
-
-#ifdef ASYNREAD
-  // this is the case for when the page is not taken from the write list
-  ret2 = evict_if_needed(ufd, pageaddr, ASYN_PAGE);
+  free(stale_list);
+  free(page_list);
 
 #ifdef PAGECACHE
   log_lock("%s: locking pagecache_lock", __func__);
   pthread_mutex_lock(&pagecache_lock);
   log_lock("%s: locked pagecache_lock", __func__);
-  length = readPageIfInPageCache_bottom(pageCache, ufd, (uint64_t)(uintptr_t)pageaddr,
-                                        (void **)read_tmp_page_ptr);
-  stop_timing(start, end, READ_VIA_PAGE_CACHE);
+
+  stale_list = discardPageRange(pageCache, ufd, start, end, &num_stale);
 
   log_lock("%s: unlocking pagecache_lock", __func__);
   pthread_mutex_unlock(&pagecache_lock);
   log_lock("%s: unlocked pagecache_lock", __func__);
 
-#else
-  // already got client
-  if (client) {
-    length = readPage_bottom(client, (uint64_t)(uintptr_t)pageaddr, read_tmp_page_ptr);
-    stop_timing(start, end, READ_PAGE);
-  }
-  else
-    log_err("%s: failed to read page %p for invalid fd %d", __func__, pageaddr, ufd);
-#endif
-#endif
-
-place_page_out:
-  if (length == PAGE_SIZE) {
-    ret = place_data_page(ufd, (void*)(uintptr_t)pageaddr, *read_tmp_page_ptr);
-    if (ret < 0) {
-      log_err("%s: place_data_page", __func__);
-    }
-    // ret = ufd if page eviction skipped
-  } else if (length == 0){
-    // place zero page
-    ret = place_zero_page(ufd, (void *)(uintptr_t)pageaddr);
-    if (ret < 0) {
-      log_err("%s: place_zero_page", __func__);
-    }
-    // ret = ufd if page eviction skipped
-  } else {
-    log_err("%s: we don't know how to handle a read of length %s", __func__, length);
-  }
-
-  if (skip_read) {
-    int ret_unmap = munmap(*read_tmp_page_ptr, PAGE_SIZE);
-    if (ret_unmap < 0) {
-      log_err("%s: munmap to %p", __func__, *read_tmp_page_ptr);
-    }
-    else {
-      log_debug("%s: munmap to %p", __func__, *read_tmp_page_ptr);
-    }
-  }
-
-#ifdef ASYNREAD
-  // ret2 = ufd if page eviction skipped
-  ret = ret2;
-
-  // we have returned page back to the faulting applications, so now we can
-  // resume asynchronous prefetch
-  log_lock("%s: unlocking read_lock", __func__);
-  pthread_mutex_unlock(&read_lock);
-  log_lock("%s: unlocked read_lock", __func__);
-#endif
-
-  // now is also a good time to try and evict pages to get LRUbuffer to the proper size
-  log_lock("%s: locking lru_lock", __func__);
-  pthread_mutex_lock(&lru_lock);
-  log_lock("%s: locked lru_lock", __func__);
-
-  numToEvict = getLRUBufferSize(lru) - getLRUBufferMaxSize(lru);
-  if (numToEvict > 0) {
-    log_debug("%s: the LRUBuffer has %d more pages that it should. Calling evict_to_externram_multi.",
-            __func__, numToEvict);
-    ret2 = evict_to_externram_multi(numToEvict);
-
-    log_lock("%s: unlocking lru_lock", __func__);
-    pthread_mutex_unlock(&lru_lock);
-    log_lock("%s: unlocked lru_lock", __func__);
-
-    // print log message outside of lock scope
-    if(ret2 != numToEvict) {
-      log_debug(
-               "%s: failed to evict some_pages. attempted=%d, evicted=%d",
-              __func__, numToEvict, ret2);
-    }
-  }
-  else {
-    log_lock("%s: unlocking lru_lock", __func__);
-    pthread_mutex_unlock(&lru_lock);
-    log_lock("%s: unlocked lru_lock", __func__);
-  }
-
-#ifdef MONITORSTATS
-  StatsSetLastFaultTime();
-#endif
-
-  log_trace_out("%s", __func__);
-  return ret;
-}
-
-/*
- * Delete_from_externram store
- * This function will delete the page from externram
- *
- */
-static inline int delete_from_externram(int ufd, externRAMClient *client, void * pageaddr) {
-  log_trace_in("%s", __func__);
-
-  int ret = 0;
-  // delete page from externram
-  if (client) {
-    int ret = removePage(client, (uint64_t)(uintptr_t)pageaddr);
-    if (ret != 1) {
-      log_warn("%s: failed deleting page %p", __func__, pageaddr);
+  if (client) {
+    for (i = 0; i < num_stale; i += n) {
+      n = num_stale - i < MAX_MULTI_WRITE ? num_stale - i : MAX_MULTI_WRITE;
+      removePages(client, &stale_list[i], n);
     }
   }
-  else {
-    log_err("%s: invalid externram client handle", __func__);
-    ret = -1;
+  free(stale_list);
+#else
+  // without the page cache it is not known which pages are in externRAM,
+  // and a fault would read back a stale copy, so the whole range goes
+  if (client) {
+    uint64_t keys[MAX_MULTI_WRITE];
+    uint64_t pageaddr = start;
+    num_stale = 0;
+    while (pageaddr < end) {
+      for (n = 0; n < MAX_MULTI_WRITE && pageaddr < end; n++, pageaddr += PAGE_SIZE)
+        keys[n] = pageaddr;
+      num_stale += removePages(client, keys, n);
+    }
   }
+#endif
+
+  n = num_pages + num_parked + num_stale;
+#ifdef MONITORSTATS
+  StatsAddDiscardedPages_notlocked(n);
+#endif
+  log_debug("%s: discarded %d resident, %d parked and %d evicted pages of ufd %d",
+            __func__, num_pages, num_parked, num_stale, ufd);
 
   log_trace_out("%s", __func__);
-  return ret;
+  return n;
 }
 
-
 int flush_buffers(int ufd, externRAMClient *client, int flush_or_delete) {
   log_trace_in("%s", __func__);
 
   uint64_t * page_list = NULL;
   int num_pages;
-  int i, ret;
 
   // If we are flushing pages, only lru buffer has dirty pages to flush.
-  num_pages = 0;
-
-  log_lock("%s: locking lru_lock", __func__);
-  pthread_mutex_lock(&lru_lock);
-  log_lock("%s: locked lru_lock", __func__);
+  // Pages are taken off the LRU in batches so that faults of other ufds
+  // get lru_lock in between.
+  if (flush_or_delete == FLUSH_TO_EXTERNRAM) {
+    // in this case ufd better not have been removed from map
+    flush_lru_pages(ufd, client);
+  }
+  else {
+    do {
+      num_pages = 0;
 
-  page_list = removeUFDFromLRU(lru, ufd, &num_pages);
+      log_lock("%s: locking lru_lock", __func__);
+      pthread_mutex_lock(&lru_lock);
+      log_lock("%s: locked lru_lock", __func__);
 
-  log_lock("%s: unlocking lru_lock", __func__);
-  pthread_mutex_unlock(&lru_lock);
-  log_lock("%s: unlocked lru_lock", __func__);
+      page_list = removeUFDFromLRU(lru, ufd, TEARDOWN_BATCH_PAGES, &num_pages);
+      if (num_pages > 0)
+        drop_precopied(ufd, page_list, num_pages);
 
-  if (num_pages < 0) {
-    log_err("%s: failure trying to remove entries from LRU", __func__);
-  }
+      log_lock("%s: unlocking lru_lock", __func__);
+      pthread_mutex_unlock(&lru_lock);
+      log_lock("%s: unlocked lru_lock", __func__);
 
-  if (flush_or_delete == FLUSH_TO_EXTERNRAM) {
-    // in this case ufd better not have been removed from map
-    for (i = 0; i < num_pages; i++) {
-      ret = evict_to_externram(ufd, (void *)(uintptr_t)page_list[i]);
-      if (ret == 0) {
-        log_debug("%s: flush of page %p succeeded", __func__, (void*)(uintptr_t)page_list[i]);
+      if (num_pages < 0) {
+        log_err("%s: failure trying to remove entries from LRU", __func__);
       }
-      else if (ret == 2) {
-        log_debug("%s: flush of page %p delayed", __func__, (void*)(uintptr_t)page_list[i]);
+
+      if (num_pages > 0) {
+        log_debug("%s: removed %d pages from LRU", __func__, num_pages);
       }
-      else
-        log_err("%s: flush of page %p failed", __func__, (void*)(uintptr_t)page_list[i]);
-    }
+      free(page_list);
+    } while (num_pages == TEARDOWN_BATCH_PAGES);
   }
 
-  if (num_pages > 0) {
-    log_debug("%s: removed %d pages from LRU", __func__, num_pages);
-    free(page_list);
+  if (flush_or_delete == DELETE_FROM_EXTERNRAM) {
+    remove_thread_faults(ufd);
+
+    log_lock("%s: locking lru_lock", __func__);
+    pthread_mutex_lock(&lru_lock);
+    log_lock("%s: locked lru_lock", __func__);
+
+    remove_ufd_from_shadows(ufd);
+    free(take_ufd_zero_pages(ufd, &num_pages));
+#ifdef PAGECACHE
+    drop_restore_order(ufd);
+#endif
+
+    log_lock("%s: unlocking lru_lock", __func__);
+    pthread_mutex_unlock(&lru_lock);
+    log_lock("%s: unlocked lru_lock", __func__);
   }
 
 
 #ifdef PAGECACHE
-  // Clean up pages in PageCache
-  num_pages = 0;
+  // Clean up pages in PageCache, a batch per hold of pagecache_lock
+  void * page_states = NULL;
+  int i, ret;
+  do {
+    num_pages = 0;
 
-  log_lock("%s: locking pagecache_lock", __func__);
-  pthread_mutex_lock(&pagecache_lock);
-  log_lock("%s: locked pagecache_lock", __func__);
+    log_lock("%s: locking pagecache_lock", __func__);
+    pthread_mutex_lock(&pagecache_lock);
+    log_lock("%s: locked pagecache_lock", __func__);
 
-  removeUFDFromPageCache(pageCache, ufd, &num_pages);
-  if ( num_pages < 0) {
-    log_err("%s: failed trying to remove entries for UFD %d from PageCache", __func__, ufd);
-  }
-  if (num_pages > 0) {
-    log_debug("%s: removed %d pages from page cache", __func__, num_pages);
-  }
+    removeUFDFromPageCache(pageCache, ufd, TEARDOWN_BATCH_PAGES, &num_pages);
+    if ( num_pages < 0) {
+      log_err("%s: failed trying to remove entries for UFD %d from PageCache", __func__, ufd);
+    }
+    if (num_pages > 0) {
+      log_debug("%s: removed %d pages from page cache", __func__, num_pages);
+    }
 
-  // Now clean up all pages that we've seen before (in pagehash)
-  num_pages = 0;
+    // once the page cache is empty, take the pages that we've seen before
+    // (in pagehash) and scan them after the lock is dropped
+    if (num_pages < TEARDOWN_BATCH_PAGES)
+      page_states = detachUFDFromPageHash(pageCache, ufd);
+
+    log_lock("%s: unlocking pagecache_lock", __func__);
+    pthread_mutex_unlock(&pagecache_lock);
+    log_lock("%s: unlocked pagecache_lock", __func__);
+  } while (num_pages == TEARDOWN_BATCH_PAGES);
 
-  page_list = removeUFDFromPageHash(pageCache, ufd, &num_pages);
+  num_pages = 0;
+  page_list = removeDetachedPageHash(pageCache, page_states, &num_pages);
   if ( num_pages < 0) {
     log_err("%s: failed trying to remove entries for UFD %d from PageHash", __func__, ufd);
   }
 
-  log_lock("%s: unlocking pagecache_lock", __func__);
-  pthread_mutex_unlock(&pagecache_lock);
-  log_lock("%s: unlocked pagecache_lock", __func__);
-
   // pages in page_list are from page hash. If process is dead, we
   // can use this list to delete them and free up space
   if (flush_or_delete == DELETE_FROM_EXTERNRAM) {
@@ -1463,9 +3882,15 @@ void clean_up_lock() {
 
   pthread_mutex_destroy(&zh_lock);
   pthread_mutex_destroy(&lru_lock);
+  pthread_mutex_destroy(&thread_faults_lock);
   pthread_mutex_destroy(&fdUpidMap_lock);
+  sem_destroy(&resize_sem);
+  pthread_cond_destroy(&precopy_cond);
 #ifdef PAGECACHE
   pthread_mutex_destroy(&pagecache_lock);
+#ifndef THREADED_WRITE_TO_EXTERNRAM
+  pthread_cond_destroy(&pagecache_written_cond);
+#endif
 #endif
 #ifdef THREADED_WRITE_TO_EXTERNRAM
   pthread_mutex_destroy(&flush_write_needed_lock);
@@ -1474,9 +3899,7 @@ void clean_up_lock() {
 #endif
 #ifdef THREADED_PREFETCH
   sem_destroy(&prefetcher_sem);
-#ifdef ASYNREAD
-  pthread_mutex_destroy(&read_lock);
-#endif
+  pthread_cond_destroy(&demand_reads_cond);
 #endif
 #if defined(THREADED_WRITE_TO_EXTERNRAM) || defined(THREADED_PREFETCH)
   pthread_mutex_destroy(&list_lock);
@@ -1631,6 +4054,11 @@ int recv_fd(int socket) {
     {
       add_upid_in_map(sent_fd, upid64);
       register_with_externram(config, sent_fd);
+#ifdef THREADED_PREFETCH
+      struct externRAMClient *client = get_client_by_fd(sent_fd);
+      if (client && openReadChannels(client, prefetch_workers) < prefetch_workers)
+        log_warn("%s: could not open %d read channels for fd %d", __func__, prefetch_workers, sent_fd);
+#endif
       break;
     } else if(ret==ZOOKEEPER_UPID_ERR)
     {
@@ -1809,6 +4237,326 @@ int listPids(uint32_t ** pid_list_ptr) {
   return num_pids;
 }
 
+int listFaultThreads(thread_faults ** list_ptr) {
+  log_trace_in("%s", __func__);
+
+  thread_faults_entry *current, *tmp;
+  int num_threads = 0;
+
+  log_lock("%s: locking thread_faults_lock", __func__);
+  pthread_mutex_lock(&thread_faults_lock);
+  log_lock("%s: locked thread_faults_lock", __func__);
+
+  *list_ptr = malloc((HASH_COUNT(threadFaultsMap) + 1) * sizeof(thread_faults));
+  if (*list_ptr) {
+    HASH_ITER(hh, threadFaultsMap, current, tmp) {
+      (*list_ptr)[num_threads++] = current->stats;
+    }
+  }
+  else
+    log_err("%s: failed to allocate the list of faulting threads", __func__);
+
+  log_lock("%s: unlocking thread_faults_lock", __func__);
+  pthread_mutex_unlock(&thread_faults_lock);
+  log_lock("%s: unlocked thread_faults_lock", __func__);
+
+  log_trace_out("%s", __func__);
+  return num_threads;
+}
+
+int setPartition(uint32_t pidToSet, int min_pages, int weight) {
+  log_trace_in("%s", __func__);
+
+  struct map_struct *current, *temp;
+  int fds[MAX_UFDS_PER_PID];
+  int num_fds = 0, i;
+
+  if (min_pages < 0 || weight < 0) {
+    log_warn("%s: invalid partition %d:%d for pid %u", __func__, min_pages, weight, pidToSet);
+    log_trace_out("%s", __func__);
+    return -1;
+  }
+
+  log_lock("%s: locking fdUpidMap_lock", __func__);
+  pthread_mutex_lock(&fdUpidMap_lock);
+  log_lock("%s: locked fdUpidMap_lock", __func__);
+
+  HASH_ITER(hh, fdUpidMap, current, temp) {
+    uint8_t upid[8];
+    memcpy(upid, &current->upid, 8);
+    if (*((uint16_t*) &upid[0]) == get_node_id() &&
+        *((uint32_t*) &upid[2]) == pidToSet && num_fds < MAX_UFDS_PER_PID)
+      fds[num_fds++] = current->fd;
+  }
+
+  log_lock("%s: unlocking fdUpidMap_lock", __func__);
+  pthread_mutex_unlock(&fdUpidMap_lock);
+  log_lock("%s: unlocked fdUpidMap_lock", __func__);
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  for (i = 0; i < num_fds; i++) {
+    setLRUPartition(lru, fds[i], min_pages, weight);
+    log_info("%s: ufd %d of pid %u has a minimum of %d pages and weight %d",
+             __func__, fds[i], pidToSet, min_pages, weight);
+  }
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  log_trace_out("%s", __func__);
+  return num_fds > 0 ? num_fds : -1;
+}
+
+/* exempts the ufds of pid from being swapped out when idle, or lifts that */
+int setIdleExempt(uint32_t pidToSet, bool exempt) {
+  log_trace_in("%s", __func__);
+
+  struct map_struct *current, *temp;
+  ufd_activity *a;
+  int fds[MAX_UFDS_PER_PID];
+  int num_fds = 0, i;
+
+  log_lock("%s: locking fdUpidMap_lock", __func__);
+  pthread_mutex_lock(&fdUpidMap_lock);
+  log_lock("%s: locked fdUpidMap_lock", __func__);
+
+  HASH_ITER(hh, fdUpidMap, current, temp) {
+    uint8_t upid[8];
+    memcpy(upid, &current->upid, 8);
+    if (*((uint16_t*) &upid[0]) == get_node_id() &&
+        *((uint32_t*) &upid[2]) == pidToSet && num_fds < MAX_UFDS_PER_PID)
+      fds[num_fds++] = current->fd;
+  }
+
+  log_lock("%s: unlocking fdUpidMap_lock", __func__);
+  pthread_mutex_unlock(&fdUpidMap_lock);
+  log_lock("%s: unlocked fdUpidMap_lock", __func__);
+
+  log_lock("%s: locking thread_faults_lock", __func__);
+  pthread_mutex_lock(&thread_faults_lock);
+  log_lock("%s: locked thread_faults_lock", __func__);
+
+  for (i = 0; i < num_fds; i++) {
+    HASH_FIND_INT(ufdActivity, &fds[i], a);
+    if (a == NULL) {
+      // not faulted yet, idle from now on
+      a = (ufd_activity *) calloc(1, sizeof(ufd_activity));
+      if (a == NULL) {
+        log_err("%s: failed to allocate activity entry", __func__);
+        break;
+      }
+      a->ufd = fds[i];
+      clock_gettime(CLOCK_MONOTONIC, &a->last_fault);
+      HASH_ADD_INT(ufdActivity, ufd, a);
+    }
+    a->exempt = exempt;
+    log_info("%s: ufd %d of pid %u is %s", __func__, fds[i], pidToSet,
+             exempt ? "exempt from idle swap-out" : "swapped out when idle");
+  }
+
+  log_lock("%s: unlocking thread_faults_lock", __func__);
+  pthread_mutex_unlock(&thread_faults_lock);
+  log_lock("%s: unlocked thread_faults_lock", __func__);
+
+  log_trace_out("%s", __func__);
+  return num_fds > 0 ? num_fds : -1;
+}
+
+int listIdle(idle_info ** list_ptr) {
+  log_trace_in("%s", __func__);
+
+  ufd_activity *a, *tmp;
+  struct timespec now;
+  int num = 0, i;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  log_lock("%s: locking thread_faults_lock", __func__);
+  pthread_mutex_lock(&thread_faults_lock);
+  log_lock("%s: locked thread_faults_lock", __func__);
+
+  *list_ptr = malloc((HASH_COUNT(ufdActivity) + 1) * sizeof(idle_info));
+  if (!(*list_ptr)) {
+    log_err("%s: failed to allocate the list of ufds", __func__);
+  }
+  else {
+    HASH_ITER(hh, ufdActivity, a, tmp) {
+      (*list_ptr)[num].ufd = a->ufd;
+      (*list_ptr)[num].idle_secs = now.tv_sec - a->last_fault.tv_sec;
+      (*list_ptr)[num].exempt = a->exempt;
+      (*list_ptr)[num].idle = a->idle;
+      num++;
+    }
+  }
+
+  log_lock("%s: unlocking thread_faults_lock", __func__);
+  pthread_mutex_unlock(&thread_faults_lock);
+  log_lock("%s: unlocked thread_faults_lock", __func__);
+
+  // get_pid_by_fd takes fdUpidMap_lock, not while holding thread_faults_lock
+  for (i = 0; i < num; i++)
+    (*list_ptr)[i].pid = get_pid_by_fd((*list_ptr)[i].ufd);
+
+  log_trace_out("%s", __func__);
+  return num;
+}
+
+int flushPid(uint32_t pidToFlush) {
+  log_trace_in("%s", __func__);
+
+  struct map_struct *current, *temp;
+  int fds[MAX_UFDS_PER_PID];
+  int num_fds = 0, num_flushed = 0, i, ret;
+
+  log_lock("%s: locking fdUpidMap_lock", __func__);
+  pthread_mutex_lock(&fdUpidMap_lock);
+  log_lock("%s: locked fdUpidMap_lock", __func__);
+
+  HASH_ITER(hh, fdUpidMap, current, temp) {
+    uint8_t upid[8];
+    memcpy(upid, &current->upid, 8);
+    if (*((uint16_t*) &upid[0]) == get_node_id() &&
+        *((uint32_t*) &upid[2]) == pidToFlush && num_fds < MAX_UFDS_PER_PID)
+      fds[num_fds++] = current->fd;
+  }
+
+  log_lock("%s: unlocking fdUpidMap_lock", __func__);
+  pthread_mutex_unlock(&fdUpidMap_lock);
+  log_lock("%s: unlocked fdUpidMap_lock", __func__);
+
+  for (i = 0; i < num_fds; i++) {
+    ret = flush_lru_pages(fds[i], get_client_by_fd(fds[i]));
+    if (ret > 0)
+      num_flushed += ret;
+  }
+
+  log_trace_out("%s", __func__);
+  return num_fds > 0 ? num_flushed : -1;
+}
+
+int restorePid(uint32_t pidToRestore, uint64_t start, uint64_t end) {
+  log_trace_in("%s", __func__);
+
+  struct map_struct *current, *temp;
+  int fds[MAX_UFDS_PER_PID];
+  int num_fds = 0, num_restored = 0, i, ret;
+
+  log_lock("%s: locking fdUpidMap_lock", __func__);
+  pthread_mutex_lock(&fdUpidMap_lock);
+  log_lock("%s: locked fdUpidMap_lock", __func__);
+
+  HASH_ITER(hh, fdUpidMap, current, temp) {
+    uint8_t upid[8];
+    memcpy(upid, &current->upid, 8);
+    if (*((uint16_t*) &upid[0]) == get_node_id() &&
+        *((uint32_t*) &upid[2]) == pidToRestore && num_fds < MAX_UFDS_PER_PID)
+      fds[num_fds++] = current->fd;
+  }
+
+  log_lock("%s: unlocking fdUpidMap_lock", __func__);
+  pthread_mutex_unlock(&fdUpidMap_lock);
+  log_lock("%s: unlocked fdUpidMap_lock", __func__);
+
+  for (i = 0; i < num_fds; i++) {
+    ret = restoreUFD(fds[i], start, end);
+    if (ret < 0) {
+      log_trace_out("%s", __func__);
+      return -1;
+    }
+    num_restored += ret;
+  }
+
+  log_trace_out("%s", __func__);
+  return num_fds > 0 ? num_restored : -1;
+}
+
+int listPartitions(partition_info ** list_ptr) {
+  log_trace_in("%s", __func__);
+
+  c_lru_partition * parts = NULL;
+  int num_parts = 0, i;
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  num_parts = listLRUPartitions(lru, &parts);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  *list_ptr = malloc((num_parts + 1) * sizeof(partition_info));
+  if (!(*list_ptr)) {
+    log_err("%s: failed to allocate the list of partitions", __func__);
+    num_parts = 0;
+  }
+  for (i = 0; i < num_parts; i++) {
+    (*list_ptr)[i].pid = get_pid_by_fd(parts[i].ufd);
+    (*list_ptr)[i].ufd = parts[i].ufd;
+    (*list_ptr)[i].min_pages = parts[i].min_pages;
+    (*list_ptr)[i].weight = parts[i].weight;
+    (*list_ptr)[i].resident = parts[i].resident;
+    (*list_ptr)[i].share = parts[i].share;
+    (*list_ptr)[i].faults = parts[i].faults;
+    (*list_ptr)[i].ghost_hits = parts[i].ghost_hits;
+  }
+  free(parts);
+
+  log_trace_out("%s", __func__);
+  return num_parts;
+}
+
+int getMissRatioCurve(int ufd, uint64_t * sampled, struct c_mrc_point ** points) {
+  log_trace_in("%s", __func__);
+
+  int num_points;
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  num_points = getLRUMissRatioCurve(lru, ufd, sampled, points);
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  log_trace_out("%s", __func__);
+  return num_points;
+}
+
+int listShadows(shadow_info ** list_ptr) {
+  log_trace_in("%s", __func__);
+
+  int i;
+
+  *list_ptr = malloc((num_shadows + 1) * sizeof(shadow_info));
+  if (!(*list_ptr)) {
+    log_err("%s: failed to allocate the list of shadow policies", __func__);
+    log_trace_out("%s", __func__);
+    return 0;
+  }
+
+  log_lock("%s: locking lru_lock", __func__);
+  pthread_mutex_lock(&lru_lock);
+  log_lock("%s: locked lru_lock", __func__);
+
+  for (i = 0; i < num_shadows; i++)
+    (*list_ptr)[i] = shadows[i].stats;
+
+  log_lock("%s: unlocking lru_lock", __func__);
+  pthread_mutex_unlock(&lru_lock);
+  log_lock("%s: unlocked lru_lock", __func__);
+
+  log_trace_out("%s", __func__);
+  return num_shadows;
+}
+
 int remove_upid(uint64_t upid) {
   int ret = 0;
 
@@ -41,6 +41,18 @@
 #define MAX_MULTI_READ 200
 #define MAX_MULTI_WRITE 200
 
+// pages removed per hold of lru_lock or pagecache_lock when a ufd is torn down
+#define TEARDOWN_BATCH_PAGES 1024
+
+// parked zero pages checked per sweep, and pagemap entries read at once
+#define ZERO_SWEEP_PAGES 4096
+#define ZERO_SWEEP_RUN 512
+
+// parallel writers of a flush, at most one per write channel of a client
+#define MAX_FLUSH_WORKERS 16
+// parallel readers of a restore, at most one per read channel of a client
+#define MAX_RESTORE_WORKERS 16
+
 /*
  * Global variables
  */
@@ -66,6 +78,44 @@ struct poll_state {
   sem_t sempoll;
 };
 
+/* faults taken by one thread of a registered process */
+typedef struct thread_faults {
+  int ufd;
+  uint32_t ptid;     /* 0 when the ufd does not report thread ids */
+  unsigned long faults;
+} thread_faults;
+
+/* the partition of the LRU buffer held by a ufd, in pages */
+typedef struct partition_info {
+  uint32_t pid;
+  int ufd;
+  int min_pages;     /* reserved for the ufd */
+  int weight;        /* for sharing what is not reserved */
+  int resident;
+  int share;         /* what the ufd may keep before others lose pages to it */
+  unsigned long faults;      /* recent faults and faults on pages just */
+  unsigned long ghost_hits;  /* evicted, when rebalancing */
+} partition_info;
+
+/* the time since the last fault of a ufd, for swapping out idle ones */
+typedef struct idle_info {
+  uint32_t pid;
+  int ufd;
+  long idle_secs;    /* since its last fault */
+  bool exempt;       /* never swapped out when idle */
+  bool idle;         /* being swapped out */
+} idle_info;
+
+/* a replacement policy run over a sample of the faults for comparison */
+#define MAX_SHADOW_POLICIES 4
+typedef struct shadow_info {
+  char policy[8];
+  bool active;          /* the policy of the LRU buffer */
+  int size;             /* pages, scaled down by the sampling */
+  unsigned long faults; /* sampled faults fed to the shadow */
+  unsigned long hits;   /* of those, the pages the shadow still held */
+} shadow_info;
+
 /* Wake the caller after a fault */
 int ack_userfault(int ufd, void *start, size_t len);
 
@@ -79,7 +129,8 @@ int evict_page(int ufd, void * dst, void * src);
 
 /* interface with libexternram */
 int evict_to_externram(int ufd, void * pageaddr);
-int read_from_externram(int ufd, void * pageaddr);
+int read_from_externram(int ufd, void * pageaddr, uint32_t ptid);
+int discard_range(int ufd, uint64_t start, uint64_t end);
 int evict_to_externram_multi(int size);
 static inline int delete_from_externram(int ufd, externRAMClient *client, void * pageaddr);
 int getExternRAMUsage(ServerUsage ** usage);
@@ -88,7 +139,26 @@ int resizeLRUBuffer(int size);
 int purgeDeadUpids(int ** ufd_list_ptr);
 int flush_ufd(int ufd, externRAMClient *client);
 int flush_buffers(int ufd, externRAMClient *client, int flush_or_delete);
+int flush_lru_pages(int ufd, externRAMClient *client);
+int flushPid(uint32_t pid);
+int restoreUFD(int ufd, uint64_t start, uint64_t end);
+int restorePid(uint32_t pid, uint64_t start, uint64_t end);
 int listPids(uint32_t ** pid_list_ptr);
+int listFaultThreads(thread_faults ** list_ptr);
+int setPartition(uint32_t pid, int min_pages, int weight);
+int listPartitions(partition_info ** list_ptr);
+int setIdleExempt(uint32_t pid, bool exempt);
+int listIdle(idle_info ** list_ptr);
+struct c_mrc_point;
+int getMissRatioCurve(int ufd, uint64_t * sampled, struct c_mrc_point ** points);
+int listShadows(shadow_info ** list_ptr);
+void *page_idle_thread(void * tmp);
+void *rebalance_thread(void * tmp);
+void *autosize_thread(void * tmp);
+void *resize_drain_thread(void * tmp);
+void *precopy_thread(void * tmp);
+void *idle_swapout_thread(void * tmp);
+void *zero_sweep_thread(void * tmp);
 int removePid(uint32_t pidToRemove);
 int remove_upid(uint64_t upid);
 void flush_write_list(void);
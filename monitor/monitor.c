@@ -35,6 +35,7 @@
 #include "pollfd_vector.h"
 #include <threaded_io.h>
 #include <buffer_allocator_array.h>
+#include <c_cache_node.h>
 
 /* cstdlib includes */
 #include <stdbool.h>
@@ -70,8 +71,15 @@
 #ifdef PAGECACHE
 int is_test_readahead = 0;
 extern int page_cache_size;
+extern int victim_cache_size;
 extern int prefetch_size;
 extern int enable_prefetch;
+extern int max_prefetch_size;
+extern int prefetch_latency_budget;
+extern int prefetch_depth;
+#ifdef THREADED_PREFETCH
+extern int prefetch_workers;
+#endif
 #endif
 
 #include <monitorstats.h>
@@ -86,6 +94,30 @@ TimingBucket * timing_buckets;
 #endif
 
 extern int cache_size;
+extern int lru_policy;
+extern int mrc_sampling;
+extern char * shadow_policies;
+extern int shadow_sampling;
+extern int autosize_interval;
+extern int autosize_min;
+extern int autosize_max;
+extern int autosize_step;
+extern int autosize_psi;
+extern int autosize_low_mb;
+extern int autosize_high_mb;
+extern int flush_workers;
+extern int restore_workers;
+extern int precopy_interval;
+extern int precopy_pages;
+extern int idle_timeout;
+extern int idle_swapout_rate;
+extern int hot_pages_pct;
+extern int hot_refaults;
+extern int zero_sweep_interval;
+extern int page_idle_interval;
+extern int page_idle_sample;
+extern int rebalance_interval;
+extern int rebalance_pages;
 
 volatile sig_atomic_t fatal_error_in_progress = 0;
 
@@ -104,6 +136,13 @@ pthread_t polling_worker;
 #ifdef REAPERTHREAD
 pthread_t reaper_worker;
 #endif
+pthread_t page_idle_worker;
+pthread_t rebalance_worker;
+pthread_t autosize_worker;
+pthread_t resize_worker;
+pthread_t precopy_worker;
+pthread_t idle_swapout_worker;
+pthread_t zero_sweep_worker;
 
 int ufd;  // the temporary recveived file descriptor
 int socket_fd;
@@ -164,6 +203,7 @@ int handle_userfault(int ufd) {
   int type;
   struct uffd_msg msg;
   uint64_t pageaddr;
+  uint32_t ptid = 0;
   declare_timers();
 
   /* Read from the ufd to get the address of the userfault */
@@ -195,12 +235,16 @@ int handle_userfault(int ufd) {
     case UFFD_EVENT_PAGEFAULT:
       /* read was succesful. now deal with fault at pageaddr */
       pageaddr = (uint64_t)msg.arg.pagefault.address;
+#ifdef UFFD_FEATURE_THREAD_ID
+      /* 0 unless the ufd was opened with UFFD_FEATURE_THREAD_ID */
+      ptid = msg.arg.pagefault.feat.ptid;
+#endif
 
       /* Now get rid of flags encoded in address */
       pageaddr &= (uint64_t)(PAGE_MASK);
 
       start_timing_bucket(start, READ_FROM_EXTERNRAM);
-      ret = read_from_externram(ufd, (void*)(uintptr_t)pageaddr);
+      ret = read_from_externram(ufd, (void*)(uintptr_t)pageaddr, ptid);
       stop_timing(start, end, READ_FROM_EXTERNRAM);
 
       if (ret < 0) {
@@ -226,6 +270,13 @@ int handle_userfault(int ufd) {
       }
       break;
     case UFFD_EVENT_REMOVE:
+      /* the range was given back (MADV_DONTNEED or MADV_REMOVE), so drop
+       * its pages. The ufd stays registered */
+      ret = discard_range(ufd, (uint64_t)msg.arg.remove.start, (uint64_t)msg.arg.remove.end);
+      log_debug("%s: discarded %d pages of uffd (%d) in %llx-%llx", __func__, ret, ufd,
+                msg.arg.remove.start, msg.arg.remove.end);
+      discard_timing();
+      break;
     case UFFD_EVENT_UNMAP:
     case UFFD_EVENT_FORK:
     case UFFD_EVENT_REMAP:
@@ -486,6 +537,31 @@ fatal_error_signal (int sig)
 #ifdef REAPERTHREAD
   pthread_cancel(reaper_worker);
 #endif
+  if( page_idle_interval>0 )
+  {
+    pthread_cancel(page_idle_worker);
+  }
+  if( rebalance_interval>0 )
+  {
+    pthread_cancel(rebalance_worker);
+  }
+  if( autosize_interval>0 )
+  {
+    pthread_cancel(autosize_worker);
+  }
+  if( precopy_interval>0 )
+  {
+    pthread_cancel(precopy_worker);
+  }
+  if( idle_timeout>0 )
+  {
+    pthread_cancel(idle_swapout_worker);
+  }
+  if( zero_sweep_interval>0 )
+  {
+    pthread_cancel(zero_sweep_worker);
+  }
+  pthread_cancel(resize_worker);
   pthread_cancel(main_worker);
 
 #ifdef ENABLE_AFFINITY
@@ -620,11 +696,40 @@ int main (int argc, char *argv[])
   strcpy(zookeeperConn,"10.0.1.1:2181");
 
   char optionStr0[] = "--cache_size=";
+  char optionStr14[] = "--lru_policy=";
+  char optionStr15[] = "--page_idle_interval=";
+  char optionStr16[] = "--page_idle_sample=";
+  char optionStr17[] = "--rebalance_interval=";
+  char optionStr18[] = "--rebalance_pages=";
+  char optionStr19[] = "--mrc_sampling=";
+  char optionStr20[] = "--shadow_policies=";
+  char optionStr21[] = "--shadow_sampling=";
+  char optionStr22[] = "--autosize_interval=";
+  char optionStr23[] = "--autosize_min=";
+  char optionStr24[] = "--autosize_max=";
+  char optionStr25[] = "--autosize_step=";
+  char optionStr26[] = "--autosize_psi=";
+  char optionStr27[] = "--autosize_low_mb=";
+  char optionStr28[] = "--autosize_high_mb=";
+  char optionStr29[] = "--flush_workers=";
+  char optionStr30[] = "--restore_workers=";
+  char optionStr31[] = "--precopy_interval=";
+  char optionStr32[] = "--precopy_pages=";
+  char optionStr33[] = "--idle_timeout=";
+  char optionStr34[] = "--idle_swapout_rate=";
+  char optionStr35[] = "--hot_pages_pct=";
+  char optionStr36[] = "--hot_refaults=";
+  char optionStr37[] = "--zero_sweep_interval=";
 #ifdef PAGECACHE
   char optionStr1[] = "--page_cache_size=";
   char optionStr2[] = "--prefetch_size=";
   char optionStr3[] = "--enable_prefetch=";
   char optionStr4[] = "--test_readahead";
+  char optionStr10[] = "--max_prefetch_size=";
+  char optionStr11[] = "--prefetch_latency_budget=";
+  char optionStr12[] = "--prefetch_workers=";
+  char optionStr13[] = "--prefetch_depth=";
+  char optionStr38[] = "--victim_cache_size=";
 #endif
   char optionStr5[] = "--zookeeper=";
   char optionStr6[] = "--print_info";
@@ -640,10 +745,108 @@ int main (int argc, char *argv[])
     if (strncmp(argv[i], optionStr0, sizeof(optionStr0) - 1) == 0) {
       cache_size = atoi(argv[i] + sizeof(optionStr0) - 1);
     }
+    else if (strncmp(argv[i], optionStr14, sizeof(optionStr14) - 1) == 0) {
+      char * policy = argv[i] + sizeof(optionStr14) - 1;
+      if (strcmp(policy, "arc") == 0)
+        lru_policy = LRU_POLICY_ARC;
+      else if (strcmp(policy, "clock") == 0)
+        lru_policy = LRU_POLICY_CLOCK;
+      else if (strcmp(policy, "lru") == 0)
+        lru_policy = LRU_POLICY_LRU;
+      else
+        log_warn("%s: unknown lru_policy %s, keeping lru", __func__, policy);
+    }
+    else if (strncmp(argv[i], optionStr15, sizeof(optionStr15) - 1) == 0) {
+      page_idle_interval = atoi(argv[i] + sizeof(optionStr15) - 1);
+    }
+    else if (strncmp(argv[i], optionStr16, sizeof(optionStr16) - 1) == 0) {
+      page_idle_sample = atoi(argv[i] + sizeof(optionStr16) - 1);
+    }
+    else if (strncmp(argv[i], optionStr17, sizeof(optionStr17) - 1) == 0) {
+      rebalance_interval = atoi(argv[i] + sizeof(optionStr17) - 1);
+    }
+    else if (strncmp(argv[i], optionStr18, sizeof(optionStr18) - 1) == 0) {
+      rebalance_pages = atoi(argv[i] + sizeof(optionStr18) - 1);
+    }
+    else if (strncmp(argv[i], optionStr19, sizeof(optionStr19) - 1) == 0) {
+      mrc_sampling = atoi(argv[i] + sizeof(optionStr19) - 1);
+    }
+    else if (strncmp(argv[i], optionStr20, sizeof(optionStr20) - 1) == 0) {
+      shadow_policies = argv[i] + sizeof(optionStr20) - 1;
+    }
+    else if (strncmp(argv[i], optionStr21, sizeof(optionStr21) - 1) == 0) {
+      shadow_sampling = atoi(argv[i] + sizeof(optionStr21) - 1);
+    }
+    else if (strncmp(argv[i], optionStr22, sizeof(optionStr22) - 1) == 0) {
+      autosize_interval = atoi(argv[i] + sizeof(optionStr22) - 1);
+    }
+    else if (strncmp(argv[i], optionStr23, sizeof(optionStr23) - 1) == 0) {
+      autosize_min = atoi(argv[i] + sizeof(optionStr23) - 1);
+    }
+    else if (strncmp(argv[i], optionStr24, sizeof(optionStr24) - 1) == 0) {
+      autosize_max = atoi(argv[i] + sizeof(optionStr24) - 1);
+    }
+    else if (strncmp(argv[i], optionStr25, sizeof(optionStr25) - 1) == 0) {
+      autosize_step = atoi(argv[i] + sizeof(optionStr25) - 1);
+    }
+    else if (strncmp(argv[i], optionStr26, sizeof(optionStr26) - 1) == 0) {
+      autosize_psi = atoi(argv[i] + sizeof(optionStr26) - 1);
+    }
+    else if (strncmp(argv[i], optionStr27, sizeof(optionStr27) - 1) == 0) {
+      autosize_low_mb = atoi(argv[i] + sizeof(optionStr27) - 1);
+    }
+    else if (strncmp(argv[i], optionStr28, sizeof(optionStr28) - 1) == 0) {
+      autosize_high_mb = atoi(argv[i] + sizeof(optionStr28) - 1);
+    }
+    else if (strncmp(argv[i], optionStr29, sizeof(optionStr29) - 1) == 0) {
+      flush_workers = atoi(argv[i] + sizeof(optionStr29) - 1);
+      if (flush_workers < 1)
+        flush_workers = 1;
+      else if (flush_workers > MAX_FLUSH_WORKERS)
+        flush_workers = MAX_FLUSH_WORKERS;
+    }
+    else if (strncmp(argv[i], optionStr30, sizeof(optionStr30) - 1) == 0) {
+      restore_workers = atoi(argv[i] + sizeof(optionStr30) - 1);
+      if (restore_workers < 1)
+        restore_workers = 1;
+      else if (restore_workers > MAX_RESTORE_WORKERS)
+        restore_workers = MAX_RESTORE_WORKERS;
+    }
+    else if (strncmp(argv[i], optionStr31, sizeof(optionStr31) - 1) == 0) {
+      precopy_interval = atoi(argv[i] + sizeof(optionStr31) - 1);
+    }
+    else if (strncmp(argv[i], optionStr32, sizeof(optionStr32) - 1) == 0) {
+      precopy_pages = atoi(argv[i] + sizeof(optionStr32) - 1);
+    }
+    else if (strncmp(argv[i], optionStr33, sizeof(optionStr33) - 1) == 0) {
+      idle_timeout = atoi(argv[i] + sizeof(optionStr33) - 1);
+    }
+    else if (strncmp(argv[i], optionStr34, sizeof(optionStr34) - 1) == 0) {
+      idle_swapout_rate = atoi(argv[i] + sizeof(optionStr34) - 1);
+      if (idle_swapout_rate < 1)
+        idle_swapout_rate = 1;
+    }
+    else if (strncmp(argv[i], optionStr35, sizeof(optionStr35) - 1) == 0) {
+      hot_pages_pct = atoi(argv[i] + sizeof(optionStr35) - 1);
+      // leave most of the buffer to the plain LRU order
+      if (hot_pages_pct < 0)
+        hot_pages_pct = 0;
+      else if (hot_pages_pct > 90)
+        hot_pages_pct = 90;
+    }
+    else if (strncmp(argv[i], optionStr36, sizeof(optionStr36) - 1) == 0) {
+      hot_refaults = atoi(argv[i] + sizeof(optionStr36) - 1);
+    }
+    else if (strncmp(argv[i], optionStr37, sizeof(optionStr37) - 1) == 0) {
+      zero_sweep_interval = atoi(argv[i] + sizeof(optionStr37) - 1);
+    }
 #ifdef PAGECACHE
     else if (strncmp(argv[i], optionStr1, sizeof(optionStr1) - 1 ) == 0) {
       page_cache_size = atoi(argv[i] + sizeof(optionStr1) - 1);
     }
+    else if (strncmp(argv[i], optionStr38, sizeof(optionStr38) - 1) == 0) {
+      victim_cache_size = atoi(argv[i] + sizeof(optionStr38) - 1);
+    }
     else if (strncmp(argv[i], optionStr2, sizeof(optionStr2) - 1) == 0) {
       prefetch_size = atoi(argv[i] + sizeof(optionStr2) - 1);
     }
@@ -653,6 +856,26 @@ int main (int argc, char *argv[])
     else if (strncmp(argv[i], optionStr4, sizeof(optionStr4) - 1) == 0) {
       is_test_readahead = 1;
     }
+    else if (strncmp(argv[i], optionStr10, sizeof(optionStr10) - 1) == 0) {
+      max_prefetch_size = atoi(argv[i] + sizeof(optionStr10) - 1);
+    }
+    else if (strncmp(argv[i], optionStr11, sizeof(optionStr11) - 1) == 0) {
+      prefetch_latency_budget = atoi(argv[i] + sizeof(optionStr11) - 1);
+    }
+    else if (strncmp(argv[i], optionStr12, sizeof(optionStr12) - 1) == 0) {
+#ifdef THREADED_PREFETCH
+      prefetch_workers = atoi(argv[i] + sizeof(optionStr12) - 1);
+      if (prefetch_workers < 1)
+        prefetch_workers = 1;
+      else if (prefetch_workers > MAX_PREFETCH_WORKERS)
+        prefetch_workers = MAX_PREFETCH_WORKERS;
+#else
+      log_warn("%s: --prefetch_workers= requires THREADED_PREFETCH", __func__);
+#endif
+    }
+    else if (strncmp(argv[i], optionStr13, sizeof(optionStr13) - 1) == 0) {
+      prefetch_depth = atoi(argv[i] + sizeof(optionStr13) - 1);
+    }
 #endif
     else if (strncmp(argv[i], optionStr5, sizeof(optionStr5) - 1) == 0) {
       strncpy(zookeeperConn, argv[i] + sizeof(optionStr5) - 1, MAX_ZK_STRING_LEN);
@@ -674,12 +897,35 @@ int main (int argc, char *argv[])
     i++;
   }
   log_info("%s: cache_size = %d", __func__, cache_size);
+  log_info("%s: lru_policy = %s", __func__, lru_policy == LRU_POLICY_ARC ? "arc" :
+                                            lru_policy == LRU_POLICY_CLOCK ? "clock" : "lru");
+  log_info("%s: page_idle_interval = %d", __func__, page_idle_interval);
+  log_info("%s: page_idle_sample = %d", __func__, page_idle_sample);
+  log_info("%s: rebalance_interval = %d", __func__, rebalance_interval);
+  log_info("%s: mrc_sampling = %d", __func__, mrc_sampling);
+  if( shadow_policies )
+    log_info("%s: shadow_policies = %s, shadow_sampling = %d", __func__, shadow_policies, shadow_sampling);
+  log_info("%s: autosize_interval = %d", __func__, autosize_interval);
+  log_info("%s: flush_workers = %d", __func__, flush_workers);
+  log_info("%s: restore_workers = %d", __func__, restore_workers);
+  log_info("%s: precopy_interval = %d, precopy_pages = %d", __func__, precopy_interval, precopy_pages);
+  log_info("%s: idle_timeout = %d, idle_swapout_rate = %d", __func__, idle_timeout, idle_swapout_rate);
+  log_info("%s: hot_pages_pct = %d, hot_refaults = %d", __func__, hot_pages_pct, hot_refaults);
+  log_info("%s: zero_sweep_interval = %d", __func__, zero_sweep_interval);
 #ifdef PAGECACHE
   if( is_test_readahead==1 )
     log_info("%s: test_readahead is set", __func__);
   log_info("%s: page_cache_size = %d", __func__, page_cache_size);
+  log_info("%s: victim_cache_size = %d", __func__, victim_cache_size);
   log_info("%s: prefetch_size = %d", __func__, prefetch_size);
   log_info("%s: enable_prefetch = %d", __func__, enable_prefetch);
+  log_info("%s: max_prefetch_size = %d", __func__, max_prefetch_size);
+  log_info("%s: prefetch_latency_budget = %d", __func__, prefetch_latency_budget);
+#ifdef THREADED_PREFETCH
+  log_info("%s: prefetch_workers = %d", __func__, prefetch_workers);
+#else
+  log_info("%s: prefetch_depth = %d", __func__, prefetch_depth);
+#endif
 #endif
   if( print_info==1 )
     log_info("%s: print_info is set", __func__);
@@ -744,6 +990,14 @@ int main (int argc, char *argv[])
   }
   sem_init(&ufhandler_sem, 0, 0);
 #endif
+#ifdef THREADED_PREFETCH
+  rc = pthread_cond_init(&demand_reads_cond, NULL);
+  if(rc)
+  {
+    log_err("%s: demand reads condition init failed", __func__);
+    return rc;
+  }
+#endif
 
 #ifdef THREADED_WRITE_TO_EXTERNRAM
   /* start writing to exterRAM processing thread */
@@ -754,11 +1008,13 @@ int main (int argc, char *argv[])
   }
 #endif
 #ifdef THREADED_PREFETCH
-  /* start writing to exterRAM processing thread */
-  rc = pthread_create(&prefetch_worker, NULL, prefetch_thread, (void *)NULL);
-  if (rc) {
-    log_err("%s: return code from prefetch_thread() is %d", __func__, rc);
-    return rc;
+  /* start prefetch threads, one read channel each */
+  for (i = 0; i < prefetch_workers; i++) {
+    rc = pthread_create(&prefetch_worker[i], NULL, prefetch_thread, (void *)(intptr_t)i);
+    if (rc) {
+      log_err("%s: return code from prefetch_thread() is %d", __func__, rc);
+      return rc;
+    }
   }
 #endif
 #ifdef THREADED_REINIT
@@ -798,6 +1054,73 @@ int main (int argc, char *argv[])
   }
 #endif
 
+  /* start the sampler of guest accesses to the pages next in line for eviction */
+  if( page_idle_interval>0 )
+  {
+    rc = pthread_create(&page_idle_worker, NULL, page_idle_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from page_idle_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
+  /* start moving LRU buffer share between VMs */
+  if( rebalance_interval>0 )
+  {
+    rc = pthread_create(&rebalance_worker, NULL, rebalance_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from rebalance_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
+  /* start sizing the LRU buffer by host memory pressure */
+  if( autosize_interval>0 )
+  {
+    rc = pthread_create(&autosize_worker, NULL, autosize_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from autosize_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
+  /* start draining the LRU buffer down to its size after a shrink */
+  rc = pthread_create(&resize_worker, NULL, resize_drain_thread, (void *)NULL);
+  if (rc) {
+    log_err("%s: return code from resize_drain_thread() is %d", __func__, rc);
+    return rc;
+  }
+
+  /* start writing cold pages to externRAM ahead of their eviction */
+  if( precopy_interval>0 )
+  {
+    rc = pthread_create(&precopy_worker, NULL, precopy_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from precopy_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
+  /* start swapping out the ufds that stopped faulting */
+  if( idle_timeout>0 )
+  {
+    rc = pthread_create(&idle_swapout_worker, NULL, idle_swapout_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from idle_swapout_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
+  /* start checking the zero pages parked off the LRU buffer */
+  if( zero_sweep_interval>0 )
+  {
+    rc = pthread_create(&zero_sweep_worker, NULL, zero_sweep_thread, (void *)NULL);
+    if (rc) {
+      log_err("%s: return code from zero_sweep_thread() is %d", __func__, rc);
+      return rc;
+    }
+  }
+
   /* start user interface processing thread */
   rc = pthread_create(&ui_worker, NULL, ui_processing_thread, (void *)NULL);
   if (rc) {
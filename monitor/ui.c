@@ -27,7 +27,14 @@ void printCommand(FILE *file)
   fprintf( file, "evict(e) [number] : evict the specified number of pages from LRU buffer\n" );
   fprintf( file, "disconnectpid(d) [pid] : disconnect the specified PID from monitor and flush data from buffers\n" );
   fprintf( file, "flush(f) : flush entries in LRU for dead processes\n" );
+  fprintf( file, "flushpid(x) [pid] : write the pages of the specified PID in the LRU buffer to externram\n" );
+  fprintf( file, "restore(g) [pid] [start:end] : read the pages of the specified PID in externram back, or those in the hex address range, up to its share of the LRU buffer\n" );
   fprintf( file, "listpids(l) : list PIDs in for this monitor\n" );
+  fprintf( file, "threads(n) : list faulting threads (vCPUs) and their fault counts\n" );
+  fprintf( file, "partition(w) [pid:min_pages:weight] : reserve min_pages of the LRU buffer for a PID and weight its share of the rest, or list partitions\n" );
+  fprintf( file, "idle(k) [pid:exempt] : exempt a PID from being swapped out when idle (1) or not (0), or list the time since the last fault of each PID\n" );
+  fprintf( file, "mrc(m) [pid] : estimated miss ratio of each PID, or the specified PID, at a range of LRU buffer sizes\n" );
+  fprintf( file, "shadows(o) : hit rates the shadow replacement policies would have had on the faults\n" );
   fprintf( file, "usage(u) : externram server usage\n" );
 #ifdef MONITORSTATS
   fprintf( file, "stat(s) : display monitor stats\n" );
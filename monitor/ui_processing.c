@@ -41,6 +41,7 @@
 
 #include <externRAMClientWrapper.h>
 #include <LRUBufferWrapper.h>
+#include <c_cache_node.h>
 #include <PageCacheWrapper.h>
 
 extern struct externRAMClient *client;
@@ -207,6 +208,38 @@ void *ui_processing_thread(void * tmp)
           fflush(out);
           break;
         }
+        else if( strcmp(token,"flushpid")==0 || strcmp(token,"x")==0 )
+        {
+          char * arg = strsep(&string, " \n");
+          int num_flushed;
+
+          if( !arg || strlen(arg)==0 )
+            fprintf(out, "usage: flushpid pid\n");
+          else if( (num_flushed = flushPid((uint32_t)atoi(arg))) < 0 )
+            fprintf(out, "error flushing pid %s\n", arg);
+          else
+            fprintf(out, "flushed %d pages of pid %s\n", num_flushed, arg);
+          fflush(out);
+          break;
+        }
+        else if( strcmp(token,"restore")==0 || strcmp(token,"g")==0 )
+        {
+          char * arg = strsep(&string, " \n");
+          char * range = strsep(&string, " \n");
+          unsigned long start = 0, end = 0;
+          int num_restored;
+
+          if( !arg || strlen(arg)==0 )
+            fprintf(out, "usage: restore pid [start:end]\n");
+          else if( range && strlen(range)>0 && sscanf(range, "%lx:%lx", &start, &end) < 2 )
+            fprintf(out, "usage: restore pid [start:end]\n");
+          else if( (num_restored = restorePid((uint32_t)atoi(arg), start, end)) < 0 )
+            fprintf(out, "error restoring pid %s\n", arg);
+          else
+            fprintf(out, "restored %d pages of pid %s\n", num_restored, arg);
+          fflush(out);
+          break;
+        }
         else if( strcmp(token,"listpids")==0 || strcmp(token,"l")==0 )
         {
           uint32_t * pid_list = malloc(1 * sizeof(uint32_t));
@@ -223,6 +256,131 @@ void *ui_processing_thread(void * tmp)
           fflush(out);
           break;
         }
+        else if( strcmp(token,"threads")==0 || strcmp(token,"n")==0 )
+        {
+          thread_faults * thread_list = NULL;
+          int num_threads = 0;
+          int i = 0;
+
+          num_threads = listFaultThreads(&thread_list);
+          fprintf(out, "%8s %10s %12s\n", "ufd", "thread", "faults");
+          for(i = 0; i < num_threads; i++) {
+            fprintf(out, "%8d %10u %12lu\n", thread_list[i].ufd, thread_list[i].ptid,
+                    thread_list[i].faults);
+          }
+          free(thread_list);
+          fflush(out);
+          break;
+        }
+        else if( strcmp(token,"partition")==0 || strcmp(token,"w")==0 )
+        {
+          char * arg = strsep(&string, " \n");
+          unsigned int pid = 0;
+          int min_pages = 0, weight = 1;
+
+          if( arg && strlen(arg)>0 )
+          {
+            if( sscanf(arg, "%u:%d:%d", &pid, &min_pages, &weight) < 2 )
+              fprintf(out, "usage: partition pid:min_pages[:weight]\n");
+            else if( setPartition((uint32_t)pid, min_pages, weight) < 0 )
+              fprintf(out, "error setting the partition of pid %u\n", pid);
+            else
+              fprintf(out, "pid %u: min_pages %d, weight %d\n", pid, min_pages, weight);
+          }
+          else
+          {
+            partition_info * part_list = NULL;
+            int num_parts = listPartitions(&part_list);
+            int i = 0;
+
+            fprintf(out, "%10s %8s %10s %8s %10s %10s %10s %10s\n", "pid", "ufd", "min_pages", "weight",
+                    "resident", "share", "faults", "ghost_hits");
+            for(i = 0; i < num_parts; i++) {
+              fprintf(out, "%10u %8d %10d %8d %10d %10d %10lu %10lu\n", part_list[i].pid, part_list[i].ufd,
+                      part_list[i].min_pages, part_list[i].weight, part_list[i].resident, part_list[i].share,
+                      part_list[i].faults, part_list[i].ghost_hits);
+            }
+            free(part_list);
+          }
+          fflush(out);
+          break;
+        }
+        else if( strcmp(token,"idle")==0 || strcmp(token,"k")==0 )
+        {
+          char * arg = strsep(&string, " \n");
+          unsigned int pid = 0;
+          int exempt = 1;
+
+          if( arg && strlen(arg)>0 )
+          {
+            if( sscanf(arg, "%u:%d", &pid, &exempt) < 1 )
+              fprintf(out, "usage: idle pid[:exempt]\n");
+            else if( setIdleExempt((uint32_t)pid, exempt!=0) < 0 )
+              fprintf(out, "error setting the idle exemption of pid %u\n", pid);
+            else
+              fprintf(out, "pid %u: exempt %d\n", pid, exempt!=0);
+          }
+          else
+          {
+            idle_info * idle_list = NULL;
+            int num_idle = listIdle(&idle_list);
+            int i = 0;
+
+            fprintf(out, "%10s %8s %10s %8s %8s\n", "pid", "ufd", "idle_secs", "exempt", "idle");
+            for(i = 0; i < num_idle; i++) {
+              fprintf(out, "%10u %8d %10ld %8d %8d\n", idle_list[i].pid, idle_list[i].ufd,
+                      idle_list[i].idle_secs, idle_list[i].exempt, idle_list[i].idle);
+            }
+            free(idle_list);
+          }
+          fflush(out);
+          break;
+        }
+        else if( strcmp(token,"mrc")==0 || strcmp(token,"m")==0 )
+        {
+          char * arg = strsep(&string, " \n");
+          uint32_t pid = (arg && strlen(arg)>0) ? (uint32_t)atoi(arg) : 0;
+          partition_info * part_list = NULL;
+          int num_parts = listPartitions(&part_list);
+          int i = 0, j = 0;
+
+          for(i = 0; i < num_parts; i++) {
+            c_mrc_point * points = NULL;
+            uint64_t sampled = 0;
+            int num_points;
+
+            if( pid && part_list[i].pid!=pid )
+              continue;
+            num_points = getMissRatioCurve(part_list[i].ufd, &sampled, &points);
+            fprintf(out, "pid %u ufd %d: %d resident, %lu faults sampled\n", part_list[i].pid,
+                    part_list[i].ufd, part_list[i].resident, sampled);
+            fprintf(out, "%12s %12s\n", "cache_pages", "miss_ratio");
+            for(j = 0; j < num_points; j++) {
+              fprintf(out, "%12d %11.1f%%\n", points[j].cache_pages, points[j].miss_permille / 10.0);
+            }
+            free(points);
+          }
+          free(part_list);
+          fflush(out);
+          break;
+        }
+        else if( strcmp(token,"shadows")==0 || strcmp(token,"o")==0 )
+        {
+          shadow_info * shadow_list = NULL;
+          int num_shadows = listShadows(&shadow_list);
+          int i = 0;
+
+          fprintf(out, "%10s %10s %12s %12s %8s\n", "policy", "pages", "faults", "hits", "hit_rate");
+          for(i = 0; i < num_shadows; i++) {
+            fprintf(out, "%10s %10d %12lu %12lu %7.2f%%%s\n", shadow_list[i].policy, shadow_list[i].size,
+                    shadow_list[i].faults, shadow_list[i].hits,
+                    shadow_list[i].faults ? 100.0 * shadow_list[i].hits / shadow_list[i].faults : 0.0,
+                    shadow_list[i].active ? " (active)" : "");
+          }
+          free(shadow_list);
+          fflush(out);
+          break;
+        }
         else if( strcmp(token,"usage")==0 || strcmp(token,"u")==0 )
         {
           ServerUsage * usage = malloc(1 * sizeof(ServerUsage));
@@ -270,6 +428,29 @@ void *ui_processing_thread(void * tmp)
           fprintf(out,"Cache Hit Count:\t%lu\n", StatsGetStat(CACHE_HIT));
           fprintf(out,"Cache Miss Count:\t%lu\n", StatsGetStat(CACHE_MISS));
           fprintf(out,"Cache Hit Percentage:\t%lu\n", StatsGetStat(CACHE_HITRATIO));
+          fprintf(out,"Prefetched Pages:\t%lu\n", StatsGetStat(PREFETCHED_PAGES));
+          fprintf(out,"Prefetch Hit Count:\t%lu\n", StatsGetStat(PREFETCH_HITS));
+          fprintf(out,"Prefetch Unused Count:\t%lu\n", StatsGetStat(PREFETCH_UNUSED));
+          fprintf(out,"Prefetch Accuracy:\t%lu\n", StatsGetStat(PREFETCH_ACCURACY));
+          fprintf(out,"Prefetch Window:\t%lu\n", StatsGetStat(PREFETCH_WINDOW));
+          fprintf(out,"Prefetch Cancelled:\t%lu\n", StatsGetStat(PREFETCH_CANCELLED));
+          fprintf(out,"Resize Pending:\t\t%lu\n", StatsGetStat(RESIZE_PENDING));
+          fprintf(out,"Resize Evicted:\t\t%lu\n", StatsGetStat(RESIZE_EVICTED));
+          fprintf(out,"Flushed Pages:\t\t%lu\n", StatsGetStat(FLUSHED_PAGES));
+          fprintf(out,"Restored Pages:\t\t%lu\n", StatsGetStat(RESTORED_PAGES));
+          fprintf(out,"Precopied Pages:\t%lu\n", StatsGetStat(PRECOPIED_PAGES));
+          fprintf(out,"Clean Evictions:\t%lu\n", StatsGetStat(CLEAN_EVICTIONS));
+          fprintf(out,"Idle Swapped Out:\t%lu\n", StatsGetStat(IDLE_SWAPPED_OUT));
+          fprintf(out,"Hot Promotions:\t%lu\n", StatsGetStat(HOT_PROMOTED));
+          fprintf(out,"Zero Pages Parked:\t%lu\n", StatsGetStat(ZERO_PARKED));
+          fprintf(out,"Victim Hits:\t%lu\n", StatsGetStat(VICTIM_HITS));
+          fprintf(out,"Pages Discarded:\t%lu\n", StatsGetStat(DISCARDED_PAGES));
+          fprintf(out,"Compressed Pages:\t%lu\n", StatsGetStat(COMPRESSED_PAGES));
+          fprintf(out,"Incompressible Pages:\t%lu\n", StatsGetStat(INCOMPRESSIBLE_PAGES));
+          fprintf(out,"Compressed Size Percentage:\t%lu\n", StatsGetStat(COMPRESSION_PERCENTAGE));
+          fprintf(out,"Compression Bytes Saved:\t%lu\n", StatsGetStat(COMPRESSION_SAVED_BYTES));
+          fprintf(out,"Compression Time (us):\t%lu\n", StatsGetStat(COMPRESSION_USECS));
+          fprintf(out,"Decompression Time (us):\t%lu\n", StatsGetStat(DECOMPRESSION_USECS));
           fprintf(out,"Writes Avoided:\t\t%lu\n", StatsGetStat(WRITES_AVOIDED));
           fprintf(out,"Invalid Pages Dropped:\t%lu\n", StatsGetStat(WRITES_SKIPPED_INVALID));
           fprintf(out,"Page Fault Rate:\t%f\n", StatsGetRate());
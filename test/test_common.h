@@ -0,0 +1,70 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * test_common.h
+ *
+ * This defines what the unit tests run by make check share: the globals
+ * the libraries expect the program to define, and checks that count
+ * failures instead of exiting as log_err does. Include it from the one
+ * file of a test program
+*/
+
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+
+#include <stdio.h>
+#include <dbg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <monitorstats.h>
+MonitorStats* _pstats;
+
+#ifdef TIMING
+#include <timingstats.h>
+uint32_t max_bucket_slots;
+char ** reverse_buckets;
+uint32_t buckets_mask;
+TimingBucket * timing_buckets;
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+int failures = 0;
+
+#define expect(cond, M, ...) do { \
+    if (!(cond)) { \
+      printf("FAIL %s: " M "\n", __func__, ##__VA_ARGS__); \
+      failures++; \
+    } \
+  } while (0)
+
+static void test_init(void) {
+#ifdef MONITORSTATS
+#ifdef TIMING
+  TimingStatsInit();
+#endif
+  MonitorStatsInit();
+#endif
+}
+
+/* returns the exit status of the test program */
+static int test_finish(void) {
+#ifdef MONITORSTATS
+  StatsDestroy();
+#endif
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
+
+#endif
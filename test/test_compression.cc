@@ -0,0 +1,267 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * test_compression writes pages through compressedClient to stores in
+ * memory and reads them back with each kind of read. Pages that compress
+ * must be stored shorter than a page, and pages that don't must be stored
+ * raw. One store hands out pages as memcached does, the other buffers only
+ * as long as the values, as RAMCloud does. It runs without a VM or an
+ * externRAM backend
+ */
+
+#include <compressedClient.hh>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <map>
+#include <vector>
+
+#include "test_common.h"
+
+#define NUM_PAGES 32
+
+/*
+ * keeps a copy of each value like memcached does. A single read copies the
+ * value into the caller's page, and a multiread hands back a buffer of a
+ * page per value for the caller to free
+ */
+class memoryClient: public externRAMClient
+{
+public:
+  std::map<uint64_t, std::vector<char> > store;
+
+  void * write(uint64_t key, void ** data, int size, int * err) {
+    store[key].assign((char *) *data, (char *) *data + size);
+    *err = 0;
+    return *data;
+  }
+  bool multiWrite(uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err) {
+    for (int i = 0; i < num_write; i++)
+      store[hashcodes[i]].assign((char *) data[i], (char *) data[i] + lengths[i]);
+    *err = 0;
+    return true;
+  }
+  bool multiWriteChannel(int, uint64_t * hashcodes, int num_write, void ** data, int * lengths, int * err) {
+    return multiWrite(hashcodes, num_write, data, lengths, err);
+  }
+  int read(uint64_t key, void ** value) {
+    std::map<uint64_t, std::vector<char> >::iterator it = store.find(key);
+    if (it == store.end())
+      return 0;
+    memcpy(*value, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+  int multiRead(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+    for (int i = 0; i < num_prefetch; i++) {
+      std::map<uint64_t, std::vector<char> >::iterator it = store.find(hashcodes[i]);
+      recvBufs[i] = NULL;
+      lengths[i] = 0;
+      if (it == store.end())
+        continue;
+      recvBufs[i] = malloc(PAGE_SIZE);
+      memcpy(recvBufs[i], it->second.data(), it->second.size());
+      lengths[i] = it->second.size();
+    }
+    return num_prefetch;
+  }
+  int multiReadChannel(int, uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+    return multiRead(hashcodes, num_prefetch, recvBufs, lengths);
+  }
+  bool readsIntoPages() {
+    return true;
+  }
+};
+
+/*
+ * hands out buffers of its own that end where the value ends, right before
+ * a page that can't be touched, so writing a page into one of them faults.
+ * They stay valid until the next multiread, as RAMCloud's values do
+ */
+class valueClient: public memoryClient
+{
+public:
+  std::vector<char *> areas;
+
+  ~valueClient() {
+    release();
+  }
+  void release() {
+    for (size_t i = 0; i < areas.size(); i++)
+      munmap(areas[i], 2 * PAGE_SIZE);
+    areas.clear();
+  }
+  bool owns(void * buf) {
+    for (size_t i = 0; i < areas.size(); i++) {
+      if ((char *) buf >= areas[i] && (char *) buf < areas[i] + PAGE_SIZE)
+        return true;
+    }
+    return false;
+  }
+  int multiRead(uint64_t * hashcodes, int num_prefetch, void ** recvBufs, int * lengths) {
+    release();
+    for (int i = 0; i < num_prefetch; i++) {
+      std::map<uint64_t, std::vector<char> >::iterator it = store.find(hashcodes[i]);
+      recvBufs[i] = NULL;
+      lengths[i] = 0;
+      if (it == store.end())
+        continue;
+      char * area = (char *) mmap(NULL, 2 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      mprotect(area + PAGE_SIZE, PAGE_SIZE, PROT_NONE);
+      areas.push_back(area);
+      recvBufs[i] = area + PAGE_SIZE - it->second.size();
+      memcpy(recvBufs[i], it->second.data(), it->second.size());
+      lengths[i] = it->second.size();
+    }
+    return num_prefetch;
+  }
+  bool readsIntoPages() {
+    return false;
+  }
+};
+
+static char pages[NUM_PAGES][PAGE_SIZE];
+static uint64_t keys[NUM_PAGES];
+
+// every third page is random and doesn't compress
+static bool compressible(int i) {
+  return i % 3 != 0;
+}
+
+static void fill_pages() {
+  srand(1);
+  for (int i = 0; i < NUM_PAGES; i++) {
+    keys[i] = (uint64_t)(i + 1) * PAGE_SIZE;
+    for (int j = 0; j < (int) PAGE_SIZE; j++)
+      pages[i][j] = compressible(i) ? (j < (int) PAGE_SIZE / 2 ? 0 : "fluidmem "[j % 9] + i) : rand();
+  }
+}
+
+static void check_stored(memoryClient * store, int first, int num) {
+  for (int i = first; i < first + num; i++) {
+    size_t length = store->store[keys[i]].size();
+    if (compressible(i))
+      expect(length <= COMPRESSED_PAGE_MAX, "page %d was stored in %zu bytes", i, length);
+    else
+      expect(length == PAGE_SIZE, "incompressible page %d was stored in %zu bytes", i, length);
+  }
+}
+
+/* single writes and reads of a page */
+void test_write_read(compressedClient * client, memoryClient * store) {
+  static char page[PAGE_SIZE];
+  int i, err, length;
+  void * value;
+
+  for (i = 0; i < NUM_PAGES / 2; i++) {
+    value = pages[i];
+    expect(client->write(keys[i], &value, PAGE_SIZE, &err) == pages[i] && err == 0,
+           "write of page %d did not return the page to free", i);
+  }
+  check_stored(store, 0, NUM_PAGES / 2);
+
+  for (i = 0; i < NUM_PAGES / 2; i++) {
+    value = page;
+    memset(page, 0xff, PAGE_SIZE);
+    length = client->read(keys[i], &value);
+    expect(length == PAGE_SIZE && value == page, "read of page %d returned %d bytes", i, length);
+    expect(memcmp(page, pages[i], PAGE_SIZE) == 0, "page %d changed on its way through", i);
+  }
+}
+
+/* multiwrites and multireads, on the client and on a channel */
+void test_multi(compressedClient * client, memoryClient * store) {
+  const int first = NUM_PAGES / 2, num = NUM_PAGES / 2;
+  void * data[num];
+  void * bufs[num];
+  int lengths[num];
+  int i, err;
+
+  for (i = 0; i < num; i++) {
+    data[i] = pages[first + i];
+    lengths[i] = PAGE_SIZE;
+  }
+  expect(client->multiWriteChannel(0, keys + first, num, data, lengths, &err) && err == 0,
+         "multiwrite failed");
+  for (i = 0; i < num; i++)
+    expect(data[i] == pages[first + i] && lengths[i] == PAGE_SIZE,
+           "multiwrite did not give page %d back", first + i);
+  check_stored(store, first, num);
+
+  client->multiRead(keys + first, num, bufs, lengths);
+  for (i = 0; i < num; i++) {
+    expect(lengths[i] == PAGE_SIZE && memcmp(bufs[i], pages[first + i], PAGE_SIZE) == 0,
+           "multiread of page %d returned %d bytes", first + i, lengths[i]);
+    free(bufs[i]);
+  }
+
+  // pages written one at a time come back in a multiread too
+  client->multiReadChannel(0, keys, num, bufs, lengths);
+  for (i = 0; i < num; i++) {
+    expect(lengths[i] == PAGE_SIZE && memcmp(bufs[i], pages[i], PAGE_SIZE) == 0,
+           "channel multiread of page %d returned %d bytes", i, lengths[i]);
+    free(bufs[i]);
+  }
+  client->releaseReadChannel(0);
+}
+
+/*
+ * multireads from a store whose buffers are only as long as the values.
+ * Compressed values come back in pages allocated for the caller, raw ones
+ * in the store's buffers
+ */
+void test_value_buffers(compressedClient * client, valueClient * store) {
+  void * data[NUM_PAGES];
+  void * bufs[NUM_PAGES];
+  int lengths[NUM_PAGES];
+  int i, err;
+
+  for (i = 0; i < NUM_PAGES; i++) {
+    data[i] = pages[i];
+    lengths[i] = PAGE_SIZE;
+  }
+  client->multiWrite(keys, NUM_PAGES, data, lengths, &err);
+  check_stored(store, 0, NUM_PAGES);
+
+  client->multiReadChannel(0, keys, NUM_PAGES, bufs, lengths);
+  for (i = 0; i < NUM_PAGES; i++) {
+    expect(lengths[i] == PAGE_SIZE && memcmp(bufs[i], pages[i], PAGE_SIZE) == 0,
+           "multiread of page %d returned %d bytes", i, lengths[i]);
+    expect(store->owns(bufs[i]) == !compressible(i),
+           "page %d came back in a buffer of the %s", i, store->owns(bufs[i]) ? "store" : "client");
+    if (!store->owns(bufs[i]))
+      free(bufs[i]);
+  }
+  client->releaseReadChannel(0);
+}
+
+int main(void) {
+  test_init();
+
+  memoryClient * store = new memoryClient();
+  compressedClient * client = new compressedClient(store);
+
+  fill_pages();
+  test_write_read(client, store);
+  test_multi(client, store);
+
+#ifdef MONITORSTATS
+  expect(_pstats->compressed_pages + _pstats->incompressible_pages == NUM_PAGES,
+         "%lu pages compressed and %lu not, expected %d in all",
+         _pstats->compressed_pages, _pstats->incompressible_pages, NUM_PAGES);
+#endif
+
+  delete client;
+  delete store;
+
+  valueClient * value_store = new valueClient();
+  client = new compressedClient(value_store);
+  test_value_buffers(client, value_store);
+  delete client;
+  delete value_store;
+
+  return test_finish();
+}
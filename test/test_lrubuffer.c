@@ -0,0 +1,148 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * test_lrubuffer checks the eviction order of the ARC and CLOCK policies of
+ * liblrubuffer, and the miss ratio curve estimated from the faults of a
+ * ufd. It runs without a VM or an externRAM backend
+ */
+
+#include <stdlib.h>
+#include <sys/user.h>
+
+#include <LRUBufferWrapper.h>
+#include <c_cache_node.h>
+#include "test_common.h"
+
+extern int cache_size;
+extern int mrc_sampling;
+
+#define TEST_UFD 3
+
+static uint64_t page(int n) {
+  return (uint64_t)n * PAGE_SIZE;
+}
+
+/* faults page n in and returns the page that was evicted for it, 0 if none */
+static int fault(LRUBuffer * l, int n) {
+  c_cache_node node = insertCacheNodeAndEvict(l, page(n), TEST_UFD);
+  return node.hashcode ? (int)((node.hashcode & PAGE_MASK) / PAGE_SIZE) : 0;
+}
+
+/*
+ * pages faulted twice are on t2 and outlive a scan through t1. A fault on
+ * a page just evicted from t1 is a ghost hit that gives t1 more room, so
+ * the next victim comes from t2 instead
+ */
+void test_arc(void) {
+  LRUBuffer * l = newShadowLRUBuffer(LRU_POLICY_ARC, 4);
+  int i, victim;
+
+  for (i = 1; i <= 4; i++)
+    expect(fault(l, i) == 0, "page %d evicted a page of a buffer with room", i);
+  referenceCachedNode(l, page(1), TEST_UFD);
+  referenceCachedNode(l, page(2), TEST_UFD);
+
+  // a scan only cycles pages through t1
+  for (i = 5; i <= 8; i++) {
+    victim = fault(l, i);
+    expect(victim != 1 && victim != 2, "scan page %d evicted page %d of t2", i, victim);
+  }
+  expect(isCachedInLRU(l, page(1), TEST_UFD) && isCachedInLRU(l, page(2), TEST_UFD),
+        "pages faulted twice did not survive a scan");
+
+  // 7 and 8 are left on t1, 5 was evicted from it last but one
+  victim = fault(l, 5);
+  expect(victim == 7, "ghost hit on page 5 evicted page %d, expected 7 from t1", victim);
+  expect(isCachedInLRU(l, page(5), TEST_UFD), "a ghost hit did not bring page 5 back");
+
+  // with t1 at its target, the least recently used page of t2 goes
+  victim = fault(l, 7);
+  expect(victim == 1, "ghost hit on page 7 evicted page %d, expected 1 from t2", victim);
+}
+
+/* a referenced page gets a second chance, the others go in fault order */
+void test_clock(void) {
+  LRUBuffer * l = newShadowLRUBuffer(LRU_POLICY_CLOCK, 4);
+  int i, victim;
+
+  for (i = 1; i <= 4; i++)
+    expect(fault(l, i) == 0, "page %d evicted a page of a buffer with room", i);
+
+  victim = fault(l, 5);
+  expect(victim == 1, "page 5 evicted page %d, expected the oldest page 1", victim);
+
+  referenceCachedNode(l, page(2), TEST_UFD);
+  victim = fault(l, 6);
+  expect(victim == 3, "page 6 evicted page %d, expected 3 after the second chance of 2", victim);
+
+  victim = fault(l, 7);
+  expect(victim == 4, "page 7 evicted page %d, expected 4", victim);
+  victim = fault(l, 8);
+  expect(victim == 5, "page 8 evicted page %d, expected 5", victim);
+
+  // 2 went back to the front, its bit is clear now
+  for (i = 9; i <= 10; i++)
+    fault(l, i);
+  expect(!isCachedInLRU(l, page(2), TEST_UFD), "page 2 had more than one second chance");
+
+  // with the other pages referenced, the sweep ends at the page just faulted
+  for (i = 7; i <= 10; i++)
+    referenceCachedNode(l, page(i), TEST_UFD);
+  victim = fault(l, 11);
+  expect(victim == 11, "page 11 evicted page %d, expected itself after a full turn", victim);
+  victim = fault(l, 12);
+  expect(victim == 7, "page 12 evicted page %d, expected 7 with every bit clear", victim);
+}
+
+/*
+ * a loop over pages faults each of them again after the others, so the
+ * curve drops from all misses to the cold misses at the size of the loop
+ */
+void test_mrc(void) {
+  const int loop = 16, rounds = 10;
+  c_mrc_point * points = NULL;
+  uint64_t sampled;
+  LRUBuffer * l;
+  int num_points, i, r;
+
+  // every page tracked, and points every 4 pages
+  cache_size = 32;
+  mrc_sampling = 1;
+  l = newLRUBuffer();
+
+  for (r = 0; r < rounds; r++) {
+    for (i = 1; i <= loop; i++)
+      insertCacheNode(l, page(i), TEST_UFD);
+  }
+
+  num_points = getLRUMissRatioCurve(l, TEST_UFD, &sampled, &points);
+  expect(num_points > 0, "no miss ratio curve");
+  expect(sampled == (uint64_t)(loop * rounds), "%lu faults sampled, expected %d", sampled, loop * rounds);
+
+  for (i = 0; i < num_points; i++) {
+    if (points[i].cache_pages < loop)
+      expect(points[i].miss_permille == 1000, "%d permille misses with %d pages, expected all",
+            points[i].miss_permille, points[i].cache_pages);
+    else
+      expect(points[i].miss_permille == 1000 / rounds, "%d permille misses with %d pages, expected %d",
+            points[i].miss_permille, points[i].cache_pages, 1000 / rounds);
+  }
+  free(points);
+
+  num_points = getLRUMissRatioCurve(l, TEST_UFD + 1, &sampled, &points);
+  expect(num_points == 0 && sampled == 0, "a curve for a ufd without faults");
+}
+
+int main(void) {
+  test_init();
+
+  test_arc();
+  test_clock();
+  test_mrc();
+
+  return test_finish();
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2026 University of Colorado,  All Rights Reserved
+ * Unauthorized copying of this file, via any medium is strictly prohibited
+ * Proprietary and confidential
+ */
+
+/*
+ * test_pagecache faults pages of a ufd through libpagecache with prefetch
+ * enabled, against a backend in memory whose read channels never report
+ * ready, as memcached's don't. Prefetch batches the guest doesn't fault on
+ * must not keep their channels busy for good. It runs without a VM or an
+ * externRAM backend
+ */
+
+#include <externRAMClient.hh>
+#include <PageCacheWrapper.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/user.h>
+
+#include "test_common.h"
+
+extern int enable_prefetch;
+extern int prefetch_depth;
+
+#define TEST_UFD 3
+#define REGION_PAGES 64
+
+/*
+ * hands out pages filled with the low byte of their page number. Reads on a
+ * channel are only counted when they are sent, and land when the page cache
+ * waits for them
+ */
+class stalledClient: public externRAMClient
+{
+public:
+  int reads, batches_sent, batches_landed;
+
+  stalledClient(): reads(0), batches_sent(0), batches_landed(0) {}
+
+  static void fill(uint64_t key, void * page) {
+    memset(page, (int)(key / PAGE_SIZE), PAGE_SIZE);
+  }
+  int read(uint64_t key, void ** value) {
+    reads++;
+    fill(key, *value);
+    return PAGE_SIZE;
+  }
+#ifdef ASYNREAD
+  void read_top(uint64_t, void **) {}
+  int read_bottom(uint64_t key, void ** value) {
+    return read(key, value);
+  }
+#endif
+  int openReadChannels(int num_channels) {
+    return num_channels;
+  }
+  void multiReadChannel_top(int, uint64_t *, int, void **, int *) {
+    batches_sent++;
+  }
+  int multiReadChannel_bottom(int, uint64_t * hashcodes, int num, void ** bufs, int * lengths) {
+    for (int i = 0; i < num; i++) {
+      bufs[i] = malloc(PAGE_SIZE);
+      fill(hashcodes[i], bufs[i]);
+      lengths[i] = PAGE_SIZE;
+    }
+    batches_landed++;
+    return num;
+  }
+  bool isReadChannelReady(int) {
+    return false;
+  }
+};
+
+static stalledClient * client;
+
+// takes the place of the lookup libpagecache has from upid.h
+struct externRAMClient * get_client_by_fd(int fd) {
+  return fd == TEST_UFD ? client : NULL;
+}
+
+// regions start past page 1, whose fault would follow address 0 as a sequential one
+static uint64_t region_page(int region, int n) {
+  return ((uint64_t)(region + 1) * REGION_PAGES + n) * PAGE_SIZE;
+}
+
+/* faults a page in and returns the buffer it came back in */
+static void * fault(PageCache * pc, uint64_t hashcode) {
+  static char page[PAGE_SIZE];
+  void * buf = page;
+
+#ifdef ASYNREAD
+  readPageIfInPageCache_top(pc, TEST_UFD, hashcode, &buf, 0);
+  readPageIfInPageCache_bottom(pc, TEST_UFD, hashcode, &buf);
+#else
+  readPageIfInPageCache(pc, TEST_UFD, hashcode, &buf, 0);
+#endif
+  return buf;
+}
+
+/*
+ * two sequential faults in a region send a batch for the page after them,
+ * then the guest moves on to the next region. Every region gets its batch,
+ * the oldest batches landing in the page cache to free their channels
+ */
+void test_busy_channels(PageCache * pc) {
+  const int regions = 3 * prefetch_depth;
+  int r, n, reads;
+  char * buf;
+
+  for (r = 0; r < regions; r++) {
+    for (n = 0; n < REGION_PAGES; n++)
+      addPageHashNode(region_page(r, n), TEST_UFD, OWNERSHIP_EXTERNRAM);
+  }
+
+  for (r = 0; r < regions; r++) {
+    fault(pc, region_page(r, 0));
+    fault(pc, region_page(r, 1));
+  }
+  expect(client->batches_sent == regions, "%d prefetch batches sent for %d regions with %d channels",
+         client->batches_sent, regions, prefetch_depth);
+  expect(client->batches_landed == regions - prefetch_depth, "%d batches landed, expected %d",
+         client->batches_landed, regions - prefetch_depth);
+
+  // the page of the first region was prefetched, so it is not read again
+  reads = client->reads;
+  buf = (char *) fault(pc, region_page(0, 2));
+  expect(client->reads == reads, "prefetched page was read again");
+  expect(buf[0] == (char)(region_page(0, 2) / PAGE_SIZE) && buf[PAGE_SIZE - 1] == buf[0],
+         "prefetched page has the wrong contents");
+  free(buf);
+}
+
+int main(void) {
+  test_init();
+
+  client = new stalledClient();
+  enable_prefetch = 1;
+  prefetch_depth = 2;
+  PageCache * pc = newPageCache(NULL);
+
+  test_busy_channels(pc);
+
+  pageCacheCleanup();
+  delete client;
+
+  return test_finish();
+}